@@ -0,0 +1,822 @@
+/**
+ * Copyright © 2026 Push Technology Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This example is written in C99. Please use an appropriate C99 capable compiler
+ *
+ * @author Push Technology Limited
+ * @since 6.4
+ */
+
+/*
+ * This is a TCP proxy which impairs the connection between a client
+ * and a Diffusion server, so that reconnection and recovery can be
+ * tested without a real unreliable network.
+ *
+ * Point a client at the proxy's port ("-l") and it will forward each
+ * connection to the server ("-H", "-P"), applying whatever impairments
+ * are in force. These are driven by a script ("-f"), or one of the
+ * built-in profiles ("-n"), with one directive per line:
+ *
+ *   <seconds> delay <ms> [<jitter ms>]   add latency in each direction
+ *   <seconds> rate <bytes per second>    throttle each direction; 0 for none
+ *   <seconds> stall <ms>                 stop forwarding for a while
+ *   <seconds> reset                      reset every connection
+ *   <seconds> clear                      remove delay and throttling
+ *   repeat <seconds>                     rerun the script with this period
+ *
+ * where <seconds> is the time since the start of the script, and lines
+ * starting with '#' are ignored. Jitter never reorders data, since TCP
+ * cannot: each piece is forwarded no earlier than the one before it.
+ *
+ * A reset closes both sides of every connection with an RST, and
+ * discards anything the proxy had read but not yet forwarded. That is
+ * what a client's recovery buffer has to make good.
+ *
+ * The proxy writes a line to standard output when it is ready and for
+ * each event, and a summary when it exits, so that it can be driven by
+ * another program (see reconnect-bench.c):
+ *
+ *   LISTENING <port>
+ *   EVENT <ms> <directive ...>
+ *   STATS connections=<n> resets=<n> up=<bytes> down=<bytes>
+ *         discarded_up=<bytes> discarded_down=<bytes>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <apr.h>
+#include <apr_time.h>
+
+#include "diffusion.h"
+#include "args.h"
+
+ARG_OPTS_T arg_opts[] = {
+        ARG_OPTS_HELP,
+        {'l', "listen", "Port to accept client connections on", ARG_OPTIONAL, ARG_HAS_VALUE, "8081"},
+        {'H', "host", "Server host to forward connections to", ARG_OPTIONAL, ARG_HAS_VALUE, "localhost"},
+        {'P', "port", "Server port to forward connections to", ARG_OPTIONAL, ARG_HAS_VALUE, "8080"},
+        {'f', "file", "Impairment script", ARG_OPTIONAL, ARG_HAS_VALUE, NULL},
+        {'n', "profile", "Built-in impairment profile: none, latency, throttle, stall, reset or flaky", ARG_OPTIONAL, ARG_HAS_VALUE, "none"},
+        {'s', "sleep", "Time to run for (in seconds)", ARG_OPTIONAL, ARG_HAS_VALUE, "30"},
+        END_OF_ARG_OPTS
+};
+
+typedef struct profile_s {
+        const char *name;
+        const char *script;
+} PROFILE_T;
+
+static const PROFILE_T profiles[] = {
+        { "none", "" },
+        { "latency", "0 delay 50 20\n" },
+        { "throttle", "0 rate 65536\n" },
+        { "stall", "repeat 10\n3 stall 3000\n" },
+        { "reset", "repeat 10\n3 reset\n" },
+        { "flaky", "repeat 8\n0 delay 20 10\n0 rate 262144\n3 stall 1500\n6 reset\n" },
+        { NULL, NULL }
+};
+
+#define MAX_CONNECTIONS 64
+#define MAX_DIRECTIVES 256
+#define READ_SIZE 16384
+
+/*
+ * Stop reading from a side once this much is waiting to be forwarded
+ * from it, so that a throttled or stalled proxy pushes back on the
+ * sender as a slow network would. The pieces' own overhead counts
+ * towards it, so that many small reads can't hold far more memory.
+ */
+#define MAX_QUEUED (4 * 1024 * 1024)
+
+typedef enum {
+        DIRECTIVE_DELAY,
+        DIRECTIVE_RATE,
+        DIRECTIVE_STALL,
+        DIRECTIVE_RESET,
+        DIRECTIVE_CLEAR
+} DIRECTIVE_TYPE_T;
+
+typedef struct directive_s {
+        apr_interval_time_t at;
+        DIRECTIVE_TYPE_T type;
+        long arg1;
+        long arg2;
+        char text[64];
+} DIRECTIVE_T;
+
+typedef struct impairment_script_s {
+        DIRECTIVE_T directives[MAX_DIRECTIVES];
+        int count;
+        apr_interval_time_t period;
+        // Position within the script, and the start of the current cycle.
+        int next;
+        apr_time_t cycle_start;
+} IMPAIRMENT_SCRIPT_T;
+
+/*
+ * Data read from one side and waiting to be written to the other.
+ */
+typedef struct piece_s {
+        struct piece_s *next;
+        apr_time_t due;
+        size_t len;
+        size_t offset;
+        char data[];
+} PIECE_T;
+
+typedef struct direction_s {
+        PIECE_T *head;
+        PIECE_T *tail;
+        size_t queued;
+        size_t pieces;
+        apr_time_t last_due;
+        // Throttling.
+        double tokens;
+        apr_time_t refilled;
+        bool closed;
+} DIRECTION_T;
+
+typedef struct connection_s {
+        int client_fd;
+        int server_fd;
+        // Set until the connection to the server has been made.
+        bool connecting;
+        DIRECTION_T up;
+        DIRECTION_T down;
+} CONNECTION_T;
+
+typedef struct impairment_s {
+        apr_interval_time_t delay;
+        apr_interval_time_t jitter;
+        long rate;
+        apr_time_t stalled_until;
+} IMPAIRMENT_T;
+
+typedef struct proxy_stats_s {
+        unsigned long connections;
+        unsigned long resets;
+        unsigned long up;
+        unsigned long down;
+        unsigned long discarded_up;
+        unsigned long discarded_down;
+} PROXY_STATS_T;
+
+/*
+ * Parse a script. Returns false, having printed the offending line,
+ * if it isn't understood.
+ */
+static bool
+script_parse(IMPAIRMENT_SCRIPT_T *script, const char *text)
+{
+        const char *line = text;
+        int line_number = 0;
+
+        while(*line != '\0') {
+                const char *eol = strchr(line, '\n');
+                const size_t len = eol != NULL ? (size_t)(eol - line) : strlen(line);
+                char buf[256];
+                snprintf(buf, sizeof(buf), "%.*s", (int)(len < sizeof(buf) ? len : sizeof(buf) - 1), line);
+                line = eol != NULL ? eol + 1 : line + len;
+                line_number++;
+
+                char action[16] = "";
+                double at = 0;
+                double period = 0;
+                long arg1 = 0;
+                long arg2 = 0;
+
+                if(buf[0] == '#' || sscanf(buf, " %15s", action) != 1) {
+                        continue;
+                }
+                if(sscanf(buf, " repeat %lf", &period) == 1) {
+                        script->period = (apr_interval_time_t)(period * APR_USEC_PER_SEC);
+                        continue;
+                }
+
+                const int n = sscanf(buf, " %lf %15s %ld %ld", &at, action, &arg1, &arg2);
+                if(n < 2 || script->count == MAX_DIRECTIVES) {
+                        printf("Invalid directive at line %d: %s\n", line_number, buf);
+                        return false;
+                }
+
+                DIRECTIVE_T *directive = &script->directives[script->count];
+                if(strcmp(action, "delay") == 0 && n >= 3) {
+                        directive->type = DIRECTIVE_DELAY;
+                }
+                else if(strcmp(action, "rate") == 0 && n >= 3) {
+                        directive->type = DIRECTIVE_RATE;
+                }
+                else if(strcmp(action, "stall") == 0 && n >= 3) {
+                        directive->type = DIRECTIVE_STALL;
+                }
+                else if(strcmp(action, "reset") == 0) {
+                        directive->type = DIRECTIVE_RESET;
+                }
+                else if(strcmp(action, "clear") == 0) {
+                        directive->type = DIRECTIVE_CLEAR;
+                }
+                else {
+                        printf("Invalid directive at line %d: %s\n", line_number, buf);
+                        return false;
+                }
+                directive->at = (apr_interval_time_t)(at * APR_USEC_PER_SEC);
+                directive->arg1 = arg1;
+                directive->arg2 = n >= 4 ? arg2 : 0;
+                snprintf(directive->text, sizeof(directive->text), "%s", buf + strspn(buf, " \t"));
+                script->count++;
+        }
+
+        // Directives are applied in time order, whatever order they were
+        // written in; an insertion sort keeps equal times in file order.
+        for(int i = 1; i < script->count; i++) {
+                DIRECTIVE_T directive = script->directives[i];
+                int j = i - 1;
+                while(j >= 0 && script->directives[j].at > directive.at) {
+                        script->directives[j + 1] = script->directives[j];
+                        j--;
+                }
+                script->directives[j + 1] = directive;
+        }
+        return true;
+}
+
+static char *
+read_file(const char *filename)
+{
+        FILE *file = fopen(filename, "r");
+        if(file == NULL) {
+                printf("Failed to open %s: %s\n", filename, strerror(errno));
+                return NULL;
+        }
+        size_t cap = 4096;
+        size_t len = 0;
+        char *text = malloc(cap);
+        size_t n;
+        while((n = fread(text + len, 1, cap - len - 1, file)) > 0) {
+                len += n;
+                if(cap - len < 1024) {
+                        cap *= 2;
+                        text = realloc(text, cap);
+                }
+        }
+        text[len] = '\0';
+        fclose(file);
+        return text;
+}
+
+static void
+set_nonblocking(int fd)
+{
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+static int
+listen_on(int port)
+{
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        const int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        struct sockaddr_in addr = { 0 };
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+                printf("Failed to listen on port %d: %s\n", port, strerror(errno));
+                close(fd);
+                return -1;
+        }
+        set_nonblocking(fd);
+        return fd;
+}
+
+/*
+ * Start connecting to the server, without waiting for the connection
+ * to be made, so that a slow or unreachable server doesn't hold up the
+ * other connections. The server's addresses are resolved once, at
+ * startup. Sets connecting if the connection is still in progress.
+ */
+static int
+connect_to(const struct addrinfo *addrs, bool *connecting)
+{
+        int fd = -1;
+        *connecting = false;
+        for(const struct addrinfo *addr = addrs; addr != NULL && fd < 0; addr = addr->ai_next) {
+                fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+                if(fd < 0) {
+                        continue;
+                }
+                set_nonblocking(fd);
+                if(connect(fd, addr->ai_addr, addr->ai_addrlen) < 0) {
+                        if(errno == EINPROGRESS) {
+                                *connecting = true;
+                        }
+                        else {
+                                close(fd);
+                                fd = -1;
+                        }
+                }
+        }
+
+        if(fd >= 0) {
+                const int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        }
+        return fd;
+}
+
+/*
+ * Returns true once a connection in progress has been made, or false
+ * if it failed.
+ */
+static bool
+connect_completed(int fd)
+{
+        int error = 0;
+        socklen_t len = sizeof(error);
+        return getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0;
+}
+
+/*
+ * Close a socket so that the peer sees a reset rather than an orderly
+ * shutdown.
+ */
+static void
+close_with_reset(int fd)
+{
+        const struct linger linger = { .l_onoff = 1, .l_linger = 0 };
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+        close(fd);
+}
+
+/*
+ * Free everything waiting in a direction, returning the number of
+ * bytes discarded.
+ */
+static size_t
+direction_clear(DIRECTION_T *direction)
+{
+        size_t discarded = direction->queued;
+        while(direction->head != NULL) {
+                PIECE_T *next = direction->head->next;
+                free(direction->head);
+                direction->head = next;
+        }
+        direction->tail = NULL;
+        direction->queued = 0;
+        direction->pieces = 0;
+        return discarded;
+}
+
+/*
+ * Whether a direction holds as much as it may, counting the memory
+ * taken by its pieces as well as the data waiting in them.
+ */
+static bool
+direction_full(const DIRECTION_T *direction)
+{
+        return direction->queued + direction->pieces * sizeof(PIECE_T) >= MAX_QUEUED;
+}
+
+static void
+connection_close(CONNECTION_T *connection, bool reset, PROXY_STATS_T *stats)
+{
+        if(reset) {
+                close_with_reset(connection->client_fd);
+                close_with_reset(connection->server_fd);
+        }
+        else {
+                close(connection->client_fd);
+                close(connection->server_fd);
+        }
+        stats->discarded_up += direction_clear(&connection->up);
+        stats->discarded_down += direction_clear(&connection->down);
+        connection->client_fd = -1;
+        connection->server_fd = -1;
+}
+
+/*
+ * Read what's available from one side into a direction, stamping it
+ * with the time it may be forwarded. Returns false on end of stream.
+ */
+static bool
+direction_read(DIRECTION_T *direction, int fd, const IMPAIRMENT_T *impairment, apr_time_t now)
+{
+        // Read into a shared buffer so that each piece is only as big
+        // as what arrived.
+        static char buf[READ_SIZE];
+        const ssize_t n = read(fd, buf, sizeof(buf));
+        if(n <= 0) {
+                return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+        }
+        PIECE_T *piece = malloc(sizeof(PIECE_T) + n);
+        memcpy(piece->data, buf, n);
+
+        apr_time_t due = now + impairment->delay;
+        if(impairment->jitter > 0) {
+                due += (rand() % (2 * impairment->jitter + 1)) - impairment->jitter;
+        }
+        if(due < direction->last_due) {
+                due = direction->last_due;
+        }
+        direction->last_due = due;
+
+        piece->next = NULL;
+        piece->due = due;
+        piece->len = n;
+        piece->offset = 0;
+        if(direction->tail != NULL) {
+                direction->tail->next = piece;
+        }
+        else {
+                direction->head = piece;
+        }
+        direction->tail = piece;
+        direction->queued += n;
+        direction->pieces++;
+        return true;
+}
+
+/*
+ * Forward whatever is due, as far as throttling allows. Returns the
+ * number of bytes written, or -1 if the other side has failed.
+ */
+static ssize_t
+direction_write(DIRECTION_T *direction, int fd, const IMPAIRMENT_T *impairment, apr_time_t now)
+{
+        if(impairment->rate > 0) {
+                // Allow bursts of up to 100ms worth of data.
+                const double burst = impairment->rate / 10.0;
+                direction->tokens += impairment->rate * (double)(now - direction->refilled) / APR_USEC_PER_SEC;
+                if(direction->tokens > burst) {
+                        direction->tokens = burst;
+                }
+        }
+        direction->refilled = now;
+
+        ssize_t written = 0;
+        while(direction->head != NULL && direction->head->due <= now) {
+                PIECE_T *piece = direction->head;
+                size_t len = piece->len - piece->offset;
+                if(impairment->rate > 0) {
+                        if(direction->tokens < 1) {
+                                break;
+                        }
+                        if(len > (size_t)direction->tokens) {
+                                len = (size_t)direction->tokens;
+                        }
+                }
+
+                const ssize_t n = write(fd, piece->data + piece->offset, len);
+                if(n < 0) {
+                        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? written : -1;
+                }
+                written += n;
+                piece->offset += n;
+                direction->queued -= n;
+                if(impairment->rate > 0) {
+                        direction->tokens -= n;
+                }
+                if(piece->offset < piece->len) {
+                        break;
+                }
+                direction->head = piece->next;
+                if(direction->head == NULL) {
+                        direction->tail = NULL;
+                }
+                direction->pieces--;
+                free(piece);
+        }
+        return written;
+}
+
+/*
+ * Microseconds until a direction next has something to forward, or
+ * -1 if it has nothing.
+ */
+static apr_interval_time_t
+direction_wait(const DIRECTION_T *direction, const IMPAIRMENT_T *impairment, apr_time_t now)
+{
+        if(direction->head == NULL) {
+                return -1;
+        }
+        apr_interval_time_t wait = direction->head->due - now;
+        if(impairment->rate > 0 && direction->tokens < 1) {
+                const apr_interval_time_t refill = (apr_interval_time_t)(APR_USEC_PER_SEC / (double)impairment->rate) + 1;
+                if(refill > wait) {
+                        wait = refill;
+                }
+        }
+        return wait > 0 ? wait : 0;
+}
+
+/*
+ * Apply any directives that have come due.
+ */
+static void
+script_run(IMPAIRMENT_SCRIPT_T *script, IMPAIRMENT_T *impairment, CONNECTION_T *connections,
+           PROXY_STATS_T *stats, apr_time_t start, apr_time_t now)
+{
+        for(;;) {
+                if(script->next == script->count) {
+                        if(script->period <= 0 || now < script->cycle_start + script->period) {
+                                return;
+                        }
+                        script->cycle_start += script->period;
+                        script->next = 0;
+                }
+                const DIRECTIVE_T *directive = &script->directives[script->next];
+                if(now < script->cycle_start + directive->at) {
+                        return;
+                }
+                script->next++;
+
+                switch(directive->type) {
+                case DIRECTIVE_DELAY:
+                        impairment->delay = directive->arg1 * 1000;
+                        impairment->jitter = directive->arg2 * 1000;
+                        break;
+                case DIRECTIVE_RATE:
+                        impairment->rate = directive->arg1;
+                        break;
+                case DIRECTIVE_STALL:
+                        impairment->stalled_until = now + directive->arg1 * 1000;
+                        break;
+                case DIRECTIVE_CLEAR:
+                        impairment->delay = 0;
+                        impairment->jitter = 0;
+                        impairment->rate = 0;
+                        break;
+                case DIRECTIVE_RESET:
+                        for(int i = 0; i < MAX_CONNECTIONS; i++) {
+                                if(connections[i].client_fd >= 0) {
+                                        connection_close(&connections[i], true, stats);
+                                }
+                        }
+                        stats->resets++;
+                        break;
+                }
+                printf("EVENT %ld %s\n", (long)apr_time_as_msec(now - start), directive->text);
+                fflush(stdout);
+        }
+}
+
+/*
+ * Entry point for the example.
+ */
+int
+main(int argc, char **argv)
+{
+        /*
+         * Standard command-line parsing.
+         */
+        HASH_T *options = parse_cmdline(argc, argv, arg_opts);
+        if(options == NULL || hash_get(options, "help") != NULL) {
+                show_usage(argc, argv, arg_opts);
+                return EXIT_FAILURE;
+        }
+
+        const int listen_port = atoi(hash_get(options, "listen"));
+        const char *host = hash_get(options, "host");
+        const char *port = hash_get(options, "port");
+        const char *filename = hash_get(options, "file");
+        const char *profile = hash_get(options, "profile");
+        const unsigned int run_time = atol(hash_get(options, "sleep"));
+
+        char *text = NULL;
+        if(filename != NULL) {
+                text = read_file(filename);
+        }
+        else {
+                for(const PROFILE_T *p = profiles; p->name != NULL; p++) {
+                        if(strcmp(p->name, profile) == 0) {
+                                text = strdup(p->script);
+                        }
+                }
+                if(text == NULL) {
+                        printf("Unknown profile: %s\n", profile);
+                }
+        }
+
+        IMPAIRMENT_SCRIPT_T *script = calloc(1, sizeof(IMPAIRMENT_SCRIPT_T));
+        if(text == NULL || !script_parse(script, text)) {
+                free(text);
+                free(script);
+                hash_free(options, NULL, free);
+                return EXIT_FAILURE;
+        }
+        free(text);
+
+        signal(SIGPIPE, SIG_IGN);
+
+        struct addrinfo hints = { 0 };
+        struct addrinfo *server_addrs = NULL;
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        const int gai_rc = getaddrinfo(host, port, &hints, &server_addrs);
+        if(gai_rc != 0) {
+                printf("Failed to resolve %s:%s: %s\n", host, port, gai_strerror(gai_rc));
+                free(script);
+                hash_free(options, NULL, free);
+                return EXIT_FAILURE;
+        }
+
+        apr_initialize();
+
+        const int listen_fd = listen_on(listen_port);
+        if(listen_fd < 0) {
+                freeaddrinfo(server_addrs);
+                return EXIT_FAILURE;
+        }
+        printf("LISTENING %d\n", listen_port);
+        fflush(stdout);
+
+        CONNECTION_T connections[MAX_CONNECTIONS];
+        for(int i = 0; i < MAX_CONNECTIONS; i++) {
+                connections[i].client_fd = -1;
+                connections[i].server_fd = -1;
+        }
+        IMPAIRMENT_T impairment = { 0 };
+        PROXY_STATS_T stats = { 0 };
+
+        const apr_time_t start = apr_time_now();
+        const apr_time_t end = start + apr_time_from_sec(run_time);
+        script->cycle_start = start;
+
+        struct pollfd fds[1 + 2 * MAX_CONNECTIONS];
+
+        for(apr_time_t now = start; now < end; now = apr_time_now()) {
+                script_run(script, &impairment, connections, &stats, start, now);
+                const bool stalled = now < impairment.stalled_until;
+
+                /*
+                 * Work out what to wait for. While stalled nothing is
+                 * read or written, and new connections wait in the
+                 * listen backlog.
+                 */
+                apr_interval_time_t timeout = apr_time_from_msec(100);
+                if(stalled && impairment.stalled_until - now < timeout) {
+                        timeout = impairment.stalled_until - now;
+                }
+                int nfds = 0;
+                fds[nfds++] = (struct pollfd){ .fd = stalled ? -1 : listen_fd, .events = POLLIN };
+                for(int i = 0; i < MAX_CONNECTIONS; i++) {
+                        CONNECTION_T *connection = &connections[i];
+                        short client_events = 0;
+                        short server_events = 0;
+                        if(connection->client_fd >= 0 && connection->connecting) {
+                                // Wait for the connection to be made,
+                                // holding on to what the client sends.
+                                if(!stalled && !connection->up.closed && !direction_full(&connection->up)) {
+                                        client_events |= POLLIN;
+                                }
+                                server_events |= POLLOUT;
+                        }
+                        else if(connection->client_fd >= 0 && !stalled) {
+                                if(!connection->up.closed && !direction_full(&connection->up)) {
+                                        client_events |= POLLIN;
+                                }
+                                if(!connection->down.closed && !direction_full(&connection->down)) {
+                                        server_events |= POLLIN;
+                                }
+                                const apr_interval_time_t up_wait = direction_wait(&connection->up, &impairment, now);
+                                const apr_interval_time_t down_wait = direction_wait(&connection->down, &impairment, now);
+                                if(up_wait == 0) {
+                                        server_events |= POLLOUT;
+                                }
+                                else if(up_wait > 0 && up_wait < timeout) {
+                                        timeout = up_wait;
+                                }
+                                if(down_wait == 0) {
+                                        client_events |= POLLOUT;
+                                }
+                                else if(down_wait > 0 && down_wait < timeout) {
+                                        timeout = down_wait;
+                                }
+                        }
+                        fds[nfds++] = (struct pollfd){ .fd = client_events ? connection->client_fd : -1, .events = client_events };
+                        fds[nfds++] = (struct pollfd){ .fd = server_events ? connection->server_fd : -1, .events = server_events };
+                }
+
+                const int timeout_ms = (int)((timeout + 999) / 1000);
+                if(poll(fds, nfds, timeout_ms) < 0 && errno != EINTR) {
+                        printf("poll() failed: %s\n", strerror(errno));
+                        break;
+                }
+                now = apr_time_now();
+
+                if(fds[0].revents & POLLIN) {
+                        const int client_fd = accept(listen_fd, NULL, NULL);
+                        int slot = 0;
+                        while(slot < MAX_CONNECTIONS && connections[slot].client_fd >= 0) {
+                                slot++;
+                        }
+                        bool connecting = false;
+                        const int server_fd = client_fd >= 0 && slot < MAX_CONNECTIONS ? connect_to(server_addrs, &connecting) : -1;
+                        if(server_fd < 0) {
+                                if(client_fd >= 0) {
+                                        close_with_reset(client_fd);
+                                }
+                        }
+                        else {
+                                const int on = 1;
+                                setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                                set_nonblocking(client_fd);
+                                connections[slot] = (CONNECTION_T){
+                                        .client_fd = client_fd,
+                                        .server_fd = server_fd,
+                                        .connecting = connecting,
+                                        .up = { .refilled = now },
+                                        .down = { .refilled = now }
+                                };
+                                stats.connections++;
+                        }
+                }
+
+                for(int i = 0; i < MAX_CONNECTIONS; i++) {
+                        CONNECTION_T *connection = &connections[i];
+                        const struct pollfd *client = &fds[1 + 2 * i];
+                        const struct pollfd *server = &fds[2 + 2 * i];
+                        if(connection->client_fd < 0) {
+                                continue;
+                        }
+                        if(connection->connecting) {
+                                if(client->revents & (POLLIN | POLLHUP | POLLERR)) {
+                                        connection->up.closed = !direction_read(&connection->up, connection->client_fd, &impairment, now);
+                                }
+                                if(server->revents & (POLLOUT | POLLHUP | POLLERR)) {
+                                        connection->connecting = false;
+                                        if(!connect_completed(connection->server_fd)) {
+                                                connection_close(connection, true, &stats);
+                                        }
+                                }
+                                continue;
+                        }
+                        if(stalled) {
+                                continue;
+                        }
+
+                        if(client->revents & (POLLIN | POLLHUP | POLLERR)) {
+                                connection->up.closed = !direction_read(&connection->up, connection->client_fd, &impairment, now);
+                        }
+                        if(server->revents & (POLLIN | POLLHUP | POLLERR)) {
+                                connection->down.closed = !direction_read(&connection->down, connection->server_fd, &impairment, now);
+                        }
+
+                        const ssize_t up = direction_write(&connection->up, connection->server_fd, &impairment, now);
+                        const ssize_t down = direction_write(&connection->down, connection->client_fd, &impairment, now);
+                        const bool failed = up < 0 || down < 0;
+                        stats.up += up > 0 ? up : 0;
+                        stats.down += down > 0 ? down : 0;
+
+                        // Pass on a close once everything before it has been
+                        // forwarded.
+                        if(failed ||
+                           (connection->up.closed && connection->up.head == NULL) ||
+                           (connection->down.closed && connection->down.head == NULL)) {
+                                connection_close(connection, failed, &stats);
+                        }
+                }
+        }
+
+        for(int i = 0; i < MAX_CONNECTIONS; i++) {
+                if(connections[i].client_fd >= 0) {
+                        connection_close(&connections[i], false, &stats);
+                }
+        }
+        close(listen_fd);
+        freeaddrinfo(server_addrs);
+
+        printf("STATS connections=%lu resets=%lu up=%lu down=%lu discarded_up=%lu discarded_down=%lu\n",
+               stats.connections, stats.resets, stats.up, stats.down,
+               stats.discarded_up, stats.discarded_down);
+
+        free(script);
+        hash_free(options, NULL, free);
+
+        apr_terminate();
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,870 @@
+/**
+ * Copyright © 2026 Push Technology Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This example is written in C99. Please use an appropriate C99 capable compiler
+ *
+ * @author Push Technology Limited
+ * @since 6.4
+ */
+
+/*
+ * This example measures contention on the client library's internal
+ * locks while several threads publish through one session, so that
+ * the locks can be ranked by the time threads spend waiting for them.
+ *
+ * It is linked with "-Wl,--wrap" for the APR thread mutex and
+ * condition variable functions (see the Makefile), which routes every
+ * mutex the library creates, locks, unlocks and destroys through the
+ * wrappers below; this needs the GNU linker. For each lock, the
+ * profiler counts acquisitions and those that had to wait, and keeps
+ * histograms of the time spent waiting for the lock and holding it.
+ *
+ * Locks are grouped by name. The session's own mutexes, semaphores and
+ * hash tables are named after their fields with lock_profiler_tag();
+ * any other lock is named after the function that created it, which
+ * is how the message queue's lock and those of every HASH_T appear.
+ *
+ * Publisher threads ("-n") each update their own topics ("-T") as fast
+ * as their window of unacknowledged updates ("-w") allows, while the
+ * same session subscribes to them. The profile is printed every "-i"
+ * seconds, ordered by total waiting time. Run with "-x" to publish
+ * without profiling, to see what the instrumentation costs.
+ */
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+#include <apr.h>
+#include <apr_atomic.h>
+#include <apr_thread_mutex.h>
+#include <apr_thread_cond.h>
+#include <apr_thread_proc.h>
+
+#include "diffusion.h"
+#include "args.h"
+
+ARG_OPTS_T arg_opts[] = {
+        ARG_OPTS_HELP,
+        {'u', "url", "Diffusion server URL", ARG_OPTIONAL, ARG_HAS_VALUE, "ws://localhost:8080"},
+        {'p', "principal", "Principal (username) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "control"},
+        {'c', "credentials", "Credentials (password) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "password"},
+        {'n', "threads", "Number of publishing threads", ARG_OPTIONAL, ARG_HAS_VALUE, "4"},
+        {'T', "topics", "Number of topics each thread updates", ARG_OPTIONAL, ARG_HAS_VALUE, "10"},
+        {'w', "window", "Unacknowledged updates allowed per thread", ARG_OPTIONAL, ARG_HAS_VALUE, "100"},
+        {'i', "interval", "Seconds between reports", ARG_OPTIONAL, ARG_HAS_VALUE, "5"},
+        {'x', "no_profile", "Publish without profiling", ARG_OPTIONAL, ARG_NO_VALUE, NULL},
+        {'s', "sleep", "Time to publish for (in seconds)", ARG_OPTIONAL, ARG_HAS_VALUE, "20"},
+        END_OF_ARG_OPTS
+};
+
+#define TOPIC_ROOT "lock-profiler"
+
+/*
+ * Times are recorded in nanoseconds, in histograms of power-of-two
+ * buckets: bucket b counts times from 2^b up to 2^(b+1) ns.
+ */
+#define LOCK_HISTOGRAM_BUCKETS 40
+
+#define MAX_LOCK_CLASSES 128
+#define LOCK_RECORDS 16384
+
+/*
+ * A profile of the locks sharing a name.
+ */
+typedef struct lock_profile_s {
+        char name[64];
+
+        // Live mutexes given this name.
+        apr_uint32_t created;
+
+        apr_uint32_t locks;
+        // Locks that found the mutex held, and had to wait.
+        apr_uint32_t contended;
+        apr_uint32_t trylocks;
+        apr_uint32_t trylock_failures;
+
+        uint64_t wait_ns;
+        uint64_t max_wait_ns;
+        uint64_t hold_ns;
+        uint64_t max_hold_ns;
+
+        apr_uint32_t wait_histogram[LOCK_HISTOGRAM_BUCKETS];
+        apr_uint32_t hold_histogram[LOCK_HISTOGRAM_BUCKETS];
+} LOCK_PROFILE_T;
+
+/*
+ * What the profiler knows of one mutex. Only the thread holding the
+ * mutex touches depth and acquired_at.
+ */
+typedef struct lock_record_s {
+        void *volatile mutex;
+        LOCK_PROFILE_T *volatile profile;
+        int depth;
+        uint64_t acquired_at;
+} LOCK_RECORD_T;
+
+/*
+ * Profiles are added under a plain pthread mutex, so that doing so
+ * doesn't pass through the wrappers. Counters are updated atomically;
+ * the 64-bit totals use the compiler's builtins, as APR has no 64-bit
+ * atomics.
+ */
+static pthread_mutex_t lock_profiles_mutex = PTHREAD_MUTEX_INITIALIZER;
+static LOCK_PROFILE_T lock_profiles[MAX_LOCK_CLASSES] = {
+        { .name = "unnamed" }
+};
+static int lock_profile_count = 1;
+
+/*
+ * Records are found by open addressing, without locking. A destroyed
+ * mutex's record is marked as freed rather than emptied, so that the
+ * records probed past it can still be found; records are claimed, and
+ * freed ones reused, under lock_records_mutex.
+ */
+static pthread_mutex_t lock_records_mutex = PTHREAD_MUTEX_INITIALIZER;
+static LOCK_RECORD_T lock_records[LOCK_RECORDS];
+static char lock_record_freed;
+static volatile apr_uint32_t untracked_mutexes;
+static volatile apr_uint32_t profiling;
+
+apr_status_t __real_apr_thread_mutex_create(apr_thread_mutex_t **mutex, unsigned int flags, apr_pool_t *pool);
+apr_status_t __real_apr_thread_mutex_lock(apr_thread_mutex_t *mutex);
+apr_status_t __real_apr_thread_mutex_trylock(apr_thread_mutex_t *mutex);
+apr_status_t __real_apr_thread_mutex_unlock(apr_thread_mutex_t *mutex);
+apr_status_t __real_apr_thread_mutex_destroy(apr_thread_mutex_t *mutex);
+apr_status_t __real_apr_thread_cond_wait(apr_thread_cond_t *cond, apr_thread_mutex_t *mutex);
+apr_status_t __real_apr_thread_cond_timedwait(apr_thread_cond_t *cond, apr_thread_mutex_t *mutex,
+                                              apr_interval_time_t timeout);
+
+static uint64_t
+now_ns(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int
+histogram_bucket(uint64_t ns)
+{
+        int bucket = 0;
+        while(ns > 1 && bucket < LOCK_HISTOGRAM_BUCKETS - 1) {
+                ns >>= 1;
+                bucket++;
+        }
+        return bucket;
+}
+
+static void
+atomic_max64(uint64_t *max, uint64_t value)
+{
+        uint64_t current = __atomic_load_n(max, __ATOMIC_RELAXED);
+        while(value > current &&
+              !__atomic_compare_exchange_n(max, &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+}
+
+/*
+ * Find the profile with the given name, adding it if there's room.
+ */
+static LOCK_PROFILE_T *
+lock_profile_get(const char *name)
+{
+        LOCK_PROFILE_T *profile = &lock_profiles[0];
+
+        pthread_mutex_lock(&lock_profiles_mutex);
+        int i;
+        for(i = 0; i < lock_profile_count; i++) {
+                if(strcmp(lock_profiles[i].name, name) == 0) {
+                        break;
+                }
+        }
+        if(i < lock_profile_count) {
+                profile = &lock_profiles[i];
+        }
+        else if(lock_profile_count < MAX_LOCK_CLASSES) {
+                profile = &lock_profiles[lock_profile_count++];
+                snprintf(profile->name, sizeof(profile->name), "%s", name);
+        }
+        pthread_mutex_unlock(&lock_profiles_mutex);
+
+        return profile;
+}
+
+/*
+ * Find the record for a mutex. If it has none, and free_record isn't
+ * NULL, the first record that could be claimed for it is returned
+ * there.
+ */
+static LOCK_RECORD_T *
+lock_record_find(const void *mutex, LOCK_RECORD_T **free_record)
+{
+        uintptr_t hash = (uintptr_t)mutex;
+        hash ^= hash >> 17;
+        hash *= 0x9E3779B97F4A7C15ULL;
+
+        for(int probe = 0; probe < LOCK_RECORDS; probe++) {
+                LOCK_RECORD_T *record = &lock_records[(hash + probe) % LOCK_RECORDS];
+                void *current = record->mutex;
+                if(current == mutex) {
+                        return record;
+                }
+                if(current == NULL || current == &lock_record_freed) {
+                        if(free_record != NULL && *free_record == NULL) {
+                                *free_record = record;
+                        }
+                        if(current == NULL) {
+                                break;
+                        }
+                }
+        }
+        return NULL;
+}
+
+/*
+ * Find the record for a mutex, claiming a free one if it's new.
+ * Returns NULL once every record is in use.
+ */
+static LOCK_RECORD_T *
+lock_record_get(const void *mutex)
+{
+        LOCK_RECORD_T *record = lock_record_find(mutex, NULL);
+        if(record != NULL) {
+                return record;
+        }
+
+        // Look again under the lock, in case another thread has just
+        // claimed a record for the same mutex.
+        LOCK_RECORD_T *free_record = NULL;
+        pthread_mutex_lock(&lock_records_mutex);
+        record = lock_record_find(mutex, &free_record);
+        if(record == NULL && free_record != NULL) {
+                record = free_record;
+                record->profile = NULL;
+                record->depth = 0;
+                apr_atomic_xchgptr((volatile void **)&record->mutex, (void *)mutex);
+        }
+        pthread_mutex_unlock(&lock_records_mutex);
+
+        if(record == NULL) {
+                apr_atomic_inc32(&untracked_mutexes);
+        }
+        return record;
+}
+
+/*
+ * Forget a mutex that is being destroyed, so that its record can be
+ * reused and its profile counts only the mutexes still live.
+ */
+static void
+lock_record_release(const void *mutex)
+{
+        pthread_mutex_lock(&lock_records_mutex);
+        LOCK_RECORD_T *record = lock_record_find(mutex, NULL);
+        if(record != NULL) {
+                LOCK_PROFILE_T *profile = record->profile;
+                record->profile = NULL;
+                record->depth = 0;
+                apr_atomic_xchgptr((volatile void **)&record->mutex, &lock_record_freed);
+                if(profile != NULL) {
+                        apr_atomic_dec32(&profile->created);
+                }
+        }
+        pthread_mutex_unlock(&lock_records_mutex);
+}
+
+static LOCK_PROFILE_T *
+lock_record_profile(const LOCK_RECORD_T *record)
+{
+        LOCK_PROFILE_T *profile = record->profile;
+        return profile != NULL ? profile : &lock_profiles[0];
+}
+
+/*
+ * Give a mutex a name. Mutexes with the same name share a profile;
+ * a mutex at an address that has been reused takes its new name.
+ */
+void
+lock_profiler_tag(apr_thread_mutex_t *mutex, const char *name)
+{
+        if(mutex == NULL) {
+                return;
+        }
+        LOCK_RECORD_T *record = lock_record_get(mutex);
+        if(record == NULL) {
+                return;
+        }
+        LOCK_PROFILE_T *profile = lock_profile_get(name);
+        LOCK_PROFILE_T *previous = record->profile;
+        if(previous == profile) {
+                return;
+        }
+        record->profile = profile;
+        apr_atomic_inc32(&profile->created);
+        if(previous != NULL) {
+                apr_atomic_dec32(&previous->created);
+        }
+}
+
+void
+lock_profiler_enable(bool enable)
+{
+        apr_atomic_set32(&profiling, enable ? 1 : 0);
+}
+
+static void
+lock_acquired(LOCK_RECORD_T *record, uint64_t wait_ns, bool contended)
+{
+        if(record->depth++ == 0) {
+                record->acquired_at = now_ns();
+        }
+
+        LOCK_PROFILE_T *profile = lock_record_profile(record);
+        apr_atomic_inc32(&profile->locks);
+        if(contended) {
+                apr_atomic_inc32(&profile->contended);
+        }
+        __atomic_fetch_add(&profile->wait_ns, wait_ns, __ATOMIC_RELAXED);
+        atomic_max64(&profile->max_wait_ns, wait_ns);
+        apr_atomic_inc32(&profile->wait_histogram[histogram_bucket(wait_ns)]);
+}
+
+static void
+lock_released(LOCK_RECORD_T *record)
+{
+        // A mutex already held when profiling began has no depth.
+        if(record->depth == 0 || --record->depth > 0) {
+                return;
+        }
+        const uint64_t hold_ns = now_ns() - record->acquired_at;
+
+        LOCK_PROFILE_T *profile = lock_record_profile(record);
+        __atomic_fetch_add(&profile->hold_ns, hold_ns, __ATOMIC_RELAXED);
+        atomic_max64(&profile->max_hold_ns, hold_ns);
+        apr_atomic_inc32(&profile->hold_histogram[histogram_bucket(hold_ns)]);
+}
+
+/*
+ * Name each new mutex after the function creating it. This relies on
+ * the function being exported, hence "-rdynamic"; a static function
+ * is reported as the exported one nearest before it.
+ */
+apr_status_t
+__wrap_apr_thread_mutex_create(apr_thread_mutex_t **mutex, unsigned int flags, apr_pool_t *pool)
+{
+        void *caller = __builtin_return_address(0);
+
+        const apr_status_t rc = __real_apr_thread_mutex_create(mutex, flags, pool);
+        if(rc == APR_SUCCESS) {
+                char name[64];
+                Dl_info info;
+                if(dladdr(caller, &info) != 0 && info.dli_sname != NULL) {
+                        snprintf(name, sizeof(name), "created by %s", info.dli_sname);
+                }
+                else {
+                        snprintf(name, sizeof(name), "created at %p", caller);
+                }
+                lock_profiler_tag(*mutex, name);
+        }
+        return rc;
+}
+
+/*
+ * Try the lock first, so that only locks which have to wait are
+ * timed and counted as contended.
+ */
+apr_status_t
+__wrap_apr_thread_mutex_lock(apr_thread_mutex_t *mutex)
+{
+        if(apr_atomic_read32(&profiling) == 0) {
+                return __real_apr_thread_mutex_lock(mutex);
+        }
+        LOCK_RECORD_T *record = lock_record_get(mutex);
+
+        uint64_t wait_ns = 0;
+        bool contended = false;
+        apr_status_t rc = __real_apr_thread_mutex_trylock(mutex);
+        if(APR_STATUS_IS_EBUSY(rc)) {
+                const uint64_t start = now_ns();
+                rc = __real_apr_thread_mutex_lock(mutex);
+                wait_ns = now_ns() - start;
+                contended = true;
+        }
+        if(rc == APR_SUCCESS && record != NULL) {
+                lock_acquired(record, wait_ns, contended);
+        }
+        return rc;
+}
+
+apr_status_t
+__wrap_apr_thread_mutex_trylock(apr_thread_mutex_t *mutex)
+{
+        const apr_status_t rc = __real_apr_thread_mutex_trylock(mutex);
+        if(apr_atomic_read32(&profiling) == 0) {
+                return rc;
+        }
+        LOCK_RECORD_T *record = lock_record_get(mutex);
+        if(record == NULL) {
+                return rc;
+        }
+
+        LOCK_PROFILE_T *profile = lock_record_profile(record);
+        apr_atomic_inc32(&profile->trylocks);
+        if(rc == APR_SUCCESS) {
+                lock_acquired(record, 0, false);
+        }
+        else if(APR_STATUS_IS_EBUSY(rc)) {
+                apr_atomic_inc32(&profile->trylock_failures);
+        }
+        return rc;
+}
+
+apr_status_t
+__wrap_apr_thread_mutex_unlock(apr_thread_mutex_t *mutex)
+{
+        if(apr_atomic_read32(&profiling) != 0) {
+                LOCK_RECORD_T *record = lock_record_get(mutex);
+                if(record != NULL) {
+                        lock_released(record);
+                }
+        }
+        return __real_apr_thread_mutex_unlock(mutex);
+}
+
+apr_status_t
+__wrap_apr_thread_mutex_destroy(apr_thread_mutex_t *mutex)
+{
+        lock_record_release(mutex);
+        return __real_apr_thread_mutex_destroy(mutex);
+}
+
+/*
+ * Waiting on a condition releases the mutex and takes it again, which
+ * ends one hold and starts another, but isn't waiting for the lock.
+ */
+static LOCK_RECORD_T *
+cond_wait_begin(apr_thread_mutex_t *mutex)
+{
+        if(apr_atomic_read32(&profiling) == 0) {
+                return NULL;
+        }
+        LOCK_RECORD_T *record = lock_record_get(mutex);
+        if(record != NULL && record->depth > 0) {
+                record->depth = 1;
+                lock_released(record);
+                return record;
+        }
+        return NULL;
+}
+
+static void
+cond_wait_end(LOCK_RECORD_T *record)
+{
+        if(record != NULL) {
+                record->depth = 1;
+                record->acquired_at = now_ns();
+        }
+}
+
+apr_status_t
+__wrap_apr_thread_cond_wait(apr_thread_cond_t *cond, apr_thread_mutex_t *mutex)
+{
+        LOCK_RECORD_T *record = cond_wait_begin(mutex);
+        const apr_status_t rc = __real_apr_thread_cond_wait(cond, mutex);
+        cond_wait_end(record);
+        return rc;
+}
+
+apr_status_t
+__wrap_apr_thread_cond_timedwait(apr_thread_cond_t *cond, apr_thread_mutex_t *mutex,
+                                 apr_interval_time_t timeout)
+{
+        LOCK_RECORD_T *record = cond_wait_begin(mutex);
+        const apr_status_t rc = __real_apr_thread_cond_timedwait(cond, mutex, timeout);
+        cond_wait_end(record);
+        return rc;
+}
+
+static int
+compare_wait(const void *a, const void *b)
+{
+        const LOCK_PROFILE_T *pa = a;
+        const LOCK_PROFILE_T *pb = b;
+        return pa->wait_ns < pb->wait_ns ? 1 : pa->wait_ns > pb->wait_ns ? -1 : 0;
+}
+
+/*
+ * Copy up to max profiles, those with the most waiting first. Returns
+ * the number copied.
+ */
+int
+lock_profiler_snapshot(LOCK_PROFILE_T *profiles, int max)
+{
+        pthread_mutex_lock(&lock_profiles_mutex);
+        const int count = lock_profile_count;
+        pthread_mutex_unlock(&lock_profiles_mutex);
+
+        LOCK_PROFILE_T *all = calloc(count, sizeof(LOCK_PROFILE_T));
+        for(int i = 0; i < count; i++) {
+                LOCK_PROFILE_T *from = &lock_profiles[i];
+                LOCK_PROFILE_T *to = &all[i];
+                memcpy(to->name, from->name, sizeof(to->name));
+                to->created = apr_atomic_read32(&from->created);
+                to->locks = apr_atomic_read32(&from->locks);
+                to->contended = apr_atomic_read32(&from->contended);
+                to->trylocks = apr_atomic_read32(&from->trylocks);
+                to->trylock_failures = apr_atomic_read32(&from->trylock_failures);
+                to->wait_ns = __atomic_load_n(&from->wait_ns, __ATOMIC_RELAXED);
+                to->max_wait_ns = __atomic_load_n(&from->max_wait_ns, __ATOMIC_RELAXED);
+                to->hold_ns = __atomic_load_n(&from->hold_ns, __ATOMIC_RELAXED);
+                to->max_hold_ns = __atomic_load_n(&from->max_hold_ns, __ATOMIC_RELAXED);
+                for(int b = 0; b < LOCK_HISTOGRAM_BUCKETS; b++) {
+                        to->wait_histogram[b] = apr_atomic_read32(&from->wait_histogram[b]);
+                        to->hold_histogram[b] = apr_atomic_read32(&from->hold_histogram[b]);
+                }
+        }
+        qsort(all, count, sizeof(LOCK_PROFILE_T), compare_wait);
+
+        const int copied = count < max ? count : max;
+        memcpy(profiles, all, copied * sizeof(LOCK_PROFILE_T));
+        free(all);
+        return copied;
+}
+
+/*
+ * An upper bound on the given percentile of a histogram, in ns.
+ */
+uint64_t
+lock_histogram_percentile(const apr_uint32_t *histogram, double percentile)
+{
+        uint64_t total = 0;
+        for(int b = 0; b < LOCK_HISTOGRAM_BUCKETS; b++) {
+                total += histogram[b];
+        }
+        if(total == 0) {
+                return 0;
+        }
+        const uint64_t rank = (uint64_t)(percentile * (total - 1)) + 1;
+        uint64_t seen = 0;
+        for(int b = 0; b < LOCK_HISTOGRAM_BUCKETS; b++) {
+                seen += histogram[b];
+                if(seen >= rank) {
+                        return 1ULL << (b + 1);
+                }
+        }
+        return 1ULL << LOCK_HISTOGRAM_BUCKETS;
+}
+
+void
+lock_profiler_print(void)
+{
+        LOCK_PROFILE_T *profiles = calloc(MAX_LOCK_CLASSES, sizeof(LOCK_PROFILE_T));
+        const int count = lock_profiler_snapshot(profiles, MAX_LOCK_CLASSES);
+
+        printf("%-44s %5s %10s %7s %10s %8s %8s %9s %10s %8s %8s %9s\n",
+               "lock", "count", "locks", "waited",
+               "wait ms", "p50 us", "p99 us", "max us",
+               "hold ms", "p50 us", "p99 us", "max us");
+        for(int i = 0; i < count; i++) {
+                const LOCK_PROFILE_T *p = &profiles[i];
+                if(p->locks == 0 && p->trylocks == 0) {
+                        continue;
+                }
+                printf("%-44.44s %5u %10u %6.2f%% %10.3f %8.1f %8.1f %9.1f %10.3f %8.1f %8.1f %9.1f\n",
+                       p->name, p->created, p->locks,
+                       p->locks > 0 ? 100.0 * p->contended / p->locks : 0.0,
+                       p->wait_ns / 1e6,
+                       lock_histogram_percentile(p->wait_histogram, 0.5) / 1e3,
+                       lock_histogram_percentile(p->wait_histogram, 0.99) / 1e3,
+                       p->max_wait_ns / 1e3,
+                       p->hold_ns / 1e6,
+                       lock_histogram_percentile(p->hold_histogram, 0.5) / 1e3,
+                       lock_histogram_percentile(p->hold_histogram, 0.99) / 1e3,
+                       p->max_hold_ns / 1e3);
+        }
+        if(apr_atomic_read32(&untracked_mutexes) > 0) {
+                printf("%u lock operations on mutexes beyond the first %d were not profiled\n",
+                       apr_atomic_read32(&untracked_mutexes), LOCK_RECORDS);
+        }
+        free(profiles);
+}
+
+/*
+ * Name the locks the session exposes.
+ */
+static void
+tag_session_locks(SESSION_T *session)
+{
+        lock_profiler_tag(session->_session_mutex, "SESSION_T._session_mutex");
+        lock_profiler_tag(session->_close_mutex, "SESSION_T._close_mutex");
+        lock_profiler_tag(session->_handler_mutex, "SESSION_T._handler_mutex");
+
+        const struct {
+                HASH_T *hash;
+                const char *name;
+        } hashes[] = {
+                { session->topic_handlers, "HASH_T.mutex (topic_handlers)" },
+                { session->stream_message_listeners, "HASH_T.mutex (stream_message_listeners)" },
+                { session->conversation_handlers, "HASH_T.mutex (conversation_handlers)" },
+                { session->_topic_details_refs, "HASH_T.mutex (_topic_details_refs)" },
+                { session->_topic_ids, "HASH_T.mutex (_topic_ids)" }
+        };
+        for(size_t i = 0; i < sizeof(hashes) / sizeof(hashes[0]); i++) {
+                if(hashes[i].hash != NULL) {
+                        lock_profiler_tag(hashes[i].hash->mutex, hashes[i].name);
+                }
+        }
+
+        if(session->_sem_connection != NULL) {
+                lock_profiler_tag(session->_sem_connection->mutex, "SEMAPHORE_T.mutex (_sem_connection)");
+        }
+        if(session->_sem_transport != NULL) {
+                lock_profiler_tag(session->_sem_transport->mutex, "SEMAPHORE_T.mutex (_sem_transport)");
+        }
+}
+
+typedef struct publisher_thread_s {
+        SESSION_T *session;
+        int index;
+        int topics;
+        apr_uint32_t window;
+        volatile apr_uint32_t *running;
+        volatile apr_uint32_t in_flight;
+        volatile apr_uint32_t acknowledged;
+        volatile apr_uint32_t failed;
+} PUBLISHER_THREAD_T;
+
+static int
+on_update(void *context)
+{
+        PUBLISHER_THREAD_T *publisher = context;
+        apr_atomic_dec32(&publisher->in_flight);
+        apr_atomic_inc32(&publisher->acknowledged);
+        return HANDLER_SUCCESS;
+}
+
+static int
+on_add_and_set(DIFFUSION_TOPIC_CREATION_RESULT_T result, void *context)
+{
+        return on_update(context);
+}
+
+static int
+on_update_error(SESSION_T *session, const DIFFUSION_ERROR_T *error)
+{
+        PUBLISHER_THREAD_T *publisher = error->context;
+        apr_atomic_dec32(&publisher->in_flight);
+        apr_atomic_inc32(&publisher->failed);
+        return HANDLER_SUCCESS;
+}
+
+static int
+on_update_discard(SESSION_T *session, void *context)
+{
+        PUBLISHER_THREAD_T *publisher = context;
+        apr_atomic_dec32(&publisher->in_flight);
+        apr_atomic_inc32(&publisher->failed);
+        return HANDLER_SUCCESS;
+}
+
+static void *APR_THREAD_FUNC
+publisher_thread(apr_thread_t *thread, void *data)
+{
+        PUBLISHER_THREAD_T *publisher = data;
+        char path[128];
+
+        TOPIC_SPECIFICATION_T *specification = topic_specification_init(TOPIC_TYPE_INT64);
+        for(int t = 0; t < publisher->topics; t++) {
+                snprintf(path, sizeof(path), TOPIC_ROOT "/%d/%d", publisher->index, t);
+                BUF_T *buf = buf_create();
+                write_diffusion_int64_value(0, buf);
+                DIFFUSION_TOPIC_UPDATE_ADD_AND_SET_PARAMS_T params = {
+                        .topic_path = path,
+                        .specification = specification,
+                        .datatype = DATATYPE_INT64,
+                        .update = buf,
+                        .on_topic_update_add_and_set = on_add_and_set,
+                        .on_error = on_update_error,
+                        .on_discard = on_update_discard,
+                        .context = publisher
+                };
+                apr_atomic_inc32(&publisher->in_flight);
+                diffusion_topic_update_add_and_set(publisher->session, params);
+                buf_free(buf);
+        }
+        topic_specification_free(specification);
+
+        int64_t value = 0;
+        while(apr_atomic_read32(publisher->running)) {
+                if(apr_atomic_read32(&publisher->in_flight) >= publisher->window) {
+                        apr_sleep(100);
+                        continue;
+                }
+                snprintf(path, sizeof(path), TOPIC_ROOT "/%d/%d", publisher->index, (int)(value % publisher->topics));
+                BUF_T *buf = buf_create();
+                write_diffusion_int64_value(++value, buf);
+                DIFFUSION_TOPIC_UPDATE_SET_PARAMS_T params = {
+                        .topic_path = path,
+                        .datatype = DATATYPE_INT64,
+                        .update = buf,
+                        .on_topic_update = on_update,
+                        .on_error = on_update_error,
+                        .on_discard = on_update_discard,
+                        .context = publisher
+                };
+                apr_atomic_inc32(&publisher->in_flight);
+                diffusion_topic_update_set(publisher->session, params);
+                buf_free(buf);
+        }
+
+        apr_thread_exit(thread, APR_SUCCESS);
+        return NULL;
+}
+
+static int
+on_value(const char *const topic_path,
+         const TOPIC_SPECIFICATION_T *const specification,
+         DIFFUSION_DATATYPE datatype,
+         const DIFFUSION_VALUE_T *const old_value,
+         const DIFFUSION_VALUE_T *const new_value,
+         void *context)
+{
+        apr_atomic_inc32(context);
+        return HANDLER_SUCCESS;
+}
+
+/*
+ * Entry point for the example.
+ */
+int
+main(int argc, char **argv)
+{
+        /*
+         * Standard command-line parsing.
+         */
+        HASH_T *options = parse_cmdline(argc, argv, arg_opts);
+        if(options == NULL || hash_get(options, "help") != NULL) {
+                show_usage(argc, argv, arg_opts);
+                return EXIT_FAILURE;
+        }
+
+        const char *url = hash_get(options, "url");
+        const int thread_count = atoi(hash_get(options, "threads"));
+        const int topics = atoi(hash_get(options, "topics"));
+        const apr_uint32_t window = atol(hash_get(options, "window"));
+        const unsigned int interval = atol(hash_get(options, "interval"));
+        const unsigned int run_time = atol(hash_get(options, "sleep"));
+        const bool profile = hash_get(options, "no_profile") == NULL;
+        if(thread_count < 1 || topics < 1 || window < 1 || interval < 1) {
+                printf("Threads, topics, window and interval must be at least 1\n");
+                return EXIT_FAILURE;
+        }
+
+        apr_initialize();
+        apr_pool_t *pool = NULL;
+        apr_pool_create(&pool, NULL);
+
+        /*
+         * Profile from the start, so that the session's locks are
+         * seen being created.
+         */
+        lock_profiler_enable(profile);
+
+        CREDENTIALS_T *credentials = credentials_create_password(hash_get(options, "credentials"));
+        DIFFUSION_ERROR_T error = { 0 };
+        SESSION_T *session = session_create(url, hash_get(options, "principal"), credentials, NULL, NULL, &error);
+        credentials_free(credentials);
+        if(session == NULL) {
+                printf("Failed to create session: %s\n", error.message);
+                free(error.message);
+                return EXIT_FAILURE;
+        }
+        tag_session_locks(session);
+
+        volatile apr_uint32_t values = 0;
+        VALUE_STREAM_T value_stream = {
+                .datatype = DATATYPE_INT64,
+                .on_value = on_value,
+                .context = (void *)&values
+        };
+        add_stream(session, "?" TOPIC_ROOT "//", &value_stream);
+        SUBSCRIPTION_PARAMS_T params = {
+                .topic_selector = "?" TOPIC_ROOT "//"
+        };
+        subscribe(session, params);
+
+        volatile apr_uint32_t running = 1;
+        PUBLISHER_THREAD_T *publishers = calloc(thread_count, sizeof(PUBLISHER_THREAD_T));
+        apr_thread_t **threads = calloc(thread_count, sizeof(apr_thread_t *));
+        for(int i = 0; i < thread_count; i++) {
+                publishers[i].session = session;
+                publishers[i].index = i;
+                publishers[i].topics = topics;
+                publishers[i].window = window;
+                publishers[i].running = &running;
+                apr_thread_create(&threads[i], NULL, publisher_thread, &publishers[i], pool);
+        }
+
+        apr_uint32_t last_acknowledged = 0;
+        for(unsigned int elapsed = 1; elapsed <= run_time; elapsed++) {
+                sleep(1);
+                if(elapsed % interval != 0 && elapsed != run_time) {
+                        continue;
+                }
+                apr_uint32_t acknowledged = 0;
+                apr_uint32_t failed = 0;
+                for(int i = 0; i < thread_count; i++) {
+                        acknowledged += apr_atomic_read32(&publishers[i].acknowledged);
+                        failed += apr_atomic_read32(&publishers[i].failed);
+                }
+                printf("\nAfter %us: %u updates acknowledged (%.0f/s), %u failed, %u values received\n",
+                       elapsed, acknowledged,
+                       (double)(acknowledged - last_acknowledged) / (elapsed % interval == 0 ? interval : elapsed % interval),
+                       failed, apr_atomic_read32(&values));
+                last_acknowledged = acknowledged;
+                if(profile) {
+                        lock_profiler_print();
+                }
+        }
+
+        apr_atomic_set32(&running, 0);
+        for(int i = 0; i < thread_count; i++) {
+                apr_status_t rc;
+                apr_thread_join(&rc, threads[i]);
+        }
+        free(threads);
+
+        // Close the session before freeing the publishers, which are
+        // the context of any update still outstanding.
+        session_close(session, NULL);
+        session_free(session);
+        free(publishers);
+        lock_profiler_enable(false);
+
+        hash_free(options, NULL, free);
+        apr_pool_destroy(pool);
+        apr_terminate();
+
+        return EXIT_SUCCESS;
+}
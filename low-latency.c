@@ -0,0 +1,557 @@
+/**
+ * Copyright © 2026 Push Technology Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This example is written in C99. Please use an appropriate C99 capable compiler
+ *
+ * @author Push Technology Limited
+ * @since 6.4
+ */
+
+/*
+ * This example shows a low-latency receive mode for subscribers, and
+ * measures what it gains against a server on the same host.
+ *
+ * A publisher session updates a topic with the time of each update,
+ * at a fixed rate ("-r"). A subscriber session receives the updates
+ * and hands them to a consumer thread, which is where an application
+ * would process them. The one-way latency to the subscriber's read
+ * thread, and to the consumer, is recorded for each update. This is
+ * done first in the default mode, then in low-latency mode, and the
+ * percentiles of each are printed side by side.
+ *
+ * In low-latency mode:
+ *
+ *  - the subscriber's socket has SO_BUSY_POLL set ("-b"), so that a
+ *    blocking read polls the device queue for that long rather than
+ *    sleeping until an interrupt. Raising it above the system's
+ *    net.core.busy_read needs CAP_NET_ADMIN;
+ *  - TCP_NODELAY is set, and TCP_QUICKACK is set again by the read
+ *    thread after each update, since the kernel clears it;
+ *  - the socket's receive and send buffers, and the session's, are
+ *    given explicit sizes ("-R", "-S");
+ *  - the consumer spins waiting for the next update for up to the spin
+ *    budget ("-B") before going to sleep, so that an update arriving
+ *    within the budget costs no wakeup.
+ *
+ * The socket options are applied again whenever the session
+ * reconnects, since it will have a new socket.
+ */
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <apr.h>
+#include <apr_atomic.h>
+#include <apr_portable.h>
+#include <apr_thread_cond.h>
+#include <apr_thread_mutex.h>
+#include <apr_thread_proc.h>
+#include <apr_time.h>
+
+#include "diffusion.h"
+#include "args.h"
+
+ARG_OPTS_T arg_opts[] = {
+        ARG_OPTS_HELP,
+        {'u', "url", "Diffusion server URL", ARG_OPTIONAL, ARG_HAS_VALUE, "ws://localhost:8080"},
+        {'p', "principal", "Principal (username) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "control"},
+        {'c', "credentials", "Credentials (password) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "password"},
+        {'r', "rate", "Updates per second", ARG_OPTIONAL, ARG_HAS_VALUE, "1000"},
+        {'B', "spin_budget", "Time the consumer spins before sleeping, in low-latency mode (in microseconds)", ARG_OPTIONAL, ARG_HAS_VALUE, "200"},
+        {'b', "busy_poll", "SO_BUSY_POLL time, in low-latency mode (in microseconds)", ARG_OPTIONAL, ARG_HAS_VALUE, "50"},
+        {'R', "rcvbuf", "Receive buffer size, in low-latency mode (in bytes)", ARG_OPTIONAL, ARG_HAS_VALUE, "262144"},
+        {'S', "sndbuf", "Send buffer size, in low-latency mode (in bytes)", ARG_OPTIONAL, ARG_HAS_VALUE, "65536"},
+        {'s', "sleep", "Time to measure each mode for (in seconds)", ARG_OPTIONAL, ARG_HAS_VALUE, "10"},
+        END_OF_ARG_OPTS
+};
+
+#define TOPIC_PATH "low-latency/timestamp"
+
+/*
+ * Size of the ring between the subscriber's read thread and the
+ * consumer. Must be a power of two.
+ */
+#define HANDOFF_RING_SIZE 4096
+
+typedef struct low_latency_options_s {
+        bool enabled;
+        apr_interval_time_t spin_budget;
+        int busy_poll;
+        int rcvbuf;
+        int sndbuf;
+} LOW_LATENCY_OPTIONS_T;
+
+typedef struct handoff_entry_s {
+        apr_time_t sent;
+        apr_time_t received;
+} HANDOFF_ENTRY_T;
+
+/*
+ * A single-producer, single-consumer ring. The consumer only takes the
+ * mutex to sleep, and the producer only to wake it.
+ */
+typedef struct handoff_s {
+        HANDOFF_ENTRY_T entries[HANDOFF_RING_SIZE];
+        volatile apr_uint32_t head;
+        volatile apr_uint32_t tail;
+        volatile apr_uint32_t sleeping;
+        volatile apr_uint32_t running;
+        volatile apr_uint32_t dropped;
+        apr_thread_mutex_t *mutex;
+        apr_thread_cond_t *cond;
+
+        SESSION_T *session;
+        const LOW_LATENCY_OPTIONS_T *options;
+
+        // Latencies, in microseconds, to the read thread and to the
+        // consumer.
+        apr_interval_time_t *receive_latencies;
+        apr_interval_time_t *consume_latencies;
+        size_t count;
+        size_t capacity;
+        unsigned long wakeups;
+} HANDOFF_T;
+
+/*
+ * Session listeners have no context, so the options for the session
+ * being tuned are held here.
+ */
+static const LOW_LATENCY_OPTIONS_T *tuned_options;
+
+/*
+ * The session's socket. The transport is replaced when the session
+ * reconnects, so this is only safe on the session's own threads, or
+ * straight after the session is created.
+ */
+static int
+session_socket(SESSION_T *session)
+{
+        apr_os_sock_t fd = -1;
+        if(session->transport == NULL || session->transport->_socket == NULL ||
+           apr_os_sock_get(&fd, session->transport->_socket) != APR_SUCCESS) {
+                return -1;
+        }
+        return fd;
+}
+
+static void
+set_option(int fd, int level, int name, int value, const char *description)
+{
+        if(setsockopt(fd, level, name, &value, sizeof(value)) < 0) {
+                printf("Failed to set %s: %s\n", description, strerror(errno));
+        }
+}
+
+/*
+ * Apply the low-latency socket options to the session's socket.
+ */
+static void
+tune_socket(SESSION_T *session, const LOW_LATENCY_OPTIONS_T *options)
+{
+        const int fd = session_socket(session);
+        if(fd < 0 || !options->enabled) {
+                return;
+        }
+
+        set_option(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+#ifdef TCP_QUICKACK
+        set_option(fd, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK");
+#endif
+#ifdef SO_BUSY_POLL
+        if(options->busy_poll > 0) {
+                set_option(fd, SOL_SOCKET, SO_BUSY_POLL, options->busy_poll, "SO_BUSY_POLL");
+        }
+#endif
+        if(options->rcvbuf > 0) {
+                set_option(fd, SOL_SOCKET, SO_RCVBUF, options->rcvbuf, "SO_RCVBUF");
+        }
+        if(options->sndbuf > 0) {
+                set_option(fd, SOL_SOCKET, SO_SNDBUF, options->sndbuf, "SO_SNDBUF");
+        }
+}
+
+static void
+on_session_state_changed(SESSION_T *session,
+        const SESSION_STATE_T old_state,
+        const SESSION_STATE_T new_state)
+{
+        if(new_state == CONNECTED_ACTIVE && tuned_options != NULL) {
+                tune_socket(session, tuned_options);
+        }
+}
+
+/*
+ * Create a session from the factory, with the low-latency options
+ * applied if they are enabled.
+ */
+static SESSION_T *
+low_latency_session_create(DIFFUSION_SESSION_FACTORY_T *factory, const char *url,
+                           const LOW_LATENCY_OPTIONS_T *options)
+{
+        static SESSION_LISTENER_T session_listener = {
+                .on_state_changed = on_session_state_changed
+        };
+
+        if(options->enabled) {
+                if(options->rcvbuf > 0) {
+                        diffusion_session_factory_input_buffer_size(factory, options->rcvbuf);
+                }
+                if(options->sndbuf > 0) {
+                        diffusion_session_factory_output_buffer_size(factory, options->sndbuf);
+                }
+                tuned_options = options;
+                diffusion_session_factory_session_listener(factory, &session_listener);
+        }
+
+        SESSION_T *session = session_create_with_session_factory(factory, url);
+        if(session != NULL) {
+                tune_socket(session, options);
+        }
+        return session;
+}
+
+/*
+ * Called on the subscriber's read thread. Hands the update to the
+ * consumer, waking it only if it has gone to sleep, and re-arms
+ * TCP_QUICKACK.
+ */
+static int
+on_value(const char *const topic_path,
+         const TOPIC_SPECIFICATION_T *const specification,
+         DIFFUSION_DATATYPE datatype,
+         const DIFFUSION_VALUE_T *const old_value,
+         const DIFFUSION_VALUE_T *const new_value,
+         void *context)
+{
+        const apr_time_t now = apr_time_now();
+        HANDOFF_T *handoff = context;
+        int64_t sent;
+        if(!read_diffusion_int64_value(new_value, &sent, NULL) || sent == 0) {
+                return HANDLER_SUCCESS;
+        }
+
+        const apr_uint32_t head = apr_atomic_read32(&handoff->head);
+        if(head - apr_atomic_read32(&handoff->tail) >= HANDOFF_RING_SIZE) {
+                apr_atomic_inc32(&handoff->dropped);
+                return HANDLER_SUCCESS;
+        }
+        HANDOFF_ENTRY_T *entry = &handoff->entries[head & (HANDOFF_RING_SIZE - 1)];
+        entry->sent = sent;
+        entry->received = now;
+        apr_atomic_inc32(&handoff->head);
+
+        if(apr_atomic_read32(&handoff->sleeping)) {
+                apr_thread_mutex_lock(handoff->mutex);
+                apr_thread_cond_signal(handoff->cond);
+                apr_thread_mutex_unlock(handoff->mutex);
+        }
+
+#ifdef TCP_QUICKACK
+        // The kernel clears TCP_QUICKACK, so set it again. This is the
+        // read thread of the socket's own transport, so the transport
+        // can't be replaced under it.
+        if(handoff->options->enabled) {
+                const int fd = session_socket(handoff->session);
+                if(fd >= 0) {
+                        const int on = 1;
+                        setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+                }
+        }
+#endif
+        return HANDLER_SUCCESS;
+}
+
+/*
+ * Wait for the next update: spin for up to the spin budget, then
+ * sleep until woken. Returns false if there is none because the
+ * consumer is stopping.
+ */
+static bool
+handoff_wait(HANDOFF_T *handoff)
+{
+        const apr_time_t spin_end = apr_time_now() + handoff->options->spin_budget;
+        do {
+                if(apr_atomic_read32(&handoff->head) != handoff->tail) {
+                        return true;
+                }
+        } while(handoff->options->spin_budget > 0 && apr_time_now() < spin_end);
+
+        apr_thread_mutex_lock(handoff->mutex);
+        // Announce that we're sleeping before looking again, so that an
+        // update added after the check is sure to signal.
+        apr_atomic_xchg32(&handoff->sleeping, 1);
+        while(apr_atomic_read32(&handoff->head) == handoff->tail && apr_atomic_read32(&handoff->running)) {
+                apr_thread_cond_timedwait(handoff->cond, handoff->mutex, apr_time_from_msec(10));
+        }
+        apr_atomic_set32(&handoff->sleeping, 0);
+        apr_thread_mutex_unlock(handoff->mutex);
+        handoff->wakeups++;
+
+        return apr_atomic_read32(&handoff->head) != handoff->tail;
+}
+
+static void * APR_THREAD_FUNC
+consumer_thread(apr_thread_t *thread, void *data)
+{
+        HANDOFF_T *handoff = data;
+
+        while(apr_atomic_read32(&handoff->running) || apr_atomic_read32(&handoff->head) != handoff->tail) {
+                if(!handoff_wait(handoff)) {
+                        continue;
+                }
+                const HANDOFF_ENTRY_T *entry = &handoff->entries[handoff->tail & (HANDOFF_RING_SIZE - 1)];
+                const apr_time_t now = apr_time_now();
+                if(handoff->count < handoff->capacity) {
+                        handoff->receive_latencies[handoff->count] = entry->received - entry->sent;
+                        handoff->consume_latencies[handoff->count] = now - entry->sent;
+                        handoff->count++;
+                }
+                apr_atomic_set32(&handoff->tail, handoff->tail + 1);
+
+        }
+
+        apr_thread_exit(thread, APR_SUCCESS);
+        return NULL;
+}
+
+static int
+compare_intervals(const void *a, const void *b)
+{
+        const apr_interval_time_t x = *(const apr_interval_time_t *)a;
+        const apr_interval_time_t y = *(const apr_interval_time_t *)b;
+        return x < y ? -1 : x > y;
+}
+
+static apr_interval_time_t
+percentile(const apr_interval_time_t *sorted, size_t count, double p)
+{
+        if(count == 0) {
+                return 0;
+        }
+        size_t i = (size_t)(p * count);
+        return sorted[i < count ? i : count - 1];
+}
+
+/*
+ * Publish the current time to the topic at a fixed rate, for the given
+ * time.
+ */
+static void
+publish_timestamps(SESSION_T *publisher, int rate, unsigned int run_time)
+{
+        const apr_interval_time_t interval = APR_USEC_PER_SEC / (rate > 0 ? rate : 1);
+        const apr_time_t end = apr_time_now() + apr_time_from_sec(run_time);
+
+        for(apr_time_t next = apr_time_now(); next < end; next += interval) {
+                const apr_time_t now = apr_time_now();
+                if(next > now) {
+                        apr_sleep(next - now);
+                }
+                BUF_T *buf = buf_create();
+                write_diffusion_int64_value(apr_time_now(), buf);
+                DIFFUSION_TOPIC_UPDATE_SET_PARAMS_T params = {
+                        .topic_path = TOPIC_PATH,
+                        .datatype = DATATYPE_INT64,
+                        .update = buf
+                };
+                diffusion_topic_update_set(publisher, params);
+                buf_free(buf);
+        }
+}
+
+/*
+ * Measure one mode, leaving the sorted latencies in the handoff.
+ * Returns false if the subscriber couldn't connect.
+ */
+static bool
+run_mode(HASH_T *options, SESSION_T *publisher, const LOW_LATENCY_OPTIONS_T *mode,
+         HANDOFF_T *handoff, apr_pool_t *pool)
+{
+        const int rate = atoi(hash_get(options, "rate"));
+        const unsigned int run_time = atol(hash_get(options, "sleep"));
+
+        DIFFUSION_SESSION_FACTORY_T *factory = diffusion_session_factory_init();
+        diffusion_session_factory_principal(factory, hash_get(options, "principal"));
+        diffusion_session_factory_password(factory, hash_get(options, "credentials"));
+        SESSION_T *subscriber = low_latency_session_create(factory, hash_get(options, "url"), mode);
+        diffusion_session_factory_free(factory);
+        if(subscriber == NULL) {
+                printf("Failed to create session: %s\n", (char *)hash_get(options, "url"));
+                return false;
+        }
+
+        memset(handoff, 0, sizeof(HANDOFF_T));
+        handoff->session = subscriber;
+        handoff->options = mode;
+        handoff->capacity = (size_t)(rate > 0 ? rate : 1) * (run_time + 1);
+        handoff->receive_latencies = calloc(handoff->capacity, sizeof(apr_interval_time_t));
+        handoff->consume_latencies = calloc(handoff->capacity, sizeof(apr_interval_time_t));
+        handoff->running = 1;
+        apr_thread_mutex_create(&handoff->mutex, APR_THREAD_MUTEX_DEFAULT, pool);
+        apr_thread_cond_create(&handoff->cond, pool);
+
+        apr_thread_t *consumer = NULL;
+        apr_thread_create(&consumer, NULL, consumer_thread, handoff, pool);
+
+        VALUE_STREAM_T value_stream = {
+                .datatype = DATATYPE_INT64,
+                .on_value = on_value,
+                .context = handoff
+        };
+        add_stream(subscriber, TOPIC_PATH, &value_stream);
+        SUBSCRIPTION_PARAMS_T params = {
+                .topic_selector = TOPIC_PATH
+        };
+        subscribe(subscriber, params);
+        sleep(1);
+
+        publish_timestamps(publisher, rate, run_time);
+        sleep(1);
+
+        apr_atomic_set32(&handoff->running, 0);
+        apr_thread_mutex_lock(handoff->mutex);
+        apr_thread_cond_signal(handoff->cond);
+        apr_thread_mutex_unlock(handoff->mutex);
+        apr_status_t status;
+        apr_thread_join(&status, consumer);
+
+        session_close(subscriber, NULL);
+        session_free(subscriber);
+        tuned_options = NULL;
+
+        qsort(handoff->receive_latencies, handoff->count, sizeof(apr_interval_time_t), compare_intervals);
+        qsort(handoff->consume_latencies, handoff->count, sizeof(apr_interval_time_t), compare_intervals);
+        return true;
+}
+
+static void
+print_latencies(const char *label, const HANDOFF_T *modes, const int mode_count, bool consumer)
+{
+        static const double percentiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+        printf("%-22s", label);
+        for(int m = 0; m < mode_count; m++) {
+                const apr_interval_time_t *sorted = consumer ? modes[m].consume_latencies : modes[m].receive_latencies;
+                for(size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+                        printf(" %8" APR_INT64_T_FMT, (apr_int64_t)percentile(sorted, modes[m].count, percentiles[i]));
+                }
+                printf("  |");
+        }
+        printf("\n");
+}
+
+/*
+ * Entry point for the example.
+ */
+int
+main(int argc, char **argv)
+{
+        /*
+         * Standard command-line parsing.
+         */
+        HASH_T *options = parse_cmdline(argc, argv, arg_opts);
+        if(options == NULL || hash_get(options, "help") != NULL) {
+                show_usage(argc, argv, arg_opts);
+                return EXIT_FAILURE;
+        }
+
+        apr_initialize();
+        apr_pool_t *pool = NULL;
+        apr_pool_create(&pool, NULL);
+
+        CREDENTIALS_T *credentials = credentials_create_password(hash_get(options, "credentials"));
+        DIFFUSION_ERROR_T error = { 0 };
+        SESSION_T *publisher = session_create(hash_get(options, "url"), hash_get(options, "principal"),
+                                              credentials, NULL, NULL, &error);
+        credentials_free(credentials);
+        if(publisher == NULL) {
+                printf("Failed to create session: %s\n", error.message);
+                free(error.message);
+                return EXIT_FAILURE;
+        }
+
+        TOPIC_SPECIFICATION_T *specification = topic_specification_init(TOPIC_TYPE_INT64);
+        BUF_T *buf = buf_create();
+        write_diffusion_int64_value(0, buf);
+        DIFFUSION_TOPIC_UPDATE_ADD_AND_SET_PARAMS_T add_params = {
+                .topic_path = TOPIC_PATH,
+                .specification = specification,
+                .datatype = DATATYPE_INT64,
+                .update = buf
+        };
+        diffusion_topic_update_add_and_set(publisher, add_params);
+        buf_free(buf);
+        topic_specification_free(specification);
+
+        const LOW_LATENCY_OPTIONS_T modes[] = {
+                { .enabled = false },
+                {
+                        .enabled = true,
+                        .spin_budget = atol(hash_get(options, "spin_budget")),
+                        .busy_poll = atoi(hash_get(options, "busy_poll")),
+                        .rcvbuf = atoi(hash_get(options, "rcvbuf")),
+                        .sndbuf = atoi(hash_get(options, "sndbuf"))
+                }
+        };
+        const char *mode_names[] = { "default", "low-latency" };
+        HANDOFF_T *results = calloc(2, sizeof(HANDOFF_T));
+        int mode_count = 0;
+
+        for(int m = 0; m < 2; m++) {
+                printf("Measuring %s mode\n", mode_names[m]);
+                if(!run_mode(options, publisher, &modes[m], &results[m], pool)) {
+                        break;
+                }
+                printf("%zu updates, %u dropped, %lu consumer wakeups\n",
+                       results[m].count, apr_atomic_read32(&results[m].dropped), results[m].wakeups);
+                mode_count++;
+        }
+
+        printf("\nLatency (us)           %-40s|", mode_names[0]);
+        if(mode_count > 1) {
+                printf(" %-38s|", mode_names[1]);
+        }
+        printf("\n%-22s", "");
+        for(int m = 0; m < mode_count; m++) {
+                printf(" %8s %8s %8s %8s  |", "p50", "p90", "p99", "p99.9");
+        }
+        printf("\n");
+        print_latencies("to read thread", results, mode_count, false);
+        print_latencies("to consumer", results, mode_count, true);
+
+        for(int m = 0; m < mode_count; m++) {
+                free(results[m].receive_latencies);
+                free(results[m].consume_latencies);
+        }
+        free(results);
+
+        session_close(publisher, NULL);
+        session_free(publisher);
+        hash_free(options, NULL, free);
+
+        apr_pool_destroy(pool);
+        apr_terminate();
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,447 @@
+/**
+ * Copyright © 2026 Push Technology Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This example is written in C99. Please use an appropriate C99 capable compiler
+ *
+ * @author Push Technology Limited
+ * @since 6.4
+ */
+
+/*
+ * This example benchmarks fan-out throughput for a number of local
+ * consumers, either through mux-proxy ("-m proxy") or with one session
+ * per consumer ("-m direct").
+ *
+ * Optionally ("-r"), a publishing session creates a set of string
+ * topics and updates them at a fixed rate for the duration of the
+ * run, so that both modes see the same load.
+ *
+ * The CPU time used by the benchmark's own process is reported, and in
+ * proxy mode that used by the mux-proxy process too, which is found
+ * from the peer of a connection to its socket. This needs SO_PEERCRED
+ * and /proc; elsewhere the proxy's CPU time is reported as "n/a" and
+ * the modes can't be compared on CPU.
+ */
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include <apr.h>
+#include <apr_atomic.h>
+#include <apr_pools.h>
+#include <apr_thread_proc.h>
+#include <apr_time.h>
+
+#include "diffusion.h"
+#include "args.h"
+
+ARG_OPTS_T arg_opts[] = {
+        ARG_OPTS_HELP,
+        {'u', "url", "Diffusion server URL", ARG_OPTIONAL, ARG_HAS_VALUE, "ws://localhost:8080"},
+        {'p', "principal", "Principal (username) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "control"},
+        {'c', "credentials", "Credentials (password) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "password"},
+        {'m', "mode", "\"proxy\" to consume through mux-proxy, \"direct\" for one session per consumer", ARG_OPTIONAL, ARG_HAS_VALUE, "proxy"},
+        {'f', "socket", "Path of the mux-proxy socket", ARG_OPTIONAL, ARG_HAS_VALUE, "/tmp/diffusion-mux.sock"},
+        {'n', "consumers", "Number of consumers", ARG_OPTIONAL, ARG_HAS_VALUE, "20"},
+        {'t', "topics", "Number of benchmark topics", ARG_OPTIONAL, ARG_HAS_VALUE, "100"},
+        {'r', "rate", "Updates per second to publish, 0 to not publish", ARG_OPTIONAL, ARG_HAS_VALUE, "1000"},
+        {'s', "sleep", "Duration of the benchmark (in seconds).", ARG_OPTIONAL, ARG_HAS_VALUE, "10" },
+        END_OF_ARG_OPTS
+};
+
+#define TOPIC_ROOT "mux-bench"
+#define TOPIC_SELECTOR "?" TOPIC_ROOT "//"
+
+typedef struct consumer_s {
+        SESSION_T *session;
+        const char *socket_path;
+        volatile apr_uint32_t *running;
+        volatile apr_uint32_t received;
+        unsigned long bytes;
+} CONSUMER_T;
+
+/*
+ * The CPU time in seconds used so far by the process serving the
+ * mux-proxy socket, or a negative value if it can't be found.
+ */
+static double
+proxy_cpu_seconds(const char *socket_path)
+{
+        double seconds = -1;
+#if defined(SO_PEERCRED)
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un addr = { 0 };
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+        struct ucred peer;
+        socklen_t peer_len = sizeof(peer);
+        if(fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+           getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &peer_len) < 0) {
+                if(fd >= 0) {
+                        close(fd);
+                }
+                return -1;
+        }
+        close(fd);
+
+        char path[64];
+        char stat[1024];
+        snprintf(path, sizeof(path), "/proc/%d/stat", (int)peer.pid);
+        FILE *file = fopen(path, "r");
+        if(file == NULL) {
+                return -1;
+        }
+        const size_t len = fread(stat, 1, sizeof(stat) - 1, file);
+        fclose(file);
+        stat[len] = '\0';
+
+        // Fields 14 and 15, after the parenthesised name, are utime
+        // and stime.
+        const char *close_paren = strrchr(stat, ')');
+        unsigned long long utime;
+        unsigned long long stime;
+        if(close_paren != NULL &&
+           sscanf(close_paren + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                  &utime, &stime) == 2) {
+                seconds = (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+        }
+#endif
+        return seconds;
+}
+
+static int
+on_value(const char *const topic_path,
+         const TOPIC_SPECIFICATION_T *const specification,
+         DIFFUSION_DATATYPE datatype,
+         const DIFFUSION_VALUE_T *const old_value,
+         const DIFFUSION_VALUE_T *const new_value,
+         void *context)
+{
+        CONSUMER_T *consumer = context;
+        apr_atomic_inc32(&consumer->received);
+        return HANDLER_SUCCESS;
+}
+
+static bool
+start_direct_consumer(CONSUMER_T *consumer, const char *url, const char *principal,
+                      CREDENTIALS_T *credentials)
+{
+        DIFFUSION_ERROR_T error = { 0 };
+        consumer->session = session_create(url, principal, credentials, NULL, NULL, &error);
+        if(consumer->session == NULL) {
+                printf("Failed to create session: %s\n", error.message);
+                free(error.message);
+                return false;
+        }
+
+        VALUE_STREAM_T value_stream = {
+                .datatype = DATATYPE_STRING,
+                .on_value = on_value,
+                .context = consumer
+        };
+        add_stream(consumer->session, TOPIC_SELECTOR, &value_stream);
+
+        SUBSCRIPTION_PARAMS_T params = {
+                .topic_selector = TOPIC_SELECTOR
+        };
+        subscribe(consumer->session, params);
+        return true;
+}
+
+/*
+ * Consume VAL frames from mux-proxy until told to stop.
+ */
+static void * APR_THREAD_FUNC
+proxy_consumer_thread(apr_thread_t *thread, void *data)
+{
+        CONSUMER_T *consumer = data;
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un addr = { 0 };
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, consumer->socket_path, sizeof(addr.sun_path) - 1);
+        if(fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+                printf("Failed to connect to %s: %s\n", consumer->socket_path, strerror(errno));
+                apr_thread_exit(thread, APR_EGENERAL);
+                return NULL;
+        }
+
+        const char *command = "SUB " TOPIC_SELECTOR "\n";
+        if(write(fd, command, strlen(command)) < 0) {
+                close(fd);
+                apr_thread_exit(thread, APR_EGENERAL);
+                return NULL;
+        }
+
+        // Don't block in read() forever once the benchmark is over.
+        struct timeval timeout = { .tv_sec = 0, .tv_usec = 100000 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        size_t cap = 64 * 1024;
+        size_t len = 0;
+        char *buf = malloc(cap);
+
+        while(apr_atomic_read32(consumer->running)) {
+                if(cap - len < 4096) {
+                        cap *= 2;
+                        buf = realloc(buf, cap);
+                }
+                ssize_t n = read(fd, buf + len, cap - len);
+                if(n == 0) {
+                        break;
+                }
+                if(n < 0) {
+                        continue;
+                }
+                len += n;
+                consumer->bytes += n;
+
+                size_t pos = 0;
+                for(;;) {
+                        char *eol = memchr(buf + pos, '\n', len - pos);
+                        if(eol == NULL) {
+                                break;
+                        }
+                        size_t payload_len = 0;
+                        char *space = eol;
+                        while(space > buf + pos && *space != ' ') {
+                                space--;
+                        }
+                        if(strncmp(buf + pos, "VAL ", 4) == 0 || strncmp(buf + pos, "RSP ", 4) == 0
+                           || strncmp(buf + pos, "CHUNK ", 6) == 0) {
+                                payload_len = strtoul(space + 1, NULL, 10);
+                        }
+                        else if(strncmp(buf + pos, "DROP ", 5) == 0) {
+                                payload_len = strtoul(buf + pos + 5, NULL, 10) * sizeof(apr_uint64_t);
+                        }
+                        const size_t frame_len = (eol - (buf + pos)) + 1 + payload_len;
+                        if(len - pos < frame_len) {
+                                break;
+                        }
+                        size_t total;
+                        size_t offset;
+                        if(strncmp(buf + pos, "VAL ", 4) == 0) {
+                                apr_atomic_inc32(&consumer->received);
+                        }
+                        else if(sscanf(buf + pos, "CHUNK %*s %*d %zu %zu", &total, &offset) == 2
+                                && offset + payload_len == total) {
+                                // The last chunk of a large value.
+                                apr_atomic_inc32(&consumer->received);
+                        }
+                        pos += frame_len;
+                }
+                memmove(buf, buf + pos, len - pos);
+                len -= pos;
+        }
+
+        free(buf);
+        close(fd);
+        apr_thread_exit(thread, APR_SUCCESS);
+        return NULL;
+}
+
+typedef struct publisher_s {
+        SESSION_T *session;
+        int topic_count;
+        int rate;
+        volatile apr_uint32_t *running;
+        unsigned long published;
+} PUBLISHER_T;
+
+/*
+ * Create the benchmark topics, then update them round-robin at the
+ * requested rate.
+ */
+static void * APR_THREAD_FUNC
+publisher_thread(apr_thread_t *thread, void *data)
+{
+        PUBLISHER_T *publisher = data;
+        TOPIC_SPECIFICATION_T *specification = topic_specification_init(TOPIC_TYPE_STRING);
+        char path[256];
+        char value[64];
+
+        for(int i = 0; i < publisher->topic_count; i++) {
+                snprintf(path, sizeof(path), TOPIC_ROOT "/%d", i);
+                BUF_T *buf = buf_create();
+                write_diffusion_string_value("0", buf);
+                DIFFUSION_TOPIC_UPDATE_ADD_AND_SET_PARAMS_T params = {
+                        .topic_path = path,
+                        .specification = specification,
+                        .datatype = DATATYPE_STRING,
+                        .update = buf
+                };
+                diffusion_topic_update_add_and_set(publisher->session, params);
+                buf_free(buf);
+        }
+
+        const apr_interval_time_t interval = APR_USEC_PER_SEC / publisher->rate;
+        apr_time_t next = apr_time_now();
+        while(apr_atomic_read32(publisher->running)) {
+                snprintf(path, sizeof(path), TOPIC_ROOT "/%lu", publisher->published % publisher->topic_count);
+                snprintf(value, sizeof(value), "%lu", publisher->published);
+
+                BUF_T *buf = buf_create();
+                write_diffusion_string_value(value, buf);
+                DIFFUSION_TOPIC_UPDATE_SET_PARAMS_T params = {
+                        .topic_path = path,
+                        .datatype = DATATYPE_STRING,
+                        .update = buf
+                };
+                diffusion_topic_update_set(publisher->session, params);
+                buf_free(buf);
+                publisher->published++;
+
+                next += interval;
+                const apr_time_t now = apr_time_now();
+                if(next > now) {
+                        apr_sleep(next - now);
+                }
+        }
+
+        topic_specification_free(specification);
+        apr_thread_exit(thread, APR_SUCCESS);
+        return NULL;
+}
+
+/*
+ * Entry point for the example.
+ */
+int
+main(int argc, char **argv)
+{
+        /*
+         * Standard command-line parsing.
+         */
+        HASH_T *options = parse_cmdline(argc, argv, arg_opts);
+        if(options == NULL || hash_get(options, "help") != NULL) {
+                show_usage(argc, argv, arg_opts);
+                return EXIT_FAILURE;
+        }
+
+        const char *url = hash_get(options, "url");
+        const char *principal = hash_get(options, "principal");
+        CREDENTIALS_T *credentials = NULL;
+        const char *password = hash_get(options, "credentials");
+        if(password != NULL) {
+                credentials = credentials_create_password(password);
+        }
+        const bool direct = strcmp(hash_get(options, "mode"), "direct") == 0;
+        const char *socket_path = hash_get(options, "socket");
+        const int consumer_count = atoi(hash_get(options, "consumers"));
+        const int topic_count = atoi(hash_get(options, "topics"));
+        const int rate = atoi(hash_get(options, "rate"));
+        const unsigned int sleep_time = atol(hash_get(options, "sleep"));
+
+        apr_initialize();
+        apr_pool_t *pool = NULL;
+        apr_pool_create(&pool, NULL);
+
+        volatile apr_uint32_t running = 1;
+        apr_status_t rv;
+
+        /*
+         * Start the consumers.
+         */
+        CONSUMER_T *consumers = calloc(consumer_count, sizeof(CONSUMER_T));
+        apr_thread_t **threads = calloc(consumer_count, sizeof(apr_thread_t *));
+        for(int i = 0; i < consumer_count; i++) {
+                consumers[i].socket_path = socket_path;
+                consumers[i].running = &running;
+                if(direct) {
+                        if(!start_direct_consumer(&consumers[i], url, principal, credentials)) {
+                                return EXIT_FAILURE;
+                        }
+                }
+                else {
+                        apr_thread_create(&threads[i], NULL, proxy_consumer_thread, &consumers[i], pool);
+                }
+        }
+
+        /*
+         * Start the publisher.
+         */
+        PUBLISHER_T publisher = { 0 };
+        apr_thread_t *publisher_thread_handle = NULL;
+        if(rate > 0) {
+                DIFFUSION_ERROR_T error = { 0 };
+                publisher.session = session_create(url, principal, credentials, NULL, NULL, &error);
+                if(publisher.session == NULL) {
+                        printf("Failed to create publishing session: %s\n", error.message);
+                        free(error.message);
+                        return EXIT_FAILURE;
+                }
+                publisher.topic_count = topic_count;
+                publisher.rate = rate;
+                publisher.running = &running;
+                apr_thread_create(&publisher_thread_handle, NULL, publisher_thread, &publisher, pool);
+        }
+
+        const double proxy_cpu_start = direct ? 0 : proxy_cpu_seconds(socket_path);
+        const clock_t cpu_start = clock();
+        const apr_time_t start = apr_time_now();
+        sleep(sleep_time);
+        apr_atomic_set32(&running, 0);
+        const double elapsed = (double)(apr_time_now() - start) / APR_USEC_PER_SEC;
+        const double cpu = (double)(clock() - cpu_start) / CLOCKS_PER_SEC;
+        const double proxy_cpu_end = direct ? 0 : proxy_cpu_seconds(socket_path);
+
+        char proxy_cpu[32] = "n/a";
+        if(proxy_cpu_start >= 0 && proxy_cpu_end >= 0) {
+                snprintf(proxy_cpu, sizeof(proxy_cpu), "%.2fs", proxy_cpu_end - proxy_cpu_start);
+        }
+
+        unsigned long total = 0;
+        for(int i = 0; i < consumer_count; i++) {
+                if(direct) {
+                        session_close(consumers[i].session, NULL);
+                        session_free(consumers[i].session);
+                }
+                else {
+                        apr_thread_join(&rv, threads[i]);
+                }
+                total += apr_atomic_read32(&consumers[i].received);
+        }
+        if(publisher_thread_handle != NULL) {
+                apr_thread_join(&rv, publisher_thread_handle);
+                session_close(publisher.session, NULL);
+                session_free(publisher.session);
+        }
+
+        printf("mode=%s consumers=%d published=%lu delivered=%lu "
+               "throughput=%.0f updates/s per-consumer=%.0f updates/s process-cpu=%.2fs proxy-cpu=%s\n",
+               direct ? "direct" : "proxy", consumer_count, publisher.published, total,
+               total / elapsed, total / elapsed / (consumer_count > 0 ? consumer_count : 1), cpu, proxy_cpu);
+
+        free(threads);
+        free(consumers);
+
+        credentials_free(credentials);
+        hash_free(options, NULL, free);
+
+        apr_pool_destroy(pool);
+        apr_terminate();
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,312 @@
+/**
+ * Copyright © 2026 Push Technology Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This example is written in C99. Please use an appropriate C99 capable compiler
+ *
+ * @author Push Technology Limited
+ * @since 6.4
+ */
+
+/*
+ * This example shows a mux-proxy client which writes large topic
+ * values, such as documents or images, to disk without holding any
+ * value whole in memory.
+ *
+ * Values larger than the proxy's chunk size arrive as a sequence of
+ * CHUNK frames. Each chunk is appended to a temporary file as it
+ * arrives, and once the last has been written the file is renamed
+ * over the topic's output file, so readers only ever see complete
+ * values. Smaller values arrive in a single VAL frame and are written
+ * the same way.
+ *
+ * Each topic is written to a file in the output directory named after
+ * its path, with '/' replaced by '_'.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include <apr.h>
+#include <apr_time.h>
+
+#include "diffusion.h"
+#include "args.h"
+
+ARG_OPTS_T arg_opts[] = {
+        ARG_OPTS_HELP,
+        {'f', "socket", "Path of the mux-proxy socket", ARG_OPTIONAL, ARG_HAS_VALUE, "/tmp/diffusion-mux.sock"},
+        {'t', "topic_selector", "Topic selector", ARG_OPTIONAL, ARG_HAS_VALUE, "?.*//"},
+        {'o', "output", "Directory to write topic values to", ARG_OPTIONAL, ARG_HAS_VALUE, "."},
+        {'s', "sleep", "Time to run for (in seconds)", ARG_OPTIONAL, ARG_HAS_VALUE, "30"},
+        END_OF_ARG_OPTS
+};
+
+#define MAX_LINE 1024
+
+/*
+ * A value being written to disk as its chunks arrive.
+ */
+typedef struct blob_s {
+        FILE *file;
+        char *tmp_path;
+        size_t received;
+} BLOB_T;
+
+typedef struct blob_stats_s {
+        unsigned long values;
+        unsigned long chunks;
+        unsigned long bytes;
+        unsigned long failed;
+} BLOB_STATS_T;
+
+static void
+blob_free(void *data)
+{
+        BLOB_T *blob = data;
+        if(blob->file != NULL) {
+                fclose(blob->file);
+                unlink(blob->tmp_path);
+        }
+        free(blob->tmp_path);
+        free(blob);
+}
+
+/*
+ * Build the name of the file a topic is written to, with the given
+ * suffix. The result must be freed by the caller.
+ */
+static char *
+output_path(const char *dir, const char *topic_path, const char *suffix)
+{
+        const size_t len = strlen(dir) + strlen(topic_path) + strlen(suffix) + 2;
+        char *path = malloc(len);
+        snprintf(path, len, "%s/%s%s", dir, topic_path, suffix);
+        for(char *p = path + strlen(dir) + 1; *p != '\0'; p++) {
+                if(*p == '/') {
+                        *p = '_';
+                }
+        }
+        return path;
+}
+
+/*
+ * Write the next piece of a topic's value, starting a new temporary
+ * file at offset 0 and renaming it into place once the total has been
+ * written.
+ */
+static void
+blob_write(HASH_T *blobs, const char *dir, const char *topic_path,
+           size_t total, size_t offset, const void *bytes, size_t len, BLOB_STATS_T *stats)
+{
+        BLOB_T *blob = hash_get(blobs, topic_path);
+
+        if(offset == 0) {
+                if(blob == NULL) {
+                        blob = calloc(1, sizeof(BLOB_T));
+                        hash_add(blobs, strdup(topic_path), blob);
+                }
+                else if(blob->file != NULL) {
+                        // A new value has replaced one that was cut short.
+                        fclose(blob->file);
+                        stats->failed++;
+                }
+                free(blob->tmp_path);
+                blob->tmp_path = output_path(dir, topic_path, ".tmp");
+                blob->file = fopen(blob->tmp_path, "wb");
+                blob->received = 0;
+                if(blob->file == NULL) {
+                        printf("Failed to open %s: %s\n", blob->tmp_path, strerror(errno));
+                        stats->failed++;
+                        return;
+                }
+        }
+        else if(blob == NULL || blob->file == NULL || blob->received != offset) {
+                // Missed the start of this value; wait for the next.
+                return;
+        }
+
+        if(fwrite(bytes, 1, len, blob->file) != len) {
+                printf("Failed to write %s: %s\n", blob->tmp_path, strerror(errno));
+                fclose(blob->file);
+                blob->file = NULL;
+                unlink(blob->tmp_path);
+                stats->failed++;
+                return;
+        }
+        blob->received += len;
+        stats->bytes += len;
+
+        if(blob->received < total) {
+                return;
+        }
+
+        char *path = output_path(dir, topic_path, "");
+        const bool ok = fclose(blob->file) == 0 && rename(blob->tmp_path, path) == 0;
+        blob->file = NULL;
+        if(ok) {
+                stats->values++;
+        }
+        else {
+                printf("Failed to write %s: %s\n", path, strerror(errno));
+                unlink(blob->tmp_path);
+                stats->failed++;
+        }
+        free(path);
+}
+
+/*
+ * Write out every complete frame in the buffer, returning the number
+ * of bytes consumed.
+ */
+static size_t
+process_frames(HASH_T *blobs, const char *dir, char *buf, size_t len, BLOB_STATS_T *stats)
+{
+        size_t pos = 0;
+
+        for(;;) {
+                char *eol = memchr(buf + pos, '\n', len - pos);
+                if(eol == NULL || eol - (buf + pos) >= MAX_LINE) {
+                        break;
+                }
+                char line[MAX_LINE];
+                memcpy(line, buf + pos, eol - (buf + pos));
+                line[eol - (buf + pos)] = '\0';
+
+                char path[MAX_LINE];
+                int datatype;
+                size_t payload_len = 0;
+                size_t total = 0;
+                size_t offset = 0;
+                size_t count = 0;
+                bool is_value = false;
+                bool is_chunk = false;
+
+                if(sscanf(line, "VAL %1023s %d %zu", path, &datatype, &payload_len) == 3) {
+                        total = payload_len;
+                        is_value = true;
+                }
+                else if(sscanf(line, "CHUNK %1023s %d %zu %zu %zu",
+                               path, &datatype, &total, &offset, &payload_len) == 5) {
+                        is_value = true;
+                        is_chunk = true;
+                }
+                else if(sscanf(line, "DROP %zu", &count) == 1) {
+                        payload_len = count * sizeof(apr_uint64_t);
+                }
+
+                const size_t frame_len = (eol - (buf + pos)) + 1 + payload_len;
+                if(len - pos < frame_len) {
+                        break;
+                }
+                if(is_chunk) {
+                        stats->chunks++;
+                }
+                if(is_value) {
+                        blob_write(blobs, dir, path, total, offset, eol + 1, payload_len, stats);
+                }
+                pos += frame_len;
+        }
+        return pos;
+}
+
+/*
+ * Entry point for the example.
+ */
+int
+main(int argc, char **argv)
+{
+        /*
+         * Standard command-line parsing.
+         */
+        HASH_T *options = parse_cmdline(argc, argv, arg_opts);
+        if(options == NULL || hash_get(options, "help") != NULL) {
+                show_usage(argc, argv, arg_opts);
+                return EXIT_FAILURE;
+        }
+
+        const char *socket_path = hash_get(options, "socket");
+        const char *selector = hash_get(options, "topic_selector");
+        const char *dir = hash_get(options, "output");
+        const unsigned int run_time = atoi(hash_get(options, "sleep"));
+
+        apr_initialize();
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un addr = { 0 };
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+        if(fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+                printf("Failed to connect to %s: %s\n", socket_path, strerror(errno));
+                return EXIT_FAILURE;
+        }
+
+        char line[MAX_LINE];
+        snprintf(line, sizeof(line), "SUB %s\n", selector);
+        if(write(fd, line, strlen(line)) < 0) {
+                printf("Failed to subscribe: %s\n", strerror(errno));
+                close(fd);
+                return EXIT_FAILURE;
+        }
+
+        struct timeval timeout = { .tv_sec = 0, .tv_usec = 100000 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        /*
+         * The buffer only ever needs to hold one frame, which is at
+         * most the proxy's chunk size plus a header.
+         */
+        HASH_T *blobs = unsync_hash_new(1024);
+        BLOB_STATS_T stats = { 0 };
+        size_t cap = 64 * 1024;
+        size_t len = 0;
+        char *buf = malloc(cap);
+
+        const apr_time_t deadline = apr_time_now() + apr_time_from_sec(run_time);
+        while(apr_time_now() < deadline) {
+                if(cap - len < 4096) {
+                        cap *= 2;
+                        buf = realloc(buf, cap);
+                }
+                ssize_t n = read(fd, buf + len, cap - len);
+                if(n == 0) {
+                        break;
+                }
+                if(n < 0) {
+                        continue;
+                }
+                len += n;
+
+                const size_t consumed = process_frames(blobs, dir, buf, len, &stats);
+                memmove(buf, buf + consumed, len - consumed);
+                len -= consumed;
+        }
+
+        printf("Wrote %lu values (%lu bytes, %lu chunks) to %s, %lu failed\n",
+               stats.values, stats.bytes, stats.chunks, dir, stats.failed);
+
+        free(buf);
+        close(fd);
+        hash_free(blobs, free, blob_free);
+        hash_free(options, NULL, free);
+
+        apr_terminate();
+
+        return EXIT_SUCCESS;
+}
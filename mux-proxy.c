@@ -0,0 +1,1840 @@
+/**
+ * Copyright © 2026 Push Technology Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This example is written in C99. Please use an appropriate C99 capable compiler
+ *
+ * @author Push Technology Limited
+ * @since 6.4
+ */
+
+/*
+ * This example is a small daemon which multiplexes many local clients
+ * over a few upstream Diffusion sessions.
+ *
+ * Local clients connect over a Unix domain socket and speak a simple
+ * framed protocol. Each command is a single line, optionally followed
+ * by a binary payload whose length is given on the line:
+ *
+ *   SUB <selector>                   subscribe to a topic selector
+ *   UNSUB <selector>                 drop a subscription
+ *   REQ <id> <path> <len>\n<bytes>   send a string request to a path
+ *   SYNC <selector> <n>\n<digests>   subscribe, resynchronising a cache
+ *
+ * and the proxy sends:
+ *
+ *   VAL <path> <datatype> <len>\n<bytes>   a topic value
+ *   CHUNK <path> <datatype> <total> <offset> <len>\n<bytes>
+ *                                          part of a large topic value
+ *   RSP <id> <len>\n<bytes>                a string response to REQ <id>
+ *   ERR <id> <message>                     REQ <id> failed
+ *   DROP <n>\n<hashes>                     topics the client should forget
+ *
+ * Identical subscriptions from different clients are deduplicated: the
+ * first client to subscribe to a selector causes a value stream and a
+ * subscription on one of the upstream sessions, and each value is
+ * encoded into a single frame which is shared by every client
+ * subscribed to that selector. Requests are spread round-robin over
+ * the upstream sessions.
+ *
+ * Client input is decoded a read at a time: every complete command in
+ * the buffer is parsed into a batch before any is acted on, and the
+ * batch is then applied under a single acquisition of the proxy's lock,
+ * with calls into the upstream sessions made after it is released. The
+ * average number of commands per read is reported with the other
+ * statistics.
+ *
+ * The proxy keeps the last value of every topic for each selector,
+ * so a client subscribing to a selector that is already subscribed
+ * upstream receives the current values straight away.
+ *
+ * A client which already holds values from an earlier connection can
+ * use SYNC rather than SUB. The payload is n digests, each a pair of
+ * native-endian 64-bit FNV-1a hashes of a topic path and of the raw
+ * bytes of the value the client holds for it. The proxy sends only
+ * the values which differ from the client's, followed by a DROP frame
+ * listing (as native-endian 64-bit path hashes) the topics the client
+ * has but which are no longer present. Where the selector is new to
+ * the proxy, the first value of each topic from the server is checked
+ * against the client's digests instead, and once the server has
+ * acknowledged the subscription and its initial values have had time
+ * to arrive, a DROP frame lists the digests no value was received for.
+ * A DROP frame is also sent when a topic is unsubscribed, for example
+ * because it has been removed.
+ *
+ * See mux-resync.c for a client which uses SYNC to recover after a
+ * disconnection.
+ *
+ * Values larger than the chunk size ("-k") are sent as a sequence of
+ * CHUNK frames, each carrying the value's total length and the offset
+ * of the piece it holds; the value is complete when a chunk reaches
+ * the total. Clients can then stream large values, to disk for
+ * example, without ever holding one whole, and smaller values for
+ * other topics are not held up behind a multi-megabyte frame. The
+ * chunks of the last large value for each topic are kept for clients
+ * joining later; like any other frame they are shared with the
+ * clients' queues, so this costs no second copy.
+ *
+ * Client buffers adapt to each client's traffic. Input buffers start
+ * small and double on demand, and send buffers (SO_SNDBUF) double
+ * while a client has more queued than the socket will take, both up
+ * to a cap. Once a client has been idle for a while ("-i") its input
+ * buffer is released and its send buffer returned to the initial
+ * size, so thousands of quiet clients cost little. With "-H", input
+ * buffers of 2MB or more are backed by huge pages where the platform
+ * allows. Buffer sizes and resizes are included in the periodic
+ * statistics, and each client's peak sizes reported when it leaves.
+ *
+ * Topics matched by more than one selector are delivered once per
+ * matching selector, just as they would be to a session with several
+ * overlapping value streams.
+ *
+ * See mux-bench.c for a benchmark comparing fan-out through the proxy
+ * with one session per client.
+ */
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include <apr.h>
+#include <apr_atomic.h>
+#include <apr_pools.h>
+#include <apr_thread_mutex.h>
+#include <apr_time.h>
+
+#include "diffusion.h"
+#include "args.h"
+
+ARG_OPTS_T arg_opts[] = {
+        ARG_OPTS_HELP,
+        {'u', "url", "Diffusion server URL", ARG_OPTIONAL, ARG_HAS_VALUE, "ws://localhost:8080"},
+        {'p', "principal", "Principal (username) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "client"},
+        {'c', "credentials", "Credentials (password) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "password"},
+        {'f', "socket", "Path of the Unix domain socket to listen on", ARG_OPTIONAL, ARG_HAS_VALUE, "/tmp/diffusion-mux.sock"},
+        {'n', "sessions", "Number of upstream sessions", ARG_OPTIONAL, ARG_HAS_VALUE, "2"},
+        {'k', "chunk", "Values larger than this many bytes are sent to clients in chunks of this size", ARG_OPTIONAL, ARG_HAS_VALUE, "65536"},
+        {'i', "idle", "Time after which an idle client's buffers are shrunk (in seconds)", ARG_OPTIONAL, ARG_HAS_VALUE, "10"},
+        {'H', "hugepages", "Back large client buffers with huge pages", ARG_OPTIONAL, ARG_NO_VALUE, NULL},
+        {'s', "sleep", "Time to run before shutting down (in seconds), 0 to run forever.", ARG_OPTIONAL, ARG_HAS_VALUE, "0" },
+        END_OF_ARG_OPTS
+};
+
+#define MAX_CLIENTS 1024
+#define MAX_LINE 1024
+#define MAX_PAYLOAD (1024 * 1024)
+#define MAX_IOV 64
+#define MAX_BATCH 64
+
+/*
+ * Clients which fall this far behind are disconnected rather than
+ * allowed to consume unbounded memory.
+ */
+#define MAX_QUEUED_BYTES (64 * 1024 * 1024)
+
+/*
+ * Limits for adaptive client buffers. The input buffer's cap leaves
+ * room for the largest command plus its payload.
+ */
+#define INPUT_BUFFER_INITIAL 4096
+#define INPUT_BUFFER_MAX (4 * 1024 * 1024)
+#define SEND_BUFFER_INITIAL (64 * 1024)
+#define SEND_BUFFER_MAX (4 * 1024 * 1024)
+#define HUGE_BUFFER_SIZE (2 * 1024 * 1024)
+
+/*
+ * Time allowed after the server acknowledges a new subscription for
+ * the initial values to arrive, before topics a SYNC client holds but
+ * which have not been received are dropped.
+ */
+#define SYNC_SETTLE_TIME apr_time_from_msec(500)
+
+static const DIFFUSION_DATATYPE stream_datatypes[] = {
+        DATATYPE_BINARY, DATATYPE_JSON, DATATYPE_STRING,
+        DATATYPE_DOUBLE, DATATYPE_INT64, DATATYPE_RECORDV2
+};
+#define STREAM_DATATYPE_COUNT (sizeof(stream_datatypes) / sizeof(stream_datatypes[0]))
+
+/*
+ * An encoded message for local clients. Frames are immutable once
+ * built and shared between every client they are queued for.
+ */
+typedef struct frame_s {
+        volatile apr_uint32_t refcount;
+        size_t len;
+        char data[];
+} FRAME_T;
+
+typedef struct queued_frame_s {
+        FRAME_T *frame;
+        struct queued_frame_s *next;
+} QUEUED_FRAME_T;
+
+typedef struct client_s {
+        int fd;
+        int slot;
+        apr_uint32_t id;
+        bool closing;
+
+        // Bytes read but not yet processed. The buffer is NULL while
+        // the client is idle, and mapped when backed by huge pages.
+        char *in_buf;
+        size_t in_len;
+        size_t in_cap;
+        bool in_mapped;
+        apr_time_t last_read;
+
+        // The socket's send buffer size as granted by the system, its
+        // size on connection, whether the system refused to grow it
+        // further, and when a flush last left data queued.
+        size_t send_buf;
+        size_t send_initial;
+        bool send_capped;
+        apr_time_t last_backlog;
+
+        // Largest buffer sizes and the number of resizes, for
+        // reporting.
+        size_t in_peak;
+        size_t send_peak;
+        apr_uint32_t resizes;
+
+        // Frames waiting to be written, and how much of the first one
+        // has been written already.
+        QUEUED_FRAME_T *out_head;
+        QUEUED_FRAME_T *out_tail;
+        size_t out_offset;
+        size_t out_bytes;
+} CLIENT_T;
+
+/*
+ * The identity of a value held by a client, as sent with SYNC.
+ */
+typedef struct digest_s {
+        apr_uint64_t path_hash;
+        apr_uint64_t value_hash;
+} DIGEST_T;
+
+/*
+ * Digests from a SYNC for a selector whose initial values have not all
+ * been received. The first value received for each path is compared
+ * against the digest and withheld if the client already has it; the
+ * rest are dropped once the subscription settles.
+ */
+typedef struct digest_filter_s {
+        DIGEST_T *digests;      // Sorted by path hash.
+        bool *consumed;
+        size_t count;
+        size_t remaining;
+} DIGEST_FILTER_T;
+
+/*
+ * The last value received for a topic, kept so that clients joining
+ * an existing subscription can be brought up to date: a single frame,
+ * or the chunks of a large value.
+ */
+typedef struct cached_frame_s {
+        // The key under which this is held, owned by the hash.
+        char *path;
+        FRAME_T **frames;
+        size_t frame_count;
+        apr_uint64_t path_hash;
+        apr_uint64_t value_hash;
+} CACHED_FRAME_T;
+
+typedef struct subscription_s {
+        struct proxy_s *proxy;
+        char *selector;
+        SESSION_T *session;
+        VALUE_STREAM_HANDLE_T *handles[STREAM_DATATYPE_COUNT];
+        bool clients[MAX_CLIENTS];
+        int client_count;
+        // Path to CACHED_FRAME_T, guarded by the proxy mutex.
+        HASH_T *values;
+        DIGEST_FILTER_T *filters[MAX_CLIENTS];
+        // When the initial values are taken to have arrived; 0 until
+        // the server has acknowledged the subscription.
+        apr_time_t settle_at;
+        struct subscription_s *next;
+} SUBSCRIPTION_T;
+
+typedef struct proxy_s {
+        apr_pool_t *pool;
+        apr_thread_mutex_t *mutex;
+
+        SESSION_T **upstreams;
+        int upstream_count;
+        int next_upstream;
+
+        CLIENT_T *clients[MAX_CLIENTS];
+        apr_uint32_t next_client_id;
+
+        SUBSCRIPTION_T *subscriptions;
+        // Subscriptions no longer in use. Value streams may still be
+        // running on them when they are removed, so they are only
+        // freed at shutdown.
+        SUBSCRIPTION_T *retired;
+
+        // Used by upstream callbacks to wake the poll loop.
+        int wake_pipe[2];
+        volatile apr_uint32_t wake_pending;
+
+        volatile apr_uint32_t updates;
+        volatile apr_uint32_t frames_queued;
+        volatile apr_uint32_t requests;
+        volatile apr_uint32_t clients_dropped;
+        volatile apr_uint32_t resync_sent;
+        volatile apr_uint32_t resync_skipped;
+        // Values larger than this are sent in chunks of this size.
+        size_t chunk_size;
+        volatile apr_uint32_t chunked_values;
+
+        // Adaptive client buffers.
+        apr_interval_time_t idle_time;
+        bool hugepages;
+        volatile apr_uint32_t buffer_grows;
+        volatile apr_uint32_t buffer_shrinks;
+
+        // Client reads, and the command batches and commands they held.
+        volatile apr_uint32_t reads;
+        volatile apr_uint32_t batches;
+        volatile apr_uint32_t commands;
+} PROXY_T;
+
+typedef enum {
+        COMMAND_NONE,
+        COMMAND_SUBSCRIBE,
+        COMMAND_UNSUBSCRIBE,
+        COMMAND_REQUEST
+} COMMAND_TYPE_T;
+
+/*
+ * A parsed client command. Strings and payloads point into the
+ * client's input buffer.
+ */
+typedef struct command_s {
+        COMMAND_TYPE_T type;
+        char *arg1;             // Selector, or request id.
+        char *arg2;             // Request path.
+        const char *payload;
+        size_t len;             // Payload length, or digest count.
+        DIGEST_T *digests;
+
+        // Decided with the proxy mutex held and acted on after.
+        SUBSCRIPTION_T *opened;
+        SUBSCRIPTION_T *closed;
+        SESSION_T *session;
+} COMMAND_T;
+
+typedef struct request_context_s {
+        PROXY_T *proxy;
+        int slot;
+        apr_uint32_t client_id;
+        char *request_id;
+} REQUEST_CONTEXT_T;
+
+static FRAME_T *
+frame_create(const char *header, const void *payload, size_t payload_len)
+{
+        const size_t header_len = strlen(header);
+        FRAME_T *frame = malloc(sizeof(FRAME_T) + header_len + payload_len);
+        frame->refcount = 1;
+        frame->len = header_len + payload_len;
+        memcpy(frame->data, header, header_len);
+        if(payload_len > 0) {
+                memcpy(frame->data + header_len, payload, payload_len);
+        }
+        return frame;
+}
+
+static void
+frame_release(FRAME_T *frame)
+{
+        if(frame != NULL && apr_atomic_dec32(&frame->refcount) == 0) {
+                free(frame);
+        }
+}
+
+static apr_uint64_t
+fnv1a64(const void *data, size_t len)
+{
+        const unsigned char *p = data;
+        apr_uint64_t hash = 14695981039346656037ULL;
+        for(size_t i = 0; i < len; i++) {
+                hash ^= p[i];
+                hash *= 1099511628211ULL;
+        }
+        return hash;
+}
+
+static int
+compare_digests(const void *a, const void *b)
+{
+        const apr_uint64_t x = ((const DIGEST_T *)a)->path_hash;
+        const apr_uint64_t y = ((const DIGEST_T *)b)->path_hash;
+        return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static DIGEST_T *
+find_digest(DIGEST_T *digests, size_t count, apr_uint64_t path_hash)
+{
+        DIGEST_T key = { .path_hash = path_hash };
+        return bsearch(&key, digests, count, sizeof(DIGEST_T), compare_digests);
+}
+
+static void
+digest_filter_free(DIGEST_FILTER_T *filter)
+{
+        if(filter != NULL) {
+                free(filter->digests);
+                free(filter->consumed);
+                free(filter);
+        }
+}
+
+/*
+ * Returns true if the client already holds this value. Only the first
+ * value seen for each path is checked. Must be called with the proxy
+ * mutex held.
+ */
+static bool
+digest_filter_match(DIGEST_FILTER_T *filter, apr_uint64_t path_hash, apr_uint64_t value_hash)
+{
+        DIGEST_T *digest = find_digest(filter->digests, filter->count, path_hash);
+        if(digest == NULL) {
+                return false;
+        }
+        const size_t index = digest - filter->digests;
+        if(filter->consumed[index]) {
+                return false;
+        }
+        filter->consumed[index] = true;
+        filter->remaining--;
+        return digest->value_hash == value_hash;
+}
+
+static DIGEST_FILTER_T *
+digest_filter_create(DIGEST_T *digests, size_t count)
+{
+        DIGEST_FILTER_T *filter = malloc(sizeof(DIGEST_FILTER_T));
+        filter->digests = digests;
+        filter->consumed = calloc(count, sizeof(bool));
+        filter->count = count;
+        filter->remaining = count;
+        return filter;
+}
+
+/*
+ * Replace the cached value with new frames, taking a reference to
+ * each.
+ */
+static void
+cached_frame_set(CACHED_FRAME_T *cached, FRAME_T **frames, size_t frame_count)
+{
+        for(size_t f = 0; f < cached->frame_count; f++) {
+                frame_release(cached->frames[f]);
+        }
+        if(frame_count != cached->frame_count) {
+                cached->frames = realloc(cached->frames, frame_count * sizeof(FRAME_T *));
+                cached->frame_count = frame_count;
+        }
+        for(size_t f = 0; f < frame_count; f++) {
+                apr_atomic_inc32(&frames[f]->refcount);
+                cached->frames[f] = frames[f];
+        }
+}
+
+static void
+cached_frame_free(void *value)
+{
+        CACHED_FRAME_T *cached = value;
+        for(size_t f = 0; f < cached->frame_count; f++) {
+                frame_release(cached->frames[f]);
+        }
+        free(cached->frames);
+        free(cached);
+}
+
+static FRAME_T *
+drop_frame_create(const apr_uint64_t *path_hashes, size_t count)
+{
+        char header[MAX_LINE];
+        snprintf(header, sizeof(header), "DROP %zu\n", count);
+        return frame_create(header, path_hashes, count * sizeof(apr_uint64_t));
+}
+
+static void
+proxy_wake(PROXY_T *proxy)
+{
+        if(apr_atomic_cas32(&proxy->wake_pending, 1, 0) == 0) {
+                const char c = 0;
+                if(write(proxy->wake_pipe[1], &c, 1) < 0) {
+                        // The pipe is full, so the poll loop is already
+                        // awake.
+                }
+        }
+}
+
+/*
+ * Queue a frame for a client. Must be called with the proxy mutex
+ * held.
+ */
+static void
+client_enqueue(PROXY_T *proxy, CLIENT_T *client, FRAME_T *frame)
+{
+        if(client->closing) {
+                return;
+        }
+        if(client->out_bytes + frame->len > MAX_QUEUED_BYTES) {
+                printf("Client %u is too slow, disconnecting\n", client->id);
+                client->closing = true;
+                return;
+        }
+
+        QUEUED_FRAME_T *queued = malloc(sizeof(QUEUED_FRAME_T));
+        apr_atomic_inc32(&frame->refcount);
+        queued->frame = frame;
+        queued->next = NULL;
+        if(client->out_tail == NULL) {
+                client->out_head = queued;
+        }
+        else {
+                client->out_tail->next = queued;
+        }
+        client->out_tail = queued;
+        client->out_bytes += frame->len;
+        apr_atomic_inc32(&proxy->frames_queued);
+}
+
+/*
+ * Queue a frame for the client in a slot, if it is still the client
+ * that the frame was intended for.
+ */
+static void
+proxy_send_to_client(PROXY_T *proxy, int slot, apr_uint32_t client_id, FRAME_T *frame)
+{
+        apr_thread_mutex_lock(proxy->mutex);
+        CLIENT_T *client = proxy->clients[slot];
+        if(client != NULL && client->id == client_id) {
+                client_enqueue(proxy, client, frame);
+        }
+        apr_thread_mutex_unlock(proxy->mutex);
+        proxy_wake(proxy);
+}
+
+/*
+ * Allocate a client buffer, from huge pages if requested and the
+ * buffer is large enough to fill them. Sets *mapped if the buffer must
+ * be released with buffer_free() rather than free().
+ */
+static char *
+buffer_alloc(PROXY_T *proxy, size_t size, bool *mapped)
+{
+        *mapped = false;
+#if defined(MAP_ANONYMOUS)
+        if(proxy->hugepages && size >= HUGE_BUFFER_SIZE) {
+                void *buf = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+                buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+                if(buf == MAP_FAILED) {
+                        // No reserved huge pages; ask for transparent
+                        // ones instead.
+                        buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#if defined(MADV_HUGEPAGE)
+                        if(buf != MAP_FAILED) {
+                                madvise(buf, size, MADV_HUGEPAGE);
+                        }
+#endif
+                }
+                if(buf != MAP_FAILED) {
+                        *mapped = true;
+                        return buf;
+                }
+        }
+#endif
+        return malloc(size);
+}
+
+static void
+buffer_free(char *buf, size_t size, bool mapped)
+{
+#if defined(MAP_ANONYMOUS)
+        if(mapped) {
+                munmap(buf, size);
+                return;
+        }
+#endif
+        free(buf);
+}
+
+/*
+ * Move the client's unprocessed input to a buffer of a new size, or
+ * release the buffer if the size is zero.
+ */
+static void
+client_resize_input(PROXY_T *proxy, CLIENT_T *client, size_t cap)
+{
+        char *buf = NULL;
+        bool mapped = false;
+        if(cap > 0) {
+                buf = buffer_alloc(proxy, cap, &mapped);
+                if(client->in_len > 0) {
+                        memcpy(buf, client->in_buf, client->in_len);
+                }
+        }
+        if(client->in_buf != NULL) {
+                buffer_free(client->in_buf, client->in_cap, client->in_mapped);
+        }
+        apr_atomic_inc32(cap > client->in_cap ? &proxy->buffer_grows : &proxy->buffer_shrinks);
+        client->in_buf = buf;
+        client->in_cap = cap;
+        client->in_mapped = mapped;
+        client->resizes++;
+        if(cap > client->in_peak) {
+                client->in_peak = cap;
+        }
+}
+
+/*
+ * Request a send buffer size for the client's socket, recording the
+ * size the system actually granted.
+ */
+static void
+client_set_send_buffer(CLIENT_T *client, int size)
+{
+        setsockopt(client->fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+        socklen_t len = sizeof(size);
+        if(getsockopt(client->fd, SOL_SOCKET, SO_SNDBUF, &size, &len) == 0) {
+                client->send_buf = size;
+        }
+        if(client->send_buf > client->send_peak) {
+                client->send_peak = client->send_buf;
+        }
+}
+
+/*
+ * Double the client's send buffer if more is queued for it than the
+ * socket will hold, up to SEND_BUFFER_MAX.
+ */
+static void
+client_grow_send_buffer(PROXY_T *proxy, CLIENT_T *client)
+{
+        if(client->out_bytes <= client->send_buf || client->send_buf >= SEND_BUFFER_MAX
+           || client->send_capped) {
+                return;
+        }
+        const size_t before = client->send_buf;
+        size_t size = client->send_buf * 2;
+        if(size > SEND_BUFFER_MAX) {
+                size = SEND_BUFFER_MAX;
+        }
+        client_set_send_buffer(client, size);
+        if(client->send_buf > before) {
+                apr_atomic_inc32(&proxy->buffer_grows);
+                client->resizes++;
+        }
+        else {
+                // The system won't go any larger.
+                client->send_capped = true;
+        }
+}
+
+/*
+ * Shrink the buffers of a client which has been idle for the idle
+ * time: the input buffer is released if empty, or cut to fit what it
+ * holds, and the send buffer returned to its initial size once
+ * nothing has been left queued for a while.
+ */
+static void
+client_trim_buffers(PROXY_T *proxy, CLIENT_T *client, apr_time_t now)
+{
+        if(client->in_cap > 0 && now - client->last_read >= proxy->idle_time) {
+                size_t cap = 0;
+                if(client->in_len > 0) {
+                        cap = INPUT_BUFFER_INITIAL;
+                        while(cap < client->in_len + MAX_LINE) {
+                                cap *= 2;
+                        }
+                }
+                if(cap < client->in_cap) {
+                        client_resize_input(proxy, client, cap);
+                }
+        }
+
+        if(client->send_buf > client->send_initial && client->out_head == NULL
+           && now - client->last_backlog >= proxy->idle_time) {
+                client_set_send_buffer(client, SEND_BUFFER_INITIAL);
+                client->send_buf = client->send_initial;
+                client->send_capped = false;
+                apr_atomic_inc32(&proxy->buffer_shrinks);
+                client->resizes++;
+        }
+}
+
+/*
+ * Write as much queued data as the client's socket will take. Must be
+ * called with the proxy mutex held.
+ */
+static void
+client_flush(PROXY_T *proxy, CLIENT_T *client)
+{
+        if(client->out_head != NULL) {
+                client_grow_send_buffer(proxy, client);
+        }
+        while(client->out_head != NULL) {
+                struct iovec iov[MAX_IOV];
+                int iovcnt = 0;
+                size_t offset = client->out_offset;
+                for(QUEUED_FRAME_T *q = client->out_head; q != NULL && iovcnt < MAX_IOV; q = q->next) {
+                        iov[iovcnt].iov_base = q->frame->data + offset;
+                        iov[iovcnt].iov_len = q->frame->len - offset;
+                        iovcnt++;
+                        offset = 0;
+                }
+
+                ssize_t written = writev(client->fd, iov, iovcnt);
+                if(written < 0) {
+                        if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                                client->closing = true;
+                        }
+                        client->last_backlog = apr_time_now();
+                        return;
+                }
+
+                client->out_bytes -= written;
+                while(written > 0) {
+                        QUEUED_FRAME_T *head = client->out_head;
+                        const size_t remaining = head->frame->len - client->out_offset;
+                        if((size_t)written < remaining) {
+                                client->out_offset += written;
+                                client->last_backlog = apr_time_now();
+                                return;
+                        }
+                        written -= remaining;
+                        client->out_offset = 0;
+                        client->out_head = head->next;
+                        if(client->out_head == NULL) {
+                                client->out_tail = NULL;
+                        }
+                        frame_release(head->frame);
+                        free(head);
+                }
+        }
+}
+
+/*
+ * Value stream callback, invoked on an upstream session's read
+ * thread. The value is encoded once and the frame shared by every
+ * subscribed client.
+ */
+static int
+on_value(const char *const topic_path,
+         const TOPIC_SPECIFICATION_T *const specification,
+         DIFFUSION_DATATYPE datatype,
+         const DIFFUSION_VALUE_T *const old_value,
+         const DIFFUSION_VALUE_T *const new_value,
+         void *context)
+{
+        SUBSCRIPTION_T *subscription = context;
+        PROXY_T *proxy = subscription->proxy;
+        void *bytes = NULL;
+        size_t len = 0;
+
+        if(new_value == NULL || !diffusion_value_get_raw_bytes(new_value, &bytes, &len)) {
+                return HANDLER_SUCCESS;
+        }
+
+        char header[MAX_LINE];
+        FRAME_T *single_frame = NULL;
+        FRAME_T **frames = &single_frame;
+        size_t frame_count = 1;
+
+        if(len > proxy->chunk_size) {
+                frame_count = (len + proxy->chunk_size - 1) / proxy->chunk_size;
+                frames = malloc(frame_count * sizeof(FRAME_T *));
+                for(size_t i = 0; i < frame_count; i++) {
+                        const size_t offset = i * proxy->chunk_size;
+                        const size_t chunk = len - offset < proxy->chunk_size ? len - offset : proxy->chunk_size;
+                        snprintf(header, sizeof(header), "CHUNK %s %d %zu %zu %zu\n",
+                                 topic_path, datatype, len, offset, chunk);
+                        frames[i] = frame_create(header, (const char *)bytes + offset, chunk);
+                }
+                apr_atomic_inc32(&proxy->chunked_values);
+        }
+        else {
+                snprintf(header, sizeof(header), "VAL %s %d %zu\n", topic_path, datatype, len);
+                single_frame = frame_create(header, bytes, len);
+        }
+        const apr_uint64_t path_hash = fnv1a64(topic_path, strlen(topic_path));
+        const apr_uint64_t value_hash = fnv1a64(bytes, len);
+        free(bytes);
+
+        apr_atomic_inc32(&proxy->updates);
+
+        apr_thread_mutex_lock(proxy->mutex);
+        CACHED_FRAME_T *cached = hash_get(subscription->values, topic_path);
+        if(cached == NULL) {
+                cached = calloc(1, sizeof(CACHED_FRAME_T));
+                cached->path = strdup(topic_path);
+                cached->path_hash = path_hash;
+                hash_add(subscription->values, cached->path, cached);
+        }
+        cached_frame_set(cached, frames, frame_count);
+        cached->value_hash = value_hash;
+
+        for(int i = 0; i < MAX_CLIENTS; i++) {
+                if(!subscription->clients[i] || proxy->clients[i] == NULL) {
+                        continue;
+                }
+                DIGEST_FILTER_T *filter = subscription->filters[i];
+                if(filter != NULL) {
+                        const bool match = digest_filter_match(filter, path_hash, value_hash);
+                        if(filter->remaining == 0) {
+                                digest_filter_free(filter);
+                                subscription->filters[i] = NULL;
+                        }
+                        if(match) {
+                                apr_atomic_inc32(&proxy->resync_skipped);
+                                continue;
+                        }
+                }
+                for(size_t f = 0; f < frame_count; f++) {
+                        client_enqueue(proxy, proxy->clients[i], frames[f]);
+                }
+        }
+        apr_thread_mutex_unlock(proxy->mutex);
+
+        for(size_t f = 0; f < frame_count; f++) {
+                frame_release(frames[f]);
+        }
+        if(frames != &single_frame) {
+                free(frames);
+        }
+        proxy_wake(proxy);
+        return HANDLER_SUCCESS;
+}
+
+/*
+ * A topic is no longer subscribed, most likely because it has been
+ * removed. Forget its value and tell the clients to do the same.
+ */
+static int
+on_unsubscription(const char *const topic_path,
+                  const TOPIC_SPECIFICATION_T *const specification,
+                  NOTIFY_UNSUBSCRIPTION_REASON_T reason,
+                  void *context)
+{
+        SUBSCRIPTION_T *subscription = context;
+        PROXY_T *proxy = subscription->proxy;
+
+        apr_thread_mutex_lock(proxy->mutex);
+        CACHED_FRAME_T *cached = hash_get(subscription->values, topic_path);
+        if(cached != NULL) {
+                FRAME_T *frame = drop_frame_create(&cached->path_hash, 1);
+                for(int i = 0; i < MAX_CLIENTS; i++) {
+                        if(subscription->clients[i] && proxy->clients[i] != NULL) {
+                                client_enqueue(proxy, proxy->clients[i], frame);
+                        }
+                }
+                frame_release(frame);
+
+                // hash_del does not free the key, which the value holds.
+                char *key = cached->path;
+                hash_del(subscription->values, topic_path);
+                free(key);
+                cached_frame_free(cached);
+        }
+        apr_thread_mutex_unlock(proxy->mutex);
+
+        proxy_wake(proxy);
+        return HANDLER_SUCCESS;
+}
+
+static SUBSCRIPTION_T *
+find_subscription(PROXY_T *proxy, const char *selector)
+{
+        for(SUBSCRIPTION_T *s = proxy->subscriptions; s != NULL; s = s->next) {
+                if(strcmp(s->selector, selector) == 0) {
+                        return s;
+                }
+        }
+        return NULL;
+}
+
+/*
+ * Bring a client joining an existing subscription up to date from the
+ * cached values. With digests, only values the client does not hold
+ * are sent, followed by a DROP for any topics it holds which are not
+ * cached. If the subscription has not settled, those topics may yet
+ * arrive, so they are filtered as for a new subscription instead. The
+ * digests must be sorted. Must be called with the proxy mutex held.
+ */
+static void
+subscription_replay(PROXY_T *proxy, SUBSCRIPTION_T *subscription, CLIENT_T *client,
+                    DIGEST_T *digests, size_t digest_count)
+{
+        bool *present = digest_count > 0 ? calloc(digest_count, sizeof(bool)) : NULL;
+        char **keys = hash_keys(subscription->values);
+
+        for(int i = 0; keys[i] != NULL; i++) {
+                CACHED_FRAME_T *cached = hash_get(subscription->values, keys[i]);
+                DIGEST_T *digest = find_digest(digests, digest_count, cached->path_hash);
+                if(digest != NULL) {
+                        present[digest - digests] = true;
+                        if(digest->value_hash == cached->value_hash) {
+                                apr_atomic_inc32(&proxy->resync_skipped);
+                                continue;
+                        }
+                }
+                if(digests != NULL) {
+                        apr_atomic_inc32(&proxy->resync_sent);
+                }
+                for(size_t f = 0; f < cached->frame_count; f++) {
+                        client_enqueue(proxy, client, cached->frames[f]);
+                }
+        }
+        free(keys);
+
+        const bool settled = subscription->settle_at != 0 && apr_time_now() >= subscription->settle_at;
+        size_t dropped = 0;
+        apr_uint64_t *drops = digest_count > 0 ? malloc(digest_count * sizeof(apr_uint64_t)) : NULL;
+        DIGEST_T *pending = NULL;
+        size_t pending_count = 0;
+        for(size_t i = 0; i < digest_count; i++) {
+                if(present[i]) {
+                        continue;
+                }
+                if(settled) {
+                        drops[dropped++] = digests[i].path_hash;
+                }
+                else {
+                        if(pending == NULL) {
+                                pending = malloc(digest_count * sizeof(DIGEST_T));
+                        }
+                        pending[pending_count++] = digests[i];
+                }
+        }
+        if(pending != NULL) {
+                digest_filter_free(subscription->filters[client->slot]);
+                subscription->filters[client->slot] = digest_filter_create(pending, pending_count);
+        }
+        if(dropped > 0) {
+                FRAME_T *frame = drop_frame_create(drops, dropped);
+                client_enqueue(proxy, client, frame);
+                frame_release(frame);
+        }
+        free(drops);
+        free(present);
+}
+
+/*
+ * Add a client to the subscription for a selector. If the selector is
+ * new, the subscription is created and returned, and must be opened
+ * with subscription_open() once the proxy mutex has been released.
+ * Digests, if given, must be sorted and are owned by this function.
+ * Must be called with the proxy mutex held.
+ */
+static SUBSCRIPTION_T *
+subscription_join(PROXY_T *proxy, CLIENT_T *client, const char *selector,
+                  DIGEST_T *digests, size_t digest_count)
+{
+        SUBSCRIPTION_T *subscription = find_subscription(proxy, selector);
+        if(subscription != NULL) {
+                if(!subscription->clients[client->slot]) {
+                        subscription->clients[client->slot] = true;
+                        subscription->client_count++;
+                }
+                subscription_replay(proxy, subscription, client, digests, digest_count);
+                free(digests);
+                return NULL;
+        }
+
+        subscription = calloc(1, sizeof(SUBSCRIPTION_T));
+        subscription->proxy = proxy;
+        subscription->selector = strdup(selector);
+        subscription->session = proxy->upstreams[proxy->next_upstream++ % proxy->upstream_count];
+        subscription->clients[client->slot] = true;
+        subscription->client_count = 1;
+        subscription->values = unsync_hash_new(1024);
+        if(digests != NULL && digest_count > 0) {
+                subscription->filters[client->slot] = digest_filter_create(digests, digest_count);
+        }
+        else {
+                free(digests);
+        }
+        subscription->next = proxy->subscriptions;
+        proxy->subscriptions = subscription;
+        return subscription;
+}
+
+/*
+ * Drop, for each SYNC client, the topics it holds that no value has
+ * been received for since the subscription settled. Must be called
+ * with the proxy mutex held.
+ */
+static void
+subscription_settle(PROXY_T *proxy, SUBSCRIPTION_T *subscription, apr_time_t now)
+{
+        if(subscription->settle_at == 0 || now < subscription->settle_at) {
+                return;
+        }
+        for(int i = 0; i < MAX_CLIENTS; i++) {
+                DIGEST_FILTER_T *filter = subscription->filters[i];
+                if(filter == NULL) {
+                        continue;
+                }
+                size_t dropped = 0;
+                apr_uint64_t *drops = malloc(filter->count * sizeof(apr_uint64_t));
+                for(size_t d = 0; d < filter->count; d++) {
+                        if(!filter->consumed[d]) {
+                                drops[dropped++] = filter->digests[d].path_hash;
+                        }
+                }
+                if(dropped > 0 && proxy->clients[i] != NULL) {
+                        FRAME_T *frame = drop_frame_create(drops, dropped);
+                        client_enqueue(proxy, proxy->clients[i], frame);
+                        frame_release(frame);
+                }
+                free(drops);
+                digest_filter_free(filter);
+                subscription->filters[i] = NULL;
+        }
+}
+
+/*
+ * The server has acknowledged the subscription; its initial values
+ * follow shortly.
+ */
+static int
+on_subscribe(SESSION_T *session, void *context)
+{
+        SUBSCRIPTION_T *subscription = context;
+        PROXY_T *proxy = subscription->proxy;
+
+        apr_thread_mutex_lock(proxy->mutex);
+        subscription->settle_at = apr_time_now() + SYNC_SETTLE_TIME;
+        apr_thread_mutex_unlock(proxy->mutex);
+        return HANDLER_SUCCESS;
+}
+
+/*
+ * The subscription failed, so no values will arrive for it.
+ */
+static int
+on_subscribe_error(SESSION_T *session, const DIFFUSION_ERROR_T *error)
+{
+        SUBSCRIPTION_T *subscription = error->context;
+        PROXY_T *proxy = subscription->proxy;
+
+        printf("Failed to subscribe to %s: %s\n", subscription->selector, error->message);
+        apr_thread_mutex_lock(proxy->mutex);
+        subscription->settle_at = apr_time_now();
+        apr_thread_mutex_unlock(proxy->mutex);
+        return HANDLER_SUCCESS;
+}
+
+/*
+ * Subscribe upstream for a new subscription. This calls into the
+ * session, so must be called without holding the proxy mutex, as
+ * value streams take it from the session's read thread.
+ */
+static void
+subscription_open(SUBSCRIPTION_T *subscription)
+{
+        for(size_t i = 0; i < STREAM_DATATYPE_COUNT; i++) {
+                VALUE_STREAM_T value_stream = {
+                        .datatype = stream_datatypes[i],
+                        .on_value = on_value,
+                        .on_unsubscription = on_unsubscription,
+                        .context = subscription
+                };
+                subscription->handles[i] = add_stream(subscription->session, subscription->selector, &value_stream);
+        }
+
+        SUBSCRIPTION_PARAMS_T params = {
+                .topic_selector = subscription->selector,
+                .on_subscribe = on_subscribe,
+                .on_error = on_subscribe_error,
+                .context = subscription
+        };
+        subscribe(subscription->session, params);
+}
+
+/*
+ * Remove a client from a subscription, returning the subscription if
+ * it is no longer needed. Must be called with the proxy mutex held.
+ */
+static SUBSCRIPTION_T *
+subscription_remove_client(PROXY_T *proxy, SUBSCRIPTION_T *subscription, int slot)
+{
+        if(!subscription->clients[slot]) {
+                return NULL;
+        }
+        subscription->clients[slot] = false;
+        digest_filter_free(subscription->filters[slot]);
+        subscription->filters[slot] = NULL;
+        if(--subscription->client_count > 0) {
+                return NULL;
+        }
+
+        SUBSCRIPTION_T **link = &proxy->subscriptions;
+        while(*link != subscription) {
+                link = &(*link)->next;
+        }
+        *link = subscription->next;
+        subscription->next = proxy->retired;
+        proxy->retired = subscription;
+        return subscription;
+}
+
+/*
+ * Whether a subscription other than the one given, on the same
+ * upstream session, selects a topic. Must be called with the proxy
+ * mutex held.
+ */
+static bool
+topic_selected_elsewhere(PROXY_T *proxy, const SUBSCRIPTION_T *subscription, const char *topic_path)
+{
+        for(SUBSCRIPTION_T *s = proxy->subscriptions; s != NULL; s = s->next) {
+                if(s != subscription && s->session == subscription->session &&
+                   selector_match(s->selector, topic_path)) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+/*
+ * Stop the upstream subscription for a selector no client needs.
+ * Unsubscribing by the selector would also drop topics that another
+ * subscription on the same session selects, so when the selectors
+ * overlap only the topics no other subscription selects are
+ * unsubscribed, one at a time.
+ */
+static void
+subscription_close(SUBSCRIPTION_T *subscription)
+{
+        PROXY_T *proxy = subscription->proxy;
+
+        for(size_t i = 0; i < STREAM_DATATYPE_COUNT; i++) {
+                if(subscription->handles[i] != NULL) {
+                        remove_stream(subscription->session, subscription->handles[i]);
+                        subscription->handles[i] = NULL;
+                }
+        }
+
+        apr_thread_mutex_lock(proxy->mutex);
+        char **paths = hash_keys(subscription->values);
+        bool overlaps = false;
+        int unique_count = 0;
+        for(int i = 0; paths[i] != NULL; i++) {
+                if(topic_selected_elsewhere(proxy, subscription, paths[i])) {
+                        overlaps = true;
+                }
+                else {
+                        paths[unique_count++] = strdup(paths[i]);
+                }
+        }
+        apr_thread_mutex_unlock(proxy->mutex);
+
+        if(!overlaps) {
+                UNSUBSCRIPTION_PARAMS_T params = {
+                        .topic_selector = subscription->selector
+                };
+                unsubscribe(subscription->session, params);
+        }
+        for(int i = 0; i < unique_count; i++) {
+                if(overlaps) {
+                        char selector[MAX_LINE];
+                        snprintf(selector, sizeof(selector), ">%s", paths[i]);
+                        UNSUBSCRIPTION_PARAMS_T params = {
+                                .topic_selector = selector
+                        };
+                        unsubscribe(subscription->session, params);
+                }
+                free(paths[i]);
+        }
+        free(paths);
+}
+
+/*
+ * Remove a client from the subscription for a selector, returning the
+ * subscription if it must be closed with subscription_close() once the
+ * proxy mutex has been released. Must be called with the proxy mutex
+ * held.
+ */
+static SUBSCRIPTION_T *
+subscription_leave(PROXY_T *proxy, CLIENT_T *client, const char *selector)
+{
+        SUBSCRIPTION_T *subscription = find_subscription(proxy, selector);
+        if(subscription == NULL) {
+                return NULL;
+        }
+        return subscription_remove_client(proxy, subscription, client->slot);
+}
+
+static void
+request_context_free(REQUEST_CONTEXT_T *request_context)
+{
+        free(request_context->request_id);
+        free(request_context);
+}
+
+static int
+on_request_response(DIFFUSION_DATATYPE response_datatype,
+                    const DIFFUSION_VALUE_T *response,
+                    void *context)
+{
+        REQUEST_CONTEXT_T *request_context = context;
+        char *string = NULL;
+        char header[MAX_LINE];
+        FRAME_T *frame;
+
+        if(read_diffusion_string_value(response, &string, NULL)) {
+                const size_t len = strlen(string);
+                snprintf(header, sizeof(header), "RSP %s %zu\n", request_context->request_id, len);
+                frame = frame_create(header, string, len);
+                free(string);
+        }
+        else {
+                snprintf(header, sizeof(header), "ERR %s unreadable response\n", request_context->request_id);
+                frame = frame_create(header, NULL, 0);
+        }
+
+        proxy_send_to_client(request_context->proxy, request_context->slot, request_context->client_id, frame);
+        frame_release(frame);
+        request_context_free(request_context);
+        return HANDLER_SUCCESS;
+}
+
+static void
+request_failed(REQUEST_CONTEXT_T *request_context, const char *message)
+{
+        char header[MAX_LINE];
+        snprintf(header, sizeof(header), "ERR %s %s\n", request_context->request_id, message);
+        FRAME_T *frame = frame_create(header, NULL, 0);
+        proxy_send_to_client(request_context->proxy, request_context->slot, request_context->client_id, frame);
+        frame_release(frame);
+        request_context_free(request_context);
+}
+
+static int
+on_request_error(SESSION_T *session, const DIFFUSION_ERROR_T *error)
+{
+        request_failed(error->context, error->message != NULL ? error->message : "error");
+        return HANDLER_SUCCESS;
+}
+
+static int
+on_request_discard(SESSION_T *session, void *context)
+{
+        request_failed(context, "discarded");
+        return HANDLER_SUCCESS;
+}
+
+static void
+proxy_request(PROXY_T *proxy, CLIENT_T *client, SESSION_T *session, const char *request_id,
+              const char *path, const char *payload, size_t len)
+{
+        REQUEST_CONTEXT_T *request_context = calloc(1, sizeof(REQUEST_CONTEXT_T));
+        request_context->proxy = proxy;
+        request_context->slot = client->slot;
+        request_context->client_id = client->id;
+        request_context->request_id = strdup(request_id);
+
+        char *string = malloc(len + 1);
+        memcpy(string, payload, len);
+        string[len] = '\0';
+
+        BUF_T *request = buf_create();
+        write_diffusion_string_value(string, request);
+        free(string);
+
+        SEND_REQUEST_PARAMS_T params = {
+                .path = path,
+                .request = request,
+                .request_datatype = DATATYPE_STRING,
+                .response_datatype = DATATYPE_STRING,
+                .on_response = on_request_response,
+                .on_error = on_request_error,
+                .on_discard = on_request_discard,
+                .context = request_context
+        };
+        send_request(session, params);
+        buf_free(request);
+
+        apr_atomic_inc32(&proxy->requests);
+}
+
+/*
+ * Split off the next space-separated token of a command line, in
+ * place. Returns NULL if there are no more.
+ */
+static char *
+next_token(char **cursor)
+{
+        char *token = *cursor;
+        while(*token == ' ') {
+                token++;
+        }
+        if(*token == '\0') {
+                return NULL;
+        }
+        char *end = strchr(token, ' ');
+        if(end != NULL) {
+                *end = '\0';
+                *cursor = end + 1;
+        }
+        else {
+                *cursor = token + strlen(token);
+        }
+        return token;
+}
+
+static bool
+parse_size(const char *token, size_t *value)
+{
+        char *end = NULL;
+        if(token == NULL) {
+                return false;
+        }
+        *value = strtoul(token, &end, 10);
+        return end != token && *end == '\0';
+}
+
+/*
+ * Parse complete commands from the client's input buffer, starting at
+ * *pos, into a batch. Arguments point into the input buffer, which
+ * must not change until the batch has been executed. Returns the
+ * number of commands parsed and advances *pos past them.
+ */
+static int
+client_parse_batch(CLIENT_T *client, size_t *pos, COMMAND_T *batch)
+{
+        int count = 0;
+
+        while(count < MAX_BATCH && *pos < client->in_len) {
+                char *line = client->in_buf + *pos;
+                char *eol = memchr(line, '\n', client->in_len - *pos);
+                if(eol == NULL) {
+                        if(client->in_len - *pos > MAX_LINE) {
+                                client->closing = true;
+                        }
+                        break;
+                }
+                const size_t available = client->in_len - *pos - ((eol - line) + 1);
+                *eol = '\0';
+
+                COMMAND_T *command = &batch[count];
+                memset(command, 0, sizeof(COMMAND_T));
+
+                char *cursor = line;
+                const char *verb = next_token(&cursor);
+                command->arg1 = next_token(&cursor);
+                size_t payload_len = 0;
+
+                if(verb == NULL || command->arg1 == NULL) {
+                        printf("Client %u sent an unknown command\n", client->id);
+                        command->type = COMMAND_NONE;
+                }
+                else if(strcmp(verb, "SUB") == 0) {
+                        command->type = COMMAND_SUBSCRIBE;
+                }
+                else if(strcmp(verb, "SYNC") == 0 && parse_size(next_token(&cursor), &command->len)) {
+                        if(command->len > MAX_PAYLOAD / sizeof(DIGEST_T)) {
+                                client->closing = true;
+                                break;
+                        }
+                        command->type = COMMAND_SUBSCRIBE;
+                        payload_len = command->len * sizeof(DIGEST_T);
+                }
+                else if(strcmp(verb, "UNSUB") == 0) {
+                        command->type = COMMAND_UNSUBSCRIBE;
+                }
+                else if(strcmp(verb, "REQ") == 0
+                        && (command->arg2 = next_token(&cursor)) != NULL
+                        && parse_size(next_token(&cursor), &command->len)) {
+                        if(command->len > MAX_PAYLOAD) {
+                                client->closing = true;
+                                break;
+                        }
+                        command->type = COMMAND_REQUEST;
+                        payload_len = command->len;
+                }
+                else {
+                        printf("Client %u sent an unknown command: %s\n", client->id, verb);
+                        command->type = COMMAND_NONE;
+                }
+
+                if(available < payload_len) {
+                        // Wait for the rest of the payload.
+                        *eol = '\n';
+                        for(char *p = line; p < eol; p++) {
+                                if(*p == '\0') {
+                                        *p = ' ';
+                                }
+                        }
+                        break;
+                }
+                command->payload = eol + 1;
+                if(command->type == COMMAND_SUBSCRIBE && command->len > 0) {
+                        command->digests = malloc(payload_len);
+                        memcpy(command->digests, command->payload, payload_len);
+                        qsort(command->digests, command->len, sizeof(DIGEST_T), compare_digests);
+                }
+
+                *pos += (eol - line) + 1 + payload_len;
+                count++;
+        }
+        return count;
+}
+
+/*
+ * Execute a batch of commands. Everything which needs the proxy mutex
+ * is done in a single acquisition; calls into the upstream sessions
+ * are made afterwards, in command order.
+ */
+static void
+client_execute_batch(PROXY_T *proxy, CLIENT_T *client, COMMAND_T *batch, int count)
+{
+        apr_thread_mutex_lock(proxy->mutex);
+        for(int i = 0; i < count; i++) {
+                COMMAND_T *command = &batch[i];
+                switch(command->type) {
+                case COMMAND_SUBSCRIBE:
+                        command->opened = subscription_join(proxy, client, command->arg1,
+                                                            command->digests, command->len);
+                        command->digests = NULL;
+                        break;
+                case COMMAND_UNSUBSCRIBE:
+                        command->closed = subscription_leave(proxy, client, command->arg1);
+                        break;
+                case COMMAND_REQUEST:
+                        command->session = proxy->upstreams[proxy->next_upstream++ % proxy->upstream_count];
+                        break;
+                default:
+                        break;
+                }
+        }
+        apr_thread_mutex_unlock(proxy->mutex);
+
+        for(int i = 0; i < count; i++) {
+                COMMAND_T *command = &batch[i];
+                if(command->opened != NULL) {
+                        subscription_open(command->opened);
+                }
+                if(command->closed != NULL) {
+                        subscription_close(command->closed);
+                }
+                if(command->type == COMMAND_REQUEST) {
+                        proxy_request(proxy, client, command->session, command->arg1,
+                                      command->arg2, command->payload, command->len);
+                }
+        }
+
+        apr_atomic_add32(&proxy->commands, count);
+        apr_atomic_inc32(&proxy->batches);
+        proxy_wake(proxy);
+}
+
+/*
+ * Act on every complete command in the client's input buffer, leaving
+ * any partial command in place. All the commands from a read are
+ * parsed first and then executed together.
+ */
+static void
+client_process_input(PROXY_T *proxy, CLIENT_T *client)
+{
+        COMMAND_T batch[MAX_BATCH];
+        size_t pos = 0;
+
+        while(!client->closing) {
+                const int count = client_parse_batch(client, &pos, batch);
+                if(count == 0) {
+                        break;
+                }
+                client_execute_batch(proxy, client, batch, count);
+        }
+
+        memmove(client->in_buf, client->in_buf + pos, client->in_len - pos);
+        client->in_len -= pos;
+}
+
+static void
+client_read(PROXY_T *proxy, CLIENT_T *client)
+{
+        if(client->in_cap - client->in_len < MAX_LINE) {
+                if(client->in_cap >= INPUT_BUFFER_MAX) {
+                        // No valid command needs this much.
+                        client->closing = true;
+                        return;
+                }
+                client_resize_input(proxy, client, client->in_cap > 0 ? client->in_cap * 2 : INPUT_BUFFER_INITIAL);
+        }
+
+        ssize_t n = read(client->fd, client->in_buf + client->in_len, client->in_cap - client->in_len);
+        if(n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                client->closing = true;
+                return;
+        }
+        if(n > 0) {
+                client->in_len += n;
+                client->last_read = apr_time_now();
+                apr_atomic_inc32(&proxy->reads);
+                client_process_input(proxy, client);
+        }
+}
+
+static void
+proxy_accept(PROXY_T *proxy, int listen_fd)
+{
+        int fd = accept(listen_fd, NULL, NULL);
+        if(fd < 0) {
+                return;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        apr_thread_mutex_lock(proxy->mutex);
+        int slot = -1;
+        for(int i = 0; i < MAX_CLIENTS; i++) {
+                if(proxy->clients[i] == NULL) {
+                        slot = i;
+                        break;
+                }
+        }
+        if(slot < 0) {
+                apr_thread_mutex_unlock(proxy->mutex);
+                close(fd);
+                return;
+        }
+
+        CLIENT_T *client = calloc(1, sizeof(CLIENT_T));
+        client->fd = fd;
+        client->slot = slot;
+        client->id = ++proxy->next_client_id;
+        client->last_read = apr_time_now();
+        client_set_send_buffer(client, SEND_BUFFER_INITIAL);
+        client->send_initial = client->send_buf;
+        proxy->clients[slot] = client;
+        apr_thread_mutex_unlock(proxy->mutex);
+
+        printf("Client %u connected\n", client->id);
+}
+
+static void
+proxy_drop_client(PROXY_T *proxy, CLIENT_T *client)
+{
+        SUBSCRIPTION_T *unused[MAX_CLIENTS];
+        int unused_count = 0;
+
+        apr_thread_mutex_lock(proxy->mutex);
+        proxy->clients[client->slot] = NULL;
+        SUBSCRIPTION_T *subscription = proxy->subscriptions;
+        while(subscription != NULL) {
+                SUBSCRIPTION_T *next = subscription->next;
+                SUBSCRIPTION_T *closed = subscription_remove_client(proxy, subscription, client->slot);
+                if(closed != NULL && unused_count < MAX_CLIENTS) {
+                        unused[unused_count++] = closed;
+                }
+                subscription = next;
+        }
+        while(client->out_head != NULL) {
+                QUEUED_FRAME_T *head = client->out_head;
+                client->out_head = head->next;
+                frame_release(head->frame);
+                free(head);
+        }
+        apr_thread_mutex_unlock(proxy->mutex);
+
+        for(int i = 0; i < unused_count; i++) {
+                subscription_close(unused[i]);
+        }
+
+        printf("Client %u disconnected, buffer peaks %zuKB in/%zuKB send, %u resizes\n",
+               client->id, client->in_peak / 1024, client->send_peak / 1024, client->resizes);
+        apr_atomic_inc32(&proxy->clients_dropped);
+        close(client->fd);
+        if(client->in_buf != NULL) {
+                buffer_free(client->in_buf, client->in_cap, client->in_mapped);
+        }
+        free(client);
+}
+
+static int
+listen_unix(const char *path)
+{
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(fd < 0) {
+                return -1;
+        }
+
+        struct sockaddr_un addr = { 0 };
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+        unlink(path);
+
+        if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 128) < 0) {
+                close(fd);
+                return -1;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        return fd;
+}
+
+/*
+ * The proxy's event loop: accept clients, read their commands and
+ * write queued frames to them.
+ */
+static void
+proxy_run(PROXY_T *proxy, int listen_fd, unsigned int run_time)
+{
+        const apr_time_t deadline = run_time > 0 ? apr_time_now() + apr_time_from_sec(run_time) : 0;
+        apr_time_t next_report = apr_time_now() + apr_time_from_sec(5);
+        apr_time_t next_trim = apr_time_now() + apr_time_from_sec(1);
+        // Client buffer sizes as of the last trim.
+        size_t in_total = 0;
+        size_t send_total = 0;
+        size_t in_largest = 0;
+        size_t send_largest = 0;
+        struct pollfd fds[MAX_CLIENTS + 2];
+        CLIENT_T *polled[MAX_CLIENTS];
+
+        while(deadline == 0 || apr_time_now() < deadline) {
+                fds[0].fd = listen_fd;
+                fds[0].events = POLLIN;
+                fds[1].fd = proxy->wake_pipe[0];
+                fds[1].events = POLLIN;
+                int nfds = 2;
+
+                apr_thread_mutex_lock(proxy->mutex);
+                for(int i = 0; i < MAX_CLIENTS; i++) {
+                        CLIENT_T *client = proxy->clients[i];
+                        if(client == NULL) {
+                                continue;
+                        }
+                        polled[nfds - 2] = client;
+                        fds[nfds].fd = client->fd;
+                        fds[nfds].events = POLLIN | (client->out_head != NULL ? POLLOUT : 0);
+                        nfds++;
+                }
+                apr_thread_mutex_unlock(proxy->mutex);
+
+                if(poll(fds, nfds, 1000) < 0 && errno != EINTR) {
+                        break;
+                }
+
+                if(fds[1].revents & POLLIN) {
+                        char drain[256];
+                        apr_atomic_set32(&proxy->wake_pending, 0);
+                        while(read(proxy->wake_pipe[0], drain, sizeof(drain)) > 0);
+                }
+
+                for(int i = 2; i < nfds; i++) {
+                        CLIENT_T *client = polled[i - 2];
+                        if(fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                                client_read(proxy, client);
+                        }
+
+                        apr_thread_mutex_lock(proxy->mutex);
+                        client_flush(proxy, client);
+                        const bool closing = client->closing;
+                        apr_thread_mutex_unlock(proxy->mutex);
+
+                        if(closing) {
+                                proxy_drop_client(proxy, client);
+                        }
+                }
+
+                if(fds[0].revents & POLLIN) {
+                        proxy_accept(proxy, listen_fd);
+                }
+
+                const apr_time_t now = apr_time_now();
+                if(now >= next_trim) {
+                        in_total = 0;
+                        send_total = 0;
+                        in_largest = 0;
+                        send_largest = 0;
+                        apr_thread_mutex_lock(proxy->mutex);
+                        for(int i = 0; i < MAX_CLIENTS; i++) {
+                                CLIENT_T *client = proxy->clients[i];
+                                if(client == NULL) {
+                                        continue;
+                                }
+                                client_trim_buffers(proxy, client, now);
+                                in_total += client->in_cap;
+                                send_total += client->send_buf;
+                                in_largest = client->in_cap > in_largest ? client->in_cap : in_largest;
+                                send_largest = client->send_buf > send_largest ? client->send_buf : send_largest;
+                        }
+                        for(SUBSCRIPTION_T *subscription = proxy->subscriptions;
+                            subscription != NULL;
+                            subscription = subscription->next) {
+                                subscription_settle(proxy, subscription, now);
+                        }
+                        apr_thread_mutex_unlock(proxy->mutex);
+                        next_trim = now + apr_time_from_sec(1);
+                }
+
+                if(now >= next_report) {
+                        const apr_uint32_t reads = apr_atomic_read32(&proxy->reads);
+                        printf("%d clients, %u updates received, %u frames queued, %u requests, "
+                               "resync %u sent/%u skipped, %u chunked, %.1f commands per read\n",
+                               nfds - 2,
+                               apr_atomic_read32(&proxy->updates),
+                               apr_atomic_read32(&proxy->frames_queued),
+                               apr_atomic_read32(&proxy->requests),
+                               apr_atomic_read32(&proxy->resync_sent),
+                               apr_atomic_read32(&proxy->resync_skipped),
+                               apr_atomic_read32(&proxy->chunked_values),
+                               reads > 0 ? (double)apr_atomic_read32(&proxy->commands) / reads : 0.0);
+                        printf("Client buffers: %zuKB in (largest %zuKB), %zuKB send (largest %zuKB), "
+                               "%u grows, %u shrinks\n",
+                               in_total / 1024, in_largest / 1024, send_total / 1024, send_largest / 1024,
+                               apr_atomic_read32(&proxy->buffer_grows),
+                               apr_atomic_read32(&proxy->buffer_shrinks));
+                        next_report += apr_time_from_sec(5);
+                }
+        }
+}
+
+/*
+ * Entry point for the example.
+ */
+int
+main(int argc, char **argv)
+{
+        /*
+         * Standard command-line parsing.
+         */
+        HASH_T *options = parse_cmdline(argc, argv, arg_opts);
+        if(options == NULL || hash_get(options, "help") != NULL) {
+                show_usage(argc, argv, arg_opts);
+                return EXIT_FAILURE;
+        }
+
+        const char *url = hash_get(options, "url");
+        const char *principal = hash_get(options, "principal");
+        CREDENTIALS_T *credentials = NULL;
+        const char *password = hash_get(options, "credentials");
+        if(password != NULL) {
+                credentials = credentials_create_password(password);
+        }
+        const char *socket_path = hash_get(options, "socket");
+        const int session_count = atoi(hash_get(options, "sessions"));
+        const unsigned int run_time = atol(hash_get(options, "sleep"));
+
+        if(session_count < 1) {
+                printf("At least one upstream session is required\n");
+                return EXIT_FAILURE;
+        }
+
+        signal(SIGPIPE, SIG_IGN);
+
+        apr_initialize();
+
+        PROXY_T *proxy = calloc(1, sizeof(PROXY_T));
+        proxy->chunk_size = atol(hash_get(options, "chunk"));
+        if(proxy->chunk_size < 1024) {
+                proxy->chunk_size = 1024;
+        }
+        proxy->idle_time = apr_time_from_sec(atol(hash_get(options, "idle")));
+        proxy->hugepages = hash_get(options, "hugepages") != NULL;
+        apr_pool_create(&proxy->pool, NULL);
+        apr_thread_mutex_create(&proxy->mutex, APR_THREAD_MUTEX_DEFAULT, proxy->pool);
+        if(pipe(proxy->wake_pipe) < 0) {
+                printf("Failed to create wake pipe\n");
+                return EXIT_FAILURE;
+        }
+        fcntl(proxy->wake_pipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(proxy->wake_pipe[1], F_SETFL, O_NONBLOCK);
+
+        /*
+         * Create the upstream sessions.
+         */
+        proxy->upstreams = calloc(session_count, sizeof(SESSION_T *));
+        for(int i = 0; i < session_count; i++) {
+                DIFFUSION_ERROR_T error = { 0 };
+                proxy->upstreams[i] = session_create(url, principal, credentials, NULL, NULL, &error);
+                if(proxy->upstreams[i] == NULL) {
+                        printf("Failed to create session: %s\n", error.message);
+                        free(error.message);
+                        return EXIT_FAILURE;
+                }
+                proxy->upstream_count++;
+        }
+
+        int listen_fd = listen_unix(socket_path);
+        if(listen_fd < 0) {
+                printf("Failed to listen on %s: %s\n", socket_path, strerror(errno));
+                return EXIT_FAILURE;
+        }
+        printf("Listening on %s with %d upstream sessions\n", socket_path, session_count);
+
+        proxy_run(proxy, listen_fd, run_time);
+
+        /*
+         * Shut down: disconnect the clients, then close the upstream
+         * sessions so that no more callbacks can arrive.
+         */
+        close(listen_fd);
+        unlink(socket_path);
+        for(int i = 0; i < MAX_CLIENTS; i++) {
+                if(proxy->clients[i] != NULL) {
+                        proxy_drop_client(proxy, proxy->clients[i]);
+                }
+        }
+        for(int i = 0; i < proxy->upstream_count; i++) {
+                session_close(proxy->upstreams[i], NULL);
+                session_free(proxy->upstreams[i]);
+        }
+
+        SUBSCRIPTION_T *subscription = proxy->retired;
+        while(subscription != NULL) {
+                SUBSCRIPTION_T *next = subscription->next;
+                hash_free(subscription->values, free, cached_frame_free);
+                free(subscription->selector);
+                free(subscription);
+                subscription = next;
+        }
+
+        close(proxy->wake_pipe[0]);
+        close(proxy->wake_pipe[1]);
+        free(proxy->upstreams);
+        apr_thread_mutex_destroy(proxy->mutex);
+        apr_pool_destroy(proxy->pool);
+        free(proxy);
+
+        credentials_free(credentials);
+        hash_free(options, NULL, free);
+
+        apr_terminate();
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,409 @@
+/**
+ * Copyright © 2026 Push Technology Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This example is written in C99. Please use an appropriate C99 capable compiler
+ *
+ * @author Push Technology Limited
+ * @since 6.4
+ */
+
+/*
+ * This example shows a mux-proxy client resynchronising its cache of
+ * topic values after a disconnection, without being sent every value
+ * again.
+ *
+ * The client keeps a digest of each value it holds: a hash of the
+ * topic path and a hash of the value's bytes. It connects, listens
+ * for a while, disconnects, and repeats. On each reconnection it
+ * sends its digests with a SYNC command ("-m sync"), and the proxy
+ * replies only with the values that have changed, plus a DROP for any
+ * topics which have gone away. With "-m sub" the client subscribes
+ * afresh each time, for comparison.
+ *
+ * The values and bytes received on each connection are printed, so
+ * the saving is easy to see for a slowly changing topic tree.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include <apr.h>
+#include <apr_time.h>
+
+#include "diffusion.h"
+#include "args.h"
+
+ARG_OPTS_T arg_opts[] = {
+        ARG_OPTS_HELP,
+        {'f', "socket", "Path of the mux-proxy socket", ARG_OPTIONAL, ARG_HAS_VALUE, "/tmp/diffusion-mux.sock"},
+        {'t', "topic_selector", "Topic selector", ARG_OPTIONAL, ARG_HAS_VALUE, "?.*//"},
+        {'m', "mode", "\"sync\" to resynchronise with digests, \"sub\" to resubscribe", ARG_OPTIONAL, ARG_HAS_VALUE, "sync"},
+        {'n', "cycles", "Number of times to connect", ARG_OPTIONAL, ARG_HAS_VALUE, "5"},
+        {'s', "sleep", "Time to stay connected each cycle (in seconds)", ARG_OPTIONAL, ARG_HAS_VALUE, "5"},
+        {'d', "disconnect", "Time to stay disconnected each cycle (in seconds)", ARG_OPTIONAL, ARG_HAS_VALUE, "5"},
+        END_OF_ARG_OPTS
+};
+
+#define MAX_LINE 1024
+
+/*
+ * Must match the digest layout expected by mux-proxy.
+ */
+typedef struct digest_s {
+        apr_uint64_t path_hash;
+        apr_uint64_t value_hash;
+} DIGEST_T;
+
+/*
+ * What the client holds for each topic. A real client would keep the
+ * value itself alongside; only the digest is needed to resynchronise.
+ */
+typedef struct local_value_s {
+        DIGEST_T digest;
+        DIFFUSION_DATATYPE datatype;
+} LOCAL_VALUE_T;
+
+typedef struct cycle_stats_s {
+        unsigned long values;
+        unsigned long changed;
+        unsigned long dropped;
+        unsigned long chunks;
+        unsigned long bytes;
+} CYCLE_STATS_T;
+
+/*
+ * A large value arriving in chunks. Its digest is computed as the
+ * chunks arrive, so the value never has to be held whole.
+ */
+typedef struct partial_value_s {
+        apr_uint64_t value_hash;
+        size_t received;
+} PARTIAL_VALUE_T;
+
+#define FNV1A64_INIT 14695981039346656037ULL
+
+static apr_uint64_t
+fnv1a64_update(apr_uint64_t hash, const void *data, size_t len)
+{
+        const unsigned char *p = data;
+        for(size_t i = 0; i < len; i++) {
+                hash ^= p[i];
+                hash *= 1099511628211ULL;
+        }
+        return hash;
+}
+
+static apr_uint64_t
+fnv1a64(const void *data, size_t len)
+{
+        return fnv1a64_update(FNV1A64_INIT, data, len);
+}
+
+static void
+apply_value(HASH_T *cache, const char *path, DIFFUSION_DATATYPE datatype,
+            apr_uint64_t value_hash, CYCLE_STATS_T *stats)
+{
+        LOCAL_VALUE_T *local = hash_get(cache, path);
+
+        if(local == NULL) {
+                local = calloc(1, sizeof(LOCAL_VALUE_T));
+                local->digest.path_hash = fnv1a64(path, strlen(path));
+                hash_add(cache, strdup(path), local);
+                stats->changed++;
+        }
+        else if(local->digest.value_hash != value_hash) {
+                stats->changed++;
+        }
+        local->digest.value_hash = value_hash;
+        local->datatype = datatype;
+        stats->values++;
+}
+
+static void
+apply_drop(HASH_T *cache, const apr_uint64_t *path_hashes, size_t count, CYCLE_STATS_T *stats)
+{
+        char **keys = hash_keys(cache);
+        for(int i = 0; keys[i] != NULL; i++) {
+                LOCAL_VALUE_T *local = hash_get(cache, keys[i]);
+                for(size_t j = 0; j < count; j++) {
+                        if(local->digest.path_hash == path_hashes[j]) {
+                                char *key = keys[i];
+                                free(hash_del(cache, key));
+                                free(key);
+                                stats->dropped++;
+                                break;
+                        }
+                }
+        }
+        free(keys);
+}
+
+/*
+ * Send SYNC with a digest of every cached value, or a plain SUB.
+ */
+static bool
+send_subscription(int fd, HASH_T *cache, const char *selector, bool sync)
+{
+        char line[MAX_LINE];
+
+        if(!sync) {
+                snprintf(line, sizeof(line), "SUB %s\n", selector);
+                return write(fd, line, strlen(line)) >= 0;
+        }
+
+        char **keys = hash_keys(cache);
+        size_t count = 0;
+        while(keys[count] != NULL) {
+                count++;
+        }
+        DIGEST_T *digests = malloc((count > 0 ? count : 1) * sizeof(DIGEST_T));
+        for(size_t i = 0; i < count; i++) {
+                LOCAL_VALUE_T *local = hash_get(cache, keys[i]);
+                digests[i] = local->digest;
+        }
+        free(keys);
+
+        snprintf(line, sizeof(line), "SYNC %s %zu\n", selector, count);
+        bool ok = write(fd, line, strlen(line)) >= 0;
+        const char *p = (const char *)digests;
+        size_t remaining = count * sizeof(DIGEST_T);
+        while(ok && remaining > 0) {
+                ssize_t n = write(fd, p, remaining);
+                if(n < 0) {
+                        ok = false;
+                        break;
+                }
+                p += n;
+                remaining -= n;
+        }
+        free(digests);
+        return ok;
+}
+
+/*
+ * Fold a chunk of a large value into its digest, applying the value
+ * once the last chunk has arrived.
+ */
+static void
+apply_chunk(HASH_T *cache, HASH_T *partials, const char *path, DIFFUSION_DATATYPE datatype,
+            size_t total, size_t offset, const void *bytes, size_t len, CYCLE_STATS_T *stats)
+{
+        PARTIAL_VALUE_T *partial = hash_get(partials, path);
+        if(offset == 0) {
+                if(partial == NULL) {
+                        partial = malloc(sizeof(PARTIAL_VALUE_T));
+                        hash_add(partials, strdup(path), partial);
+                }
+                partial->value_hash = FNV1A64_INIT;
+                partial->received = 0;
+        }
+        else if(partial == NULL || partial->received != offset) {
+                // Missed the start of this value; wait for the next.
+                return;
+        }
+
+        partial->value_hash = fnv1a64_update(partial->value_hash, bytes, len);
+        partial->received += len;
+        stats->chunks++;
+
+        if(partial->received == total) {
+                apply_value(cache, path, datatype, partial->value_hash, stats);
+                partial->received = 0;
+        }
+}
+
+/*
+ * Apply every complete frame in the buffer, returning the number of
+ * bytes consumed.
+ */
+static size_t
+process_frames(HASH_T *cache, HASH_T *partials, char *buf, size_t len, CYCLE_STATS_T *stats)
+{
+        size_t pos = 0;
+
+        for(;;) {
+                char *eol = memchr(buf + pos, '\n', len - pos);
+                if(eol == NULL || eol - (buf + pos) >= MAX_LINE) {
+                        break;
+                }
+                char line[MAX_LINE];
+                memcpy(line, buf + pos, eol - (buf + pos));
+                line[eol - (buf + pos)] = '\0';
+
+                char path[MAX_LINE];
+                int datatype;
+                size_t payload_len = 0;
+                size_t count = 0;
+                size_t total = 0;
+                size_t offset = 0;
+                bool is_value = false;
+                bool is_chunk = false;
+
+                if(sscanf(line, "VAL %1023s %d %zu", path, &datatype, &payload_len) == 3) {
+                        is_value = true;
+                }
+                else if(sscanf(line, "CHUNK %1023s %d %zu %zu %zu",
+                               path, &datatype, &total, &offset, &payload_len) == 5) {
+                        is_chunk = true;
+                }
+                else if(sscanf(line, "DROP %zu", &count) == 1) {
+                        payload_len = count * sizeof(apr_uint64_t);
+                }
+
+                const size_t frame_len = (eol - (buf + pos)) + 1 + payload_len;
+                if(len - pos < frame_len) {
+                        break;
+                }
+                if(is_value) {
+                        apply_value(cache, path, datatype, fnv1a64(eol + 1, payload_len), stats);
+                }
+                else if(is_chunk) {
+                        apply_chunk(cache, partials, path, datatype, total, offset,
+                                    eol + 1, payload_len, stats);
+                }
+                else if(count > 0) {
+                        apr_uint64_t *path_hashes = malloc(payload_len);
+                        memcpy(path_hashes, eol + 1, payload_len);
+                        apply_drop(cache, path_hashes, count, stats);
+                        free(path_hashes);
+                }
+                pos += frame_len;
+        }
+        return pos;
+}
+
+/*
+ * Connect to the proxy, resynchronise and then receive updates until
+ * the deadline.
+ */
+static bool
+run_cycle(const char *socket_path, HASH_T *cache, const char *selector, bool sync,
+          unsigned int connected_time, CYCLE_STATS_T *stats)
+{
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un addr = { 0 };
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+        if(fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+                printf("Failed to connect to %s: %s\n", socket_path, strerror(errno));
+                if(fd >= 0) {
+                        close(fd);
+                }
+                return false;
+        }
+
+        if(!send_subscription(fd, cache, selector, sync)) {
+                close(fd);
+                return false;
+        }
+
+        struct timeval timeout = { .tv_sec = 0, .tv_usec = 100000 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        const apr_time_t deadline = apr_time_now() + apr_time_from_sec(connected_time);
+        size_t cap = 64 * 1024;
+        size_t len = 0;
+        char *buf = malloc(cap);
+
+        // Chunked values in progress; a value cut off by a
+        // disconnection is resent whole on the next resync.
+        HASH_T *partials = unsync_hash_new(64);
+
+        while(apr_time_now() < deadline) {
+                if(cap - len < 4096) {
+                        cap *= 2;
+                        buf = realloc(buf, cap);
+                }
+                ssize_t n = read(fd, buf + len, cap - len);
+                if(n == 0) {
+                        break;
+                }
+                if(n < 0) {
+                        continue;
+                }
+                len += n;
+                stats->bytes += n;
+
+                const size_t consumed = process_frames(cache, partials, buf, len, stats);
+                memmove(buf, buf + consumed, len - consumed);
+                len -= consumed;
+        }
+
+        hash_free(partials, free, free);
+        free(buf);
+        close(fd);
+        return true;
+}
+
+/*
+ * Entry point for the example.
+ */
+int
+main(int argc, char **argv)
+{
+        /*
+         * Standard command-line parsing.
+         */
+        HASH_T *options = parse_cmdline(argc, argv, arg_opts);
+        if(options == NULL || hash_get(options, "help") != NULL) {
+                show_usage(argc, argv, arg_opts);
+                return EXIT_FAILURE;
+        }
+
+        const char *socket_path = hash_get(options, "socket");
+        const char *selector = hash_get(options, "topic_selector");
+        const char *mode = hash_get(options, "mode");
+        const int cycles = atoi(hash_get(options, "cycles"));
+        const unsigned int connected_time = atoi(hash_get(options, "sleep"));
+        const unsigned int disconnected_time = atoi(hash_get(options, "disconnect"));
+        const bool sync = strcmp(mode, "sub") != 0;
+
+        apr_initialize();
+
+        HASH_T *cache = unsync_hash_new(1024);
+
+        for(int cycle = 1; cycle <= cycles; cycle++) {
+                CYCLE_STATS_T stats = { 0 };
+                if(!run_cycle(socket_path, cache, selector, sync, connected_time, &stats)) {
+                        break;
+                }
+
+                char **keys = hash_keys(cache);
+                int held = 0;
+                while(keys[held] != NULL) {
+                        held++;
+                }
+                free(keys);
+
+                printf("Connection %d: %lu values (%lu changed), %lu dropped, %lu chunks, %lu bytes, holding %d topics\n",
+                       cycle, stats.values, stats.changed, stats.dropped, stats.chunks, stats.bytes, held);
+
+                if(cycle < cycles) {
+                        sleep(disconnected_time);
+                }
+        }
+
+        hash_free(cache, free, free);
+        hash_free(options, NULL, free);
+
+        apr_terminate();
+
+        return EXIT_SUCCESS;
+}
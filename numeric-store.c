@@ -0,0 +1,1002 @@
+/**
+ * Copyright © 2026 Push Technology Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This example is written in C99. Please use an appropriate C99 capable compiler
+ *
+ * @author Push Technology Limited
+ * @since 6.4
+ */
+
+/*
+ * This example keeps a local materialised view of a large number of
+ * numeric topics and computes aggregates over groups of them.
+ *
+ * Values of double and int64 topics are decoded as they arrive into a
+ * column store: each topic is given a slot, and its value is written
+ * to a contiguous array of doubles at that slot (int64 values are also
+ * kept exactly, in a parallel column). Bitmaps record which slots hold
+ * a value and which have changed since the application last looked.
+ * Subscription notifications give the server's ID for each topic,
+ * which is mapped to its slot, so values can also be looked up by ID.
+ *
+ * Groups are defined by topic path prefix ("-g"), and each has a
+ * membership bitmap over the slots. Aggregating a group (count, min,
+ * max, sum and mean) walks the bitmap a word at a time. Topics are
+ * usually subscribed to in path order, so a group's members tend to
+ * occupy runs of adjacent slots, and a word with every bit set is
+ * aggregated as a block of 64 values with AVX2 where the CPU supports
+ * it. A group's result is cached until one of its members changes.
+ *
+ * With "-w price:volume", a topic whose path ends in "/volume" is
+ * taken as the weight of its sibling ending in "/price", and groups
+ * also report the weighted mean of their members (a VWAP for trade
+ * prices). Weight topics are not members of any group, and are best
+ * subscribed to separately from the values so that they don't break up
+ * the runs of slots the values occupy.
+ *
+ * With "-b", no session is created: a number of synthetic topics are
+ * loaded into the store and the cost of aggregating every group with
+ * the scalar and vector kernels is compared.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#ifndef WIN32
+#include <unistd.h>
+#else
+#define sleep(x) Sleep(1000 * x)
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define NUMERIC_STORE_X86 1
+#include <immintrin.h>
+#endif
+
+#include <apr.h>
+#include <apr_pools.h>
+#include <apr_thread_mutex.h>
+#include <apr_time.h>
+
+#include "diffusion.h"
+#include "args.h"
+
+ARG_OPTS_T arg_opts[] = {
+        ARG_OPTS_HELP,
+        {'u', "url", "Diffusion server URL", ARG_OPTIONAL, ARG_HAS_VALUE, "ws://localhost:8080"},
+        {'p', "principal", "Principal (username) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "client"},
+        {'c', "credentials", "Credentials (password) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "password"},
+        {'t', "topic_selector", "Topic selector to subscribe to", ARG_OPTIONAL, ARG_HAS_VALUE, "?numeric//"},
+        {'g', "groups", "Comma-separated topic path prefixes to aggregate over", ARG_OPTIONAL, ARG_HAS_VALUE, "numeric/"},
+        {'w', "weights", "Sibling topic names giving values and their weights, as value:weight", ARG_OPTIONAL, ARG_HAS_VALUE, NULL},
+        {'b', "benchmark", "Aggregate this many synthetic topics without a session", ARG_OPTIONAL, ARG_HAS_VALUE, NULL},
+        {'s', "sleep", "Time to run for (in seconds)", ARG_OPTIONAL, ARG_HAS_VALUE, "30"},
+        END_OF_ARG_OPTS
+};
+
+/*
+ * Groups are recorded against each slot in a 32-bit mask.
+ */
+#define MAX_GROUPS 32
+
+/*
+ * Slots are allocated in multiples of a bitmap word, so that a full
+ * word always covers 64 valid slots.
+ */
+#define INITIAL_CAPACITY 1024
+
+#define NO_SLOT -1
+
+typedef struct numeric_aggregate_s {
+        size_t count;
+        double min;
+        double max;
+        double sum;
+        double weighted_sum;
+        double weight_sum;
+} NUMERIC_AGGREGATE_T;
+
+typedef struct numeric_kernels_s {
+        const char *name;
+        // Folds len values and their weights into the aggregate; len is
+        // a multiple of 4.
+        void (*aggregate_block)(const double *values, const double *weights, size_t len,
+                                NUMERIC_AGGREGATE_T *aggregate);
+} NUMERIC_KERNELS_T;
+
+typedef struct numeric_group_s {
+        char *prefix;
+        // One bit per slot.
+        apr_uint64_t *members;
+        // Set when a member changes; the cached aggregate is valid
+        // while it is clear.
+        bool dirty;
+        NUMERIC_AGGREGATE_T cached;
+        unsigned long recomputed;
+        unsigned long reused;
+} NUMERIC_GROUP_T;
+
+typedef struct numeric_store_s {
+        apr_pool_t *pool;
+        apr_thread_mutex_t *mutex;
+        const NUMERIC_KERNELS_T *kernels;
+
+        // Columns, indexed by slot.
+        size_t capacity;
+        size_t slot_count;
+        double *values;
+        int64_t *int64_values;
+        double *weights;
+        int32_t *weight_of;
+        apr_uint32_t *group_masks;
+        DIFFUSION_DATATYPE *datatypes;
+        char **paths;
+        apr_uint64_t *present;
+        apr_uint64_t *changed;
+
+        // Slots released by unsubscriptions, for reuse.
+        int32_t *free_slots;
+        size_t free_count;
+
+        // Topic path to slot + 1; the keys are the paths column.
+        HASH_T *slots_by_path;
+
+        // Topic ID to slot, NO_SLOT where unknown.
+        int32_t *slots_by_id;
+        apr_uint32_t id_capacity;
+
+        NUMERIC_GROUP_T groups[MAX_GROUPS];
+        int group_count;
+
+        // Sibling names of value and weight topics, if weighting.
+        char *value_name;
+        char *weight_name;
+
+        unsigned long updates;
+        unsigned long decode_failures;
+} NUMERIC_STORE_T;
+
+static void
+aggregate_init(NUMERIC_AGGREGATE_T *aggregate)
+{
+        aggregate->count = 0;
+        aggregate->min = HUGE_VAL;
+        aggregate->max = -HUGE_VAL;
+        aggregate->sum = 0;
+        aggregate->weighted_sum = 0;
+        aggregate->weight_sum = 0;
+}
+
+static void
+aggregate_add(NUMERIC_AGGREGATE_T *aggregate, double value, double weight)
+{
+        aggregate->count++;
+        if(value < aggregate->min) {
+                aggregate->min = value;
+        }
+        if(value > aggregate->max) {
+                aggregate->max = value;
+        }
+        aggregate->sum += value;
+        aggregate->weighted_sum += value * weight;
+        aggregate->weight_sum += weight;
+}
+
+static void
+aggregate_block_scalar(const double *values, const double *weights, size_t len,
+                       NUMERIC_AGGREGATE_T *aggregate)
+{
+        for(size_t i = 0; i < len; i++) {
+                aggregate_add(aggregate, values[i], weights[i]);
+        }
+}
+
+static const NUMERIC_KERNELS_T scalar_kernels = {
+        "scalar", aggregate_block_scalar
+};
+
+#ifdef NUMERIC_STORE_X86
+
+__attribute__((target("avx2")))
+static double
+horizontal_min_avx2(__m256d v)
+{
+        __m128d m = _mm_min_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+        m = _mm_min_sd(m, _mm_unpackhi_pd(m, m));
+        return _mm_cvtsd_f64(m);
+}
+
+__attribute__((target("avx2")))
+static double
+horizontal_max_avx2(__m256d v)
+{
+        __m128d m = _mm_max_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+        m = _mm_max_sd(m, _mm_unpackhi_pd(m, m));
+        return _mm_cvtsd_f64(m);
+}
+
+__attribute__((target("avx2")))
+static double
+horizontal_sum_avx2(__m256d v)
+{
+        __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+        s = _mm_add_sd(s, _mm_unpackhi_pd(s, s));
+        return _mm_cvtsd_f64(s);
+}
+
+/*
+ * Four lanes each of min, max and the sums, combined at the end.
+ */
+__attribute__((target("avx2")))
+static void
+aggregate_block_avx2(const double *values, const double *weights, size_t len,
+                     NUMERIC_AGGREGATE_T *aggregate)
+{
+        __m256d min = _mm256_set1_pd(HUGE_VAL);
+        __m256d max = _mm256_set1_pd(-HUGE_VAL);
+        __m256d sum = _mm256_setzero_pd();
+        __m256d weighted_sum = _mm256_setzero_pd();
+        __m256d weight_sum = _mm256_setzero_pd();
+
+        for(size_t i = 0; i < len; i += 4) {
+                const __m256d v = _mm256_loadu_pd(values + i);
+                const __m256d w = _mm256_loadu_pd(weights + i);
+                min = _mm256_min_pd(min, v);
+                max = _mm256_max_pd(max, v);
+                sum = _mm256_add_pd(sum, v);
+                weighted_sum = _mm256_add_pd(weighted_sum, _mm256_mul_pd(v, w));
+                weight_sum = _mm256_add_pd(weight_sum, w);
+        }
+
+        const double block_min = horizontal_min_avx2(min);
+        const double block_max = horizontal_max_avx2(max);
+        aggregate->count += len;
+        if(block_min < aggregate->min) {
+                aggregate->min = block_min;
+        }
+        if(block_max > aggregate->max) {
+                aggregate->max = block_max;
+        }
+        aggregate->sum += horizontal_sum_avx2(sum);
+        aggregate->weighted_sum += horizontal_sum_avx2(weighted_sum);
+        aggregate->weight_sum += horizontal_sum_avx2(weight_sum);
+}
+
+static const NUMERIC_KERNELS_T avx2_kernels = {
+        "avx2", aggregate_block_avx2
+};
+
+#endif
+
+/*
+ * Choose the best kernels for this CPU.
+ */
+static const NUMERIC_KERNELS_T *
+numeric_kernels_select(void)
+{
+#ifdef NUMERIC_STORE_X86
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2")) {
+                return &avx2_kernels;
+        }
+#endif
+        return &scalar_kernels;
+}
+
+static void *
+grow_column(void *column, size_t element_size, size_t old_count, size_t new_count)
+{
+        char *grown = realloc(column, element_size * new_count);
+        memset(grown + element_size * old_count, 0, element_size * (new_count - old_count));
+        return grown;
+}
+
+static NUMERIC_STORE_T *
+numeric_store_create(void)
+{
+        NUMERIC_STORE_T *store = calloc(1, sizeof(NUMERIC_STORE_T));
+        apr_pool_create(&store->pool, NULL);
+        apr_thread_mutex_create(&store->mutex, APR_THREAD_MUTEX_DEFAULT, store->pool);
+        store->kernels = numeric_kernels_select();
+        store->slots_by_path = unsync_hash_new(INITIAL_CAPACITY);
+        return store;
+}
+
+/*
+ * Double the capacity of every column, bitmap and group membership.
+ */
+static void
+numeric_store_grow(NUMERIC_STORE_T *store)
+{
+        const size_t old_capacity = store->capacity;
+        const size_t capacity = old_capacity > 0 ? old_capacity * 2 : INITIAL_CAPACITY;
+
+        store->values = grow_column(store->values, sizeof(double), old_capacity, capacity);
+        store->int64_values = grow_column(store->int64_values, sizeof(int64_t), old_capacity, capacity);
+        store->weights = grow_column(store->weights, sizeof(double), old_capacity, capacity);
+        store->weight_of = grow_column(store->weight_of, sizeof(int32_t), old_capacity, capacity);
+        store->group_masks = grow_column(store->group_masks, sizeof(apr_uint32_t), old_capacity, capacity);
+        store->datatypes = grow_column(store->datatypes, sizeof(DIFFUSION_DATATYPE), old_capacity, capacity);
+        store->paths = grow_column(store->paths, sizeof(char *), old_capacity, capacity);
+        store->present = grow_column(store->present, sizeof(apr_uint64_t), old_capacity / 64, capacity / 64);
+        store->changed = grow_column(store->changed, sizeof(apr_uint64_t), old_capacity / 64, capacity / 64);
+        store->free_slots = realloc(store->free_slots, capacity * sizeof(int32_t));
+        for(int i = 0; i < store->group_count; i++) {
+                NUMERIC_GROUP_T *group = &store->groups[i];
+                group->members = grow_column(group->members, sizeof(apr_uint64_t),
+                                             old_capacity / 64, capacity / 64);
+        }
+        store->capacity = capacity;
+}
+
+static bool
+bit_test(const apr_uint64_t *bitmap, size_t bit)
+{
+        return (bitmap[bit / 64] >> (bit % 64)) & 1;
+}
+
+static void
+bit_set(apr_uint64_t *bitmap, size_t bit)
+{
+        bitmap[bit / 64] |= (apr_uint64_t)1 << (bit % 64);
+}
+
+static void
+bit_clear(apr_uint64_t *bitmap, size_t bit)
+{
+        bitmap[bit / 64] &= ~((apr_uint64_t)1 << (bit % 64));
+}
+
+static int32_t
+numeric_store_lookup(const NUMERIC_STORE_T *store, const char *path)
+{
+        const intptr_t slot = (intptr_t)hash_get(store->slots_by_path, path);
+        return slot > 0 ? (int32_t)(slot - 1) : NO_SLOT;
+}
+
+static void
+mark_groups_dirty(NUMERIC_STORE_T *store, apr_uint32_t mask)
+{
+        for(int i = 0; mask != 0; i++, mask >>= 1) {
+                if(mask & 1) {
+                        store->groups[i].dirty = true;
+                }
+        }
+}
+
+/*
+ * If the path ends in "/<name>", find the slot of its sibling ending
+ * in "/<sibling_name>".
+ */
+static int32_t
+sibling_slot(const NUMERIC_STORE_T *store, const char *path, const char *name, const char *sibling_name)
+{
+        const char *last = strrchr(path, '/');
+        if(last == NULL || strcmp(last + 1, name) != 0) {
+                return NO_SLOT;
+        }
+        const size_t parent_len = last - path + 1;
+        char *sibling = malloc(parent_len + strlen(sibling_name) + 1);
+        memcpy(sibling, path, parent_len);
+        strcpy(sibling + parent_len, sibling_name);
+        const int32_t slot = numeric_store_lookup(store, sibling);
+        free(sibling);
+        return slot;
+}
+
+static bool
+is_weight_path(const NUMERIC_STORE_T *store, const char *path)
+{
+        if(store->weight_name == NULL) {
+                return false;
+        }
+        const char *last = strrchr(path, '/');
+        return last != NULL && strcmp(last + 1, store->weight_name) == 0;
+}
+
+/*
+ * Add a topic to the groups whose prefix it matches. Weight topics
+ * belong to no group.
+ */
+static void
+slot_join_groups(NUMERIC_STORE_T *store, int32_t slot)
+{
+        const char *path = store->paths[slot];
+        if(is_weight_path(store, path)) {
+                return;
+        }
+        for(int i = 0; i < store->group_count; i++) {
+                NUMERIC_GROUP_T *group = &store->groups[i];
+                if(strncmp(path, group->prefix, strlen(group->prefix)) == 0) {
+                        bit_set(group->members, slot);
+                        store->group_masks[slot] |= (apr_uint32_t)1 << i;
+                        group->dirty = true;
+                }
+        }
+}
+
+/*
+ * Find the slot for a topic path, allocating one if the topic is new.
+ * Must be called with the store's mutex held.
+ */
+static int32_t
+numeric_store_slot(NUMERIC_STORE_T *store, const char *path)
+{
+        int32_t slot = numeric_store_lookup(store, path);
+        if(slot != NO_SLOT) {
+                return slot;
+        }
+
+        if(store->free_count > 0) {
+                slot = store->free_slots[--store->free_count];
+        }
+        else {
+                if(store->slot_count == store->capacity) {
+                        numeric_store_grow(store);
+                }
+                slot = store->slot_count++;
+        }
+
+        store->paths[slot] = strdup(path);
+        store->weights[slot] = 0;
+        store->weight_of[slot] = NO_SLOT;
+        store->group_masks[slot] = 0;
+        hash_add(store->slots_by_path, store->paths[slot], (void *)(intptr_t)(slot + 1));
+        slot_join_groups(store, slot);
+
+        if(store->weight_name != NULL) {
+                // Link the topic with its weight, whichever arrives first.
+                const int32_t value_slot = sibling_slot(store, path, store->weight_name, store->value_name);
+                if(value_slot != NO_SLOT) {
+                        store->weight_of[slot] = value_slot;
+                }
+                const int32_t weight_slot = sibling_slot(store, path, store->value_name, store->weight_name);
+                if(weight_slot != NO_SLOT) {
+                        store->weight_of[weight_slot] = slot;
+                        store->weights[slot] = store->values[weight_slot];
+                }
+        }
+        return slot;
+}
+
+/*
+ * Record the server's ID for a topic. Must be called with the store's
+ * mutex held.
+ */
+static void
+numeric_store_add_topic(NUMERIC_STORE_T *store, apr_uint32_t topic_id, const char *path)
+{
+        if(topic_id >= store->id_capacity) {
+                apr_uint32_t capacity = store->id_capacity > 0 ? store->id_capacity : INITIAL_CAPACITY;
+                while(capacity <= topic_id) {
+                        capacity *= 2;
+                }
+                store->slots_by_id = realloc(store->slots_by_id, capacity * sizeof(int32_t));
+                for(apr_uint32_t i = store->id_capacity; i < capacity; i++) {
+                        store->slots_by_id[i] = NO_SLOT;
+                }
+                store->id_capacity = capacity;
+        }
+        store->slots_by_id[topic_id] = numeric_store_slot(store, path);
+}
+
+/*
+ * Forget a topic the session is no longer subscribed to, releasing its
+ * slot for reuse. Must be called with the store's mutex held.
+ */
+static void
+numeric_store_remove_topic(NUMERIC_STORE_T *store, apr_uint32_t topic_id)
+{
+        if(topic_id >= store->id_capacity || store->slots_by_id[topic_id] == NO_SLOT) {
+                return;
+        }
+        const int32_t slot = store->slots_by_id[topic_id];
+        store->slots_by_id[topic_id] = NO_SLOT;
+
+        mark_groups_dirty(store, store->group_masks[slot]);
+        for(int i = 0; i < store->group_count; i++) {
+                bit_clear(store->groups[i].members, slot);
+        }
+        const int32_t weighted = store->weight_of[slot];
+        if(weighted != NO_SLOT) {
+                store->weights[weighted] = 0;
+                mark_groups_dirty(store, store->group_masks[weighted]);
+        }
+        if(store->weight_name != NULL) {
+                const int32_t weight_slot = sibling_slot(store, store->paths[slot],
+                                                         store->value_name, store->weight_name);
+                if(weight_slot != NO_SLOT) {
+                        store->weight_of[weight_slot] = NO_SLOT;
+                }
+        }
+        bit_clear(store->present, slot);
+        bit_clear(store->changed, slot);
+        store->group_masks[slot] = 0;
+        hash_del(store->slots_by_path, store->paths[slot]);
+        free(store->paths[slot]);
+        store->paths[slot] = NULL;
+        store->free_slots[store->free_count++] = slot;
+}
+
+/*
+ * Decode a value into its topic's slot.
+ */
+static void
+numeric_store_update(NUMERIC_STORE_T *store, const char *path,
+                     DIFFUSION_DATATYPE datatype, const DIFFUSION_VALUE_T *value)
+{
+        double double_value = 0;
+        int64_t int64_value = 0;
+        bool decoded = false;
+
+        if(value != NULL && datatype == DATATYPE_DOUBLE) {
+                decoded = read_diffusion_double_value(value, &double_value, NULL);
+                int64_value = (int64_t)double_value;
+        }
+        else if(value != NULL && datatype == DATATYPE_INT64) {
+                decoded = read_diffusion_int64_value(value, &int64_value, NULL);
+                double_value = (double)int64_value;
+        }
+
+        apr_thread_mutex_lock(store->mutex);
+        if(!decoded) {
+                store->decode_failures++;
+                apr_thread_mutex_unlock(store->mutex);
+                return;
+        }
+        const int32_t slot = numeric_store_slot(store, path);
+        store->values[slot] = double_value;
+        store->int64_values[slot] = int64_value;
+        store->datatypes[slot] = datatype;
+        bit_set(store->present, slot);
+        bit_set(store->changed, slot);
+        mark_groups_dirty(store, store->group_masks[slot]);
+
+        const int32_t weighted = store->weight_of[slot];
+        if(weighted != NO_SLOT) {
+                store->weights[weighted] = double_value;
+                mark_groups_dirty(store, store->group_masks[weighted]);
+        }
+        store->updates++;
+        apr_thread_mutex_unlock(store->mutex);
+}
+
+/*
+ * Look up the latest value of a topic by its ID. Returns false if the
+ * topic is unknown or has no value yet.
+ */
+static bool
+numeric_store_get(NUMERIC_STORE_T *store, apr_uint32_t topic_id, double *value)
+{
+        bool found = false;
+        apr_thread_mutex_lock(store->mutex);
+        if(topic_id < store->id_capacity && store->slots_by_id[topic_id] != NO_SLOT) {
+                const int32_t slot = store->slots_by_id[topic_id];
+                if(bit_test(store->present, slot)) {
+                        *value = store->values[slot];
+                        found = true;
+                }
+        }
+        apr_thread_mutex_unlock(store->mutex);
+        return found;
+}
+
+/*
+ * Define a group of topics by path prefix, returning its index or -1
+ * if there are too many groups. Topics already in the store are added
+ * to the group.
+ */
+static int
+numeric_store_add_group(NUMERIC_STORE_T *store, const char *prefix)
+{
+        apr_thread_mutex_lock(store->mutex);
+        if(store->group_count == MAX_GROUPS) {
+                apr_thread_mutex_unlock(store->mutex);
+                return -1;
+        }
+        const int index = store->group_count++;
+        NUMERIC_GROUP_T *group = &store->groups[index];
+        group->prefix = strdup(prefix);
+        group->members = calloc(store->capacity / 64 + 1, sizeof(apr_uint64_t));
+        group->dirty = true;
+        for(size_t slot = 0; slot < store->slot_count; slot++) {
+                if(store->paths[slot] != NULL) {
+                        store->group_masks[slot] &= ~((apr_uint32_t)1 << index);
+                        slot_join_groups(store, slot);
+                }
+        }
+        apr_thread_mutex_unlock(store->mutex);
+        return index;
+}
+
+/*
+ * Aggregate the members of a group which have a value. Words of the
+ * bitmap with every bit set are handed to the block kernel.
+ */
+static void
+group_aggregate(const NUMERIC_STORE_T *store, const NUMERIC_KERNELS_T *kernels,
+                const NUMERIC_GROUP_T *group, NUMERIC_AGGREGATE_T *aggregate)
+{
+        aggregate_init(aggregate);
+        const size_t words = (store->slot_count + 63) / 64;
+        for(size_t w = 0; w < words; w++) {
+                apr_uint64_t bits = group->members[w] & store->present[w];
+                if(bits == 0) {
+                        continue;
+                }
+                const size_t base = w * 64;
+                if(bits == ~(apr_uint64_t)0) {
+                        kernels->aggregate_block(store->values + base, store->weights + base, 64, aggregate);
+                        continue;
+                }
+                while(bits != 0) {
+                        const size_t slot = base + __builtin_ctzll(bits);
+                        aggregate_add(aggregate, store->values[slot], store->weights[slot]);
+                        bits &= bits - 1;
+                }
+        }
+}
+
+/*
+ * Get the aggregate for a group, recomputing it only if a member has
+ * changed since it was last computed.
+ */
+static void
+numeric_store_aggregate(NUMERIC_STORE_T *store, int index, NUMERIC_AGGREGATE_T *aggregate)
+{
+        apr_thread_mutex_lock(store->mutex);
+        NUMERIC_GROUP_T *group = &store->groups[index];
+        if(group->dirty) {
+                group_aggregate(store, store->kernels, group, &group->cached);
+                group->dirty = false;
+                group->recomputed++;
+        }
+        else {
+                group->reused++;
+        }
+        *aggregate = group->cached;
+        apr_thread_mutex_unlock(store->mutex);
+}
+
+/*
+ * Count and clear the topics changed since the last call.
+ */
+static size_t
+numeric_store_take_changed(NUMERIC_STORE_T *store)
+{
+        size_t count = 0;
+        apr_thread_mutex_lock(store->mutex);
+        for(size_t w = 0; w < store->capacity / 64; w++) {
+                count += __builtin_popcountll(store->changed[w]);
+                store->changed[w] = 0;
+        }
+        apr_thread_mutex_unlock(store->mutex);
+        return count;
+}
+
+static void
+numeric_store_free(NUMERIC_STORE_T *store)
+{
+        for(size_t slot = 0; slot < store->slot_count; slot++) {
+                free(store->paths[slot]);
+        }
+        for(int i = 0; i < store->group_count; i++) {
+                free(store->groups[i].prefix);
+                free(store->groups[i].members);
+        }
+        hash_free(store->slots_by_path, NULL, NULL);
+        free(store->values);
+        free(store->int64_values);
+        free(store->weights);
+        free(store->weight_of);
+        free(store->group_masks);
+        free(store->datatypes);
+        free(store->paths);
+        free(store->present);
+        free(store->changed);
+        free(store->free_slots);
+        free(store->slots_by_id);
+        free(store->value_name);
+        free(store->weight_name);
+        apr_thread_mutex_destroy(store->mutex);
+        apr_pool_destroy(store->pool);
+        free(store);
+}
+
+static void
+print_aggregate(const NUMERIC_STORE_T *store, const NUMERIC_GROUP_T *group,
+                const NUMERIC_AGGREGATE_T *aggregate)
+{
+        if(aggregate->count == 0) {
+                printf("  %-24s no values\n", group->prefix);
+                return;
+        }
+        printf("  %-24s %zu topics, min %g, max %g, sum %g, mean %g",
+               group->prefix, aggregate->count, aggregate->min, aggregate->max,
+               aggregate->sum, aggregate->sum / aggregate->count);
+        if(store->weight_name != NULL && aggregate->weight_sum != 0) {
+                printf(", weighted mean %g", aggregate->weighted_sum / aggregate->weight_sum);
+        }
+        printf("\n");
+}
+
+/*
+ * Value stream callback, decoding every value into the store.
+ */
+static int
+on_value(const char *const topic_path,
+         const TOPIC_SPECIFICATION_T *const specification,
+         DIFFUSION_DATATYPE datatype,
+         const DIFFUSION_VALUE_T *const old_value,
+         const DIFFUSION_VALUE_T *const new_value,
+         void *context)
+{
+        numeric_store_update(context, topic_path, datatype, new_value);
+        return HANDLER_SUCCESS;
+}
+
+static int
+on_notify_subscription(SESSION_T *session,
+                       const SVC_NOTIFY_SUBSCRIPTION_REQUEST_T *request,
+                       void *context)
+{
+        NUMERIC_STORE_T *store = context;
+
+        if(request->topic_details != NULL
+           && request->topic_details->topic_type != TOPIC_TYPE_DOUBLE
+           && request->topic_details->topic_type != TOPIC_TYPE_INT64) {
+                return HANDLER_SUCCESS;
+        }
+        apr_thread_mutex_lock(store->mutex);
+        numeric_store_add_topic(store, request->topic_info.topic_id, request->topic_info.topic_path);
+        apr_thread_mutex_unlock(store->mutex);
+        return HANDLER_SUCCESS;
+}
+
+static int
+on_notify_unsubscription(SESSION_T *session,
+                         const SVC_NOTIFY_UNSUBSCRIPTION_REQUEST_T *request,
+                         void *context)
+{
+        NUMERIC_STORE_T *store = context;
+
+        apr_thread_mutex_lock(store->mutex);
+        numeric_store_remove_topic(store, request->topic_id);
+        apr_thread_mutex_unlock(store->mutex);
+        return HANDLER_SUCCESS;
+}
+
+/*
+ * Parse "value:weight" sibling names.
+ */
+static bool
+numeric_store_set_weights(NUMERIC_STORE_T *store, const char *spec)
+{
+        const char *colon = strchr(spec, ':');
+        if(colon == NULL || colon == spec || colon[1] == '\0') {
+                return false;
+        }
+        store->value_name = malloc(colon - spec + 1);
+        memcpy(store->value_name, spec, colon - spec);
+        store->value_name[colon - spec] = '\0';
+        store->weight_name = strdup(colon + 1);
+        return true;
+}
+
+static void
+add_groups(NUMERIC_STORE_T *store, const char *groups)
+{
+        char *list = strdup(groups);
+        char *saveptr = NULL;
+        for(char *prefix = strtok_r(list, ",", &saveptr); prefix != NULL; prefix = strtok_r(NULL, ",", &saveptr)) {
+                if(numeric_store_add_group(store, prefix) < 0) {
+                        printf("Too many groups, ignoring %s\n", prefix);
+                }
+        }
+        free(list);
+}
+
+/*
+ * Load synthetic prices and volumes for topic_count topics spread
+ * over the groups, then time aggregating every group with each set of
+ * kernels.
+ */
+static void
+run_benchmark(long topic_count, int iterations)
+{
+        NUMERIC_STORE_T *store = numeric_store_create();
+        numeric_store_set_weights(store, "price:volume");
+        const int group_count = 16;
+        char buf[256];
+        for(int g = 0; g < group_count; g++) {
+                snprintf(buf, sizeof(buf), "numeric/%d/", g);
+                numeric_store_add_group(store, buf);
+        }
+
+        // Prices are loaded before volumes, as if subscribed to
+        // separately, so that each group's prices occupy adjacent slots.
+        srand(1);
+        apr_thread_mutex_lock(store->mutex);
+        for(long i = 0; i < topic_count; i++) {
+                snprintf(buf, sizeof(buf), "numeric/%ld/%ld/price", i * group_count / topic_count, i);
+                const int32_t slot = numeric_store_slot(store, buf);
+                store->values[slot] = 100.0 + (double)rand() / RAND_MAX;
+                bit_set(store->present, slot);
+        }
+        for(long i = 0; i < topic_count; i++) {
+                snprintf(buf, sizeof(buf), "numeric/%ld/%ld/volume", i * group_count / topic_count, i);
+                const int32_t slot = numeric_store_slot(store, buf);
+                store->values[slot] = rand() % 1000;
+                store->weights[store->weight_of[slot]] = store->values[slot];
+                bit_set(store->present, slot);
+        }
+        apr_thread_mutex_unlock(store->mutex);
+
+        const NUMERIC_KERNELS_T *candidates[] = { &scalar_kernels, store->kernels };
+        const int candidate_count = store->kernels == &scalar_kernels ? 1 : 2;
+        NUMERIC_AGGREGATE_T results[2][16];
+
+        printf("%ld topics with weights in %d groups\n", topic_count, group_count);
+        for(int k = 0; k < candidate_count; k++) {
+                const apr_time_t start = apr_time_now();
+                for(int i = 0; i < iterations; i++) {
+                        for(int g = 0; g < group_count; g++) {
+                                group_aggregate(store, candidates[k], &store->groups[g], &results[k][g]);
+                        }
+                }
+                const apr_interval_time_t elapsed = apr_time_now() - start;
+                printf("%-8s %.3f ms per pass over every group, %.2f ns per topic\n",
+                       candidates[k]->name, (double)elapsed / iterations / 1000,
+                       (double)elapsed * 1000 / iterations / topic_count);
+        }
+
+        if(candidate_count == 2) {
+                // Sums are added in a different order, so only compare
+                // them approximately.
+                bool agree = true;
+                for(int g = 0; g < group_count; g++) {
+                        const NUMERIC_AGGREGATE_T *a = &results[0][g];
+                        const NUMERIC_AGGREGATE_T *b = &results[1][g];
+                        agree = agree && a->count == b->count && a->min == b->min && a->max == b->max
+                                && fabs(a->sum - b->sum) <= 1e-9 * fabs(a->sum)
+                                && fabs(a->weighted_sum - b->weighted_sum) <= 1e-9 * fabs(a->weighted_sum);
+                }
+                printf("Results %s\n", agree ? "agree" : "DIFFER");
+        }
+        print_aggregate(store, &store->groups[0], &results[0][0]);
+
+        numeric_store_free(store);
+}
+
+/*
+ * Entry point for the example.
+ */
+int
+main(int argc, char **argv)
+{
+        /*
+         * Standard command-line parsing.
+         */
+        HASH_T *options = parse_cmdline(argc, argv, arg_opts);
+        if(options == NULL || hash_get(options, "help") != NULL) {
+                show_usage(argc, argv, arg_opts);
+                return EXIT_FAILURE;
+        }
+
+        const char *url = hash_get(options, "url");
+        const char *principal = hash_get(options, "principal");
+        CREDENTIALS_T *credentials = NULL;
+        const char *password = hash_get(options, "credentials");
+        if(password != NULL) {
+                credentials = credentials_create_password(password);
+        }
+        const char *topic_selector = hash_get(options, "topic_selector");
+        const char *weights = hash_get(options, "weights");
+        const char *benchmark = hash_get(options, "benchmark");
+        const unsigned int sleep_time = atol(hash_get(options, "sleep"));
+
+        apr_initialize();
+
+        if(benchmark != NULL) {
+                run_benchmark(atol(benchmark), 100);
+                credentials_free(credentials);
+                hash_free(options, NULL, free);
+                apr_terminate();
+                return EXIT_SUCCESS;
+        }
+
+        NUMERIC_STORE_T *store = numeric_store_create();
+        if(weights != NULL && !numeric_store_set_weights(store, weights)) {
+                printf("Weights must be given as value:weight\n");
+                return EXIT_FAILURE;
+        }
+        add_groups(store, hash_get(options, "groups"));
+        printf("Aggregating with %s kernels\n", store->kernels->name);
+
+        /*
+         * Create a session, synchronously.
+         */
+        DIFFUSION_ERROR_T error = { 0 };
+        SESSION_T *session = session_create(url, principal, credentials, NULL, NULL, &error);
+        if(session == NULL) {
+                printf("Failed to create session: %s\n", error.message);
+                free(error.message);
+                return EXIT_FAILURE;
+        }
+
+        const DIFFUSION_DATATYPE datatypes[] = { DATATYPE_DOUBLE, DATATYPE_INT64 };
+        for(size_t i = 0; i < sizeof(datatypes) / sizeof(datatypes[0]); i++) {
+                VALUE_STREAM_T value_stream = {
+                        .datatype = datatypes[i],
+                        .on_value = on_value,
+                        .context = store
+                };
+                add_stream(session, topic_selector, &value_stream);
+        }
+
+        NOTIFY_SUBSCRIPTION_PARAMS_T notify_subscription_params = {
+                .on_notify_subscription = on_notify_subscription,
+                .context = store
+        };
+        notify_subscription_register(session, notify_subscription_params);
+
+        NOTIFY_UNSUBSCRIPTION_PARAMS_T notify_unsubscription_params = {
+                .on_notify_unsubscription = on_notify_unsubscription,
+                .context = store
+        };
+        notify_unsubscription_register(session, notify_unsubscription_params);
+
+        SUBSCRIPTION_PARAMS_T params = {
+                .topic_selector = topic_selector
+        };
+        subscribe(session, params);
+
+        for(unsigned int t = 0; t < sleep_time; t++) {
+                sleep(1);
+                const size_t changed = numeric_store_take_changed(store);
+
+                apr_thread_mutex_lock(store->mutex);
+                printf("%lu updates, %zu topics changed in the last second, %zu slots in use\n",
+                       store->updates, changed, store->slot_count - store->free_count);
+                const int group_count = store->group_count;
+                apr_thread_mutex_unlock(store->mutex);
+
+                for(int g = 0; g < group_count; g++) {
+                        NUMERIC_AGGREGATE_T aggregate;
+                        numeric_store_aggregate(store, g, &aggregate);
+                        print_aggregate(store, &store->groups[g], &aggregate);
+                }
+
+                double first;
+                if(numeric_store_get(store, 0, &first)) {
+                        printf("  topic 0 = %g\n", first);
+                }
+        }
+
+        /*
+         * Close the session before freeing the store, so that no value
+         * streams can be invoked on it.
+         */
+        session_close(session, NULL);
+        session_free(session);
+        numeric_store_free(store);
+
+        credentials_free(credentials);
+        hash_free(options, NULL, free);
+        apr_terminate();
+
+        return EXIT_SUCCESS;
+}
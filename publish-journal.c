@@ -0,0 +1,1023 @@
+/**
+ * Copyright © 2026 Push Technology Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This example is written in C99. Please use an appropriate C99 capable compiler
+ *
+ * @author Push Technology Limited
+ * @since 6.4
+ */
+
+/*
+ * This example shows a publisher which doesn't lose updates during
+ * long disconnections, and whose memory use doesn't grow with the
+ * length of the outage.
+ *
+ * Updates are only handed to the session while it is connected and
+ * the number of unacknowledged updates is below a window. Otherwise
+ * they are appended to a journal: a memory-mapped, append-only file.
+ * When the session is connected again the journal is replayed in
+ * order, paced by the same window, and new updates keep going to the
+ * journal until it has drained so that ordering is preserved.
+ *
+ * Updates the session discards when it loses its connection were sent
+ * before anything still in the journal, so they are requeued ahead of
+ * it, in the order they were first sent. Run with "-V" to check this
+ * ordering without a server.
+ *
+ * Topics under a configurable path prefix ("-C") are conflated while
+ * in the journal: only the most recent update for each such topic is
+ * replayed, and a discarded update is dropped if a newer one for the
+ * topic has been published since.
+ *
+ * With "-A", the session's recovery buffer is sized from the measured
+ * update rate and size, so that it covers an outage of a given length
+ * ("-O") within byte limits ("-m", "-M"). The recovery buffer's size
+ * is fixed when a session is created, so the window is held within it
+ * and, when the target moves far enough from the current size, the
+ * session is replaced by one with a buffer of the target size once
+ * its updates have been acknowledged. A session whose recovery fails
+ * is also replaced. Updates published in the meantime are journalled,
+ * so none are lost.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include <apr.h>
+#include <apr_atomic.h>
+#include <apr_pools.h>
+#include <apr_thread_mutex.h>
+#include <apr_time.h>
+
+#include "diffusion.h"
+#include "args.h"
+
+ARG_OPTS_T arg_opts[] = {
+        ARG_OPTS_HELP,
+        {'u', "url", "Diffusion server URL", ARG_OPTIONAL, ARG_HAS_VALUE, "ws://localhost:8080"},
+        {'p', "principal", "Principal (username) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "control"},
+        {'c', "credentials", "Credentials (password) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "password"},
+        {'j', "journal", "Journal file", ARG_OPTIONAL, ARG_HAS_VALUE, "/tmp/diffusion-publish.journal"},
+        {'J', "journal_size", "Maximum size of the journal, in MB", ARG_OPTIONAL, ARG_HAS_VALUE, "1024"},
+        {'C', "conflate", "Conflate journalled updates for topics under this path", ARG_OPTIONAL, ARG_HAS_VALUE, NULL},
+        {'w', "window", "Maximum number of unacknowledged updates", ARG_OPTIONAL, ARG_HAS_VALUE, "100"},
+        {'t', "topics", "Number of topics to update", ARG_OPTIONAL, ARG_HAS_VALUE, "100"},
+        {'r', "rate", "Updates per second", ARG_OPTIONAL, ARG_HAS_VALUE, "1000"},
+        {'A', "adaptive", "Size the recovery buffer from the measured update rate", ARG_OPTIONAL, ARG_NO_VALUE, NULL},
+        {'O', "outage", "Outage the recovery buffer should cover, when adaptive (in seconds)", ARG_OPTIONAL, ARG_HAS_VALUE, "5"},
+        {'m', "recovery_min", "Minimum recovery buffer size, when adaptive (in KB)", ARG_OPTIONAL, ARG_HAS_VALUE, "16"},
+        {'M', "recovery_max", "Maximum recovery buffer size, when adaptive (in KB)", ARG_OPTIONAL, ARG_HAS_VALUE, "4096"},
+        {'s', "sleep", "Time to publish for (in seconds).", ARG_OPTIONAL, ARG_HAS_VALUE, "60" },
+        {'V', "verify", "Check the ordering of discarded and journalled updates, then exit", ARG_OPTIONAL, ARG_NO_VALUE, NULL},
+        END_OF_ARG_OPTS
+};
+
+#define TOPIC_ROOT "publish-journal"
+
+/*
+ * Time allowed at the end of the run for the journal to drain.
+ */
+#define DRAIN_TIMEOUT_SECS 30
+
+typedef struct journal_record_s {
+        // Length of the record including this header and padding.
+        apr_uint32_t len;
+        apr_uint32_t path_len;
+        apr_uint32_t value_len;
+        apr_uint32_t datatype;
+        apr_uint64_t seq;
+} JOURNAL_RECORD_T;
+
+struct update_context_s;
+
+typedef struct journal_s {
+        apr_thread_mutex_t *mutex;
+        const char *filename;
+        int fd;
+        unsigned char *map;
+        apr_size_t capacity;
+        // Offset at which the next record will be written.
+        apr_size_t head;
+        // Offset of the next record to be replayed.
+        apr_size_t tail;
+        // Every update, whether journalled or sent directly, takes the
+        // next sequence number, so they order updates by publication.
+        apr_uint64_t next_seq;
+
+        // Discarded updates, in sequence order, to be replayed before
+        // the journal.
+        struct update_context_s *requeued;
+
+        // Topics under this prefix are conflated, or NULL.
+        const char *conflate_prefix;
+        // Sequence number of the latest update published for each
+        // conflated topic. This outlives the journal's records, so
+        // that a late discard can't replace a newer value.
+        HASH_T *latest;
+
+        unsigned long appended;
+        unsigned long requeued_count;
+        unsigned long replayed;
+        unsigned long conflated;
+        unsigned long lost;
+} JOURNAL_T;
+
+/*
+ * Sizes the recovery buffer from the update rate and size. Only used
+ * from the publishing thread, so needs no locking.
+ */
+typedef struct recovery_tuner_s {
+        apr_interval_time_t outage;
+        apr_size_t min_bytes;
+        apr_size_t max_bytes;
+
+        // Updates sent in the current measurement interval.
+        apr_time_t interval_start;
+        unsigned long interval_messages;
+        apr_size_t interval_bytes;
+
+        // Smoothed rate (messages per second) and message size.
+        double rate;
+        double message_size;
+
+        // The buffer size wanted, and that of the current session, in
+        // messages.
+        apr_uint32_t target;
+        apr_uint32_t session_size;
+        unsigned long resizes;
+} RECOVERY_TUNER_T;
+
+typedef struct publisher_s {
+        SESSION_T *session;
+        JOURNAL_T *journal;
+        apr_uint32_t window;
+        // The window asked for; the window in use is held within the
+        // recovery buffer when adaptive.
+        apr_uint32_t max_window;
+        RECOVERY_TUNER_T *tuner;
+        // Set while waiting to replace the session.
+        bool resize_pending;
+        volatile apr_uint32_t in_flight;
+        volatile apr_uint32_t acknowledged;
+        volatile apr_uint32_t failed;
+} PUBLISHER_T;
+
+typedef struct update_context_s {
+        PUBLISHER_T *publisher;
+        apr_uint64_t seq;
+        char *path;
+        DIFFUSION_DATATYPE datatype;
+        BUF_T *value;
+        // Next in the journal's requeued updates.
+        struct update_context_s *next;
+} UPDATE_CONTEXT_T;
+
+static void update_context_free(UPDATE_CONTEXT_T *context);
+
+static JOURNAL_T *
+journal_open(const char *filename, apr_size_t capacity, const char *conflate_prefix, apr_pool_t *pool)
+{
+        int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if(fd < 0) {
+                printf("Failed to open journal %s: %s\n", filename, strerror(errno));
+                return NULL;
+        }
+
+        // The file is sparse; disk space is only used for what is
+        // actually written.
+        if(ftruncate(fd, capacity) < 0) {
+                printf("Failed to size journal %s: %s\n", filename, strerror(errno));
+                close(fd);
+                return NULL;
+        }
+
+        void *map = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(map == MAP_FAILED) {
+                printf("Failed to map journal %s: %s\n", filename, strerror(errno));
+                close(fd);
+                return NULL;
+        }
+
+        JOURNAL_T *journal = calloc(1, sizeof(JOURNAL_T));
+        apr_thread_mutex_create(&journal->mutex, APR_THREAD_MUTEX_DEFAULT, pool);
+        journal->filename = filename;
+        journal->fd = fd;
+        journal->map = map;
+        journal->capacity = capacity;
+        journal->conflate_prefix = conflate_prefix;
+        journal->latest = hash_new(1024);
+        return journal;
+}
+
+static void
+journal_close(JOURNAL_T *journal)
+{
+        munmap(journal->map, journal->capacity);
+        close(journal->fd);
+        unlink(journal->filename);
+        while(journal->requeued != NULL) {
+                UPDATE_CONTEXT_T *context = journal->requeued;
+                journal->requeued = context->next;
+                update_context_free(context);
+        }
+        hash_free(journal->latest, free, free);
+        apr_thread_mutex_destroy(journal->mutex);
+        free(journal);
+}
+
+static bool
+journal_pending(JOURNAL_T *journal)
+{
+        apr_thread_mutex_lock(journal->mutex);
+        const bool pending = journal->tail != journal->head || journal->requeued != NULL;
+        apr_thread_mutex_unlock(journal->mutex);
+        return pending;
+}
+
+static bool
+journal_is_conflated(const JOURNAL_T *journal, const char *path)
+{
+        return journal->conflate_prefix != NULL &&
+                strncmp(path, journal->conflate_prefix, strlen(journal->conflate_prefix)) == 0;
+}
+
+/*
+ * Record that an update has been published for a conflated topic.
+ * Must be called with the journal mutex held.
+ */
+static void
+journal_set_latest(JOURNAL_T *journal, const char *path, apr_uint64_t seq)
+{
+        if(!journal_is_conflated(journal, path)) {
+                return;
+        }
+        apr_uint64_t *latest = hash_get(journal->latest, path);
+        if(latest != NULL) {
+                if(*latest < seq) {
+                        *latest = seq;
+                }
+                return;
+        }
+        latest = malloc(sizeof(apr_uint64_t));
+        *latest = seq;
+        hash_add(journal->latest, strdup(path), latest);
+}
+
+/*
+ * True if a newer update than the given one has been published for a
+ * conflated topic. Must be called with the journal mutex held.
+ */
+static bool
+journal_is_superseded(const JOURNAL_T *journal, const char *path, apr_uint64_t seq)
+{
+        if(!journal_is_conflated(journal, path)) {
+                return false;
+        }
+        const apr_uint64_t *latest = hash_get(journal->latest, path);
+        return latest != NULL && *latest > seq;
+}
+
+/*
+ * Take the sequence number for an update to be sent without being
+ * journalled. Returns false if there are updates waiting to be
+ * replayed, which the update must not overtake.
+ */
+static bool
+journal_sequence(JOURNAL_T *journal, const char *path, apr_uint64_t *seq)
+{
+        apr_thread_mutex_lock(journal->mutex);
+        const bool idle = journal->tail == journal->head && journal->requeued == NULL;
+        if(idle) {
+                *seq = journal->next_seq++;
+                journal_set_latest(journal, path, *seq);
+        }
+        apr_thread_mutex_unlock(journal->mutex);
+        return idle;
+}
+
+/*
+ * Append an update to the journal. Returns false if the journal is
+ * full, in which case the update is lost.
+ */
+static bool
+journal_append(JOURNAL_T *journal, const char *path, DIFFUSION_DATATYPE datatype, const BUF_T *value)
+{
+        const apr_size_t path_len = strlen(path);
+        const apr_size_t len = (sizeof(JOURNAL_RECORD_T) + path_len + 1 + value->len + 7) & ~(apr_size_t)7;
+
+        apr_thread_mutex_lock(journal->mutex);
+        if(journal->head + len > journal->capacity) {
+                journal->lost++;
+                apr_thread_mutex_unlock(journal->mutex);
+                return false;
+        }
+
+        JOURNAL_RECORD_T record = {
+                .len = len,
+                .path_len = path_len,
+                .value_len = value->len,
+                .datatype = datatype,
+                .seq = journal->next_seq++
+        };
+        unsigned char *dst = journal->map + journal->head;
+        memcpy(dst, &record, sizeof(record));
+        memcpy(dst + sizeof(record), path, path_len + 1);
+        memcpy(dst + sizeof(record) + path_len + 1, value->data, value->len);
+        journal->head += len;
+        journal->appended++;
+        journal_set_latest(journal, path, record.seq);
+
+        apr_thread_mutex_unlock(journal->mutex);
+        return true;
+}
+
+/*
+ * Put an update the session discarded back for replay. It was sent
+ * before anything still in the journal, so it goes ahead of the
+ * journal, in sequence order among other discarded updates. Returns
+ * false, leaving the caller to free the update, if a newer update for
+ * a conflated topic has been published since.
+ */
+static bool
+journal_requeue(JOURNAL_T *journal, UPDATE_CONTEXT_T *context)
+{
+        apr_thread_mutex_lock(journal->mutex);
+        if(journal_is_superseded(journal, context->path, context->seq)) {
+                journal->conflated++;
+                apr_thread_mutex_unlock(journal->mutex);
+                return false;
+        }
+
+        UPDATE_CONTEXT_T **link = &journal->requeued;
+        while(*link != NULL && (*link)->seq < context->seq) {
+                link = &(*link)->next;
+        }
+        context->next = *link;
+        *link = context;
+        journal->requeued_count++;
+
+        apr_thread_mutex_unlock(journal->mutex);
+        return true;
+}
+
+/*
+ * Discard everything in the journal once it has been replayed, and
+ * give the disk space back.
+ */
+static void
+journal_reset(JOURNAL_T *journal)
+{
+        journal->head = 0;
+        journal->tail = 0;
+        if(ftruncate(journal->fd, 0) < 0 || ftruncate(journal->fd, journal->capacity) < 0) {
+                printf("Failed to release journal space: %s\n", strerror(errno));
+        }
+}
+
+static void publish_now(PUBLISHER_T *publisher, apr_uint64_t seq, const char *path,
+                        DIFFUSION_DATATYPE datatype, const BUF_T *value);
+
+/*
+ * Take the next update to replay, requeued updates first, skipping
+ * those superseded by conflation. Returns false if there are none.
+ * Must be called with the journal mutex held.
+ */
+static bool
+journal_next(JOURNAL_T *journal, apr_uint64_t *seq, char **path, DIFFUSION_DATATYPE *datatype, BUF_T **value)
+{
+        while(journal->requeued != NULL) {
+                UPDATE_CONTEXT_T *context = journal->requeued;
+                journal->requeued = context->next;
+                if(journal_is_superseded(journal, context->path, context->seq)) {
+                        journal->conflated++;
+                        update_context_free(context);
+                        continue;
+                }
+
+                *seq = context->seq;
+                *path = context->path;
+                *datatype = context->datatype;
+                *value = context->value;
+                free(context);
+                journal->replayed++;
+                return true;
+        }
+
+        while(journal->tail < journal->head) {
+                JOURNAL_RECORD_T record;
+                const unsigned char *src = journal->map + journal->tail;
+                memcpy(&record, src, sizeof(record));
+                journal->tail += record.len;
+
+                const char *record_path = (const char *)src + sizeof(record);
+                if(journal_is_superseded(journal, record_path, record.seq)) {
+                        journal->conflated++;
+                        continue;
+                }
+
+                *seq = record.seq;
+                *path = strdup(record_path);
+                *datatype = record.datatype;
+                *value = buf_create();
+                buf_write_bytes(*value, src + sizeof(record) + record.path_len + 1, record.value_len);
+                journal->replayed++;
+                return true;
+        }
+
+        if(journal->head > 0) {
+                journal_reset(journal);
+        }
+        return false;
+}
+
+/*
+ * Replay journalled updates while the window allows. Returns the
+ * number of updates sent.
+ *
+ * The journal mutex is not held while publishing, because a discarded
+ * update is put back into the journal from the session's threads.
+ */
+static int
+journal_replay(PUBLISHER_T *publisher)
+{
+        JOURNAL_T *journal = publisher->journal;
+        int sent = 0;
+
+        while(apr_atomic_read32(&publisher->in_flight) < publisher->window) {
+                apr_uint64_t seq;
+                char *path;
+                DIFFUSION_DATATYPE datatype;
+                BUF_T *value;
+
+                apr_thread_mutex_lock(journal->mutex);
+                const bool found = journal_next(journal, &seq, &path, &datatype, &value);
+                apr_thread_mutex_unlock(journal->mutex);
+                if(!found) {
+                        break;
+                }
+
+                publish_now(publisher, seq, path, datatype, value);
+                free(path);
+                buf_free(value);
+                sent++;
+        }
+
+        return sent;
+}
+
+/*
+ * Weight given to each new measurement in the smoothed rate and size.
+ */
+#define TUNER_ALPHA 0.3
+
+static void
+recovery_tuner_init(RECOVERY_TUNER_T *tuner, apr_interval_time_t outage,
+                    apr_size_t min_bytes, apr_size_t max_bytes,
+                    double expected_rate, double expected_size)
+{
+        tuner->outage = outage;
+        tuner->min_bytes = min_bytes;
+        tuner->max_bytes = max_bytes > min_bytes ? max_bytes : min_bytes;
+        tuner->interval_start = apr_time_now();
+        tuner->rate = expected_rate;
+        tuner->message_size = expected_size;
+}
+
+/*
+ * The recovery buffer size, in messages, needed to cover the target
+ * outage at the current rate, within the byte limits.
+ */
+static apr_uint32_t
+recovery_tuner_target(const RECOVERY_TUNER_T *tuner)
+{
+        const double size = tuner->message_size > 1 ? tuner->message_size : 1;
+        double target = tuner->rate * tuner->outage / APR_USEC_PER_SEC;
+
+        if(target * size < tuner->min_bytes) {
+                target = tuner->min_bytes / size;
+        }
+        if(target * size > tuner->max_bytes) {
+                target = tuner->max_bytes / size;
+        }
+        return target < 1 ? 1 : (apr_uint32_t)(target + 0.5);
+}
+
+/*
+ * Count an update put on the session. The size is that of the path and
+ * value; the protocol's framing is small by comparison.
+ */
+static void
+recovery_tuner_record(RECOVERY_TUNER_T *tuner, const char *path, const BUF_T *value)
+{
+        tuner->interval_messages++;
+        tuner->interval_bytes += strlen(path) + value->len;
+}
+
+/*
+ * Fold the last interval's measurements in, once a second, and update
+ * the target. Returns true if the target has moved far enough from
+ * the current session's buffer size for the session to be replaced:
+ * above it, or below half of it.
+ */
+static bool
+recovery_tuner_update(RECOVERY_TUNER_T *tuner, apr_time_t now)
+{
+        const apr_interval_time_t elapsed = now - tuner->interval_start;
+        if(elapsed < apr_time_from_sec(1)) {
+                return false;
+        }
+
+        // Intervals with nothing sent, such as during an outage, say
+        // nothing about the rate the buffer has to cope with.
+        if(tuner->interval_messages > 0) {
+                const double rate = tuner->interval_messages * (double)APR_USEC_PER_SEC / elapsed;
+                const double size = (double)tuner->interval_bytes / tuner->interval_messages;
+                tuner->rate += TUNER_ALPHA * (rate - tuner->rate);
+                tuner->message_size += TUNER_ALPHA * (size - tuner->message_size);
+        }
+        tuner->interval_start = now;
+        tuner->interval_messages = 0;
+        tuner->interval_bytes = 0;
+
+        tuner->target = recovery_tuner_target(tuner);
+        return tuner->target > tuner->session_size || tuner->target < tuner->session_size / 2;
+}
+
+static void
+update_context_free(UPDATE_CONTEXT_T *context)
+{
+        free(context->path);
+        buf_free(context->value);
+        free(context);
+}
+
+static int
+on_update(void *context)
+{
+        UPDATE_CONTEXT_T *update = context;
+        apr_atomic_dec32(&update->publisher->in_flight);
+        apr_atomic_inc32(&update->publisher->acknowledged);
+        update_context_free(update);
+        return HANDLER_SUCCESS;
+}
+
+static int
+on_update_error(SESSION_T *session, const DIFFUSION_ERROR_T *error)
+{
+        UPDATE_CONTEXT_T *update = error->context;
+        printf("Update of %s failed: %s\n", update->path, error->message);
+        apr_atomic_dec32(&update->publisher->in_flight);
+        apr_atomic_inc32(&update->publisher->failed);
+        update_context_free(update);
+        return HANDLER_SUCCESS;
+}
+
+/*
+ * The update was never acknowledged, typically because the session
+ * was lost. Requeue it for replay rather than drop it.
+ */
+static int
+on_update_discard(SESSION_T *session, void *context)
+{
+        UPDATE_CONTEXT_T *update = context;
+        PUBLISHER_T *publisher = update->publisher;
+        if(!journal_requeue(publisher->journal, update)) {
+                update_context_free(update);
+        }
+        apr_atomic_dec32(&publisher->in_flight);
+        return HANDLER_SUCCESS;
+}
+
+/*
+ * Track an update handed to the session, until it is acknowledged or
+ * discarded.
+ */
+static UPDATE_CONTEXT_T *
+update_context_create(PUBLISHER_T *publisher, apr_uint64_t seq, const char *path,
+                      DIFFUSION_DATATYPE datatype, const BUF_T *value)
+{
+        UPDATE_CONTEXT_T *context = calloc(1, sizeof(UPDATE_CONTEXT_T));
+        context->publisher = publisher;
+        context->seq = seq;
+        context->path = strdup(path);
+        context->datatype = datatype;
+        context->value = buf_dup(value);
+
+        apr_atomic_inc32(&publisher->in_flight);
+        return context;
+}
+
+static void
+publish_now(PUBLISHER_T *publisher, apr_uint64_t seq, const char *path,
+            DIFFUSION_DATATYPE datatype, const BUF_T *value)
+{
+        UPDATE_CONTEXT_T *context = update_context_create(publisher, seq, path, datatype, value);
+        if(publisher->tuner != NULL) {
+                recovery_tuner_record(publisher->tuner, path, value);
+        }
+
+        DIFFUSION_TOPIC_UPDATE_SET_PARAMS_T params = {
+                .topic_path = path,
+                .datatype = datatype,
+                .update = context->value,
+                .on_topic_update = on_update,
+                .on_error = on_update_error,
+                .on_discard = on_update_discard,
+                .context = context
+        };
+        diffusion_topic_update_set(publisher->session, params);
+}
+
+/*
+ * Publish an update, or journal it if the session can't take it now.
+ */
+static void
+publish(PUBLISHER_T *publisher, const char *path, DIFFUSION_DATATYPE datatype, const BUF_T *value)
+{
+        apr_uint64_t seq;
+        if(session_state_get(publisher->session) != CONNECTED_ACTIVE ||
+           publisher->resize_pending ||
+           apr_atomic_read32(&publisher->in_flight) >= publisher->window ||
+           !journal_sequence(publisher->journal, path, &seq)) {
+                journal_append(publisher->journal, path, datatype, value);
+        }
+        else {
+                publish_now(publisher, seq, path, datatype, value);
+        }
+}
+
+static void
+on_session_state_changed(SESSION_T *session,
+        const SESSION_STATE_T old_state,
+        const SESSION_STATE_T new_state)
+{
+        printf("Session state changed from %s (%d) to %s (%d)\n",
+               session_state_as_string(old_state), old_state,
+               session_state_as_string(new_state), new_state);
+}
+
+static void
+print_stats(const PUBLISHER_T *publisher)
+{
+        const JOURNAL_T *journal = publisher->journal;
+        printf("in-flight=%u acknowledged=%u failed=%u journalled=%lu requeued=%lu replayed=%lu "
+               "conflated=%lu lost=%lu journal-bytes=%lu\n",
+               apr_atomic_read32((volatile apr_uint32_t *)&publisher->in_flight),
+               apr_atomic_read32((volatile apr_uint32_t *)&publisher->acknowledged),
+               apr_atomic_read32((volatile apr_uint32_t *)&publisher->failed),
+               journal->appended, journal->requeued_count, journal->replayed, journal->conflated, journal->lost,
+               (unsigned long)(journal->head - journal->tail));
+
+        const RECOVERY_TUNER_T *tuner = publisher->tuner;
+        if(tuner != NULL) {
+                printf("recovery-target=%u recovery-size=%u window=%u rate=%.0f message-size=%.0f resizes=%lu\n",
+                       tuner->target, tuner->session_size, publisher->window,
+                       tuner->rate, tuner->message_size, tuner->resizes);
+        }
+}
+
+/*
+ * Create the publisher's session. When adaptive, its recovery buffer
+ * is given the tuner's target size, and the window is held within it
+ * so that every unacknowledged update can be recovered.
+ */
+static SESSION_T *
+publisher_connect(PUBLISHER_T *publisher, DIFFUSION_SESSION_FACTORY_T *factory, const char *url)
+{
+        RECOVERY_TUNER_T *tuner = publisher->tuner;
+        if(tuner != NULL) {
+                diffusion_session_factory_recovery_buffer_size(factory, tuner->target);
+        }
+
+        SESSION_T *session = session_create_with_session_factory(factory, url);
+        if(session == NULL || tuner == NULL) {
+                return session;
+        }
+        tuner->session_size = tuner->target;
+        publisher->window = publisher->max_window < tuner->session_size ? publisher->max_window : tuner->session_size;
+        return session;
+}
+
+/*
+ * Replace the session with one whose recovery buffer is the tuner's
+ * target size. This waits until the current session's updates have
+ * all been acknowledged, unless it has closed; new updates are
+ * journalled until then.
+ */
+static void
+publisher_resize(PUBLISHER_T *publisher, DIFFUSION_SESSION_FACTORY_T *factory, const char *url)
+{
+        const bool closed = session_is_closed(publisher->session);
+        if(!closed && apr_atomic_read32(&publisher->in_flight) > 0) {
+                return;
+        }
+
+        const apr_uint32_t old_size = publisher->tuner->session_size;
+        SESSION_T *session = publisher_connect(publisher, factory, url);
+        if(session == NULL) {
+                // Try again on the next pass.
+                return;
+        }
+        printf("Replaced %s session: recovery buffer %u -> %u messages\n",
+               closed ? "closed" : "active", old_size, publisher->tuner->session_size);
+
+        session_close(publisher->session, NULL);
+        session_free(publisher->session);
+        publisher->session = session;
+        publisher->tuner->resizes++;
+        publisher->resize_pending = false;
+}
+
+/*
+ * Check, without a server, that updates discarded at a disconnection
+ * are replayed ahead of those journalled after them, and that a
+ * discarded update never replaces a newer one for a conflated topic.
+ */
+static bool
+verify_journal_ordering(const char *filename, apr_pool_t *pool)
+{
+        static const struct {
+                const char *path;
+                const char *value;
+        } sent[] = {
+                { TOPIC_ROOT "/plain", "1" },
+                { TOPIC_ROOT "/conflated/x", "x1" },
+                { TOPIC_ROOT "/conflated/y", "y1" }
+        }, journalled[] = {
+                { TOPIC_ROOT "/plain", "2" },
+                { TOPIC_ROOT "/conflated/x", "x2" }
+        }, later = {
+                TOPIC_ROOT "/conflated/y", "y2"
+        }, expected[] = {
+                { TOPIC_ROOT "/plain", "1" },
+                { TOPIC_ROOT "/plain", "2" },
+                { TOPIC_ROOT "/conflated/x", "x2" },
+                { TOPIC_ROOT "/conflated/y", "y2" }
+        };
+        const size_t sent_count = sizeof(sent) / sizeof(sent[0]);
+        const size_t expected_count = sizeof(expected) / sizeof(expected[0]);
+
+        PUBLISHER_T publisher = { 0 };
+        publisher.journal = journal_open(filename, 1024 * 1024, TOPIC_ROOT "/conflated/", pool);
+        if(publisher.journal == NULL) {
+                return false;
+        }
+        JOURNAL_T *journal = publisher.journal;
+
+        // Updates sent while connected, as publish_now() tracks them.
+        UPDATE_CONTEXT_T *in_flight[sizeof(sent) / sizeof(sent[0])];
+        for(size_t i = 0; i < sent_count; i++) {
+                BUF_T *value = buf_create();
+                buf_write_bytes(value, sent[i].value, strlen(sent[i].value));
+                apr_uint64_t seq = 0;
+                journal_sequence(journal, sent[i].path, &seq);
+                in_flight[i] = update_context_create(&publisher, seq, sent[i].path, DATATYPE_STRING, value);
+                buf_free(value);
+        }
+
+        // The connection is lost; newer updates are journalled, then
+        // the session discards what was in flight, latest first.
+        for(size_t i = 0; i < sizeof(journalled) / sizeof(journalled[0]); i++) {
+                BUF_T *value = buf_create();
+                buf_write_bytes(value, journalled[i].value, strlen(journalled[i].value));
+                journal_append(journal, journalled[i].path, DATATYPE_STRING, value);
+                buf_free(value);
+        }
+        for(size_t i = sent_count; i > 0; i--) {
+                on_update_discard(NULL, in_flight[i - 1]);
+        }
+
+        // A newer update for a topic whose discarded update has
+        // already been requeued.
+        BUF_T *later_value = buf_create();
+        buf_write_bytes(later_value, later.value, strlen(later.value));
+        journal_append(journal, later.path, DATATYPE_STRING, later_value);
+        buf_free(later_value);
+
+        bool ok = apr_atomic_read32(&publisher.in_flight) == 0;
+        size_t replayed = 0;
+        apr_uint64_t seq;
+        char *path;
+        DIFFUSION_DATATYPE datatype;
+        BUF_T *value;
+        while(journal_next(journal, &seq, &path, &datatype, &value)) {
+                printf("Replayed %s = %.*s\n", path, (int)value->len, value->data);
+                if(replayed >= expected_count ||
+                   strcmp(path, expected[replayed].path) != 0 ||
+                   value->len != strlen(expected[replayed].value) ||
+                   memcmp(value->data, expected[replayed].value, value->len) != 0) {
+                        ok = false;
+                }
+                replayed++;
+                free(path);
+                buf_free(value);
+        }
+        ok = ok && replayed == expected_count;
+
+        journal_close(journal);
+        return ok;
+}
+
+/*
+ * Entry point for the example.
+ */
+int
+main(int argc, char **argv)
+{
+        /*
+         * Standard command-line parsing.
+         */
+        HASH_T *options = parse_cmdline(argc, argv, arg_opts);
+        if(options == NULL || hash_get(options, "help") != NULL) {
+                show_usage(argc, argv, arg_opts);
+                return EXIT_FAILURE;
+        }
+
+        const char *url = hash_get(options, "url");
+        const char *principal = hash_get(options, "principal");
+        CREDENTIALS_T *credentials = NULL;
+        const char *password = hash_get(options, "credentials");
+        if(password != NULL) {
+                credentials = credentials_create_password(password);
+        }
+        const char *journal_filename = hash_get(options, "journal");
+        const apr_size_t journal_size = (apr_size_t)atol(hash_get(options, "journal_size")) * 1024 * 1024;
+        const char *conflate_prefix = hash_get(options, "conflate");
+        const int topic_count = atoi(hash_get(options, "topics"));
+        const int rate = atoi(hash_get(options, "rate"));
+        const unsigned int run_time = atol(hash_get(options, "sleep"));
+        const bool adaptive = hash_get(options, "adaptive") != NULL;
+
+        apr_initialize();
+        apr_pool_t *pool = NULL;
+        apr_pool_create(&pool, NULL);
+
+        if(hash_get(options, "verify") != NULL) {
+                const bool ok = verify_journal_ordering(journal_filename, pool);
+                printf("Journal ordering %s\n", ok ? "verified" : "FAILED");
+                credentials_free(credentials);
+                hash_free(options, NULL, free);
+                apr_pool_destroy(pool);
+                apr_terminate();
+                return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        PUBLISHER_T publisher = { 0 };
+        publisher.max_window = atol(hash_get(options, "window"));
+        publisher.window = publisher.max_window;
+        publisher.journal = journal_open(journal_filename, journal_size, conflate_prefix, pool);
+        if(publisher.journal == NULL || topic_count < 1 || rate < 1) {
+                return EXIT_FAILURE;
+        }
+
+        /*
+         * Until there are measurements, assume the requested rate and
+         * updates the size of the largest path with a short value.
+         */
+        RECOVERY_TUNER_T tuner = { 0 };
+        if(adaptive) {
+                char largest_path[256];
+                snprintf(largest_path, sizeof(largest_path), TOPIC_ROOT "/%d", topic_count - 1);
+                recovery_tuner_init(&tuner,
+                                    apr_time_from_sec(atol(hash_get(options, "outage"))),
+                                    (apr_size_t)atol(hash_get(options, "recovery_min")) * 1024,
+                                    (apr_size_t)atol(hash_get(options, "recovery_max")) * 1024,
+                                    rate, strlen(largest_path) + 8);
+                tuner.target = recovery_tuner_target(&tuner);
+                publisher.tuner = &tuner;
+        }
+
+        SESSION_LISTENER_T session_listener = { 0 };
+        session_listener.on_state_changed = &on_session_state_changed;
+
+        /*
+         * Keep trying to reconnect for as long as we're publishing.
+         */
+        RECONNECTION_STRATEGY_T *reconnection_strategy =
+                make_reconnection_strategy_repeating_attempt(run_time, 1000);
+        reconnection_strategy_set_timeout(reconnection_strategy, run_time * 1000);
+
+        DIFFUSION_SESSION_FACTORY_T *factory = diffusion_session_factory_init();
+        if(principal != NULL) {
+                diffusion_session_factory_principal(factory, principal);
+        }
+        if(credentials != NULL) {
+                diffusion_session_factory_credentials(factory, credentials);
+        }
+        diffusion_session_factory_session_listener(factory, &session_listener);
+        diffusion_session_factory_reconnection_strategy(factory, reconnection_strategy);
+
+        publisher.session = publisher_connect(&publisher, factory, url);
+        if(publisher.session == NULL) {
+                printf("Failed to create session: %s\n", url);
+                return EXIT_FAILURE;
+        }
+
+        /*
+         * Create the topics.
+         */
+        TOPIC_SPECIFICATION_T *specification = topic_specification_init(TOPIC_TYPE_STRING);
+        char path[256];
+        char value_str[64];
+        for(int i = 0; i < topic_count; i++) {
+                snprintf(path, sizeof(path), TOPIC_ROOT "/%d", i);
+                BUF_T *buf = buf_create();
+                write_diffusion_string_value("", buf);
+                DIFFUSION_TOPIC_UPDATE_ADD_AND_SET_PARAMS_T params = {
+                        .topic_path = path,
+                        .specification = specification,
+                        .datatype = DATATYPE_STRING,
+                        .update = buf
+                };
+                diffusion_topic_update_add_and_set(publisher.session, params);
+                buf_free(buf);
+        }
+        topic_specification_free(specification);
+
+        /*
+         * Publish at a fixed rate, replaying the journal whenever the
+         * session can take more.
+         */
+        const apr_interval_time_t interval = APR_USEC_PER_SEC / rate;
+        const apr_time_t end = apr_time_now() + apr_time_from_sec(run_time);
+        apr_time_t next = apr_time_now();
+        apr_time_t next_report = next + apr_time_from_sec(1);
+        unsigned long count = 0;
+
+        while(apr_time_now() < end && (adaptive || !session_is_closed(publisher.session))) {
+                if(adaptive) {
+                        if(recovery_tuner_update(&tuner, apr_time_now()) || session_is_closed(publisher.session)) {
+                                publisher.resize_pending = true;
+                        }
+                        if(publisher.resize_pending) {
+                                publisher_resize(&publisher, factory, url);
+                        }
+                }
+                if(session_state_get(publisher.session) == CONNECTED_ACTIVE && !publisher.resize_pending) {
+                        journal_replay(&publisher);
+                }
+
+                snprintf(path, sizeof(path), TOPIC_ROOT "/%lu", count % topic_count);
+                snprintf(value_str, sizeof(value_str), "%lu", count);
+                BUF_T *value = buf_create();
+                write_diffusion_string_value(value_str, value);
+                publish(&publisher, path, DATATYPE_STRING, value);
+                buf_free(value);
+                count++;
+
+                next += interval;
+                const apr_time_t now = apr_time_now();
+                if(next > now) {
+                        apr_sleep(next - now);
+                }
+                if(now >= next_report) {
+                        print_stats(&publisher);
+                        next_report += apr_time_from_sec(1);
+                }
+        }
+
+        /*
+         * Give the journal a chance to drain before closing.
+         */
+        const apr_time_t drain_end = apr_time_now() + apr_time_from_sec(DRAIN_TIMEOUT_SECS);
+        while((journal_pending(publisher.journal) || apr_atomic_read32(&publisher.in_flight) > 0) &&
+              apr_time_now() < drain_end && !session_is_closed(publisher.session)) {
+                if(session_state_get(publisher.session) == CONNECTED_ACTIVE) {
+                        journal_replay(&publisher);
+                }
+                apr_sleep(1000);
+        }
+        print_stats(&publisher);
+
+        session_close(publisher.session, NULL);
+        session_free(publisher.session);
+        diffusion_session_factory_free(factory);
+        free(reconnection_strategy);
+
+        journal_close(publisher.journal);
+
+        credentials_free(credentials);
+        hash_free(options, NULL, free);
+
+        apr_pool_destroy(pool);
+        apr_terminate();
+
+        return EXIT_SUCCESS;
+}
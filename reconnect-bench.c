@@ -0,0 +1,600 @@
+/**
+ * Copyright © 2026 Push Technology Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This example is written in C99. Please use an appropriate C99 capable compiler
+ *
+ * @author Push Technology Limited
+ * @since 6.4
+ */
+
+/*
+ * This example measures how well a session recovers from network
+ * failures, using impair-proxy to inject them.
+ *
+ * For each impairment profile ("-n", comma separated; a name which is
+ * a readable file is used as an impair-proxy script) the benchmark
+ * starts the proxy, connects a publisher through it and a subscriber
+ * directly to the server, and publishes a sequence number to a single
+ * topic at a fixed rate ("-r") for the duration of the run ("-s").
+ * Updates are only published while the publisher's session is
+ * connected. The topic is reset to 0 before the subscriber subscribes,
+ * and removed after each profile, so that each profile starts afresh.
+ *
+ * For each profile it reports:
+ *
+ *  - how many times the publisher lost its connection, and the time
+ *    from each loss to the session being active again;
+ *  - how many recoveries failed, closing the session;
+ *  - the updates (and their bytes) which were unacknowledged when the
+ *    connection was lost and acknowledged after recovery, which are
+ *    the ones replayed from the session's recovery buffer ("-b" sets
+ *    its size, in messages);
+ *  - the updates which failed or were discarded by the publisher, and
+ *    the sequence numbers the subscriber never saw;
+ *  - the bytes in flight which the proxy discarded at each reset.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <apr.h>
+#include <apr_atomic.h>
+#include <apr_time.h>
+
+#include "diffusion.h"
+#include "args.h"
+
+ARG_OPTS_T arg_opts[] = {
+        ARG_OPTS_HELP,
+        {'u', "url", "Diffusion server URL, for the subscriber", ARG_OPTIONAL, ARG_HAS_VALUE, "ws://localhost:8080"},
+        {'p', "principal", "Principal (username) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "control"},
+        {'c', "credentials", "Credentials (password) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "password"},
+        {'H', "host", "Server host, for the proxy", ARG_OPTIONAL, ARG_HAS_VALUE, "localhost"},
+        {'P', "port", "Server port, for the proxy", ARG_OPTIONAL, ARG_HAS_VALUE, "8080"},
+        {'l', "listen", "Port for the proxy to listen on", ARG_OPTIONAL, ARG_HAS_VALUE, "8081"},
+        {'x', "proxy", "Path of the impair-proxy executable", ARG_OPTIONAL, ARG_HAS_VALUE, "./impair-proxy"},
+        {'n', "profiles", "Comma-separated impairment profiles or script files", ARG_OPTIONAL, ARG_HAS_VALUE, "none,latency,throttle,stall,reset,flaky"},
+        {'b', "recovery_buffer", "Recovery buffer size (in messages)", ARG_OPTIONAL, ARG_HAS_VALUE, "128"},
+        {'r', "rate", "Updates per second", ARG_OPTIONAL, ARG_HAS_VALUE, "500"},
+        {'s', "sleep", "Time to run each profile for (in seconds)", ARG_OPTIONAL, ARG_HAS_VALUE, "30"},
+        END_OF_ARG_OPTS
+};
+
+#define TOPIC_PATH "reconnect-bench/sequence"
+#define MAX_RECOVERIES 1024
+
+/*
+ * Time allowed for the topic to be created or removed (in seconds).
+ */
+#define TOPIC_TIMEOUT_SECS 10
+
+/*
+ * Progress of a topic creation or removal.
+ */
+#define TOPIC_PENDING 0
+#define TOPIC_DONE 1
+#define TOPIC_FAILED 2
+
+typedef struct bench_s {
+        // Publisher.
+        volatile apr_uint32_t epoch;
+        volatile apr_uint32_t acknowledged;
+        volatile apr_uint32_t replayed;
+        volatile apr_uint32_t replayed_bytes;
+        volatile apr_uint32_t failed;
+        volatile apr_uint32_t discarded;
+        unsigned long published;
+        SESSION_STATE_T state;
+        apr_time_t disconnected_at;
+        apr_interval_time_t recoveries[MAX_RECOVERIES];
+        int recovery_count;
+        int failed_recoveries;
+
+        // Topic creation and removal.
+        volatile apr_uint32_t topic_state;
+
+        // Subscriber. Values are ignored until the topic's initial
+        // value has been seen, as the topic may hold the last value of
+        // an earlier run.
+        bool synced;
+        int64_t last_received;
+        unsigned long received;
+        unsigned long gaps;
+        unsigned long out_of_order;
+
+        // Proxy.
+        unsigned long resets;
+        unsigned long discarded_up;
+        unsigned long discarded_down;
+} BENCH_T;
+
+typedef struct update_context_s {
+        BENCH_T *bench;
+        apr_uint32_t epoch;
+        apr_size_t bytes;
+} UPDATE_CONTEXT_T;
+
+/*
+ * Session listeners have no context, so the state callback finds the
+ * profile being run here.
+ */
+static BENCH_T *current_bench;
+
+static void
+on_publisher_state_changed(SESSION_T *session,
+        const SESSION_STATE_T old_state,
+        const SESSION_STATE_T new_state)
+{
+        BENCH_T *bench = current_bench;
+        const apr_time_t now = apr_time_now();
+
+        if(old_state == CONNECTED_ACTIVE && new_state == RECOVERING_RECONNECT) {
+                bench->disconnected_at = now;
+                apr_atomic_inc32(&bench->epoch);
+        }
+        else if(old_state == RECOVERING_RECONNECT && new_state == CONNECTED_ACTIVE) {
+                if(bench->recovery_count < MAX_RECOVERIES) {
+                        bench->recoveries[bench->recovery_count] = now - bench->disconnected_at;
+                }
+                bench->recovery_count++;
+        }
+        else if(old_state == RECOVERING_RECONNECT) {
+                bench->failed_recoveries++;
+        }
+        bench->state = new_state;
+}
+
+/*
+ * An update acknowledged after a disconnection that happened while it
+ * was in flight must have been replayed from the recovery buffer.
+ */
+static int
+on_update(void *context)
+{
+        UPDATE_CONTEXT_T *update = context;
+        apr_atomic_inc32(&update->bench->acknowledged);
+        if(apr_atomic_read32(&update->bench->epoch) != update->epoch) {
+                apr_atomic_inc32(&update->bench->replayed);
+                apr_atomic_add32(&update->bench->replayed_bytes, (apr_uint32_t)update->bytes);
+        }
+        free(update);
+        return HANDLER_SUCCESS;
+}
+
+static int
+on_update_error(SESSION_T *session, const DIFFUSION_ERROR_T *error)
+{
+        UPDATE_CONTEXT_T *update = error->context;
+        apr_atomic_inc32(&update->bench->failed);
+        free(update);
+        return HANDLER_SUCCESS;
+}
+
+static int
+on_update_discard(SESSION_T *session, void *context)
+{
+        UPDATE_CONTEXT_T *update = context;
+        apr_atomic_inc32(&update->bench->discarded);
+        free(update);
+        return HANDLER_SUCCESS;
+}
+
+/*
+ * The subscriber's value stream. Values are sequence numbers, so any
+ * jump forward is a run of lost updates.
+ */
+static int
+on_value(const char *const topic_path,
+         const TOPIC_SPECIFICATION_T *const specification,
+         DIFFUSION_DATATYPE datatype,
+         const DIFFUSION_VALUE_T *const old_value,
+         const DIFFUSION_VALUE_T *const new_value,
+         void *context)
+{
+        BENCH_T *bench = context;
+        int64_t sequence;
+        if(!read_diffusion_int64_value(new_value, &sequence, NULL)) {
+                return HANDLER_SUCCESS;
+        }
+        if(!bench->synced) {
+                bench->synced = sequence == 0;
+                return HANDLER_SUCCESS;
+        }
+
+        if(sequence > bench->last_received + 1) {
+                bench->gaps += sequence - bench->last_received - 1;
+        }
+        else if(sequence <= bench->last_received) {
+                bench->out_of_order++;
+        }
+        if(sequence > bench->last_received) {
+                bench->last_received = sequence;
+        }
+        bench->received++;
+        return HANDLER_SUCCESS;
+}
+
+static int
+on_topic_added(DIFFUSION_TOPIC_CREATION_RESULT_T result, void *context)
+{
+        BENCH_T *bench = context;
+        apr_atomic_set32(&bench->topic_state, TOPIC_DONE);
+        return HANDLER_SUCCESS;
+}
+
+static int
+on_topic_removed(SESSION_T *session, const SVC_TOPIC_REMOVAL_RESPONSE_T *response, void *context)
+{
+        BENCH_T *bench = context;
+        apr_atomic_set32(&bench->topic_state, TOPIC_DONE);
+        return HANDLER_SUCCESS;
+}
+
+static int
+on_topic_error(SESSION_T *session, const DIFFUSION_ERROR_T *error)
+{
+        BENCH_T *bench = error->context;
+        printf("Topic operation failed: %s\n", error->message);
+        apr_atomic_set32(&bench->topic_state, TOPIC_FAILED);
+        return HANDLER_SUCCESS;
+}
+
+static int
+on_topic_discard(SESSION_T *session, void *context)
+{
+        BENCH_T *bench = context;
+        apr_atomic_set32(&bench->topic_state, TOPIC_FAILED);
+        return HANDLER_SUCCESS;
+}
+
+/*
+ * Wait for a topic creation or removal to complete. Returns false if
+ * it failed or timed out.
+ */
+static bool
+topic_wait(BENCH_T *bench)
+{
+        const apr_time_t end = apr_time_now() + apr_time_from_sec(TOPIC_TIMEOUT_SECS);
+        while(apr_atomic_read32(&bench->topic_state) == TOPIC_PENDING && apr_time_now() < end) {
+                apr_sleep(10000);
+        }
+        return apr_atomic_read32(&bench->topic_state) == TOPIC_DONE;
+}
+
+static void
+publish(SESSION_T *session, BENCH_T *bench, int64_t sequence)
+{
+        BUF_T *buf = buf_create();
+        write_diffusion_int64_value(sequence, buf);
+
+        UPDATE_CONTEXT_T *update = calloc(1, sizeof(UPDATE_CONTEXT_T));
+        update->bench = bench;
+        update->epoch = apr_atomic_read32(&bench->epoch);
+        update->bytes = buf->len;
+
+        DIFFUSION_TOPIC_UPDATE_SET_PARAMS_T params = {
+                .topic_path = TOPIC_PATH,
+                .datatype = DATATYPE_INT64,
+                .update = buf,
+                .on_topic_update = on_update,
+                .on_error = on_update_error,
+                .on_discard = on_update_discard,
+                .context = update
+        };
+        diffusion_topic_update_set(session, params);
+        buf_free(buf);
+}
+
+/*
+ * Start impair-proxy, waiting until it is accepting connections.
+ */
+static FILE *
+proxy_start(HASH_T *options, const char *profile, unsigned int run_time)
+{
+        const bool is_file = access(profile, R_OK) == 0;
+        char command[1024];
+        snprintf(command, sizeof(command), "%s -l %s -H %s -P %s %s %s -s %u",
+                 (char *)hash_get(options, "proxy"),
+                 (char *)hash_get(options, "listen"),
+                 (char *)hash_get(options, "host"),
+                 (char *)hash_get(options, "port"),
+                 is_file ? "-f" : "-n", profile, run_time);
+
+        FILE *proxy = popen(command, "r");
+        if(proxy == NULL) {
+                return NULL;
+        }
+        char line[256];
+        while(fgets(line, sizeof(line), proxy) != NULL) {
+                if(strncmp(line, "LISTENING", 9) == 0) {
+                        return proxy;
+                }
+                fputs(line, stdout);
+        }
+        pclose(proxy);
+        return NULL;
+}
+
+/*
+ * Wait for the proxy to exit, collecting its statistics.
+ */
+static void
+proxy_finish(FILE *proxy, BENCH_T *bench)
+{
+        char line[256];
+        while(fgets(line, sizeof(line), proxy) != NULL) {
+                sscanf(line, "STATS connections=%*u resets=%lu up=%*u down=%*u discarded_up=%lu discarded_down=%lu",
+                       &bench->resets, &bench->discarded_up, &bench->discarded_down);
+        }
+        pclose(proxy);
+}
+
+/*
+ * Run one profile. Returns false if the sessions couldn't be set up.
+ */
+static bool
+run_profile(HASH_T *options, const char *profile, BENCH_T *bench)
+{
+        const char *url = hash_get(options, "url");
+        const char *principal = hash_get(options, "principal");
+        const char *password = hash_get(options, "credentials");
+        const int rate = atoi(hash_get(options, "rate"));
+        const unsigned int run_time = atol(hash_get(options, "sleep"));
+
+        // The proxy runs on for a while so that the publisher can close
+        // cleanly and the subscriber catch up.
+        FILE *proxy = proxy_start(options, profile, run_time + 5);
+        if(proxy == NULL) {
+                printf("Failed to start impair-proxy for profile %s\n", profile);
+                return false;
+        }
+
+        current_bench = bench;
+        bench->synced = false;
+        bench->last_received = 0;
+
+        /*
+         * The subscriber connects straight to the server.
+         */
+        CREDENTIALS_T *credentials = credentials_create_password(password);
+        DIFFUSION_ERROR_T error = { 0 };
+        SESSION_T *subscriber = session_create(url, principal, credentials, NULL, NULL, &error);
+        credentials_free(credentials);
+        if(subscriber == NULL) {
+                printf("Failed to create session: %s\n", error.message);
+                free(error.message);
+                proxy_finish(proxy, bench);
+                return false;
+        }
+
+        /*
+         * The publisher connects through the proxy, and keeps trying to
+         * reconnect for the whole run.
+         */
+        char proxy_url[256];
+        snprintf(proxy_url, sizeof(proxy_url), "ws://localhost:%s", (char *)hash_get(options, "listen"));
+
+        SESSION_LISTENER_T session_listener = { 0 };
+        session_listener.on_state_changed = &on_publisher_state_changed;
+        RECONNECTION_STRATEGY_T *reconnection_strategy =
+                make_reconnection_strategy_repeating_attempt(run_time * 10, 100);
+
+        DIFFUSION_SESSION_FACTORY_T *factory = diffusion_session_factory_init();
+        diffusion_session_factory_principal(factory, principal);
+        diffusion_session_factory_password(factory, password);
+        diffusion_session_factory_session_listener(factory, &session_listener);
+        diffusion_session_factory_reconnection_strategy(factory, reconnection_strategy);
+        diffusion_session_factory_reconnection_timeout(factory, run_time * 1000);
+        diffusion_session_factory_recovery_buffer_size(factory, atol(hash_get(options, "recovery_buffer")));
+
+        SESSION_T *publisher = session_create_with_session_factory(factory, proxy_url);
+        diffusion_session_factory_free(factory);
+        free(reconnection_strategy);
+        if(publisher == NULL) {
+                printf("Failed to create session through impair-proxy\n");
+                session_close(subscriber, NULL);
+                session_free(subscriber);
+                proxy_finish(proxy, bench);
+                return false;
+        }
+        bench->state = session_state_get(publisher);
+
+        /*
+         * Create the topic, without conflation so that the subscriber
+         * sees every update, and subscribe to it once it has been
+         * reset, so that the subscriber starts from 0.
+         */
+        HASH_T *properties = hash_new(5);
+        hash_add(properties, DIFFUSION_CONFLATION, "off");
+        TOPIC_SPECIFICATION_T *specification = topic_specification_init_with_properties(TOPIC_TYPE_INT64, properties);
+        BUF_T *buf = buf_create();
+        write_diffusion_int64_value(0, buf);
+        DIFFUSION_TOPIC_UPDATE_ADD_AND_SET_PARAMS_T add_params = {
+                .topic_path = TOPIC_PATH,
+                .specification = specification,
+                .datatype = DATATYPE_INT64,
+                .update = buf,
+                .on_topic_update_add_and_set = on_topic_added,
+                .on_error = on_topic_error,
+                .on_discard = on_topic_discard,
+                .context = bench
+        };
+        apr_atomic_set32(&bench->topic_state, TOPIC_PENDING);
+        diffusion_topic_update_add_and_set(publisher, add_params);
+        buf_free(buf);
+        topic_specification_free(specification);
+        hash_free(properties, NULL, NULL);
+        if(!topic_wait(bench)) {
+                printf("Failed to create %s through impair-proxy\n", TOPIC_PATH);
+                session_close(publisher, NULL);
+                session_free(publisher);
+                session_close(subscriber, NULL);
+                session_free(subscriber);
+                proxy_finish(proxy, bench);
+                current_bench = NULL;
+                return false;
+        }
+
+        VALUE_STREAM_T value_stream = {
+                .datatype = DATATYPE_INT64,
+                .on_value = on_value,
+                .context = bench
+        };
+        add_stream(subscriber, TOPIC_PATH, &value_stream);
+        SUBSCRIPTION_PARAMS_T subscription_params = {
+                .topic_selector = TOPIC_PATH
+        };
+        subscribe(subscriber, subscription_params);
+        sleep(1);
+
+        /*
+         * Publish at a fixed rate while connected.
+         */
+        const apr_interval_time_t interval = APR_USEC_PER_SEC / (rate > 0 ? rate : 1);
+        const apr_time_t end = apr_time_now() + apr_time_from_sec(run_time);
+        apr_time_t next = apr_time_now();
+        while(apr_time_now() < end && !session_is_closed(publisher)) {
+                if(session_state_get(publisher) == CONNECTED_ACTIVE) {
+                        publish(publisher, bench, ++bench->published);
+                }
+                next += interval;
+                const apr_time_t now = apr_time_now();
+                if(next > now) {
+                        apr_sleep(next - now);
+                }
+        }
+
+        // Let the last updates arrive.
+        sleep(2);
+
+        session_close(publisher, NULL);
+        session_free(publisher);
+
+        /*
+         * Remove the topic, so that the next profile's subscriber
+         * doesn't start from this one's last value.
+         */
+        TOPIC_REMOVAL_PARAMS_T removal_params = {
+                .topic_selector = TOPIC_PATH,
+                .on_removed = on_topic_removed,
+                .on_error = on_topic_error,
+                .on_discard = on_topic_discard,
+                .context = bench
+        };
+        apr_atomic_set32(&bench->topic_state, TOPIC_PENDING);
+        topic_removal(subscriber, removal_params);
+        if(!topic_wait(bench)) {
+                printf("Failed to remove %s\n", TOPIC_PATH);
+        }
+
+        session_close(subscriber, NULL);
+        session_free(subscriber);
+
+        // Updates published but never seen at the end of the run are lost
+        // too.
+        if((int64_t)bench->published > bench->last_received) {
+                bench->gaps += bench->published - bench->last_received;
+        }
+
+        proxy_finish(proxy, bench);
+        current_bench = NULL;
+        return true;
+}
+
+static void
+print_result(const char *profile, const BENCH_T *bench)
+{
+        apr_interval_time_t min = 0;
+        apr_interval_time_t max = 0;
+        apr_interval_time_t total = 0;
+        const int samples = bench->recovery_count < MAX_RECOVERIES ? bench->recovery_count : MAX_RECOVERIES;
+        for(int i = 0; i < samples; i++) {
+                const apr_interval_time_t t = bench->recoveries[i];
+                if(i == 0 || t < min) {
+                        min = t;
+                }
+                if(t > max) {
+                        max = t;
+                }
+                total += t;
+        }
+
+        printf("%-10s %5u %5d/%-5d %7.1f %7.1f %7.1f %9lu %9u %7u %9u %7u %7lu %9lu %9lu\n",
+               profile,
+               apr_atomic_read32((volatile apr_uint32_t *)&bench->epoch),
+               bench->recovery_count, bench->failed_recoveries,
+               min / 1000.0, samples > 0 ? total / 1000.0 / samples : 0.0, max / 1000.0,
+               bench->published,
+               apr_atomic_read32((volatile apr_uint32_t *)&bench->acknowledged),
+               apr_atomic_read32((volatile apr_uint32_t *)&bench->replayed),
+               apr_atomic_read32((volatile apr_uint32_t *)&bench->replayed_bytes),
+               apr_atomic_read32((volatile apr_uint32_t *)&bench->failed) +
+               apr_atomic_read32((volatile apr_uint32_t *)&bench->discarded),
+               bench->gaps,
+               bench->discarded_up, bench->discarded_down);
+}
+
+/*
+ * Entry point for the example.
+ */
+int
+main(int argc, char **argv)
+{
+        /*
+         * Standard command-line parsing.
+         */
+        HASH_T *options = parse_cmdline(argc, argv, arg_opts);
+        if(options == NULL || hash_get(options, "help") != NULL) {
+                show_usage(argc, argv, arg_opts);
+                return EXIT_FAILURE;
+        }
+
+        apr_initialize();
+
+        char *profiles = strdup(hash_get(options, "profiles"));
+        int profile_count = 0;
+        for(char *p = profiles; p != NULL; p = strchr(p + 1, ',')) {
+                profile_count++;
+        }
+        BENCH_T *benches = calloc(profile_count, sizeof(BENCH_T));
+        const char **names = calloc(profile_count, sizeof(char *));
+
+        char *saveptr = NULL;
+        int run = 0;
+        for(char *profile = strtok_r(profiles, ",", &saveptr); profile != NULL; profile = strtok_r(NULL, ",", &saveptr)) {
+                printf("Running profile %s\n", profile);
+                if(run_profile(options, profile, &benches[run])) {
+                        names[run++] = profile;
+                }
+        }
+
+        printf("\n%-10s %5s %11s %7s %7s %7s %9s %9s %7s %9s %7s %7s %9s %9s\n",
+               "profile", "drops", "recovered", "min ms", "avg ms", "max ms",
+               "published", "acked", "replay", "replay B", "failed", "lost",
+               "disc up", "disc down");
+        for(int i = 0; i < run; i++) {
+                print_result(names[i], &benches[i]);
+        }
+
+        free(names);
+        free(benches);
+        free(profiles);
+        hash_free(options, NULL, free);
+
+        apr_terminate();
+
+        return EXIT_SUCCESS;
+}
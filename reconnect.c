@@ -21,9 +21,42 @@
 /*
  * This example shows how to make a synchronous connection to
  * Diffusion, with user-provided reconnection logic.
+ *
+ * It also keeps recovery statistics for the session, so that the
+ * recovery buffer can be sized from what the session actually needs:
+ *
+ *  - the number of reconnections, and the time spent in each state;
+ *  - the messages that were unacknowledged at each disconnection, and
+ *    so had to be replayed from the recovery buffer on reconnection;
+ *  - the high-water mark of unacknowledged messages, which is the
+ *    smallest recovery buffer that would have covered every outage;
+ *  - the recoveries that lost state and so forced the application to
+ *    reload everything: those that failed, closing the session, and
+ *    those where the server gave the client a new session.
+ *
+ * A message is known to be acknowledged once a ping sent after it has
+ * been answered, since the server handles a session's messages in
+ * order.
+ *
+ * Ping round trips also feed a smoothed RTT and RTT variance estimate
+ * (as TCP's retransmission timer does), from which the example derives
+ * its timeouts rather than using fixed ones:
+ *
+ *  - a connection is treated as dead if a ping goes unanswered for
+ *    three smoothed RTTs plus four times the variance, and the socket
+ *    is shut down so that the session starts recovering straight away;
+ *  - pings are sent more often on fast links, so that a failure is
+ *    noticed within a few RTTs of it happening;
+ *  - the first reconnection attempt waits for one retransmission
+ *    timeout (smoothed RTT plus four times the variance).
+ *
+ * Until the first round trip has been measured, the fixed defaults
+ * are used. The statistics are printed every few seconds.
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
 #include <time.h>
 #ifndef WIN32
 #include <unistd.h>
@@ -31,6 +64,9 @@
 #define sleep(x) Sleep(1000 * x)
 #endif
 
+#include <apr_network_io.h>
+#include <apr_pools.h>
+#include <apr_thread_mutex.h>
 #include <apr_time.h>
 
 #include "diffusion.h"
@@ -45,6 +81,376 @@ ARG_OPTS_T arg_opts[] = {
         END_OF_ARG_OPTS
 };
 
+#define STATE_COUNT (CLOSED_FAILED - SESSION_STATE_UNKNOWN + 1)
+#define RECENT_RECOVERIES 8
+
+typedef struct recovery_stats_s {
+        apr_thread_mutex_t *mutex;
+
+        SESSION_STATE_T state;
+        apr_time_t state_entered;
+        apr_interval_time_t time_in_state[STATE_COUNT];
+
+        unsigned long reconnections;
+        unsigned long full_reloads;
+        SESSION_ID_T session_id;
+
+        // lastSentSequence as of the latest answered ping; everything up
+        // to it has reached the server.
+        apr_uint32_t acknowledged_sequence;
+        apr_uint32_t unacknowledged_high_water;
+
+        // Unacknowledged messages at each disconnection, most recent last.
+        apr_uint32_t replayed[RECENT_RECOVERIES];
+        unsigned long disconnections;
+        unsigned long replayed_total;
+} RECOVERY_STATS_T;
+
+/*
+ * A copy of the statistics, with the time in the current state
+ * brought up to date.
+ */
+typedef struct recovery_stats_snapshot_s {
+        SESSION_STATE_T state;
+        apr_interval_time_t time_in_state[STATE_COUNT];
+        unsigned long reconnections;
+        unsigned long disconnections;
+        unsigned long full_reloads;
+        unsigned long replayed_total;
+        apr_uint32_t replayed[RECENT_RECOVERIES];
+        int replayed_count;
+        apr_uint32_t unacknowledged;
+        apr_uint32_t unacknowledged_high_water;
+} RECOVERY_STATS_SNAPSHOT_T;
+
+/*
+ * Session listeners have no context, so the statistics for the
+ * session are held here.
+ */
+static RECOVERY_STATS_T recovery_stats;
+
+static void
+recovery_stats_init(apr_pool_t *pool)
+{
+        apr_thread_mutex_create(&recovery_stats.mutex, APR_THREAD_MUTEX_DEFAULT, pool);
+        recovery_stats.state = SESSION_STATE_UNKNOWN;
+        recovery_stats.state_entered = apr_time_now();
+}
+
+static void
+recovery_stats_state_changed(SESSION_T *session, SESSION_STATE_T old_state, SESSION_STATE_T new_state)
+{
+        RECOVERY_STATS_T *stats = &recovery_stats;
+        const apr_time_t now = apr_time_now();
+
+        apr_thread_mutex_lock(stats->mutex);
+        stats->time_in_state[stats->state - SESSION_STATE_UNKNOWN] += now - stats->state_entered;
+        stats->state = new_state;
+        stats->state_entered = now;
+
+        if(old_state == CONNECTED_ACTIVE && new_state == RECOVERING_RECONNECT) {
+                // Anything sent since the last answered ping may not have
+                // reached the server.
+                const apr_uint32_t unacknowledged = session->lastSentSequence - stats->acknowledged_sequence;
+                stats->replayed[stats->disconnections % RECENT_RECOVERIES] = unacknowledged;
+                stats->disconnections++;
+                stats->replayed_total += unacknowledged;
+                if(unacknowledged > stats->unacknowledged_high_water) {
+                        stats->unacknowledged_high_water = unacknowledged;
+                }
+        }
+        else if(old_state == RECOVERING_RECONNECT && new_state == CONNECTED_ACTIVE) {
+                stats->reconnections++;
+                if(session->id != NULL && session_id_cmp(*session->id, stats->session_id) != 0) {
+                        stats->full_reloads++;
+                }
+        }
+        else if(old_state == RECOVERING_RECONNECT) {
+                stats->full_reloads++;
+        }
+
+        if(new_state == CONNECTED_ACTIVE) {
+                if(session->id != NULL) {
+                        stats->session_id = *session->id;
+                }
+                stats->acknowledged_sequence = session->lastSentSequence;
+        }
+        apr_thread_mutex_unlock(stats->mutex);
+}
+
+/*
+ * Record that every message sent before a ping has been acknowledged.
+ */
+static void
+recovery_stats_acknowledged(SESSION_T *session, apr_uint32_t sequence)
+{
+        RECOVERY_STATS_T *stats = &recovery_stats;
+
+        apr_thread_mutex_lock(stats->mutex);
+        // Sequence numbers wrap, so compare by difference.
+        if((apr_int32_t)(sequence - stats->acknowledged_sequence) > 0) {
+                stats->acknowledged_sequence = sequence;
+        }
+        const apr_uint32_t unacknowledged = session->lastSentSequence - stats->acknowledged_sequence;
+        if(unacknowledged > stats->unacknowledged_high_water) {
+                stats->unacknowledged_high_water = unacknowledged;
+        }
+        apr_thread_mutex_unlock(stats->mutex);
+}
+
+static void
+recovery_stats_get(SESSION_T *session, RECOVERY_STATS_SNAPSHOT_T *snapshot)
+{
+        RECOVERY_STATS_T *stats = &recovery_stats;
+
+        apr_thread_mutex_lock(stats->mutex);
+        snapshot->state = stats->state;
+        memcpy(snapshot->time_in_state, stats->time_in_state, sizeof(snapshot->time_in_state));
+        snapshot->time_in_state[stats->state - SESSION_STATE_UNKNOWN] += apr_time_now() - stats->state_entered;
+        snapshot->reconnections = stats->reconnections;
+        snapshot->disconnections = stats->disconnections;
+        snapshot->full_reloads = stats->full_reloads;
+        snapshot->replayed_total = stats->replayed_total;
+        snapshot->replayed_count = stats->disconnections < RECENT_RECOVERIES ? (int)stats->disconnections : RECENT_RECOVERIES;
+        for(int i = 0; i < snapshot->replayed_count; i++) {
+                const unsigned long n = stats->disconnections - snapshot->replayed_count + i;
+                snapshot->replayed[i] = stats->replayed[n % RECENT_RECOVERIES];
+        }
+        snapshot->unacknowledged = session != NULL ? session->lastSentSequence - stats->acknowledged_sequence : 0;
+        snapshot->unacknowledged_high_water = stats->unacknowledged_high_water;
+        apr_thread_mutex_unlock(stats->mutex);
+}
+
+/*
+ * Print the statistics as name=value pairs, for collection by a
+ * metrics agent.
+ */
+static void
+recovery_stats_print(SESSION_T *session)
+{
+        RECOVERY_STATS_SNAPSHOT_T snapshot;
+        recovery_stats_get(session, &snapshot);
+
+        printf("\t--> Recovery: state=%s reconnections=%lu disconnections=%lu full_reloads=%lu "
+               "replayed_total=%lu unacknowledged=%u unacknowledged_high_water=%u\n",
+               session_state_as_string(snapshot.state),
+               snapshot.reconnections, snapshot.disconnections, snapshot.full_reloads,
+               snapshot.replayed_total, snapshot.unacknowledged, snapshot.unacknowledged_high_water);
+
+        printf("\t--> Time in state:");
+        for(int i = 0; i < STATE_COUNT; i++) {
+                if(snapshot.time_in_state[i] > 0) {
+                        printf(" %s=%" APR_INT64_T_FMT "ms",
+                               session_state_as_string(i + SESSION_STATE_UNKNOWN),
+                               (apr_int64_t)apr_time_as_msec(snapshot.time_in_state[i]));
+                }
+        }
+        printf("\n");
+
+        if(snapshot.replayed_count > 0) {
+                printf("\t--> Replayed on recent reconnections:");
+                for(int i = 0; i < snapshot.replayed_count; i++) {
+                        printf(" %u", snapshot.replayed[i]);
+                }
+                printf("\n");
+        }
+
+        if(snapshot.unacknowledged_high_water > DIFFUSION_DEFAULT_RECOVERY_BUFFER_SIZE) {
+                printf("\t--> The recovery buffer (%u messages by default) would not have covered %u unacknowledged messages\n",
+                       DIFFUSION_DEFAULT_RECOVERY_BUFFER_SIZE, snapshot.unacknowledged_high_water);
+        }
+}
+
+/*
+ * Limits on the derived timeouts, and the values used before the RTT
+ * has been measured. The dead connection timeout is never less than
+ * TCP's own minimum retransmission timeout, so that a short pause by
+ * the server on a fast link is not mistaken for a dead connection.
+ */
+#define RTO_MIN apr_time_from_msec(10)
+#define DEAD_TIMEOUT_MIN apr_time_from_msec(200)
+#define TIMEOUT_MAX apr_time_from_sec(10)
+#define KEEPALIVE_MIN apr_time_from_msec(200)
+#define KEEPALIVE_MAX apr_time_from_sec(3)
+
+typedef struct rtt_estimator_s {
+        apr_thread_mutex_t *mutex;
+
+        double srtt;
+        double rttvar;
+        unsigned long samples;
+
+        // The outstanding ping, if any. The epoch changes whenever the
+        // connection is lost, so that a ping which spanned a reconnection
+        // is not taken as a sample.
+        bool ping_outstanding;
+        apr_time_t ping_sent;
+        apr_uint32_t epoch;
+
+        // True between the session reporting CONNECTED_ACTIVE and it
+        // reporting any other state; see force_reconnection().
+        bool connected;
+
+        unsigned long dead_connections;
+} RTT_ESTIMATOR_T;
+
+typedef struct ping_context_s {
+        apr_uint32_t sequence;
+        apr_time_t sent;
+        apr_uint32_t epoch;
+} PING_CONTEXT_T;
+
+static RTT_ESTIMATOR_T rtt_estimator;
+
+static void
+rtt_init(apr_pool_t *pool)
+{
+        apr_thread_mutex_create(&rtt_estimator.mutex, APR_THREAD_MUTEX_DEFAULT, pool);
+}
+
+static apr_interval_time_t
+clamp_interval(double value, apr_interval_time_t min, apr_interval_time_t max)
+{
+        if(value < min) {
+                return min;
+        }
+        return value > max ? max : (apr_interval_time_t)value;
+}
+
+/*
+ * The retransmission timeout: how long a request can take before
+ * something is probably wrong.
+ */
+static apr_interval_time_t
+rtt_rto(const RTT_ESTIMATOR_T *rtt)
+{
+        if(rtt->samples == 0) {
+                return TIMEOUT_MAX;
+        }
+        return clamp_interval(rtt->srtt + 4 * rtt->rttvar, RTO_MIN, TIMEOUT_MAX);
+}
+
+/*
+ * How long a ping may go unanswered before the connection is treated
+ * as dead.
+ */
+static apr_interval_time_t
+rtt_dead_timeout(const RTT_ESTIMATOR_T *rtt)
+{
+        if(rtt->samples == 0) {
+                return TIMEOUT_MAX;
+        }
+        return clamp_interval(3 * rtt->srtt + 4 * rtt->rttvar, DEAD_TIMEOUT_MIN, TIMEOUT_MAX);
+}
+
+/*
+ * The interval between pings on an idle connection, so that a failure
+ * is noticed within a few dead timeouts.
+ */
+static apr_interval_time_t
+rtt_keepalive(const RTT_ESTIMATOR_T *rtt)
+{
+        if(rtt->samples == 0) {
+                return KEEPALIVE_MAX;
+        }
+        return clamp_interval(4.0 * rtt_dead_timeout(rtt), KEEPALIVE_MIN, KEEPALIVE_MAX);
+}
+
+static void
+rtt_sample(RTT_ESTIMATOR_T *rtt, apr_interval_time_t sample)
+{
+        if(rtt->samples == 0) {
+                rtt->srtt = sample;
+                rtt->rttvar = sample / 2.0;
+        }
+        else {
+                const double error = sample - rtt->srtt;
+                rtt->rttvar += ((error < 0 ? -error : error) - rtt->rttvar) / 4;
+                rtt->srtt += error / 8;
+        }
+        rtt->samples++;
+}
+
+static void
+rtt_connection_lost(void)
+{
+        apr_thread_mutex_lock(rtt_estimator.mutex);
+        rtt_estimator.epoch++;
+        rtt_estimator.ping_outstanding = false;
+        rtt_estimator.connected = false;
+        apr_thread_mutex_unlock(rtt_estimator.mutex);
+}
+
+static void
+rtt_connection_established(void)
+{
+        apr_thread_mutex_lock(rtt_estimator.mutex);
+        rtt_estimator.connected = true;
+        apr_thread_mutex_unlock(rtt_estimator.mutex);
+}
+
+/*
+ * Returns true if the outstanding ping has been unanswered for longer
+ * than the dead timeout, in which case it is abandoned.
+ */
+static bool
+rtt_ping_overdue(apr_time_t now)
+{
+        RTT_ESTIMATOR_T *rtt = &rtt_estimator;
+
+        apr_thread_mutex_lock(rtt->mutex);
+        const bool overdue = rtt->ping_outstanding && now - rtt->ping_sent > rtt_dead_timeout(rtt);
+        if(overdue) {
+                rtt->ping_outstanding = false;
+                rtt->epoch++;
+                rtt->dead_connections++;
+        }
+        apr_thread_mutex_unlock(rtt->mutex);
+        return overdue;
+}
+
+static void
+rtt_print(void)
+{
+        RTT_ESTIMATOR_T *rtt = &rtt_estimator;
+
+        apr_thread_mutex_lock(rtt->mutex);
+        printf("\t--> RTT: srtt=%.2fms rttvar=%.2fms rto=%.2fms dead_timeout=%.2fms keepalive=%.2fms samples=%lu dead_connections=%lu\n",
+               rtt->srtt / 1000, rtt->rttvar / 1000,
+               rtt_rto(rtt) / 1000.0, rtt_dead_timeout(rtt) / 1000.0, rtt_keepalive(rtt) / 1000.0,
+               rtt->samples, rtt->dead_connections);
+        apr_thread_mutex_unlock(rtt->mutex);
+}
+
+/*
+ * Shut the session's socket down, so that its read thread fails and
+ * the session starts to recover.
+ *
+ * The C client has no API for abandoning a connection, so this reaches
+ * into session->transport from the application thread, which races
+ * with the library replacing the transport. The race is narrowed, not
+ * removed: the shutdown only happens while the estimator's mutex is
+ * held and the session has not reported leaving CONNECTED_ACTIVE.
+ * Since the library reports the state change before it releases the
+ * transport, and on_session_state_changed() has to take the same mutex
+ * to record it, the transport cannot be replaced while it is in use
+ * here. That ordering is the library's, not a documented guarantee.
+ */
+static void
+force_reconnection(SESSION_T *session)
+{
+        apr_thread_mutex_lock(rtt_estimator.mutex);
+        if(rtt_estimator.connected) {
+                struct transport_s *transport = session->transport;
+                if(transport != NULL && transport->_socket != NULL) {
+                        apr_socket_shutdown(transport->_socket, APR_SHUTDOWN_READWRITE);
+                }
+                // Only once per connection; the read thread will notice.
+                rtt_estimator.connected = false;
+        }
+        apr_thread_mutex_unlock(rtt_estimator.mutex);
+}
+
 /*
  * This callback is used when the session state changes, e.g. when a session
  * moves from a "connecting" to a "connected" state, or from "connected" to
@@ -58,6 +464,13 @@ on_session_state_changed(SESSION_T *session,
         printf("Session state changed from %s (%d) to %s (%d)\n",
                session_state_as_string(old_state), old_state,
                session_state_as_string(new_state), new_state);
+        recovery_stats_state_changed(session, old_state, new_state);
+        if(old_state == CONNECTED_ACTIVE) {
+                rtt_connection_lost();
+        }
+        if(new_state == CONNECTED_ACTIVE) {
+                rtt_connection_established();
+        }
 }
 
 typedef struct {
@@ -98,9 +511,14 @@ backoff_failure(SESSION_T *session, void *args)
 
         BACKOFF_STRATEGY_ARGS_T *backoff_args = args;
 
-        // Exponential backoff.
+        // Exponential backoff, starting from one retransmission timeout.
         if(backoff_args->current_wait == 0) {
-                backoff_args->current_wait = 1;
+                apr_thread_mutex_lock(rtt_estimator.mutex);
+                backoff_args->current_wait = (long)apr_time_as_msec(rtt_rto(&rtt_estimator));
+                apr_thread_mutex_unlock(rtt_estimator.mutex);
+                if(backoff_args->current_wait < 1) {
+                        backoff_args->current_wait = 1;
+                }
         }
         else {
                 backoff_args->current_wait *= 2;
@@ -108,20 +526,81 @@ backoff_failure(SESSION_T *session, void *args)
 }
 
 
+/*
+ * Release a ping that will not be answered, allowing the next one to
+ * be sent. A ping from an earlier connection is no longer outstanding.
+ */
+static void
+ping_abandon(PING_CONTEXT_T *ping)
+{
+        apr_thread_mutex_lock(rtt_estimator.mutex);
+        if(ping->epoch == rtt_estimator.epoch) {
+                rtt_estimator.ping_outstanding = false;
+        }
+        apr_thread_mutex_unlock(rtt_estimator.mutex);
+        free(ping);
+}
+
 static int on_ping_user_error(SESSION_T *session, const DIFFUSION_ERROR_T *error)
 {
         printf("\t--> Ping error: %s\n", error->message);
+        ping_abandon(error->context);
+        return HANDLER_SUCCESS;
+}
+
+static int on_ping_user_discard(SESSION_T *session, void *context)
+{
+        ping_abandon(context);
         return HANDLER_SUCCESS;
 }
 
 static int on_ping_user_response(SESSION_T *session, void *context)
 {
-        int64_t period = session->ping_period;
-        //printf ("\t--> Ping response from server [" "%"PRId64"" "]\n", period);
-        printf ("\t--> Ping response from server [%lld]\n", period);
+        PING_CONTEXT_T *ping = context;
+        const apr_time_t now = apr_time_now();
+
+        apr_thread_mutex_lock(rtt_estimator.mutex);
+        if(ping->epoch == rtt_estimator.epoch) {
+                rtt_sample(&rtt_estimator, now - ping->sent);
+                rtt_estimator.ping_outstanding = false;
+        }
+        apr_thread_mutex_unlock(rtt_estimator.mutex);
+
+        recovery_stats_acknowledged(session, ping->sequence);
+        free(ping);
         return HANDLER_SUCCESS;
 }
 
+/*
+ * Send a ping if none is outstanding and the keepalive interval has
+ * passed since the last was sent.
+ */
+static void
+send_ping(SESSION_T *session, PING_USER_PARAMS_T ping_parameters, apr_time_t now)
+{
+        RTT_ESTIMATOR_T *rtt = &rtt_estimator;
+
+        apr_thread_mutex_lock(rtt->mutex);
+        const bool due = !rtt->ping_outstanding && now - rtt->ping_sent >= rtt_keepalive(rtt);
+        PING_CONTEXT_T *ping = NULL;
+        if(due) {
+                // Messages sent before the ping are acknowledged when it
+                // is answered.
+                ping = malloc(sizeof(PING_CONTEXT_T));
+                ping->sequence = session->lastSentSequence;
+                ping->sent = now;
+                ping->epoch = rtt->epoch;
+                rtt->ping_outstanding = true;
+                rtt->ping_sent = now;
+        }
+        apr_thread_mutex_unlock(rtt->mutex);
+
+        if(ping != NULL) {
+                ping_parameters.context = ping;
+                ping_user(session, ping_parameters);
+        }
+}
+
 /*
  * Entry point for the example.
  */
@@ -147,6 +626,12 @@ main(int argc, char **argv)
 
         const unsigned int sleep_time = atol(hash_get(options, "sleep"));
 
+        apr_initialize();
+        apr_pool_t *pool = NULL;
+        apr_pool_create(&pool, NULL);
+        recovery_stats_init(pool);
+        rtt_init(pool);
+
         printf("\n\n\n\n");
         printf("Connection example with a reconnection strategy\n");
         printf("Connecting to server [%s]\n", url);
@@ -195,18 +680,44 @@ main(int argc, char **argv)
         // With the exception of backoff_args, the reconnection strategy is
         // copied withing session_create() and may be freed now.
         free(reconnection_strategy);
+
+        if(session == NULL) {
+                free(backoff_args);
+                credentials_free(credentials);
+                hash_free(options, NULL, free);
+                apr_pool_destroy(pool);
+                apr_terminate();
+                return EXIT_FAILURE;
+        }
         PING_USER_PARAMS_T ping_parameters = {
                 .on_ping_response = on_ping_user_response,
-                .on_error = on_ping_user_error
+                .on_error = on_ping_user_error,
+                .on_discard = on_ping_user_discard
         };
 
-        for (int i = 0; i < sleep_time; i++)
-        {
-                printf("Pinging server...\n");
-                ping_user(session, ping_parameters);
-                // 
-                printf ("Sleeping for 3 seconds...\n");
-                sleep(3);
+        /*
+         * Keep the connection alive for 3 seconds per "sleep", pinging
+         * at the adaptive interval and checking for a dead connection
+         * every few milliseconds.
+         */
+        const apr_time_t end = apr_time_now() + apr_time_from_sec(3 * sleep_time);
+        apr_time_t next_report = apr_time_now() + apr_time_from_sec(3);
+        for(apr_time_t now = apr_time_now(); now < end; now = apr_time_now()) {
+                if(session_state_get(session) == CONNECTED_ACTIVE) {
+                        if(rtt_ping_overdue(now)) {
+                                printf("\t--> No ping response within the dead timeout; reconnecting\n");
+                                force_reconnection(session);
+                        }
+                        else {
+                                send_ping(session, ping_parameters, now);
+                        }
+                }
+                if(now >= next_report) {
+                        rtt_print();
+                        recovery_stats_print(session);
+                        next_report += apr_time_from_sec(3);
+                }
+                apr_sleep(apr_time_from_msec(5));
         }
 
         /*
@@ -220,5 +731,8 @@ main(int argc, char **argv)
         credentials_free(credentials);
         hash_free(options, NULL, free);
 
+        apr_pool_destroy(pool);
+        apr_terminate();
+
         return EXIT_SUCCESS;
 }
@@ -0,0 +1,268 @@
+/**
+ * Copyright © 2026 Push Technology Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This example is written in C99. Please use an appropriate C99 capable compiler
+ *
+ * @author Push Technology Limited
+ * @since 6.4
+ */
+
+/*
+ * This example measures the memory cost of idle sessions, to help size
+ * processes which hold many thousands of them.
+ *
+ * A number of sessions are opened from a session factory and left
+ * idle, and the growth in resident and virtual memory and in the
+ * number of threads is reported per session.
+ *
+ * With "-m default" the factory is left at its defaults. With
+ * "-m lean" it is configured for a small footprint:
+ *
+ *  - input and output buffers at the minimum message size, as the
+ *    receive buffer is only touched when reading and most idle sessions
+ *    receive little;
+ *  - a small recovery buffer and outbound queue, since idle sessions
+ *    send little (the trade-off being fewer messages which can be
+ *    replayed after a reconnection);
+ *  - on glibc, a smaller default stack for the threads each session
+ *    starts, which otherwise reserve 8MB of address space apiece. The
+ *    default is process-wide, so it is only changed while the sessions
+ *    are created and restored afterwards; threads a session starts
+ *    later, when it reconnects, get the usual stack.
+ *
+ * Where many local consumers want the same topics, sharing a few
+ * sessions through mux-proxy is cheaper still.
+ */
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <apr.h>
+#include <apr_time.h>
+
+#include "diffusion.h"
+#include "args.h"
+
+ARG_OPTS_T arg_opts[] = {
+        ARG_OPTS_HELP,
+        {'u', "url", "Diffusion server URL", ARG_OPTIONAL, ARG_HAS_VALUE, "ws://localhost:8080"},
+        {'p', "principal", "Principal (username) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "client"},
+        {'c', "credentials", "Credentials (password) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "password"},
+        {'n', "sessions", "Number of sessions to open", ARG_OPTIONAL, ARG_HAS_VALUE, "1000"},
+        {'m', "mode", "\"default\" or \"lean\" session configuration", ARG_OPTIONAL, ARG_HAS_VALUE, "lean"},
+        {'r', "recovery", "Recovery buffer size (in messages) for lean sessions", ARG_OPTIONAL, ARG_HAS_VALUE, "16"},
+        {'q', "queue", "Maximum outbound queue size (in messages) for lean sessions", ARG_OPTIONAL, ARG_HAS_VALUE, "256"},
+        {'k', "stack", "Thread stack size (in KB) for lean sessions, 0 for the system default", ARG_OPTIONAL, ARG_HAS_VALUE, "256"},
+        {'s', "sleep", "Time to leave the sessions idle before measuring (in seconds)", ARG_OPTIONAL, ARG_HAS_VALUE, "5"},
+        END_OF_ARG_OPTS
+};
+
+/*
+ * The per-session budget this example reports against.
+ */
+#define TARGET_BYTES_PER_SESSION (64 * 1024)
+
+typedef struct footprint_s {
+        long rss_kb;
+        long vm_kb;
+        long threads;
+} FOOTPRINT_T;
+
+/*
+ * Read the process's memory use and thread count. Only available on
+ * Linux; elsewhere every field is left at -1.
+ */
+static void
+footprint_read(FOOTPRINT_T *footprint)
+{
+        footprint->rss_kb = -1;
+        footprint->vm_kb = -1;
+        footprint->threads = -1;
+
+        FILE *status = fopen("/proc/self/status", "r");
+        if(status == NULL) {
+                return;
+        }
+        char line[256];
+        while(fgets(line, sizeof(line), status) != NULL) {
+                sscanf(line, "VmRSS: %ld", &footprint->rss_kb);
+                sscanf(line, "VmSize: %ld", &footprint->vm_kb);
+                sscanf(line, "Threads: %ld", &footprint->threads);
+        }
+        fclose(status);
+}
+
+static DIFFUSION_SESSION_FACTORY_T *
+create_factory(HASH_T *options, int lean)
+{
+        DIFFUSION_SESSION_FACTORY_T *factory = diffusion_session_factory_init();
+        diffusion_session_factory_principal(factory, hash_get(options, "principal"));
+        diffusion_session_factory_password(factory, hash_get(options, "credentials"));
+
+        if(!lean) {
+                return factory;
+        }
+
+        diffusion_session_factory_input_buffer_size(factory, DIFFUSION_MAXIMUM_MESSAGE_SIZE_MINIMUM);
+        diffusion_session_factory_output_buffer_size(factory, DIFFUSION_MAXIMUM_MESSAGE_SIZE_MINIMUM);
+        diffusion_session_factory_recovery_buffer_size(factory, atoi(hash_get(options, "recovery")));
+        diffusion_session_factory_maximum_queue_size(factory, atoi(hash_get(options, "queue")));
+        return factory;
+}
+
+#if defined(__GLIBC__)
+/*
+ * Sessions create their threads without explicit attributes, so they
+ * pick up the process default stack size. That default applies to
+ * every thread the process creates, so the previous default is saved
+ * and must be put back with thread_stack_restore().
+ */
+static bool
+thread_stack_set(size_t stack_kb, pthread_attr_t *saved)
+{
+        if(pthread_getattr_default_np(saved) != 0) {
+                printf("Unable to set the thread stack size to %zuKB\n", stack_kb);
+                return false;
+        }
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        const bool set = pthread_attr_setstacksize(&attr, stack_kb * 1024) == 0
+                         && pthread_setattr_default_np(&attr) == 0;
+        pthread_attr_destroy(&attr);
+        if(!set) {
+                printf("Unable to set the thread stack size to %zuKB\n", stack_kb);
+                pthread_attr_destroy(saved);
+        }
+        return set;
+}
+
+static void
+thread_stack_restore(pthread_attr_t *saved)
+{
+        pthread_setattr_default_np(saved);
+        pthread_attr_destroy(saved);
+}
+#endif
+
+static void
+print_per_session(const char *label, long before, long after, int count)
+{
+        if(before < 0 || after < 0) {
+                printf("%-10s unavailable\n", label);
+                return;
+        }
+        printf("%-10s %8ld KB total, %8.1f KB per session\n",
+               label, after - before, (double)(after - before) / count);
+}
+
+/*
+ * Entry point for the example.
+ */
+int
+main(int argc, char **argv)
+{
+        /*
+         * Standard command-line parsing.
+         */
+        HASH_T *options = parse_cmdline(argc, argv, arg_opts);
+        if(options == NULL || hash_get(options, "help") != NULL) {
+                show_usage(argc, argv, arg_opts);
+                return EXIT_FAILURE;
+        }
+
+        const char *url = hash_get(options, "url");
+        const int session_count = atoi(hash_get(options, "sessions"));
+        const int lean = strcmp(hash_get(options, "mode"), "default") != 0;
+        const unsigned int sleep_time = atoi(hash_get(options, "sleep"));
+
+        apr_initialize();
+
+        DIFFUSION_SESSION_FACTORY_T *factory = create_factory(options, lean);
+        SESSION_T **sessions = calloc(session_count, sizeof(SESSION_T *));
+
+        FOOTPRINT_T before;
+        footprint_read(&before);
+
+        const size_t stack_kb = lean ? atoi(hash_get(options, "stack")) : 0;
+#if defined(__GLIBC__)
+        pthread_attr_t saved_attr;
+        const bool stack_set = stack_kb > 0 && thread_stack_set(stack_kb, &saved_attr);
+#else
+        if(stack_kb > 0) {
+                printf("Setting the thread stack size is not supported on this platform\n");
+        }
+#endif
+
+        const apr_time_t start = apr_time_now();
+        int opened = 0;
+        for(int i = 0; i < session_count; i++) {
+                sessions[i] = session_create_with_session_factory(factory, url);
+                if(sessions[i] == NULL) {
+                        printf("Failed to create session %d\n", i);
+                        break;
+                }
+                opened++;
+                if(opened % 1000 == 0) {
+                        printf("%d sessions open\n", opened);
+                }
+        }
+        const apr_interval_time_t elapsed = apr_time_now() - start;
+#if defined(__GLIBC__)
+        if(stack_set) {
+                thread_stack_restore(&saved_attr);
+        }
+#endif
+
+        if(opened > 0) {
+                printf("Opened %d %s sessions in %.1fs, idling for %us\n",
+                       opened, lean ? "lean" : "default",
+                       (double)elapsed / APR_USEC_PER_SEC, sleep_time);
+                apr_sleep(apr_time_from_sec(sleep_time));
+
+                FOOTPRINT_T after;
+                footprint_read(&after);
+
+                print_per_session("Resident", before.rss_kb, after.rss_kb, opened);
+                print_per_session("Virtual", before.vm_kb, after.vm_kb, opened);
+                if(before.threads >= 0 && after.threads >= 0) {
+                        printf("%-10s %8ld total, %8.1f per session\n", "Threads",
+                               after.threads - before.threads,
+                               (double)(after.threads - before.threads) / opened);
+                }
+                if(before.rss_kb >= 0 && after.rss_kb >= 0) {
+                        const double per_session = (double)(after.rss_kb - before.rss_kb) * 1024 / opened;
+                        printf("Resident memory per session is %s the %dKB target\n",
+                               per_session <= TARGET_BYTES_PER_SESSION ? "within" : "above",
+                               TARGET_BYTES_PER_SESSION / 1024);
+                }
+        }
+
+        for(int i = 0; i < opened; i++) {
+                session_close(sessions[i], NULL);
+                session_free(sessions[i]);
+        }
+        free(sessions);
+        diffusion_session_factory_free(factory);
+        hash_free(options, NULL, free);
+
+        apr_terminate();
+
+        return EXIT_SUCCESS;
+}
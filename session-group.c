@@ -0,0 +1,662 @@
+/**
+ * Copyright © 2026 Push Technology Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This example is written in C99. Please use an appropriate C99 capable compiler
+ *
+ * @author Push Technology Limited
+ * @since 6.4
+ */
+
+/*
+ * This example spreads a client's subscriptions over a group of
+ * sessions, so that receiving and decoding values uses several cores.
+ *
+ * Each session reads and decodes its inbound messages, and runs its
+ * value streams, on its own read thread. A session group opens a
+ * number of sessions ("shards") from one session factory and gives
+ * each subscribed selector to the shard with the fewest selectors, so
+ * with several selectors ("-t", comma separated) the work is spread
+ * over as many threads as there are shards.
+ *
+ * The group looks like a single session to the application:
+ *
+ *  - session_group_add_stream() adds a value stream to every shard;
+ *  - session_group_subscribe() places a selector on a shard;
+ *  - session_group_get_value() returns the latest value of any topic
+ *    the group is subscribed to, whichever shard it arrived on.
+ *
+ * Each topic belongs to exactly one shard: the first to be subscribed
+ * to it or to receive a value for it. If selectors on different shards
+ * overlap, values for the topic from the other shards are dropped, so
+ * the application's streams see each update once and in order. When
+ * the owning shard is unsubscribed from the topic, ownership passes to
+ * another shard still subscribed to it without the application being
+ * told; the application's streams only see the unsubscription once no
+ * shard is subscribed. Likewise, a stream's on_error is called once
+ * for the group, with the stream's own context, and its on_close when
+ * the group is freed.
+ *
+ * Partitioning by selector is the finest split available, as the
+ * server decides which topics a session receives from the selectors
+ * it subscribes with; topics matched by a single selector are all
+ * received by one shard.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#ifndef WIN32
+#include <unistd.h>
+#else
+#define sleep(x) Sleep(1000 * x)
+#endif
+
+#include <apr.h>
+#include <apr_atomic.h>
+#include <apr_pools.h>
+#include <apr_thread_mutex.h>
+
+#include "diffusion.h"
+#include "args.h"
+
+ARG_OPTS_T arg_opts[] = {
+        ARG_OPTS_HELP,
+        {'u', "url", "Diffusion server URL", ARG_OPTIONAL, ARG_HAS_VALUE, "ws://localhost:8080"},
+        {'p', "principal", "Principal (username) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "client"},
+        {'c', "credentials", "Credentials (password) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "password"},
+        {'t', "topic_selector", "Comma-separated topic selectors to subscribe to", ARG_OPTIONAL, ARG_HAS_VALUE, "?.*//"},
+        {'k', "shards", "Number of sessions in the group", ARG_OPTIONAL, ARG_HAS_VALUE, "4"},
+        {'r', "read", "Topic path to look up in the group's cache each second", ARG_OPTIONAL, ARG_HAS_VALUE, "foo"},
+        {'s', "sleep", "Time to run for (in seconds)", ARG_OPTIONAL, ARG_HAS_VALUE, "30"},
+        END_OF_ARG_OPTS
+};
+
+/*
+ * The topic ownership table is split into stripes, each with its own
+ * lock, so that shards rarely contend on it. Must be a power of two.
+ */
+#define OWNER_STRIPES 64
+
+typedef struct session_group_s SESSION_GROUP_T;
+
+typedef struct session_shard_s {
+        SESSION_GROUP_T *group;
+        int index;
+        SESSION_T *session;
+        int selector_count;
+
+        // Latest value of each topic this shard has owned, held in a
+        // slot that is emptied when ownership is given up. Written on the
+        // shard's read thread; the mutex is only contended by
+        // session_group_get_value().
+        apr_thread_mutex_t *mutex;
+        HASH_T *values;
+
+        volatile apr_uint32_t received;
+        volatile apr_uint32_t delivered;
+        volatile apr_uint32_t duplicates;
+        volatile apr_uint32_t owned;
+} SESSION_SHARD_T;
+
+/*
+ * The shards subscribed to a topic, and which of them owns it.
+ */
+typedef struct topic_owner_s {
+        // Owning shard index + 1, or 0 if none.
+        int owner;
+        // The shard which last gave the topic up with no other shard
+        // subscribed to take it over, index + 1.
+        int released_by;
+        bool subscribed[];
+} TOPIC_OWNER_T;
+
+typedef struct owner_stripe_s {
+        apr_thread_mutex_t *mutex;
+        // Topic path to TOPIC_OWNER_T.
+        HASH_T *owners;
+} OWNER_STRIPE_T;
+
+/*
+ * An application value stream as added to one shard. The copy added
+ * to the first shard stands for the stream as a whole.
+ */
+typedef struct group_stream_s {
+        SESSION_SHARD_T *shard;
+        VALUE_STREAM_T stream;
+        struct group_stream_s *primary;
+        volatile apr_uint32_t error_reported;
+        struct group_stream_s *next;
+} GROUP_STREAM_T;
+
+struct session_group_s {
+        apr_pool_t *pool;
+        SESSION_SHARD_T *shards;
+        int shard_count;
+        OWNER_STRIPE_T stripes[OWNER_STRIPES];
+        // Every stream added, freed with the group.
+        GROUP_STREAM_T *streams;
+        apr_thread_mutex_t *mutex;
+};
+
+static apr_uint32_t
+hash_path(const char *path)
+{
+        // FNV-1a
+        apr_uint32_t hash = 2166136261u;
+        for(const unsigned char *p = (const unsigned char *)path; *p != '\0'; p++) {
+                hash ^= *p;
+                hash *= 16777619u;
+        }
+        return hash;
+}
+
+static OWNER_STRIPE_T *
+owner_stripe(SESSION_GROUP_T *group, const char *path)
+{
+        return &group->stripes[hash_path(path) & (OWNER_STRIPES - 1)];
+}
+
+/*
+ * Returns true if the shard owns the topic, recording that the shard
+ * is subscribed to it and claiming it if no shard owns it.
+ */
+static bool
+shard_claim(SESSION_SHARD_T *shard, const char *path)
+{
+        SESSION_GROUP_T *group = shard->group;
+        OWNER_STRIPE_T *stripe = owner_stripe(group, path);
+
+        apr_thread_mutex_lock(stripe->mutex);
+        TOPIC_OWNER_T *owner = hash_get(stripe->owners, path);
+        if(owner == NULL) {
+                owner = calloc(1, sizeof(TOPIC_OWNER_T) + group->shard_count * sizeof(bool));
+                hash_add(stripe->owners, strdup(path), owner);
+        }
+        owner->subscribed[shard->index] = true;
+        if(owner->owner == 0) {
+                owner->owner = shard->index + 1;
+                owner->released_by = 0;
+                apr_atomic_inc32(&shard->owned);
+        }
+        const bool owned = owner->owner == shard->index + 1;
+        apr_thread_mutex_unlock(stripe->mutex);
+
+        return owned;
+}
+
+/*
+ * Record that the shard is no longer subscribed to a topic. If it owned
+ * the topic, ownership passes to another subscribed shard, whose index
+ * is returned in successor (or -1 if there is none). Returns true if
+ * no shard is left subscribed and the shard was the last owner, so the
+ * application should be told of the unsubscription.
+ */
+static bool
+shard_release(SESSION_SHARD_T *shard, const char *path, int *successor)
+{
+        SESSION_GROUP_T *group = shard->group;
+        OWNER_STRIPE_T *stripe = owner_stripe(group, path);
+        bool unsubscribed = false;
+        *successor = -1;
+
+        apr_thread_mutex_lock(stripe->mutex);
+        TOPIC_OWNER_T *owner = hash_get(stripe->owners, path);
+        if(owner != NULL) {
+                owner->subscribed[shard->index] = false;
+                if(owner->owner == shard->index + 1) {
+                        apr_atomic_dec32(&shard->owned);
+                        owner->owner = 0;
+                        for(int i = 0; i < group->shard_count; i++) {
+                                if(owner->subscribed[i]) {
+                                        owner->owner = i + 1;
+                                        apr_atomic_inc32(&group->shards[i].owned);
+                                        *successor = i;
+                                        break;
+                                }
+                        }
+                        if(owner->owner == 0) {
+                                owner->released_by = shard->index + 1;
+                        }
+                }
+                // Every stream of the last owner sees the unsubscription.
+                unsubscribed = owner->owner == 0 && owner->released_by == shard->index + 1;
+        }
+        apr_thread_mutex_unlock(stripe->mutex);
+
+        return unsubscribed;
+}
+
+/*
+ * Replace the shard's cached value of a topic; a NULL value removes
+ * it. The cache's entries are updated in place so a key is only
+ * allocated once per topic.
+ */
+static void
+shard_cache_put(SESSION_SHARD_T *shard, const char *path, const DIFFUSION_VALUE_T *value)
+{
+        DIFFUSION_VALUE_T *copy = value != NULL ? diffusion_value_dup(value) : NULL;
+        DIFFUSION_VALUE_T *old = NULL;
+
+        apr_thread_mutex_lock(shard->mutex);
+        DIFFUSION_VALUE_T **slot = hash_get(shard->values, path);
+        if(slot != NULL) {
+                old = *slot;
+                *slot = copy;
+        }
+        else if(copy != NULL) {
+                slot = malloc(sizeof(DIFFUSION_VALUE_T *));
+                *slot = copy;
+                hash_add(shard->values, strdup(path), slot);
+        }
+        apr_thread_mutex_unlock(shard->mutex);
+
+        if(old != NULL) {
+                diffusion_value_free(old);
+        }
+}
+
+/*
+ * Remove the shard's cached value of a topic and return it, or NULL.
+ */
+static DIFFUSION_VALUE_T *
+shard_cache_take(SESSION_SHARD_T *shard, const char *path)
+{
+        DIFFUSION_VALUE_T *value = NULL;
+
+        apr_thread_mutex_lock(shard->mutex);
+        DIFFUSION_VALUE_T **slot = hash_get(shard->values, path);
+        if(slot != NULL) {
+                value = *slot;
+                *slot = NULL;
+        }
+        apr_thread_mutex_unlock(shard->mutex);
+        return value;
+}
+
+/*
+ * Give a shard which has taken over a topic the previous owner's
+ * value, unless a newer one has already arrived. Takes ownership of
+ * the value.
+ */
+static void
+shard_cache_offer(SESSION_SHARD_T *shard, const char *path, DIFFUSION_VALUE_T *value)
+{
+        apr_thread_mutex_lock(shard->mutex);
+        DIFFUSION_VALUE_T **slot = hash_get(shard->values, path);
+        if(slot == NULL) {
+                slot = calloc(1, sizeof(DIFFUSION_VALUE_T *));
+                hash_add(shard->values, strdup(path), slot);
+        }
+        if(*slot == NULL) {
+                *slot = value;
+                value = NULL;
+        }
+        apr_thread_mutex_unlock(shard->mutex);
+
+        if(value != NULL) {
+                diffusion_value_free(value);
+        }
+}
+
+/*
+ * Value stream callbacks, invoked on a shard's read thread. Values
+ * reach the application's stream only from the topic's owner.
+ */
+static int
+on_shard_value(const char *const topic_path,
+               const TOPIC_SPECIFICATION_T *const specification,
+               DIFFUSION_DATATYPE datatype,
+               const DIFFUSION_VALUE_T *const old_value,
+               const DIFFUSION_VALUE_T *const new_value,
+               void *context)
+{
+        GROUP_STREAM_T *group_stream = context;
+        SESSION_SHARD_T *shard = group_stream->shard;
+
+        apr_atomic_inc32(&shard->received);
+        if(!shard_claim(shard, topic_path)) {
+                apr_atomic_inc32(&shard->duplicates);
+                return HANDLER_SUCCESS;
+        }
+        shard_cache_put(shard, topic_path, new_value);
+        apr_atomic_inc32(&shard->delivered);
+
+        if(group_stream->stream.on_value == NULL) {
+                return HANDLER_SUCCESS;
+        }
+        return group_stream->stream.on_value(topic_path, specification, datatype,
+                                             old_value, new_value, group_stream->stream.context);
+}
+
+static int
+on_shard_subscription(const char *const topic_path,
+                      const TOPIC_SPECIFICATION_T *specification,
+                      void *context)
+{
+        GROUP_STREAM_T *group_stream = context;
+
+        if(!shard_claim(group_stream->shard, topic_path) || group_stream->stream.on_subscription == NULL) {
+                return HANDLER_SUCCESS;
+        }
+        return group_stream->stream.on_subscription(topic_path, specification, group_stream->stream.context);
+}
+
+static int
+on_shard_unsubscription(const char *const topic_path,
+                        const TOPIC_SPECIFICATION_T *const specification,
+                        NOTIFY_UNSUBSCRIPTION_REASON_T reason,
+                        void *context)
+{
+        GROUP_STREAM_T *group_stream = context;
+        SESSION_SHARD_T *shard = group_stream->shard;
+
+        int successor;
+        const bool unsubscribed = shard_release(shard, topic_path, &successor);
+        DIFFUSION_VALUE_T *value = shard_cache_take(shard, topic_path);
+        if(value != NULL && successor >= 0) {
+                shard_cache_offer(&shard->group->shards[successor], topic_path, value);
+        }
+        else if(value != NULL) {
+                diffusion_value_free(value);
+        }
+
+        if(!unsubscribed || group_stream->stream.on_unsubscription == NULL) {
+                return HANDLER_SUCCESS;
+        }
+        return group_stream->stream.on_unsubscription(topic_path, specification, reason,
+                                                      group_stream->stream.context);
+}
+
+/*
+ * Errors are reported once for the group, with the application's
+ * context.
+ */
+static void
+on_shard_error(const DIFFUSION_ERROR_T *error)
+{
+        GROUP_STREAM_T *primary = ((GROUP_STREAM_T *)error->context)->primary;
+
+        if(primary->stream.on_error == NULL || apr_atomic_cas32(&primary->error_reported, 1, 0) != 0) {
+                return;
+        }
+        DIFFUSION_ERROR_T stream_error = *error;
+        stream_error.context = primary->stream.context;
+        primary->stream.on_error(&stream_error);
+}
+
+static void
+free_slot(void *data)
+{
+        DIFFUSION_VALUE_T **slot = data;
+        if(*slot != NULL) {
+                diffusion_value_free(*slot);
+        }
+        free(slot);
+}
+
+/*
+ * Open a group of sessions from a factory. Returns NULL, with the
+ * error populated, if any session can't be opened.
+ */
+static SESSION_GROUP_T *
+session_group_create(DIFFUSION_SESSION_FACTORY_T *factory, const char *url,
+                     int shard_count, DIFFUSION_ERROR_T *error)
+{
+        SESSION_GROUP_T *group = calloc(1, sizeof(SESSION_GROUP_T));
+        apr_pool_create(&group->pool, NULL);
+        apr_thread_mutex_create(&group->mutex, APR_THREAD_MUTEX_DEFAULT, group->pool);
+        for(int i = 0; i < OWNER_STRIPES; i++) {
+                apr_thread_mutex_create(&group->stripes[i].mutex, APR_THREAD_MUTEX_DEFAULT, group->pool);
+                group->stripes[i].owners = unsync_hash_new(1024);
+        }
+
+        group->shards = calloc(shard_count, sizeof(SESSION_SHARD_T));
+        for(int i = 0; i < shard_count; i++) {
+                SESSION_SHARD_T *shard = &group->shards[i];
+                shard->group = group;
+                shard->index = i;
+                apr_thread_mutex_create(&shard->mutex, APR_THREAD_MUTEX_DEFAULT, group->pool);
+                shard->values = unsync_hash_new(1024);
+                shard->session = session_create_with_session_factory(factory, url);
+                if(shard->session == NULL) {
+                        error->message = strdup("Unable to open a session for the group");
+                        hash_free(shard->values, free, free_slot);
+                        group->shard_count = i;
+                        return group;
+                }
+                group->shard_count = i + 1;
+        }
+        return group;
+}
+
+/*
+ * Add a value stream to every shard. Values are delivered to it from
+ * each topic's owning shard only.
+ */
+static void
+session_group_add_stream(SESSION_GROUP_T *group, const char *selector, const VALUE_STREAM_T *stream)
+{
+        GROUP_STREAM_T *primary = NULL;
+        for(int i = 0; i < group->shard_count; i++) {
+                GROUP_STREAM_T *group_stream = calloc(1, sizeof(GROUP_STREAM_T));
+                group_stream->shard = &group->shards[i];
+                group_stream->stream = *stream;
+                if(primary == NULL) {
+                        primary = group_stream;
+                }
+                group_stream->primary = primary;
+
+                apr_thread_mutex_lock(group->mutex);
+                group_stream->next = group->streams;
+                group->streams = group_stream;
+                apr_thread_mutex_unlock(group->mutex);
+
+                VALUE_STREAM_T shard_stream = {
+                        .datatype = stream->datatype,
+                        .on_subscription = on_shard_subscription,
+                        .on_unsubscription = on_shard_unsubscription,
+                        .on_value = on_shard_value,
+                        .on_error = on_shard_error,
+                        .context = group_stream
+                };
+                add_stream(group->shards[i].session, selector, &shard_stream);
+        }
+}
+
+/*
+ * Subscribe to a selector on the shard with the fewest selectors,
+ * returning the shard's index.
+ */
+static int
+session_group_subscribe(SESSION_GROUP_T *group, SUBSCRIPTION_PARAMS_T params)
+{
+        apr_thread_mutex_lock(group->mutex);
+        SESSION_SHARD_T *target = &group->shards[0];
+        for(int i = 1; i < group->shard_count; i++) {
+                if(group->shards[i].selector_count < target->selector_count) {
+                        target = &group->shards[i];
+                }
+        }
+        target->selector_count++;
+        apr_thread_mutex_unlock(group->mutex);
+
+        subscribe(target->session, params);
+        return target->index;
+}
+
+/*
+ * Look up the latest value of a topic, from whichever shard owns it.
+ * Returns NULL if the topic has no value; otherwise the caller must
+ * free the returned copy.
+ */
+static DIFFUSION_VALUE_T *
+session_group_get_value(SESSION_GROUP_T *group, const char *path)
+{
+        OWNER_STRIPE_T *stripe = owner_stripe(group, path);
+        apr_thread_mutex_lock(stripe->mutex);
+        const TOPIC_OWNER_T *topic_owner = hash_get(stripe->owners, path);
+        const int owner = topic_owner != NULL ? topic_owner->owner : 0;
+        apr_thread_mutex_unlock(stripe->mutex);
+        if(owner == 0) {
+                return NULL;
+        }
+
+        SESSION_SHARD_T *shard = &group->shards[owner - 1];
+        apr_thread_mutex_lock(shard->mutex);
+        DIFFUSION_VALUE_T **slot = hash_get(shard->values, path);
+        DIFFUSION_VALUE_T *copy = slot != NULL && *slot != NULL ? diffusion_value_dup(*slot) : NULL;
+        apr_thread_mutex_unlock(shard->mutex);
+        return copy;
+}
+
+/*
+ * Close every session in the group and free it.
+ */
+static void
+session_group_free(SESSION_GROUP_T *group)
+{
+        for(int i = 0; i < group->shard_count; i++) {
+                session_close(group->shards[i].session, NULL);
+                session_free(group->shards[i].session);
+        }
+        // Each application stream is closed once, with the group.
+        for(GROUP_STREAM_T *group_stream = group->streams; group_stream != NULL; group_stream = group_stream->next) {
+                if(group_stream->primary == group_stream && group_stream->stream.on_close != NULL) {
+                        group_stream->stream.on_close();
+                }
+        }
+        for(int i = 0; i < group->shard_count; i++) {
+                hash_free(group->shards[i].values, free, free_slot);
+        }
+        for(int i = 0; i < OWNER_STRIPES; i++) {
+                hash_free(group->stripes[i].owners, free, free);
+        }
+        while(group->streams != NULL) {
+                GROUP_STREAM_T *next = group->streams->next;
+                free(group->streams);
+                group->streams = next;
+        }
+        free(group->shards);
+        apr_pool_destroy(group->pool);
+        free(group);
+}
+
+/*
+ * The application's value stream; it only counts what it receives.
+ */
+static int
+on_value(const char *const topic_path,
+         const TOPIC_SPECIFICATION_T *const specification,
+         DIFFUSION_DATATYPE datatype,
+         const DIFFUSION_VALUE_T *const old_value,
+         const DIFFUSION_VALUE_T *const new_value,
+         void *context)
+{
+        apr_atomic_inc32(context);
+        return HANDLER_SUCCESS;
+}
+
+/*
+ * Entry point for the example.
+ */
+int
+main(int argc, char **argv)
+{
+        /*
+         * Standard command-line parsing.
+         */
+        HASH_T *options = parse_cmdline(argc, argv, arg_opts);
+        if(options == NULL || hash_get(options, "help") != NULL) {
+                show_usage(argc, argv, arg_opts);
+                return EXIT_FAILURE;
+        }
+
+        const char *url = hash_get(options, "url");
+        const char *selectors = hash_get(options, "topic_selector");
+        const int shard_count = atoi(hash_get(options, "shards"));
+        const char *read_path = hash_get(options, "read");
+        const unsigned int sleep_time = atol(hash_get(options, "sleep"));
+
+        apr_initialize();
+
+        DIFFUSION_SESSION_FACTORY_T *factory = diffusion_session_factory_init();
+        diffusion_session_factory_principal(factory, hash_get(options, "principal"));
+        diffusion_session_factory_password(factory, hash_get(options, "credentials"));
+
+        DIFFUSION_ERROR_T error = { 0 };
+        SESSION_GROUP_T *group = session_group_create(factory, url, shard_count > 0 ? shard_count : 1, &error);
+        if(error.message != NULL) {
+                printf("Failed to create session: %s\n", error.message);
+                free(error.message);
+                session_group_free(group);
+                diffusion_session_factory_free(factory);
+                return EXIT_FAILURE;
+        }
+
+        volatile apr_uint32_t values = 0;
+        char *list = strdup(selectors);
+        char *saveptr = NULL;
+        for(char *selector = strtok_r(list, ",", &saveptr); selector != NULL; selector = strtok_r(NULL, ",", &saveptr)) {
+                const DIFFUSION_DATATYPE datatypes[] = {
+                        DATATYPE_BINARY, DATATYPE_JSON, DATATYPE_STRING,
+                        DATATYPE_DOUBLE, DATATYPE_INT64, DATATYPE_RECORDV2
+                };
+                for(size_t i = 0; i < sizeof(datatypes) / sizeof(datatypes[0]); i++) {
+                        VALUE_STREAM_T value_stream = {
+                                .datatype = datatypes[i],
+                                .on_value = on_value,
+                                .context = (void *)&values
+                        };
+                        session_group_add_stream(group, selector, &value_stream);
+                }
+
+                SUBSCRIPTION_PARAMS_T params = {
+                        .topic_selector = selector
+                };
+                printf("Subscribing to %s on shard %d\n", selector, session_group_subscribe(group, params));
+        }
+        free(list);
+
+        for(unsigned int t = 0; t < sleep_time; t++) {
+                sleep(1);
+                printf("%u values delivered\n", apr_atomic_read32(&values));
+                for(int i = 0; i < group->shard_count; i++) {
+                        SESSION_SHARD_T *shard = &group->shards[i];
+                        printf("  shard %d: %d selectors, %u topics, %u received, %u delivered, %u duplicates dropped\n",
+                               i, shard->selector_count,
+                               apr_atomic_read32(&shard->owned),
+                               apr_atomic_read32(&shard->received),
+                               apr_atomic_read32(&shard->delivered),
+                               apr_atomic_read32(&shard->duplicates));
+                }
+
+                DIFFUSION_VALUE_T *value = session_group_get_value(group, read_path);
+                if(value != NULL) {
+                        void *bytes = NULL;
+                        size_t len = 0;
+                        diffusion_value_get_raw_bytes(value, &bytes, &len);
+                        printf("  %s: %zu bytes\n", read_path, len);
+                        free(bytes);
+                        diffusion_value_free(value);
+                }
+        }
+
+        session_group_free(group);
+        diffusion_session_factory_free(factory);
+        hash_free(options, NULL, free);
+
+        apr_terminate();
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,625 @@
+/**
+ * Copyright © 2026 Push Technology Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This example is written in C99. Please use an appropriate C99 capable compiler
+ *
+ * @author Push Technology Limited
+ * @since 6.4
+ */
+
+/*
+ * This example shows how a single session can fan topic values out to
+ * other processes on the same host through shared memory, so that
+ * co-located workers don't each need their own session and
+ * subscriptions.
+ *
+ * The publishing process creates a named shared memory region holding
+ * a fixed table of topic slots, an open-addressed hash index from topic
+ * path to slot, and a ring of changed slot numbers. Each slot is
+ * guarded by a sequence lock, so workers attached to the region can
+ * read values consistently without any locking. On Linux, workers
+ * forked by the publisher are woken through an eventfd each; elsewhere,
+ * or when a worker attaches to an existing region with "-m attach",
+ * the worker polls the ring.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#ifndef WIN32
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#else
+#define sleep(x) Sleep(1000 * x)
+#endif
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#define HAVE_EVENTFD 1
+#endif
+
+#include <apr.h>
+#include <apr_atomic.h>
+#include <apr_pools.h>
+#include <apr_shm.h>
+#include <apr_time.h>
+
+#include "diffusion.h"
+#include "args.h"
+
+ARG_OPTS_T arg_opts[] = {
+        ARG_OPTS_HELP,
+        {'u', "url", "Diffusion server URL", ARG_OPTIONAL, ARG_HAS_VALUE, "ws://localhost:8080"},
+        {'p', "principal", "Principal (username) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "client"},
+        {'c', "credentials", "Credentials (password) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "password"},
+        {'t', "topic_selector", "Topic selector to fan out", ARG_OPTIONAL, ARG_HAS_VALUE, "?.*//"},
+        {'m', "mode", "\"publish\" to own the region, \"attach\" to read from an existing one", ARG_OPTIONAL, ARG_HAS_VALUE, "publish"},
+        {'f', "file", "Name of the shared memory region", ARG_OPTIONAL, ARG_HAS_VALUE, "/tmp/diffusion-fanout.shm"},
+        {'w', "workers", "Number of worker processes to fork when publishing", ARG_OPTIONAL, ARG_HAS_VALUE, "2"},
+        {'n', "slots", "Maximum number of topics in the region", ARG_OPTIONAL, ARG_HAS_VALUE, "16384"},
+        {'z', "value_size", "Maximum size of a topic value, in bytes", ARG_OPTIONAL, ARG_HAS_VALUE, "1024"},
+        {'s', "sleep", "Time to run before disconnecting (in seconds).", ARG_OPTIONAL, ARG_HAS_VALUE, "10" },
+        END_OF_ARG_OPTS
+};
+
+#define FANOUT_MAGIC 0x44465830 /* "DFX0" */
+#define FANOUT_MAX_PATH 256
+#define FANOUT_RING_SIZE 65536 /* power of two */
+#define FANOUT_MAX_WORKERS 64
+
+/*
+ * Layout of the shared memory region. All offsets are relative to the
+ * start of the region, so that it can be mapped at different
+ * addresses in each process.
+ */
+typedef struct fanout_header_s {
+        apr_uint32_t magic;
+        apr_uint32_t slot_count;
+        apr_uint32_t value_size;
+        apr_uint32_t index_size;
+        apr_size_t slot_stride;
+        apr_size_t index_offset;
+        apr_size_t ring_offset;
+        apr_size_t slots_offset;
+        // Number of slots that have been assigned to topics.
+        volatile apr_uint32_t slots_used;
+        // Total number of changes written to the ring.
+        volatile apr_uint32_t ring_head;
+} FANOUT_HEADER_T;
+
+typedef struct fanout_slot_s {
+        // Odd while the publisher is writing the slot.
+        volatile apr_uint32_t seq;
+        apr_uint32_t hash;
+        apr_uint32_t datatype;
+        // Length of the value, or UINT32_MAX if it was too large to
+        // store.
+        apr_uint32_t len;
+        char path[FANOUT_MAX_PATH];
+        unsigned char bytes[];
+} FANOUT_SLOT_T;
+
+typedef struct fanout_region_s {
+        apr_shm_t *shm;
+        FANOUT_HEADER_T *header;
+        // Slot number + 1 for each index position, 0 if unused.
+        volatile apr_uint32_t *index;
+        volatile apr_uint32_t *ring;
+        unsigned char *slots;
+        int eventfds[FANOUT_MAX_WORKERS];
+        int eventfd_count;
+} FANOUT_REGION_T;
+
+static apr_uint32_t
+hash_path(const char *path)
+{
+        // FNV-1a
+        apr_uint32_t hash = 2166136261u;
+        for(const unsigned char *p = (const unsigned char *)path; *p != '\0'; p++) {
+                hash ^= *p;
+                hash *= 16777619u;
+        }
+        return hash;
+}
+
+static FANOUT_SLOT_T *
+region_slot(const FANOUT_REGION_T *region, apr_uint32_t slot)
+{
+        return (FANOUT_SLOT_T *)(region->slots + (apr_size_t)slot * region->header->slot_stride);
+}
+
+static void
+region_map(FANOUT_REGION_T *region)
+{
+        unsigned char *base = apr_shm_baseaddr_get(region->shm);
+        region->header = (FANOUT_HEADER_T *)base;
+        region->index = (volatile apr_uint32_t *)(base + region->header->index_offset);
+        region->ring = (volatile apr_uint32_t *)(base + region->header->ring_offset);
+        region->slots = base + region->header->slots_offset;
+}
+
+static apr_size_t
+align64(apr_size_t n)
+{
+        return (n + 63) & ~(apr_size_t)63;
+}
+
+static FANOUT_REGION_T *
+region_create(const char *filename, apr_uint32_t slot_count, apr_uint32_t value_size, apr_pool_t *pool)
+{
+        apr_uint32_t index_size = 1;
+        while(index_size < slot_count * 2) {
+                index_size <<= 1;
+        }
+
+        const apr_size_t slot_stride = align64(sizeof(FANOUT_SLOT_T) + value_size);
+        const apr_size_t index_offset = align64(sizeof(FANOUT_HEADER_T));
+        const apr_size_t ring_offset = align64(index_offset + index_size * sizeof(apr_uint32_t));
+        const apr_size_t slots_offset = align64(ring_offset + FANOUT_RING_SIZE * sizeof(apr_uint32_t));
+        const apr_size_t size = slots_offset + slot_stride * slot_count;
+
+        FANOUT_REGION_T *region = calloc(1, sizeof(FANOUT_REGION_T));
+
+        // Remove any region left behind by a previous run.
+        apr_shm_remove(filename, pool);
+        apr_status_t rv = apr_shm_create(&region->shm, size, filename, pool);
+        if(rv != APR_SUCCESS) {
+                char msg[256];
+                printf("Failed to create shared memory region %s: %s\n",
+                       filename, apr_strerror(rv, msg, sizeof(msg)));
+                free(region);
+                return NULL;
+        }
+
+        unsigned char *base = apr_shm_baseaddr_get(region->shm);
+        memset(base, 0, size);
+
+        FANOUT_HEADER_T *header = (FANOUT_HEADER_T *)base;
+        header->slot_count = slot_count;
+        header->value_size = value_size;
+        header->index_size = index_size;
+        header->slot_stride = slot_stride;
+        header->index_offset = index_offset;
+        header->ring_offset = ring_offset;
+        header->slots_offset = slots_offset;
+        apr_atomic_set32(&header->magic, FANOUT_MAGIC);
+
+        region_map(region);
+        return region;
+}
+
+static FANOUT_REGION_T *
+region_attach(const char *filename, apr_pool_t *pool)
+{
+        FANOUT_REGION_T *region = calloc(1, sizeof(FANOUT_REGION_T));
+        apr_status_t rv = apr_shm_attach(&region->shm, filename, pool);
+        if(rv != APR_SUCCESS) {
+                char msg[256];
+                printf("Failed to attach to shared memory region %s: %s\n",
+                       filename, apr_strerror(rv, msg, sizeof(msg)));
+                free(region);
+                return NULL;
+        }
+
+        FANOUT_HEADER_T *header = apr_shm_baseaddr_get(region->shm);
+        if(apr_atomic_read32(&header->magic) != FANOUT_MAGIC) {
+                printf("%s is not a fan-out region\n", filename);
+                apr_shm_detach(region->shm);
+                free(region);
+                return NULL;
+        }
+
+        region_map(region);
+        return region;
+}
+
+/*
+ * Find the slot holding a topic path, or UINT32_MAX if the path isn't
+ * in the region. Slots are never reassigned, so this is safe to call
+ * from any process without locking.
+ */
+static apr_uint32_t
+region_find(const FANOUT_REGION_T *region, const char *path, apr_uint32_t hash)
+{
+        const apr_uint32_t mask = region->header->index_size - 1;
+        for(apr_uint32_t i = hash & mask; ; i = (i + 1) & mask) {
+                apr_uint32_t entry = apr_atomic_read32((volatile apr_uint32_t *)&region->index[i]);
+                if(entry == 0) {
+                        return UINT32_MAX;
+                }
+                FANOUT_SLOT_T *slot = region_slot(region, entry - 1);
+                if(slot->hash == hash && strcmp(slot->path, path) == 0) {
+                        return entry - 1;
+                }
+        }
+}
+
+/*
+ * Find or assign the slot for a topic path. Only called by the
+ * publisher.
+ */
+static apr_uint32_t
+region_find_or_add(FANOUT_REGION_T *region, const char *path)
+{
+        const apr_uint32_t hash = hash_path(path);
+        apr_uint32_t slot_number = region_find(region, path, hash);
+        if(slot_number != UINT32_MAX) {
+                return slot_number;
+        }
+
+        FANOUT_HEADER_T *header = region->header;
+        if(header->slots_used == header->slot_count || strlen(path) >= FANOUT_MAX_PATH) {
+                return UINT32_MAX;
+        }
+
+        slot_number = header->slots_used;
+        FANOUT_SLOT_T *slot = region_slot(region, slot_number);
+        slot->hash = hash;
+        strcpy(slot->path, path);
+        slot->len = 0;
+
+        // Publish the slot before making it reachable from the index.
+        apr_atomic_inc32(&header->slots_used);
+        const apr_uint32_t mask = header->index_size - 1;
+        apr_uint32_t i = hash & mask;
+        while(region->index[i] != 0) {
+                i = (i + 1) & mask;
+        }
+        apr_atomic_set32((volatile apr_uint32_t *)&region->index[i], slot_number + 1);
+
+        return slot_number;
+}
+
+/*
+ * Write a topic value into its slot and announce the change.
+ */
+static void
+region_publish(FANOUT_REGION_T *region, const char *path, DIFFUSION_DATATYPE datatype,
+               const void *bytes, size_t len)
+{
+        const apr_uint32_t slot_number = region_find_or_add(region, path);
+        if(slot_number == UINT32_MAX) {
+                return;
+        }
+
+        // The slot is a seqlock: an odd sequence marks a write in
+        // progress. The fences keep the value's stores between the two
+        // increments, pairing with the acquire fences in
+        // region_read_slot().
+        FANOUT_SLOT_T *slot = region_slot(region, slot_number);
+        apr_atomic_inc32(&slot->seq);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        slot->datatype = datatype;
+        if(len <= region->header->value_size) {
+                memcpy(slot->bytes, bytes, len);
+                slot->len = len;
+        }
+        else {
+                slot->len = UINT32_MAX;
+        }
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        apr_atomic_inc32(&slot->seq);
+
+        const apr_uint32_t head = apr_atomic_read32(&region->header->ring_head);
+        apr_atomic_set32((volatile apr_uint32_t *)&region->ring[head & (FANOUT_RING_SIZE - 1)], slot_number);
+        apr_atomic_inc32(&region->header->ring_head);
+
+#ifdef HAVE_EVENTFD
+        const uint64_t one = 1;
+        for(int i = 0; i < region->eventfd_count; i++) {
+                if(write(region->eventfds[i], &one, sizeof(one)) < 0) {
+                        // The worker has gone away, or its counter is
+                        // saturated; either way it will catch up from
+                        // the ring.
+                }
+        }
+#endif
+}
+
+/*
+ * Consistently copy a slot's value. Returns the value length, or -1
+ * if the value was too large for the region or doesn't fit in the
+ * supplied buffer.
+ */
+static long
+region_read_slot(const FANOUT_REGION_T *region, apr_uint32_t slot_number,
+                 void *buf, size_t buf_len, DIFFUSION_DATATYPE *datatype)
+{
+        FANOUT_SLOT_T *slot = region_slot(region, slot_number);
+        for(;;) {
+                const apr_uint32_t seq = apr_atomic_read32(&slot->seq);
+                if(seq & 1) {
+                        continue;
+                }
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+                const apr_uint32_t len = slot->len;
+                long result = -1;
+                if(len != UINT32_MAX && len <= buf_len) {
+                        memcpy(buf, slot->bytes, len);
+                        result = len;
+                }
+                *datatype = slot->datatype;
+
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                if(apr_atomic_read32(&slot->seq) == seq) {
+                        return result;
+                }
+        }
+}
+
+/*
+ * Read the current value of a topic from the region.
+ */
+long
+fanout_read(const FANOUT_REGION_T *region, const char *path,
+            void *buf, size_t buf_len, DIFFUSION_DATATYPE *datatype)
+{
+        const apr_uint32_t slot_number = region_find(region, path, hash_path(path));
+        if(slot_number == UINT32_MAX) {
+                return -1;
+        }
+        return region_read_slot(region, slot_number, buf, buf_len, datatype);
+}
+
+/*
+ * Worker loop: wait for changes and report them until the time is up.
+ */
+static void
+run_worker(const FANOUT_REGION_T *region, int eventfd, unsigned int run_time)
+{
+        const apr_time_t deadline = apr_time_now() + apr_time_from_sec(run_time);
+        unsigned char *buf = malloc(region->header->value_size);
+        apr_uint32_t tail = apr_atomic_read32(&region->header->ring_head);
+        unsigned long changes = 0;
+
+        while(apr_time_now() < deadline) {
+#ifdef HAVE_EVENTFD
+                if(eventfd >= 0) {
+                        struct pollfd pfd = { .fd = eventfd, .events = POLLIN };
+                        uint64_t count;
+                        if(poll(&pfd, 1, 100) > 0 && read(eventfd, &count, sizeof(count)) < 0) {
+                                apr_sleep(1000);
+                        }
+                }
+                else {
+                        apr_sleep(1000);
+                }
+#else
+                apr_sleep(1000);
+#endif
+                const apr_uint32_t head = apr_atomic_read32(&region->header->ring_head);
+                if(head - tail > FANOUT_RING_SIZE) {
+                        // We fell too far behind and the ring has
+                        // wrapped; the individual changes are lost, but
+                        // every slot still holds its latest value.
+                        printf("[worker %d] ring overrun, %u changes skipped\n",
+                               (int)getpid(), head - tail);
+                        tail = head;
+                        continue;
+                }
+
+                for(; tail != head; tail++) {
+                        const apr_uint32_t slot_number = region->ring[tail & (FANOUT_RING_SIZE - 1)];
+                        DIFFUSION_DATATYPE datatype;
+                        const long len = region_read_slot(region, slot_number, buf,
+                                                          region->header->value_size, &datatype);
+                        changes++;
+                        if(changes % 1000 == 1) {
+                                printf("[worker %d] %s changed (datatype %d, %ld bytes), %lu changes seen\n",
+                                       (int)getpid(), region_slot(region, slot_number)->path,
+                                       datatype, len, changes);
+                        }
+                }
+        }
+
+        printf("[worker %d] saw %lu changes\n", (int)getpid(), changes);
+        free(buf);
+}
+
+/*
+ * Stop the workers that were started, and wait for them to exit. A
+ * pid which isn't positive is never passed to kill(), where -1 would
+ * signal every process the user owns.
+ */
+static void
+workers_stop(const pid_t *workers, int worker_count)
+{
+        for(int i = 0; i < worker_count; i++) {
+                if(workers[i] > 0) {
+                        kill(workers[i], SIGTERM);
+                }
+        }
+        for(int i = 0; i < worker_count; i++) {
+                if(workers[i] > 0) {
+                        waitpid(workers[i], NULL, 0);
+                }
+        }
+}
+
+static int
+on_value(const char *const topic_path,
+         const TOPIC_SPECIFICATION_T *const specification,
+         DIFFUSION_DATATYPE datatype,
+         const DIFFUSION_VALUE_T *const old_value,
+         const DIFFUSION_VALUE_T *const new_value,
+         void *context)
+{
+        FANOUT_REGION_T *region = context;
+        void *bytes = NULL;
+        size_t len = 0;
+
+        if(new_value != NULL && diffusion_value_get_raw_bytes(new_value, &bytes, &len)) {
+                region_publish(region, topic_path, datatype, bytes, len);
+                free(bytes);
+        }
+        return HANDLER_SUCCESS;
+}
+
+static int
+on_subscribe(SESSION_T *session, void *context)
+{
+        printf("Subscribed to %s\n", (const char *)context);
+        return HANDLER_SUCCESS;
+}
+
+/*
+ * Entry point for the example.
+ */
+int
+main(int argc, char **argv)
+{
+        /*
+         * Standard command-line parsing.
+         */
+        HASH_T *options = parse_cmdline(argc, argv, arg_opts);
+        if(options == NULL || hash_get(options, "help") != NULL) {
+                show_usage(argc, argv, arg_opts);
+                return EXIT_FAILURE;
+        }
+
+        const char *url = hash_get(options, "url");
+        const char *principal = hash_get(options, "principal");
+        CREDENTIALS_T *credentials = NULL;
+        const char *password = hash_get(options, "credentials");
+        if(password != NULL) {
+                credentials = credentials_create_password(password);
+        }
+        const char *topic_selector = hash_get(options, "topic_selector");
+        const char *mode = hash_get(options, "mode");
+        const char *filename = hash_get(options, "file");
+        int worker_count = atoi(hash_get(options, "workers"));
+        const apr_uint32_t slot_count = atol(hash_get(options, "slots"));
+        const apr_uint32_t value_size = atol(hash_get(options, "value_size"));
+        const unsigned int sleep_time = atol(hash_get(options, "sleep"));
+
+        if(worker_count > FANOUT_MAX_WORKERS) {
+                worker_count = FANOUT_MAX_WORKERS;
+        }
+
+        apr_initialize();
+        apr_pool_t *pool = NULL;
+        apr_pool_create(&pool, NULL);
+
+        if(strcmp(mode, "attach") == 0) {
+                FANOUT_REGION_T *region = region_attach(filename, pool);
+                if(region == NULL) {
+                        return EXIT_FAILURE;
+                }
+                run_worker(region, -1, sleep_time);
+                apr_shm_detach(region->shm);
+                free(region);
+                apr_pool_destroy(pool);
+                apr_terminate();
+                return EXIT_SUCCESS;
+        }
+
+        FANOUT_REGION_T *region = region_create(filename, slot_count, value_size, pool);
+        if(region == NULL) {
+                return EXIT_FAILURE;
+        }
+
+        /*
+         * Fork the workers before the session exists, as the session
+         * starts threads of its own.
+         */
+        pid_t workers[FANOUT_MAX_WORKERS];
+        for(int i = 0; i < worker_count; i++) {
+                int efd = -1;
+#ifdef HAVE_EVENTFD
+                efd = eventfd(0, EFD_NONBLOCK);
+                region->eventfds[region->eventfd_count++] = efd;
+#endif
+                workers[i] = fork();
+                if(workers[i] == 0) {
+                        run_worker(region, efd, sleep_time + 1);
+                        _exit(EXIT_SUCCESS);
+                }
+                if(workers[i] < 0) {
+                        printf("Failed to fork worker %d: %s\n", i, strerror(errno));
+                        workers_stop(workers, i);
+                        apr_shm_destroy(region->shm);
+                        free(region);
+                        return EXIT_FAILURE;
+                }
+        }
+
+        DIFFUSION_ERROR_T error = { 0 };
+        SESSION_T *session = session_create(url, principal, credentials, NULL, NULL, &error);
+        if(session == NULL) {
+                printf("Failed to create session: %s\n", error.message);
+                free(error.message);
+                workers_stop(workers, worker_count);
+                apr_shm_destroy(region->shm);
+                free(region);
+                return EXIT_FAILURE;
+        }
+
+        const DIFFUSION_DATATYPE datatypes[] = {
+                DATATYPE_BINARY, DATATYPE_JSON, DATATYPE_STRING,
+                DATATYPE_DOUBLE, DATATYPE_INT64, DATATYPE_RECORDV2
+        };
+        for(size_t i = 0; i < sizeof(datatypes) / sizeof(datatypes[0]); i++) {
+                VALUE_STREAM_T value_stream = {
+                        .datatype = datatypes[i],
+                        .on_value = on_value,
+                        .context = region
+                };
+                add_stream(session, topic_selector, &value_stream);
+        }
+
+        SUBSCRIPTION_PARAMS_T params = {
+                .topic_selector = topic_selector,
+                .on_subscribe = on_subscribe,
+                .context = (void *)topic_selector
+        };
+        subscribe(session, params);
+
+        sleep(sleep_time);
+
+        /*
+         * Close the session before tearing down the region, so that no
+         * value streams can write to it.
+         */
+        session_close(session, NULL);
+        session_free(session);
+
+        printf("Published %u changes for %u topics\n",
+               apr_atomic_read32(&region->header->ring_head),
+               apr_atomic_read32(&region->header->slots_used));
+
+        for(int i = 0; i < worker_count; i++) {
+                if(workers[i] > 0) {
+                        waitpid(workers[i], NULL, 0);
+                }
+#ifdef HAVE_EVENTFD
+                close(region->eventfds[i]);
+#endif
+        }
+
+        apr_shm_destroy(region->shm);
+        free(region);
+
+        credentials_free(credentials);
+        hash_free(options, NULL, free);
+
+        apr_pool_destroy(pool);
+        apr_terminate();
+
+        return EXIT_SUCCESS;
+}
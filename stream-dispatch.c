@@ -0,0 +1,838 @@
+/**
+ * Copyright © 2026 Push Technology Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This example is written in C99. Please use an appropriate C99 capable compiler
+ *
+ * @author Push Technology Limited
+ * @since 6.4
+ */
+
+/*
+ * This example shows how to dispatch topic values to a large number of
+ * handlers, most of which are interested in a single topic path,
+ * without evaluating every handler's selector for every value.
+ *
+ * Rather than adding a value stream per handler, the application adds
+ * one value stream per datatype and registers its handlers with a
+ * dispatcher:
+ *
+ *  - handlers for an exact topic path go into a hash index keyed by
+ *    the path;
+ *  - handlers for wildcard selectors are kept in a list and evaluated
+ *    with selector_match();
+ *  - a fallback handler receives values which match nothing else.
+ *
+ * The result of matching a topic is cached against the topic, so in the
+ * steady state dispatching a value costs a single hash lookup however
+ * many handlers are registered. Registering a wildcard or fallback
+ * handler invalidates every cached result; registering an exact handler
+ * only invalidates its own topic's.
+ *
+ * The server refers to topics by a numeric ID once the session has
+ * been told of its subscription, and IDs are allocated densely. The
+ * dispatcher listens for subscription notifications and keeps an
+ * alias table: an array indexed by topic ID whose slots point at the
+ * topic's entry, which holds the path, topic type, last value and
+ * match list. Anything holding a topic ID, such as an unsubscription
+ * notification, resolves it with one bounds-checked array load rather
+ * than a string lookup.
+ *
+ * With "-b", no session is created: a number of exact and wildcard
+ * handlers are registered for synthetic paths, and the cost per
+ * dispatch is compared with evaluating every selector.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#ifndef WIN32
+#include <unistd.h>
+#else
+#define sleep(x) Sleep(1000 * x)
+#endif
+
+#include <apr.h>
+#include <apr_atomic.h>
+#include <apr_pools.h>
+#include <apr_thread_mutex.h>
+#include <apr_time.h>
+
+#include "diffusion.h"
+#include "args.h"
+
+ARG_OPTS_T arg_opts[] = {
+        ARG_OPTS_HELP,
+        {'u', "url", "Diffusion server URL", ARG_OPTIONAL, ARG_HAS_VALUE, "ws://localhost:8080"},
+        {'p', "principal", "Principal (username) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "client"},
+        {'c', "credentials", "Credentials (password) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "password"},
+        {'t', "topic_selector", "Topic selector to subscribe to", ARG_OPTIONAL, ARG_HAS_VALUE, "?.*//"},
+        {'e', "exact", "Number of exact-path handlers to register", ARG_OPTIONAL, ARG_HAS_VALUE, "10000"},
+        {'w', "wildcards", "Number of wildcard handlers to register", ARG_OPTIONAL, ARG_HAS_VALUE, "10"},
+        {'b', "benchmark", "Dispatch this many synthetic values without a session", ARG_OPTIONAL, ARG_HAS_VALUE, NULL},
+        {'s', "sleep", "Time to run for (in seconds)", ARG_OPTIONAL, ARG_HAS_VALUE, "30"},
+        END_OF_ARG_OPTS
+};
+
+/*
+ * Number of hash buckets in the path index; must be a power of 2.
+ */
+#define DISPATCH_BUCKETS 65536
+
+typedef int (*dispatch_handler_cb)(const char *topic_path,
+                                   DIFFUSION_DATATYPE datatype,
+                                   const DIFFUSION_VALUE_T *value,
+                                   void *context);
+
+typedef struct dispatch_handler_s {
+        char *selector;
+        dispatch_handler_cb on_value;
+        void *context;
+        struct dispatch_handler_s *next;
+} DISPATCH_HANDLER_T;
+
+/*
+ * The handlers matching a topic. Match lists are immutable once built,
+ * so they can be used after the dispatcher's mutex is released. A
+ * superseded list is retired rather than freed, as a handler may still
+ * be running from it, and retired lists are freed whenever no dispatch
+ * is in progress.
+ */
+typedef struct match_list_s {
+        struct match_list_s *next_retired;
+        int count;
+        DISPATCH_HANDLER_T *handlers[];
+} MATCH_LIST_T;
+
+/*
+ * A topic path known to the dispatcher, either because an exact
+ * handler was registered for it or because a value has arrived for it.
+ * An entry without exact handlers is removed when the session is
+ * unsubscribed from its topic.
+ */
+typedef struct dispatch_entry_s {
+        struct dispatch_entry_s *next;
+        apr_uint32_t hash;
+        char *path;
+        DISPATCH_HANDLER_T *exact;
+        // Cached result of matching this topic, valid while the
+        // generation equals the dispatcher's.
+        MATCH_LIST_T *matches;
+        apr_uint32_t generation;
+        // Set while the session is subscribed to the topic.
+        apr_uint32_t topic_id;
+        TOPIC_TYPE_T topic_type;
+        DIFFUSION_DATATYPE datatype;
+        DIFFUSION_VALUE_T *value;
+} DISPATCH_ENTRY_T;
+
+#define NO_TOPIC_ID UINT32_MAX
+
+typedef struct dispatcher_s {
+        apr_pool_t *pool;
+        apr_thread_mutex_t *mutex;
+        DISPATCH_ENTRY_T **buckets;
+        DISPATCH_HANDLER_T *wildcards;
+        DISPATCH_HANDLER_T *fallback;
+        // Starts at 1; entries with generation 0 are always stale.
+        apr_uint32_t generation;
+        MATCH_LIST_T *retired;
+        volatile apr_uint32_t retired_count;
+        DISPATCH_HANDLER_T *retired_handlers;
+        // Dispatches which may be using a match list. Only incremented
+        // with the mutex held.
+        volatile apr_uint32_t dispatching;
+
+        // Entries of subscribed topics, indexed by topic ID.
+        DISPATCH_ENTRY_T **aliases;
+        apr_uint32_t alias_capacity;
+        apr_uint32_t alias_count;
+
+        volatile apr_uint32_t dispatched;
+        volatile apr_uint32_t resolved;
+        volatile apr_uint32_t selector_evaluations;
+} DISPATCHER_T;
+
+static apr_uint32_t
+hash_path(const char *path)
+{
+        // FNV-1a
+        apr_uint32_t hash = 2166136261u;
+        for(const unsigned char *p = (const unsigned char *)path; *p != '\0'; p++) {
+                hash ^= *p;
+                hash *= 16777619u;
+        }
+        return hash;
+}
+
+/*
+ * A path selector ("path" or ">path") which doesn't select descendants
+ * names exactly one topic. Returns that topic's path, or NULL if the
+ * selector may match more than one.
+ */
+static const char *
+selector_exact_path(const char *selector)
+{
+        if(strchr("?*#$%", selector[0]) != NULL || selector[0] == '\0') {
+                return NULL;
+        }
+        const size_t len = strlen(selector);
+        if(len >= 2 && strcmp(selector + len - 2, "//") == 0) {
+                return NULL;
+        }
+        return selector[0] == '>' ? selector + 1 : selector;
+}
+
+static DISPATCHER_T *
+dispatcher_create(void)
+{
+        DISPATCHER_T *dispatcher = calloc(1, sizeof(DISPATCHER_T));
+        dispatcher->buckets = calloc(DISPATCH_BUCKETS, sizeof(DISPATCH_ENTRY_T *));
+        dispatcher->generation = 1;
+        apr_pool_create(&dispatcher->pool, NULL);
+        apr_thread_mutex_create(&dispatcher->mutex, APR_THREAD_MUTEX_DEFAULT, dispatcher->pool);
+        return dispatcher;
+}
+
+/*
+ * Find the entry for a topic path, adding one if it doesn't exist.
+ * Must be called with the dispatcher mutex held.
+ */
+static DISPATCH_ENTRY_T *
+dispatcher_entry(DISPATCHER_T *dispatcher, const char *path)
+{
+        const apr_uint32_t hash = hash_path(path);
+        DISPATCH_ENTRY_T **bucket = &dispatcher->buckets[hash & (DISPATCH_BUCKETS - 1)];
+
+        for(DISPATCH_ENTRY_T *entry = *bucket; entry != NULL; entry = entry->next) {
+                if(entry->hash == hash && strcmp(entry->path, path) == 0) {
+                        return entry;
+                }
+        }
+
+        DISPATCH_ENTRY_T *entry = calloc(1, sizeof(DISPATCH_ENTRY_T));
+        entry->hash = hash;
+        entry->topic_id = NO_TOPIC_ID;
+        entry->path = strdup(path);
+        entry->next = *bucket;
+        *bucket = entry;
+        return entry;
+}
+
+/*
+ * Retire the match list cached for an entry. Must be called with the
+ * dispatcher mutex held.
+ */
+static void
+dispatcher_retire_matches(DISPATCHER_T *dispatcher, DISPATCH_ENTRY_T *entry)
+{
+        if(entry->matches != NULL) {
+                entry->matches->next_retired = dispatcher->retired;
+                dispatcher->retired = entry->matches;
+                apr_atomic_inc32(&dispatcher->retired_count);
+                entry->matches = NULL;
+        }
+}
+
+/*
+ * Free the retired match lists if no dispatch can be using them. Must
+ * be called with the dispatcher mutex held.
+ */
+static void
+dispatcher_reclaim(DISPATCHER_T *dispatcher)
+{
+        if(apr_atomic_read32(&dispatcher->dispatching) != 0) {
+                return;
+        }
+        while(dispatcher->retired != NULL) {
+                MATCH_LIST_T *next = dispatcher->retired->next_retired;
+                free(dispatcher->retired);
+                dispatcher->retired = next;
+        }
+        apr_atomic_set32(&dispatcher->retired_count, 0);
+}
+
+/*
+ * Remove an entry which has no exact handlers, once its topic has no
+ * ID. Must be called with the dispatcher mutex held.
+ */
+static void
+dispatcher_entry_remove(DISPATCHER_T *dispatcher, DISPATCH_ENTRY_T *entry)
+{
+        if(entry->exact != NULL || entry->topic_id != NO_TOPIC_ID) {
+                return;
+        }
+        DISPATCH_ENTRY_T **link = &dispatcher->buckets[entry->hash & (DISPATCH_BUCKETS - 1)];
+        while(*link != entry) {
+                link = &(*link)->next;
+        }
+        *link = entry->next;
+
+        dispatcher_retire_matches(dispatcher, entry);
+        if(entry->value != NULL) {
+                diffusion_value_free(entry->value);
+        }
+        free(entry->path);
+        free(entry);
+}
+
+/*
+ * Look up a subscribed topic by ID. Must be called with the dispatcher
+ * mutex held.
+ */
+static DISPATCH_ENTRY_T *
+dispatcher_alias(const DISPATCHER_T *dispatcher, apr_uint32_t topic_id)
+{
+        return topic_id < dispatcher->alias_capacity ? dispatcher->aliases[topic_id] : NULL;
+}
+
+/*
+ * Record the ID the server uses for a topic, growing the table as
+ * needed. Must be called with the dispatcher mutex held.
+ */
+static void
+dispatcher_alias_add(DISPATCHER_T *dispatcher, apr_uint32_t topic_id, DISPATCH_ENTRY_T *entry)
+{
+        if(topic_id == NO_TOPIC_ID) {
+                return;
+        }
+        if(topic_id >= dispatcher->alias_capacity) {
+                apr_uint32_t capacity = dispatcher->alias_capacity > 0 ? dispatcher->alias_capacity : 1024;
+                while(capacity <= topic_id) {
+                        capacity *= 2;
+                }
+                dispatcher->aliases = realloc(dispatcher->aliases, capacity * sizeof(DISPATCH_ENTRY_T *));
+                memset(dispatcher->aliases + dispatcher->alias_capacity, 0,
+                       (capacity - dispatcher->alias_capacity) * sizeof(DISPATCH_ENTRY_T *));
+                dispatcher->alias_capacity = capacity;
+        }
+
+        if(entry->topic_id != NO_TOPIC_ID && entry->topic_id != topic_id) {
+                dispatcher->aliases[entry->topic_id] = NULL;
+                dispatcher->alias_count--;
+        }
+        if(dispatcher->aliases[topic_id] == NULL) {
+                dispatcher->alias_count++;
+        }
+        dispatcher->aliases[topic_id] = entry;
+        entry->topic_id = topic_id;
+}
+
+/*
+ * Forget a topic ID, along with the value held for it, and the topic's
+ * entry unless it has exact handlers. Must be called with the
+ * dispatcher mutex held.
+ */
+static void
+dispatcher_alias_remove(DISPATCHER_T *dispatcher, apr_uint32_t topic_id)
+{
+        DISPATCH_ENTRY_T *entry = dispatcher_alias(dispatcher, topic_id);
+        if(entry == NULL) {
+                return;
+        }
+        dispatcher->aliases[topic_id] = NULL;
+        dispatcher->alias_count--;
+        entry->topic_id = NO_TOPIC_ID;
+        if(entry->value != NULL) {
+                diffusion_value_free(entry->value);
+                entry->value = NULL;
+        }
+        dispatcher_entry_remove(dispatcher, entry);
+        dispatcher_reclaim(dispatcher);
+}
+
+/*
+ * Copy the last value received for a subscribed topic, or return NULL
+ * if there is none. The caller must free the copy.
+ */
+static DIFFUSION_VALUE_T *
+dispatcher_get_value(DISPATCHER_T *dispatcher, apr_uint32_t topic_id, DIFFUSION_DATATYPE *datatype)
+{
+        DIFFUSION_VALUE_T *value = NULL;
+
+        apr_thread_mutex_lock(dispatcher->mutex);
+        DISPATCH_ENTRY_T *entry = dispatcher_alias(dispatcher, topic_id);
+        if(entry != NULL && entry->value != NULL) {
+                value = diffusion_value_dup(entry->value);
+                if(datatype != NULL) {
+                        *datatype = entry->datatype;
+                }
+        }
+        apr_thread_mutex_unlock(dispatcher->mutex);
+        return value;
+}
+
+static DISPATCH_HANDLER_T *
+handler_create(const char *selector, dispatch_handler_cb on_value, void *context)
+{
+        DISPATCH_HANDLER_T *handler = calloc(1, sizeof(DISPATCH_HANDLER_T));
+        handler->selector = strdup(selector);
+        handler->on_value = on_value;
+        handler->context = context;
+        return handler;
+}
+
+/*
+ * Register a handler for values of topics matching a selector.
+ */
+static void
+dispatcher_add(DISPATCHER_T *dispatcher, const char *selector,
+               dispatch_handler_cb on_value, void *context)
+{
+        DISPATCH_HANDLER_T *handler = handler_create(selector, on_value, context);
+        const char *path = selector_exact_path(selector);
+
+        apr_thread_mutex_lock(dispatcher->mutex);
+        if(path != NULL) {
+                DISPATCH_ENTRY_T *entry = dispatcher_entry(dispatcher, path);
+                handler->next = entry->exact;
+                entry->exact = handler;
+                entry->generation = 0;
+        }
+        else {
+                handler->next = dispatcher->wildcards;
+                dispatcher->wildcards = handler;
+                dispatcher->generation++;
+        }
+        apr_thread_mutex_unlock(dispatcher->mutex);
+}
+
+/*
+ * Set the handler for values which no other handler matches.
+ */
+static void
+dispatcher_set_fallback(DISPATCHER_T *dispatcher, dispatch_handler_cb on_value, void *context)
+{
+        DISPATCH_HANDLER_T *handler = handler_create("", on_value, context);
+
+        apr_thread_mutex_lock(dispatcher->mutex);
+        if(dispatcher->fallback != NULL) {
+                // The old handler may be in use by cached match lists.
+                dispatcher->fallback->next = dispatcher->retired_handlers;
+                dispatcher->retired_handlers = dispatcher->fallback;
+        }
+        dispatcher->fallback = handler;
+        dispatcher->generation++;
+        apr_thread_mutex_unlock(dispatcher->mutex);
+}
+
+/*
+ * Work out which handlers a topic's values go to. Must be called with
+ * the dispatcher mutex held.
+ */
+static MATCH_LIST_T *
+dispatcher_resolve(DISPATCHER_T *dispatcher, DISPATCH_ENTRY_T *entry)
+{
+        int capacity = 1;
+        for(DISPATCH_HANDLER_T *h = entry->exact; h != NULL; h = h->next) {
+                capacity++;
+        }
+        for(DISPATCH_HANDLER_T *h = dispatcher->wildcards; h != NULL; h = h->next) {
+                capacity++;
+        }
+
+        MATCH_LIST_T *matches = malloc(sizeof(MATCH_LIST_T) + capacity * sizeof(DISPATCH_HANDLER_T *));
+        matches->count = 0;
+        for(DISPATCH_HANDLER_T *h = entry->exact; h != NULL; h = h->next) {
+                matches->handlers[matches->count++] = h;
+        }
+        for(DISPATCH_HANDLER_T *h = dispatcher->wildcards; h != NULL; h = h->next) {
+                apr_atomic_inc32(&dispatcher->selector_evaluations);
+                if(selector_match(h->selector, entry->path)) {
+                        matches->handlers[matches->count++] = h;
+                }
+        }
+        if(matches->count == 0 && dispatcher->fallback != NULL) {
+                matches->handlers[matches->count++] = dispatcher->fallback;
+        }
+
+        dispatcher_retire_matches(dispatcher, entry);
+        entry->matches = matches;
+        entry->generation = dispatcher->generation;
+        apr_atomic_inc32(&dispatcher->resolved);
+        return matches;
+}
+
+/*
+ * Pass a value to every handler matching its topic. Handlers are
+ * called without the dispatcher's mutex held, so they may register
+ * further handlers.
+ */
+static int
+dispatcher_dispatch(DISPATCHER_T *dispatcher, const char *topic_path,
+                    DIFFUSION_DATATYPE datatype, const DIFFUSION_VALUE_T *value)
+{
+        apr_thread_mutex_lock(dispatcher->mutex);
+        DISPATCH_ENTRY_T *entry = dispatcher_entry(dispatcher, topic_path);
+        MATCH_LIST_T *matches = entry->matches;
+        if(entry->generation != dispatcher->generation) {
+                matches = dispatcher_resolve(dispatcher, entry);
+        }
+        if(entry->topic_id != NO_TOPIC_ID) {
+                // Keep the last value of subscribed topics.
+                if(entry->value != NULL) {
+                        diffusion_value_free(entry->value);
+                }
+                entry->value = value != NULL ? diffusion_value_dup(value) : NULL;
+                entry->datatype = datatype;
+        }
+        apr_atomic_inc32(&dispatcher->dispatching);
+        apr_thread_mutex_unlock(dispatcher->mutex);
+
+        apr_atomic_inc32(&dispatcher->dispatched);
+        const int count = matches->count;
+        for(int i = 0; i < count; i++) {
+                DISPATCH_HANDLER_T *handler = matches->handlers[i];
+                handler->on_value(topic_path, datatype, value, handler->context);
+        }
+
+        // The last dispatch to finish frees the lists retired meanwhile.
+        if(apr_atomic_dec32(&dispatcher->dispatching) == 0 && apr_atomic_read32(&dispatcher->retired_count) > 0) {
+                apr_thread_mutex_lock(dispatcher->mutex);
+                dispatcher_reclaim(dispatcher);
+                apr_thread_mutex_unlock(dispatcher->mutex);
+        }
+        return count;
+}
+
+static void
+handler_list_free(DISPATCH_HANDLER_T *handler)
+{
+        while(handler != NULL) {
+                DISPATCH_HANDLER_T *next = handler->next;
+                free(handler->selector);
+                free(handler);
+                handler = next;
+        }
+}
+
+static void
+dispatcher_free(DISPATCHER_T *dispatcher)
+{
+        for(int i = 0; i < DISPATCH_BUCKETS; i++) {
+                DISPATCH_ENTRY_T *entry = dispatcher->buckets[i];
+                while(entry != NULL) {
+                        DISPATCH_ENTRY_T *next = entry->next;
+                        handler_list_free(entry->exact);
+                        if(entry->value != NULL) {
+                                diffusion_value_free(entry->value);
+                        }
+                        free(entry->matches);
+                        free(entry->path);
+                        free(entry);
+                        entry = next;
+                }
+        }
+        while(dispatcher->retired != NULL) {
+                MATCH_LIST_T *next = dispatcher->retired->next_retired;
+                free(dispatcher->retired);
+                dispatcher->retired = next;
+        }
+        handler_list_free(dispatcher->wildcards);
+        handler_list_free(dispatcher->fallback);
+        handler_list_free(dispatcher->retired_handlers);
+
+        apr_thread_mutex_destroy(dispatcher->mutex);
+        apr_pool_destroy(dispatcher->pool);
+        free(dispatcher->aliases);
+        free(dispatcher->buckets);
+        free(dispatcher);
+}
+
+/*
+ * Value stream callback, passing every value to the dispatcher.
+ */
+static int
+on_value(const char *const topic_path,
+         const TOPIC_SPECIFICATION_T *const specification,
+         DIFFUSION_DATATYPE datatype,
+         const DIFFUSION_VALUE_T *const old_value,
+         const DIFFUSION_VALUE_T *const new_value,
+         void *context)
+{
+        dispatcher_dispatch(context, topic_path, datatype, new_value);
+        return HANDLER_SUCCESS;
+}
+
+/*
+ * Subscription notifications tell us the server's ID for each topic.
+ */
+static int
+on_notify_subscription(SESSION_T *session,
+                       const SVC_NOTIFY_SUBSCRIPTION_REQUEST_T *request,
+                       void *context)
+{
+        DISPATCHER_T *dispatcher = context;
+
+        apr_thread_mutex_lock(dispatcher->mutex);
+        DISPATCH_ENTRY_T *entry = dispatcher_entry(dispatcher, request->topic_info.topic_path);
+        dispatcher_alias_add(dispatcher, request->topic_info.topic_id, entry);
+        if(request->topic_details != NULL) {
+                entry->topic_type = request->topic_details->topic_type;
+        }
+        apr_thread_mutex_unlock(dispatcher->mutex);
+        return HANDLER_SUCCESS;
+}
+
+static int
+on_notify_unsubscription(SESSION_T *session,
+                         const SVC_NOTIFY_UNSUBSCRIPTION_REQUEST_T *request,
+                         void *context)
+{
+        DISPATCHER_T *dispatcher = context;
+
+        apr_thread_mutex_lock(dispatcher->mutex);
+        dispatcher_alias_remove(dispatcher, request->topic_id);
+        apr_thread_mutex_unlock(dispatcher->mutex);
+        return HANDLER_SUCCESS;
+}
+
+/*
+ * Handlers used by the example; they only count what they receive.
+ */
+static int
+count_value(const char *topic_path, DIFFUSION_DATATYPE datatype,
+            const DIFFUSION_VALUE_T *value, void *context)
+{
+        apr_atomic_inc32(context);
+        return HANDLER_SUCCESS;
+}
+
+static void
+register_handlers(DISPATCHER_T *dispatcher, int exact_count, int wildcard_count,
+                  volatile apr_uint32_t *exact_received, volatile apr_uint32_t *wildcard_received,
+                  volatile apr_uint32_t *fallback_received)
+{
+        char selector[256];
+
+        for(int i = 0; i < exact_count; i++) {
+                snprintf(selector, sizeof(selector), ">dispatch/exact/%d", i);
+                dispatcher_add(dispatcher, selector, count_value, (void *)exact_received);
+        }
+        for(int i = 0; i < wildcard_count; i++) {
+                snprintf(selector, sizeof(selector), "?dispatch/wildcard/%d/.*", i);
+                dispatcher_add(dispatcher, selector, count_value, (void *)wildcard_received);
+        }
+        dispatcher_set_fallback(dispatcher, count_value, (void *)fallback_received);
+}
+
+/*
+ * Compare dispatching synthetic values through the dispatcher with
+ * evaluating every registered selector for every value.
+ */
+static void
+run_benchmark(int exact_count, int wildcard_count, long iterations)
+{
+        volatile apr_uint32_t exact_received = 0;
+        volatile apr_uint32_t wildcard_received = 0;
+        volatile apr_uint32_t fallback_received = 0;
+
+        DISPATCHER_T *dispatcher = dispatcher_create();
+        register_handlers(dispatcher, exact_count, wildcard_count,
+                          &exact_received, &wildcard_received, &fallback_received);
+
+        // A mix of exact, wildcard and unmatched topics.
+        const int path_count = exact_count > 0 ? exact_count : 1;
+        char **paths = calloc(path_count, sizeof(char *));
+        char **selectors = calloc(exact_count + wildcard_count, sizeof(char *));
+        char buf[256];
+        for(int i = 0; i < path_count; i++) {
+                if(i % 10 == 9 && wildcard_count > 0) {
+                        snprintf(buf, sizeof(buf), "dispatch/wildcard/%d/x", i % wildcard_count);
+                }
+                else if(i % 10 == 8) {
+                        snprintf(buf, sizeof(buf), "dispatch/other/%d", i);
+                }
+                else {
+                        snprintf(buf, sizeof(buf), "dispatch/exact/%d", i);
+                }
+                paths[i] = strdup(buf);
+        }
+        for(int i = 0; i < exact_count; i++) {
+                snprintf(buf, sizeof(buf), ">dispatch/exact/%d", i);
+                selectors[i] = strdup(buf);
+        }
+        for(int i = 0; i < wildcard_count; i++) {
+                snprintf(buf, sizeof(buf), "?dispatch/wildcard/%d/.*", i);
+                selectors[exact_count + i] = strdup(buf);
+        }
+
+        apr_time_t start = apr_time_now();
+        for(long i = 0; i < iterations; i++) {
+                dispatcher_dispatch(dispatcher, paths[i % path_count], DATATYPE_STRING, NULL);
+        }
+        const apr_interval_time_t indexed = apr_time_now() - start;
+
+        // The naive equivalent is too slow to run as many times.
+        const long naive_iterations = iterations / 100 > 0 ? iterations / 100 : 1;
+        unsigned long naive_matches = 0;
+        start = apr_time_now();
+        for(long i = 0; i < naive_iterations; i++) {
+                for(int j = 0; j < exact_count + wildcard_count; j++) {
+                        naive_matches += selector_match(selectors[j], paths[i % path_count]);
+                }
+        }
+        const apr_interval_time_t naive = apr_time_now() - start;
+
+        printf("%d exact and %d wildcard handlers\n", exact_count, wildcard_count);
+        printf("Indexed: %ld dispatches, %.3f us each (%u resolved, %u selector evaluations)\n",
+               iterations, (double)indexed / iterations,
+               apr_atomic_read32(&dispatcher->resolved),
+               apr_atomic_read32(&dispatcher->selector_evaluations));
+        printf("         %u exact, %u wildcard, %u fallback deliveries\n",
+               apr_atomic_read32(&exact_received), apr_atomic_read32(&wildcard_received),
+               apr_atomic_read32(&fallback_received));
+        printf("Naive:   %ld dispatches, %.3f us each (%lu matches)\n",
+               naive_iterations, (double)naive / naive_iterations, naive_matches);
+
+        for(int i = 0; i < path_count; i++) {
+                free(paths[i]);
+        }
+        for(int i = 0; i < exact_count + wildcard_count; i++) {
+                free(selectors[i]);
+        }
+        free(paths);
+        free(selectors);
+        dispatcher_free(dispatcher);
+}
+
+/*
+ * Entry point for the example.
+ */
+int
+main(int argc, char **argv)
+{
+        /*
+         * Standard command-line parsing.
+         */
+        HASH_T *options = parse_cmdline(argc, argv, arg_opts);
+        if(options == NULL || hash_get(options, "help") != NULL) {
+                show_usage(argc, argv, arg_opts);
+                return EXIT_FAILURE;
+        }
+
+        const char *url = hash_get(options, "url");
+        const char *principal = hash_get(options, "principal");
+        CREDENTIALS_T *credentials = NULL;
+        const char *password = hash_get(options, "credentials");
+        if(password != NULL) {
+                credentials = credentials_create_password(password);
+        }
+        const char *topic_selector = hash_get(options, "topic_selector");
+        const int exact_count = atoi(hash_get(options, "exact"));
+        const int wildcard_count = atoi(hash_get(options, "wildcards"));
+        const char *benchmark = hash_get(options, "benchmark");
+        const unsigned int sleep_time = atol(hash_get(options, "sleep"));
+
+        apr_initialize();
+
+        if(benchmark != NULL) {
+                run_benchmark(exact_count, wildcard_count, atol(benchmark));
+                credentials_free(credentials);
+                hash_free(options, NULL, free);
+                apr_terminate();
+                return EXIT_SUCCESS;
+        }
+
+        volatile apr_uint32_t exact_received = 0;
+        volatile apr_uint32_t wildcard_received = 0;
+        volatile apr_uint32_t fallback_received = 0;
+
+        DISPATCHER_T *dispatcher = dispatcher_create();
+        register_handlers(dispatcher, exact_count, wildcard_count,
+                          &exact_received, &wildcard_received, &fallback_received);
+
+        /*
+         * Create a session, synchronously.
+         */
+        DIFFUSION_ERROR_T error = { 0 };
+        SESSION_T *session = session_create(url, principal, credentials, NULL, NULL, &error);
+        if(session == NULL) {
+                printf("Failed to create session: %s\n", error.message);
+                free(error.message);
+                return EXIT_FAILURE;
+        }
+
+        /*
+         * One value stream per datatype feeds the dispatcher, however
+         * many handlers are registered with it.
+         */
+        const DIFFUSION_DATATYPE datatypes[] = {
+                DATATYPE_BINARY, DATATYPE_JSON, DATATYPE_STRING,
+                DATATYPE_DOUBLE, DATATYPE_INT64, DATATYPE_RECORDV2
+        };
+        for(size_t i = 0; i < sizeof(datatypes) / sizeof(datatypes[0]); i++) {
+                VALUE_STREAM_T value_stream = {
+                        .datatype = datatypes[i],
+                        .on_value = on_value,
+                        .context = dispatcher
+                };
+                add_stream(session, topic_selector, &value_stream);
+        }
+
+        NOTIFY_SUBSCRIPTION_PARAMS_T notify_subscription_params = {
+                .on_notify_subscription = on_notify_subscription,
+                .context = dispatcher
+        };
+        notify_subscription_register(session, notify_subscription_params);
+
+        NOTIFY_UNSUBSCRIPTION_PARAMS_T notify_unsubscription_params = {
+                .on_notify_unsubscription = on_notify_unsubscription,
+                .context = dispatcher
+        };
+        notify_unsubscription_register(session, notify_unsubscription_params);
+
+        SUBSCRIPTION_PARAMS_T params = {
+                .topic_selector = topic_selector
+        };
+        subscribe(session, params);
+
+        for(unsigned int t = 0; t < sleep_time; t++) {
+                sleep(1);
+                printf("%u values dispatched (%u resolved): %u exact, %u wildcard, %u fallback\n",
+                       apr_atomic_read32(&dispatcher->dispatched),
+                       apr_atomic_read32(&dispatcher->resolved),
+                       apr_atomic_read32(&exact_received),
+                       apr_atomic_read32(&wildcard_received),
+                       apr_atomic_read32(&fallback_received));
+
+                apr_thread_mutex_lock(dispatcher->mutex);
+                const apr_uint32_t alias_count = dispatcher->alias_count;
+                const apr_uint32_t alias_capacity = dispatcher->alias_capacity;
+                apr_thread_mutex_unlock(dispatcher->mutex);
+
+                DIFFUSION_DATATYPE datatype;
+                DIFFUSION_VALUE_T *first = dispatcher_get_value(dispatcher, 0, &datatype);
+                printf("%u topic aliases in a table of %u; topic 0 %s\n",
+                       alias_count, alias_capacity, first != NULL ? "has a value" : "has no value");
+                if(first != NULL) {
+                        diffusion_value_free(first);
+                }
+        }
+
+        /*
+         * Close the session before freeing the dispatcher, so that no
+         * value streams can be invoked on it.
+         */
+        session_close(session, NULL);
+        session_free(session);
+        dispatcher_free(dispatcher);
+
+        credentials_free(credentials);
+        hash_free(options, NULL, free);
+
+        apr_terminate();
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,734 @@
+/**
+ * Copyright © 2026 Push Technology Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This example is written in C99. Please use an appropriate C99 capable compiler
+ *
+ * @author Push Technology Limited
+ * @since 6.4
+ */
+
+/*
+ * This example provides vectorised versions of string handling which
+ * applications commonly do around topic values: validating that text
+ * is UTF-8 before publishing it as a string value, escaping text for
+ * embedding in a JSON value, and hex encoding binary values for
+ * logging.
+ *
+ * Each kernel has a portable scalar version and, on x86, SSE4.2 and
+ * AVX2 versions. The best version the CPU supports is chosen at run
+ * time, so the program can be built for a baseline x86-64 target and
+ * still use AVX2 where it is available.
+ *
+ *  - UTF-8 validation skips runs of ASCII a vector at a time and only
+ *    decodes the multibyte sequences themselves.
+ *  - Escape scanning finds the next byte which needs escaping in a
+ *    JSON string (a quote, a backslash or a control character); the
+ *    escaper copies everything before it in one go.
+ *  - Hex encoding looks up 16 or 32 nibbles at once with a byte
+ *    shuffle.
+ *  - WebSocket masking XORs a payload with the frame's masking key as
+ *    it copies it into the send buffer, 32 bytes at a time with AVX2,
+ *    so masking costs no pass over the data beyond the copy. Every
+ *    frame a client sends must be masked, so this is on the publishing
+ *    path for every byte.
+ *
+ * When run, the example checks that every version gives the same
+ * results as the scalar one and reports the throughput of each.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define STRING_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+#include <apr.h>
+#include <apr_time.h>
+
+#include "diffusion.h"
+#include "args.h"
+
+ARG_OPTS_T arg_opts[] = {
+        ARG_OPTS_HELP,
+        {'n', "size", "Size of the benchmark buffers (in KB)", ARG_OPTIONAL, ARG_HAS_VALUE, "16384"},
+        {'i', "iterations", "Number of passes over each buffer", ARG_OPTIONAL, ARG_HAS_VALUE, "20"},
+        END_OF_ARG_OPTS
+};
+
+typedef struct string_kernels_s {
+        const char *name;
+        // Returns true if the bytes are well-formed UTF-8.
+        bool (*utf8_validate)(const unsigned char *data, size_t len);
+        // Returns the offset of the first byte needing a JSON escape,
+        // or len if there is none.
+        size_t (*escape_scan)(const unsigned char *data, size_t len);
+        // Writes 2 * len lowercase hex digits to out.
+        void (*hex_encode)(const unsigned char *data, size_t len, char *out);
+        // Copies len bytes to dst, XORed with a WebSocket masking key.
+        // The offset is the position of src within the masked payload.
+        void (*mask_copy)(unsigned char *dst, const unsigned char *src, size_t len,
+                          const unsigned char key[4], size_t offset);
+} STRING_KERNELS_T;
+
+static const char hex_digits[] = "0123456789abcdef";
+
+/*
+ * Returns the length of the well-formed UTF-8 sequence starting at p,
+ * or 0 if it is not well-formed. Overlong forms, surrogates and code
+ * points above U+10FFFF are rejected.
+ */
+static size_t
+utf8_sequence_length(const unsigned char *p, size_t remaining)
+{
+        const unsigned char c = p[0];
+
+        if(c < 0x80) {
+                return 1;
+        }
+        if(c >= 0xc2 && c <= 0xdf) {
+                return remaining >= 2 && (p[1] & 0xc0) == 0x80 ? 2 : 0;
+        }
+        if(c >= 0xe0 && c <= 0xef) {
+                if(remaining < 3 || (p[1] & 0xc0) != 0x80 || (p[2] & 0xc0) != 0x80) {
+                        return 0;
+                }
+                if((c == 0xe0 && p[1] < 0xa0) || (c == 0xed && p[1] > 0x9f)) {
+                        return 0;
+                }
+                return 3;
+        }
+        if(c >= 0xf0 && c <= 0xf4) {
+                if(remaining < 4 || (p[1] & 0xc0) != 0x80 || (p[2] & 0xc0) != 0x80 || (p[3] & 0xc0) != 0x80) {
+                        return 0;
+                }
+                if((c == 0xf0 && p[1] < 0x90) || (c == 0xf4 && p[1] > 0x8f)) {
+                        return 0;
+                }
+                return 4;
+        }
+        return 0;
+}
+
+static bool
+utf8_validate_scalar(const unsigned char *data, size_t len)
+{
+        size_t i = 0;
+        while(i < len) {
+                const size_t n = utf8_sequence_length(data + i, len - i);
+                if(n == 0) {
+                        return false;
+                }
+                i += n;
+        }
+        return true;
+}
+
+static bool
+needs_escape(unsigned char c)
+{
+        return c < 0x20 || c == '"' || c == '\\';
+}
+
+static size_t
+escape_scan_scalar(const unsigned char *data, size_t len)
+{
+        for(size_t i = 0; i < len; i++) {
+                if(needs_escape(data[i])) {
+                        return i;
+                }
+        }
+        return len;
+}
+
+static void
+hex_encode_scalar(const unsigned char *data, size_t len, char *out)
+{
+        for(size_t i = 0; i < len; i++) {
+                out[2 * i] = hex_digits[data[i] >> 4];
+                out[2 * i + 1] = hex_digits[data[i] & 0x0f];
+        }
+}
+
+/*
+ * The straightforward byte loop, kept as the reference the other
+ * masking kernels are checked against.
+ */
+static void
+mask_copy_bytewise(unsigned char *dst, const unsigned char *src, size_t len,
+                   const unsigned char key[4], size_t offset)
+{
+        for(size_t i = 0; i < len; i++) {
+                dst[i] = src[i] ^ key[(offset + i) & 3];
+        }
+}
+
+/*
+ * Fill a pattern with the masking key, rotated so that its first byte
+ * applies to payload position offset.
+ */
+static void
+mask_pattern(unsigned char *pattern, size_t len, const unsigned char key[4], size_t offset)
+{
+        for(size_t i = 0; i < len; i++) {
+                pattern[i] = key[(offset + i) & 3];
+        }
+}
+
+static void
+mask_copy_scalar(unsigned char *dst, const unsigned char *src, size_t len,
+                 const unsigned char key[4], size_t offset)
+{
+        uint64_t pattern;
+        mask_pattern((unsigned char *)&pattern, sizeof(pattern), key, offset);
+
+        size_t i = 0;
+        for(; i + 8 <= len; i += 8) {
+                uint64_t word;
+                memcpy(&word, src + i, 8);
+                word ^= pattern;
+                memcpy(dst + i, &word, 8);
+        }
+        mask_copy_bytewise(dst + i, src + i, len - i, key, offset + i);
+}
+
+static const STRING_KERNELS_T scalar_kernels = {
+        "scalar", utf8_validate_scalar, escape_scan_scalar, hex_encode_scalar, mask_copy_scalar
+};
+
+#ifdef STRING_KERNELS_X86
+
+__attribute__((target("sse4.2")))
+static bool
+utf8_validate_sse42(const unsigned char *data, size_t len)
+{
+        size_t i = 0;
+        while(i + 16 <= len) {
+                const int high = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(data + i)));
+                if(high == 0) {
+                        i += 16;
+                        continue;
+                }
+                // Skip the ASCII prefix, then decode one sequence.
+                i += __builtin_ctz(high);
+                const size_t n = utf8_sequence_length(data + i, len - i);
+                if(n == 0) {
+                        return false;
+                }
+                i += n;
+        }
+        return utf8_validate_scalar(data + i, len - i);
+}
+
+/*
+ * SSE4.2's string comparison matches against up to eight byte ranges
+ * at once: control characters, the quote and the backslash.
+ */
+__attribute__((target("sse4.2")))
+static size_t
+escape_scan_sse42(const unsigned char *data, size_t len)
+{
+        const __m128i ranges = _mm_setr_epi8(0x00, 0x1f, '"', '"', '\\', '\\',
+                                             0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+        size_t i = 0;
+        while(i + 16 <= len) {
+                const __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+                const int index = _mm_cmpestri(ranges, 6, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES);
+                if(index < 16) {
+                        return i + index;
+                }
+                i += 16;
+        }
+        return i + escape_scan_scalar(data + i, len - i);
+}
+
+__attribute__((target("sse4.2")))
+static void
+hex_encode_sse42(const unsigned char *data, size_t len, char *out)
+{
+        const __m128i lut = _mm_loadu_si128((const __m128i *)hex_digits);
+        const __m128i low_nibble = _mm_set1_epi8(0x0f);
+        size_t i = 0;
+        for(; i + 16 <= len; i += 16) {
+                const __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+                const __m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), low_nibble));
+                const __m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(v, low_nibble));
+                _mm_storeu_si128((__m128i *)(out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+                _mm_storeu_si128((__m128i *)(out + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+        }
+        hex_encode_scalar(data + i, len - i, out + 2 * i);
+}
+
+__attribute__((target("sse4.2")))
+static void
+mask_copy_sse42(unsigned char *dst, const unsigned char *src, size_t len,
+                const unsigned char key[4], size_t offset)
+{
+        unsigned char bytes[16];
+        mask_pattern(bytes, sizeof(bytes), key, offset);
+        const __m128i pattern = _mm_loadu_si128((const __m128i *)bytes);
+
+        size_t i = 0;
+        for(; i + 16 <= len; i += 16) {
+                const __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+                _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(v, pattern));
+        }
+        mask_copy_scalar(dst + i, src + i, len - i, key, offset + i);
+}
+
+static const STRING_KERNELS_T sse42_kernels = {
+        "sse4.2", utf8_validate_sse42, escape_scan_sse42, hex_encode_sse42, mask_copy_sse42
+};
+
+__attribute__((target("avx2")))
+static bool
+utf8_validate_avx2(const unsigned char *data, size_t len)
+{
+        size_t i = 0;
+        while(i + 32 <= len) {
+                const unsigned int high = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(data + i)));
+                if(high == 0) {
+                        i += 32;
+                        continue;
+                }
+                i += __builtin_ctz(high);
+                const size_t n = utf8_sequence_length(data + i, len - i);
+                if(n == 0) {
+                        return false;
+                }
+                i += n;
+        }
+        return utf8_validate_scalar(data + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t
+escape_scan_avx2(const unsigned char *data, size_t len)
+{
+        const __m256i control_max = _mm256_set1_epi8(0x1f);
+        const __m256i quote = _mm256_set1_epi8('"');
+        const __m256i backslash = _mm256_set1_epi8('\\');
+        size_t i = 0;
+        while(i + 32 <= len) {
+                const __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+                // min(v, 0x1f) == v exactly when v <= 0x1f, unsigned.
+                const __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(v, control_max), v);
+                const __m256i special = _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                                                        _mm256_cmpeq_epi8(v, backslash));
+                const unsigned int mask = _mm256_movemask_epi8(_mm256_or_si256(control, special));
+                if(mask != 0) {
+                        return i + __builtin_ctz(mask);
+                }
+                i += 32;
+        }
+        return i + escape_scan_scalar(data + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static void
+hex_encode_avx2(const unsigned char *data, size_t len, char *out)
+{
+        const __m256i lut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)hex_digits));
+        const __m256i low_nibble = _mm256_set1_epi8(0x0f);
+        size_t i = 0;
+        for(; i + 32 <= len; i += 32) {
+                const __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+                const __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibble));
+                const __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, low_nibble));
+                // Unpacking works within 128-bit lanes, so put the
+                // lanes back in order before storing.
+                const __m256i a = _mm256_unpacklo_epi8(hi, lo);
+                const __m256i b = _mm256_unpackhi_epi8(hi, lo);
+                _mm256_storeu_si256((__m256i *)(out + 2 * i), _mm256_permute2x128_si256(a, b, 0x20));
+                _mm256_storeu_si256((__m256i *)(out + 2 * i + 32), _mm256_permute2x128_si256(a, b, 0x31));
+        }
+        hex_encode_sse42(data + i, len - i, out + 2 * i);
+}
+
+__attribute__((target("avx2")))
+static void
+mask_copy_avx2(unsigned char *dst, const unsigned char *src, size_t len,
+               const unsigned char key[4], size_t offset)
+{
+        unsigned char bytes[32];
+        mask_pattern(bytes, sizeof(bytes), key, offset);
+        const __m256i pattern = _mm256_loadu_si256((const __m256i *)bytes);
+
+        size_t i = 0;
+        for(; i + 64 <= len; i += 64) {
+                const __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+                const __m256i b = _mm256_loadu_si256((const __m256i *)(src + i + 32));
+                _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(a, pattern));
+                _mm256_storeu_si256((__m256i *)(dst + i + 32), _mm256_xor_si256(b, pattern));
+        }
+        for(; i + 32 <= len; i += 32) {
+                const __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+                _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(v, pattern));
+        }
+        mask_copy_sse42(dst + i, src + i, len - i, key, offset + i);
+}
+
+static const STRING_KERNELS_T avx2_kernels = {
+        "avx2", utf8_validate_avx2, escape_scan_avx2, hex_encode_avx2, mask_copy_avx2
+};
+
+#endif
+
+/*
+ * Choose the best kernels for this CPU.
+ */
+static const STRING_KERNELS_T *
+string_kernels_select(void)
+{
+#ifdef STRING_KERNELS_X86
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2")) {
+                return &avx2_kernels;
+        }
+        if(__builtin_cpu_supports("sse4.2")) {
+                return &sse42_kernels;
+        }
+#endif
+        return &scalar_kernels;
+}
+
+/*
+ * Escape text for inclusion in a JSON string, returning the length
+ * written. The output must have room for 6 bytes per input byte.
+ */
+static size_t
+json_escape(const STRING_KERNELS_T *kernels, const char *src, size_t len, char *dst)
+{
+        const unsigned char *p = (const unsigned char *)src;
+        size_t out = 0;
+        size_t i = 0;
+
+        while(i < len) {
+                const size_t run = kernels->escape_scan(p + i, len - i);
+                memcpy(dst + out, p + i, run);
+                out += run;
+                i += run;
+                if(i == len) {
+                        break;
+                }
+
+                const unsigned char c = p[i++];
+                dst[out++] = '\\';
+                switch(c) {
+                case '"':
+                case '\\':
+                        dst[out++] = c;
+                        break;
+                case '\n':
+                        dst[out++] = 'n';
+                        break;
+                case '\r':
+                        dst[out++] = 'r';
+                        break;
+                case '\t':
+                        dst[out++] = 't';
+                        break;
+                default:
+                        out += sprintf(dst + out, "u%04x", c);
+                        break;
+                }
+        }
+        return out;
+}
+
+/*
+ * Write a masked, final client-to-server WebSocket frame into out,
+ * returning its length. The payload is masked as it is copied in. The
+ * output must have room for the payload plus 14 bytes of header.
+ */
+static size_t
+ws_write_client_frame(const STRING_KERNELS_T *kernels, unsigned char *out, unsigned char opcode,
+                      const void *payload, size_t len, const unsigned char key[4])
+{
+        size_t header = 0;
+
+        out[header++] = 0x80 | (opcode & 0x0f);
+        if(len < 126) {
+                out[header++] = 0x80 | (unsigned char)len;
+        }
+        else if(len <= 0xffff) {
+                out[header++] = 0x80 | 126;
+                out[header++] = (unsigned char)(len >> 8);
+                out[header++] = (unsigned char)len;
+        }
+        else {
+                out[header++] = 0x80 | 127;
+                for(int shift = 56; shift >= 0; shift -= 8) {
+                        out[header++] = (unsigned char)((uint64_t)len >> shift);
+                }
+        }
+        memcpy(out + header, key, 4);
+        header += 4;
+
+        kernels->mask_copy(out + header, payload, len, key, 0);
+        return header + len;
+}
+
+/*
+ * Write a string value only if it is valid UTF-8, which the server
+ * requires of string topics.
+ */
+static bool
+write_string_value_checked(const STRING_KERNELS_T *kernels, const char *value, BUF_T *buf)
+{
+        if(!kernels->utf8_validate((const unsigned char *)value, strlen(value))) {
+                return false;
+        }
+        return write_diffusion_string_value(value, buf);
+}
+
+/*
+ * Fill a buffer with text: mostly ASCII, with a multibyte character
+ * every "spacing" bytes (none if 0) and the occasional quote.
+ */
+static void
+fill_text(unsigned char *data, size_t len, size_t spacing)
+{
+        static const char words[] = "the quick brown fox jumps over the lazy dog ";
+        static const unsigned char multibyte[][4] = {
+                { 0xc3, 0xa9 }, { 0xe2, 0x82, 0xac }, { 0xf0, 0x9f, 0x98, 0x80 }
+        };
+        size_t i = 0;
+        size_t k = 0;
+
+        while(i < len) {
+                if(spacing > 0 && i % spacing == spacing - 1 && i + 4 <= len) {
+                        const size_t n = 2 + k % 3;
+                        memcpy(data + i, multibyte[k % 3], n);
+                        i += n;
+                        k++;
+                }
+                else if(i % 4099 == 4098) {
+                        data[i++] = '"';
+                }
+                else {
+                        data[i] = words[i % (sizeof(words) - 1)];
+                        i++;
+                }
+        }
+}
+
+/*
+ * Compare a set of kernels with the scalar ones over a range of
+ * lengths and alignments, and over some malformed UTF-8.
+ */
+static bool
+verify_kernels(const STRING_KERNELS_T *kernels)
+{
+        static const struct {
+                unsigned char bytes[4];
+                size_t len;
+        } invalid[] = {
+                { { 0xc0, 0x80 }, 2 },                  // overlong
+                { { 0xe0, 0x80, 0x80 }, 3 },            // overlong
+                { { 0xed, 0xa0, 0x80 }, 3 },            // surrogate
+                { { 0xf4, 0x90, 0x80, 0x80 }, 4 },      // above U+10FFFF
+                { { 0xff }, 1 },
+                { { 0x80 }, 1 },                        // stray continuation
+                { { 0xe2, 0x82 }, 2 }                   // truncated
+        };
+        static const unsigned char key[4] = { 0x37, 0xfa, 0x21, 0x3d };
+        unsigned char data[512];
+        char expected[1024];
+        char actual[1024];
+
+        fill_text(data, sizeof(data), 7);
+        data[100] = '\n';
+
+        for(size_t offset = 0; offset < 32; offset++) {
+                for(size_t len = 0; len + offset <= sizeof(data); len += 1 + len / 8) {
+                        const unsigned char *p = data + offset;
+                        if(kernels->utf8_validate(p, len) != utf8_validate_scalar(p, len)
+                           || kernels->escape_scan(p, len) != escape_scan_scalar(p, len)) {
+                                return false;
+                        }
+                        kernels->hex_encode(p, len, actual);
+                        hex_encode_scalar(p, len, expected);
+                        if(memcmp(actual, expected, 2 * len) != 0) {
+                                return false;
+                        }
+                        for(size_t mask_offset = 0; mask_offset < 4; mask_offset++) {
+                                kernels->mask_copy((unsigned char *)actual + 1, p, len, key, mask_offset);
+                                mask_copy_bytewise((unsigned char *)expected + 1, p, len, key, mask_offset);
+                                if(memcmp(actual + 1, expected + 1, len) != 0) {
+                                        return false;
+                                }
+                        }
+                }
+        }
+
+        for(size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+                for(size_t position = 0; position < 100; position += 13) {
+                        fill_text(data, 128, 0);
+                        memcpy(data + position, invalid[i].bytes, invalid[i].len);
+                        if(kernels->utf8_validate(data, 128) || utf8_validate_scalar(data, 128)) {
+                                return false;
+                        }
+                }
+        }
+        return true;
+}
+
+static double
+megabytes_per_second(size_t bytes, apr_interval_time_t elapsed)
+{
+        return elapsed > 0 ? (double)bytes / elapsed : 0;
+}
+
+static void
+benchmark_kernels(const STRING_KERNELS_T *kernels, const unsigned char *ascii,
+                  const unsigned char *mixed, size_t len, int iterations, char *out)
+{
+        volatile size_t sink = 0;
+
+        apr_time_t start = apr_time_now();
+        for(int i = 0; i < iterations; i++) {
+                sink += kernels->utf8_validate(ascii, len);
+        }
+        const apr_interval_time_t validate_ascii = apr_time_now() - start;
+
+        start = apr_time_now();
+        for(int i = 0; i < iterations; i++) {
+                sink += kernels->utf8_validate(mixed, len);
+        }
+        const apr_interval_time_t validate_mixed = apr_time_now() - start;
+
+        start = apr_time_now();
+        for(int i = 0; i < iterations; i++) {
+                sink += json_escape(kernels, (const char *)ascii, len, out);
+        }
+        const apr_interval_time_t escape = apr_time_now() - start;
+
+        start = apr_time_now();
+        for(int i = 0; i < iterations; i++) {
+                kernels->hex_encode(ascii, len, out);
+                sink += out[0];
+        }
+        const apr_interval_time_t hex = apr_time_now() - start;
+
+        const unsigned char key[4] = { 0x37, 0xfa, 0x21, 0x3d };
+        start = apr_time_now();
+        for(int i = 0; i < iterations; i++) {
+                kernels->mask_copy((unsigned char *)out, ascii, len, key, 0);
+                sink += out[0];
+        }
+        const apr_interval_time_t mask = apr_time_now() - start;
+
+        const size_t total = len * iterations;
+        printf("%-8s masked copy %8.0f MB/s\n", kernels->name, megabytes_per_second(total, mask));
+        printf("%-8s validate %8.0f MB/s (ASCII) %8.0f MB/s (mixed), escape %8.0f MB/s, hex %8.0f MB/s\n",
+               kernels->name,
+               megabytes_per_second(total, validate_ascii),
+               megabytes_per_second(total, validate_mixed),
+               megabytes_per_second(total, escape),
+               megabytes_per_second(total, hex));
+}
+
+/*
+ * Entry point for the example.
+ */
+int
+main(int argc, char **argv)
+{
+        /*
+         * Standard command-line parsing.
+         */
+        HASH_T *options = parse_cmdline(argc, argv, arg_opts);
+        if(options == NULL || hash_get(options, "help") != NULL) {
+                show_usage(argc, argv, arg_opts);
+                return EXIT_FAILURE;
+        }
+
+        const size_t len = (size_t)atol(hash_get(options, "size")) * 1024;
+        const int iterations = atoi(hash_get(options, "iterations"));
+
+        apr_initialize();
+
+        const STRING_KERNELS_T *candidates[3];
+        int candidate_count = 0;
+        candidates[candidate_count++] = &scalar_kernels;
+#ifdef STRING_KERNELS_X86
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("sse4.2")) {
+                candidates[candidate_count++] = &sse42_kernels;
+        }
+        if(__builtin_cpu_supports("avx2")) {
+                candidates[candidate_count++] = &avx2_kernels;
+        }
+#endif
+        const STRING_KERNELS_T *selected = string_kernels_select();
+        printf("Using %s kernels\n", selected->name);
+
+        int status = EXIT_SUCCESS;
+        for(int i = 0; i < candidate_count; i++) {
+                const bool ok = verify_kernels(candidates[i]);
+                printf("%-8s %s\n", candidates[i]->name, ok ? "agrees with scalar" : "MISMATCH");
+                if(!ok) {
+                        status = EXIT_FAILURE;
+                }
+        }
+
+        BUF_T *buf = buf_create();
+        const char *good = "caf\xc3\xa9";
+        const char *bad = "caf\xc3";
+        printf("Writing \"%s\": %s\n", good, write_string_value_checked(selected, good, buf) ? "ok" : "rejected");
+        printf("Writing a truncated sequence: %s\n", write_string_value_checked(selected, bad, buf) ? "ok" : "rejected");
+        buf_free(buf);
+
+        unsigned char *ascii = malloc(len);
+        unsigned char *mixed = malloc(len);
+        char *out = malloc(len * 6 + 1);
+        fill_text(ascii, len, 0);
+        fill_text(mixed, len, 64);
+
+        /*
+         * The baseline for masking: copy the payload into the send
+         * buffer, then mask it in place a byte at a time.
+         */
+        const unsigned char key[4] = { 0x37, 0xfa, 0x21, 0x3d };
+        apr_time_t start = apr_time_now();
+        for(int i = 0; i < iterations; i++) {
+                memcpy(out, ascii, len);
+                mask_copy_bytewise((unsigned char *)out, (unsigned char *)out, len, key, 0);
+        }
+        printf("%-8s copy+mask   %8.0f MB/s\n", "bytewise",
+               megabytes_per_second(len * iterations, apr_time_now() - start));
+
+        for(int i = 0; i < candidate_count; i++) {
+                benchmark_kernels(candidates[i], ascii, mixed, len, iterations, out);
+        }
+
+        unsigned char frame[64];
+        const size_t frame_len = ws_write_client_frame(selected, frame, 0x2, "hello", 5, key);
+        unsigned char unmasked[5];
+        selected->mask_copy(unmasked, frame + frame_len - 5, 5, key, 0);
+        printf("Wrote a %zu byte frame, which unmasks to \"%.5s\"\n", frame_len, (const char *)unmasked);
+
+        free(out);
+        free(mixed);
+        free(ascii);
+        hash_free(options, NULL, free);
+
+        apr_terminate();
+
+        return status;
+}
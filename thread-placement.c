@@ -0,0 +1,457 @@
+/**
+ * Copyright © 2026 Push Technology Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This example is written in C99. Please use an appropriate C99 capable compiler
+ *
+ * @author Push Technology Limited
+ * @since 6.4
+ */
+
+/*
+ * This example shows how to control where a session's threads run, so
+ * that they neither migrate between NUMA nodes nor collide with an
+ * application's own pinned threads.
+ *
+ * The session thread, and the transport's read and write threads, are
+ * each given a name ("<prefix>-session" and so on, "-N"), a set of
+ * CPUs ("-S", "-R", "-W"; lists such as "0,2-3") and a scheduling
+ * policy and priority ("-P", "-r"). Only these threads are placed: the
+ * session exposes their handles, so they are known to be the library's.
+ * Any other thread, including the application's own pinned threads and
+ * any it starts later, is left alone. Threads are placed when the
+ * session becomes active, and again whenever it reconnects, since the
+ * transport threads are replaced.
+ *
+ * Every second the example lists each thread in the process with the
+ * CPU time it has used, its share of a CPU over the last second, and
+ * the CPU it last ran on, so that the placement can be checked.
+ *
+ * Thread placement uses Linux interfaces; elsewhere only the
+ * statistics that are available are shown.
+ */
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <apr.h>
+#include <apr_atomic.h>
+#include <apr_portable.h>
+
+#include "diffusion.h"
+#include "args.h"
+
+ARG_OPTS_T arg_opts[] = {
+        ARG_OPTS_HELP,
+        {'u', "url", "Diffusion server URL", ARG_OPTIONAL, ARG_HAS_VALUE, "ws://localhost:8080"},
+        {'p', "principal", "Principal (username) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "client"},
+        {'c', "credentials", "Credentials (password) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "password"},
+        {'t', "topic_selector", "Topic selector to subscribe to", ARG_OPTIONAL, ARG_HAS_VALUE, "?.*//"},
+        {'N', "name", "Prefix for the names of the session's threads", ARG_OPTIONAL, ARG_HAS_VALUE, "diffusion"},
+        {'S', "session_cpus", "CPUs for the session thread", ARG_OPTIONAL, ARG_HAS_VALUE, NULL},
+        {'R', "read_cpus", "CPUs for the read thread", ARG_OPTIONAL, ARG_HAS_VALUE, NULL},
+        {'W', "write_cpus", "CPUs for the write thread", ARG_OPTIONAL, ARG_HAS_VALUE, NULL},
+        {'P', "policy", "Scheduling policy: other, batch, idle, fifo or rr", ARG_OPTIONAL, ARG_HAS_VALUE, NULL},
+        {'r', "priority", "Scheduling priority, for fifo and rr", ARG_OPTIONAL, ARG_HAS_VALUE, "0"},
+        {'s', "sleep", "Time to run for (in seconds)", ARG_OPTIONAL, ARG_HAS_VALUE, "30"},
+        END_OF_ARG_OPTS
+};
+
+typedef enum {
+        THREAD_ROLE_SESSION,
+        THREAD_ROLE_READ,
+        THREAD_ROLE_WRITE,
+        THREAD_ROLE_COUNT
+} THREAD_ROLE_T;
+
+static const char *const role_names[THREAD_ROLE_COUNT] = {
+        "session", "read", "write"
+};
+
+#define MAX_THREADS 256
+
+typedef struct thread_placement_s {
+        const char *name_prefix;
+#if defined(__linux__)
+        bool has_cpus[THREAD_ROLE_COUNT];
+        cpu_set_t cpus[THREAD_ROLE_COUNT];
+#endif
+        bool has_policy;
+        int policy;
+        int priority;
+        volatile apr_uint32_t placements;
+} THREAD_PLACEMENT_T;
+
+/*
+ * Session listeners have no context, so the placement for the session
+ * is held here.
+ */
+static THREAD_PLACEMENT_T *session_placement;
+
+#if defined(__linux__)
+
+/*
+ * Parse a CPU list such as "0,2-3". Returns false if it isn't valid.
+ */
+static bool
+parse_cpu_list(const char *list, cpu_set_t *cpus)
+{
+        CPU_ZERO(cpus);
+        const char *p = list;
+        while(*p != '\0') {
+                char *end;
+                const long first = strtol(p, &end, 10);
+                long last = first;
+                if(end == p || first < 0) {
+                        return false;
+                }
+                if(*end == '-') {
+                        p = end + 1;
+                        last = strtol(p, &end, 10);
+                        if(end == p || last < first) {
+                                return false;
+                        }
+                }
+                for(long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+                        CPU_SET(cpu, cpus);
+                }
+                if(*end == ',') {
+                        end++;
+                }
+                else if(*end != '\0') {
+                        return false;
+                }
+                p = end;
+        }
+        return CPU_COUNT(cpus) > 0;
+}
+
+static bool
+parse_policy(const char *name, int *policy)
+{
+        static const struct {
+                const char *name;
+                int policy;
+        } policies[] = {
+                { "other", SCHED_OTHER },
+                { "batch", SCHED_BATCH },
+                { "idle", SCHED_IDLE },
+                { "fifo", SCHED_FIFO },
+                { "rr", SCHED_RR }
+        };
+        for(size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+                if(strcmp(name, policies[i].name) == 0) {
+                        *policy = policies[i].policy;
+                        return true;
+                }
+        }
+        return false;
+}
+
+/*
+ * Place one of the session's threads, given its APR handle.
+ */
+static void
+place_thread(apr_thread_t *thread, THREAD_ROLE_T role, const THREAD_PLACEMENT_T *placement)
+{
+        apr_os_thread_t *os_thread = NULL;
+        if(thread == NULL || apr_os_thread_get(&os_thread, thread) != APR_SUCCESS || os_thread == NULL) {
+                return;
+        }
+
+        // Thread names are limited to 15 characters.
+        char name[16];
+        snprintf(name, sizeof(name), "%s-%s", placement->name_prefix, role_names[role]);
+        pthread_setname_np(*os_thread, name);
+
+        int rc;
+        if(placement->has_cpus[role] &&
+           (rc = pthread_setaffinity_np(*os_thread, sizeof(cpu_set_t), &placement->cpus[role])) != 0) {
+                printf("Failed to set the CPUs of the %s thread: %s\n", role_names[role], strerror(rc));
+        }
+        if(placement->has_policy) {
+                const struct sched_param param = { .sched_priority = placement->priority };
+                if((rc = pthread_setschedparam(*os_thread, placement->policy, &param)) != 0) {
+                        printf("Failed to set the scheduling policy of the %s thread: %s\n", role_names[role], strerror(rc));
+                }
+        }
+}
+
+#endif
+
+/*
+ * Place every thread the session has. Called whenever it becomes
+ * active, when the transport's threads are new.
+ */
+static void
+thread_placement_apply(SESSION_T *session, THREAD_PLACEMENT_T *placement)
+{
+#if defined(__linux__)
+        place_thread(session->session_thread, THREAD_ROLE_SESSION, placement);
+        if(session->transport != NULL) {
+                place_thread(session->transport->_read_thread, THREAD_ROLE_READ, placement);
+                place_thread(session->transport->_write_thread, THREAD_ROLE_WRITE, placement);
+        }
+        apr_atomic_inc32(&placement->placements);
+#endif
+}
+
+static void
+on_session_state_changed(SESSION_T *session,
+        const SESSION_STATE_T old_state,
+        const SESSION_STATE_T new_state)
+{
+        printf("Session state changed from %s (%d) to %s (%d)\n",
+               session_state_as_string(old_state), old_state,
+               session_state_as_string(new_state), new_state);
+        if(new_state == CONNECTED_ACTIVE && session_placement != NULL) {
+                thread_placement_apply(session, session_placement);
+        }
+}
+
+/*
+ * Create a session from the factory, placing its threads as it
+ * connects.
+ */
+static SESSION_T *
+thread_placement_session_create(DIFFUSION_SESSION_FACTORY_T *factory, const char *url,
+                                THREAD_PLACEMENT_T *placement)
+{
+        static SESSION_LISTENER_T session_listener = {
+                .on_state_changed = on_session_state_changed
+        };
+
+        session_placement = placement;
+        diffusion_session_factory_session_listener(factory, &session_listener);
+
+        SESSION_T *session = session_create_with_session_factory(factory, url);
+        if(session != NULL && apr_atomic_read32(&placement->placements) == 0) {
+                // The session was active before it could be placed.
+                thread_placement_apply(session, placement);
+        }
+        return session;
+}
+
+/*
+ * CPU time used by each thread, from /proc, keyed by thread ID.
+ */
+typedef struct thread_times_s {
+        int count;
+        long tids[MAX_THREADS];
+        char names[MAX_THREADS][32];
+        unsigned long long ticks[MAX_THREADS];
+        int cpus[MAX_THREADS];
+} THREAD_TIMES_T;
+
+static void
+thread_times_read(THREAD_TIMES_T *times)
+{
+        times->count = 0;
+        DIR *dir = opendir("/proc/self/task");
+        if(dir == NULL) {
+                return;
+        }
+        struct dirent *entry;
+        while((entry = readdir(dir)) != NULL && times->count < MAX_THREADS) {
+                const long tid = atol(entry->d_name);
+                if(tid <= 0) {
+                        continue;
+                }
+                char path[64];
+                char stat[1024];
+                snprintf(path, sizeof(path), "/proc/self/task/%ld/stat", tid);
+                FILE *file = fopen(path, "r");
+                if(file == NULL) {
+                        continue;
+                }
+                const size_t len = fread(stat, 1, sizeof(stat) - 1, file);
+                fclose(file);
+                stat[len] = '\0';
+
+                // The name is in parentheses, and may itself contain
+                // spaces or parentheses; the fields after it are fixed.
+                char *open = strchr(stat, '(');
+                char *close = strrchr(stat, ')');
+                if(open == NULL || close == NULL || close < open) {
+                        continue;
+                }
+                const int i = times->count;
+                snprintf(times->names[i], sizeof(times->names[i]), "%.*s", (int)(close - open - 1), open + 1);
+
+                // Fields 14 and 15 are utime and stime; field 39 is the
+                // CPU the thread last ran on. The state is field 3.
+                unsigned long long utime = 0;
+                unsigned long long stime = 0;
+                int cpu = -1;
+                if(sscanf(close + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu "
+                          "%*d %*d %*d %*d %*d %*d %*u %*u %*d %*u %*u %*u %*u %*u %*u %*u "
+                          "%*u %*u %*u %*u %*u %*u %*d %d", &utime, &stime, &cpu) < 2) {
+                        continue;
+                }
+                times->tids[i] = tid;
+                times->ticks[i] = utime + stime;
+                times->cpus[i] = cpu;
+                times->count++;
+        }
+        closedir(dir);
+}
+
+static void
+thread_times_print(const THREAD_TIMES_T *now, const THREAD_TIMES_T *before, double interval_secs)
+{
+        const double ticks_per_sec = sysconf(_SC_CLK_TCK);
+
+        printf("%8s %-16s %10s %6s %4s\n", "tid", "name", "cpu ms", "cpu %", "on");
+        for(int i = 0; i < now->count; i++) {
+                // A thread new since the last sample used all of its
+                // time within the interval.
+                unsigned long long previous = 0;
+                for(int j = 0; j < before->count; j++) {
+                        if(before->tids[j] == now->tids[i]) {
+                                previous = before->ticks[j];
+                                break;
+                        }
+                }
+                printf("%8ld %-16s %10.0f %6.1f %4d\n",
+                       now->tids[i], now->names[i],
+                       now->ticks[i] * 1000.0 / ticks_per_sec,
+                       (now->ticks[i] - previous) * 100.0 / ticks_per_sec / interval_secs,
+                       now->cpus[i]);
+        }
+}
+
+static int
+on_value(const char *const topic_path,
+         const TOPIC_SPECIFICATION_T *const specification,
+         DIFFUSION_DATATYPE datatype,
+         const DIFFUSION_VALUE_T *const old_value,
+         const DIFFUSION_VALUE_T *const new_value,
+         void *context)
+{
+        apr_atomic_inc32(context);
+        return HANDLER_SUCCESS;
+}
+
+/*
+ * Entry point for the example.
+ */
+int
+main(int argc, char **argv)
+{
+        /*
+         * Standard command-line parsing.
+         */
+        HASH_T *options = parse_cmdline(argc, argv, arg_opts);
+        if(options == NULL || hash_get(options, "help") != NULL) {
+                show_usage(argc, argv, arg_opts);
+                return EXIT_FAILURE;
+        }
+
+        const char *url = hash_get(options, "url");
+        const char *selector = hash_get(options, "topic_selector");
+        const unsigned int run_time = atol(hash_get(options, "sleep"));
+
+        THREAD_PLACEMENT_T placement = { 0 };
+        placement.name_prefix = hash_get(options, "name");
+#if defined(__linux__)
+        const char *cpu_options[THREAD_ROLE_COUNT] = {
+                "session_cpus", "read_cpus", "write_cpus"
+        };
+        for(int role = 0; role < THREAD_ROLE_COUNT; role++) {
+                const char *list = hash_get(options, cpu_options[role]);
+                if(list == NULL) {
+                        continue;
+                }
+                if(!parse_cpu_list(list, &placement.cpus[role])) {
+                        printf("Invalid CPU list for the %s thread: %s\n", role_names[role], list);
+                        return EXIT_FAILURE;
+                }
+                placement.has_cpus[role] = true;
+        }
+        const char *policy = hash_get(options, "policy");
+        if(policy != NULL) {
+                if(!parse_policy(policy, &placement.policy)) {
+                        printf("Unknown scheduling policy: %s\n", policy);
+                        return EXIT_FAILURE;
+                }
+                placement.has_policy = true;
+                placement.priority = atoi(hash_get(options, "priority"));
+        }
+#endif
+
+        apr_initialize();
+
+        DIFFUSION_SESSION_FACTORY_T *factory = diffusion_session_factory_init();
+        diffusion_session_factory_principal(factory, hash_get(options, "principal"));
+        diffusion_session_factory_password(factory, hash_get(options, "credentials"));
+
+        SESSION_T *session = thread_placement_session_create(factory, url, &placement);
+        diffusion_session_factory_free(factory);
+        if(session == NULL) {
+                printf("Failed to create session: %s\n", url);
+                return EXIT_FAILURE;
+        }
+
+        /*
+         * Subscribe, so that the read thread has some work to do.
+         */
+        volatile apr_uint32_t values = 0;
+        const DIFFUSION_DATATYPE datatypes[] = {
+                DATATYPE_BINARY, DATATYPE_JSON, DATATYPE_STRING,
+                DATATYPE_DOUBLE, DATATYPE_INT64, DATATYPE_RECORDV2
+        };
+        for(size_t i = 0; i < sizeof(datatypes) / sizeof(datatypes[0]); i++) {
+                VALUE_STREAM_T value_stream = {
+                        .datatype = datatypes[i],
+                        .on_value = on_value,
+                        .context = (void *)&values
+                };
+                add_stream(session, selector, &value_stream);
+        }
+        SUBSCRIPTION_PARAMS_T params = {
+                .topic_selector = selector
+        };
+        subscribe(session, params);
+
+        THREAD_TIMES_T *times = calloc(2, sizeof(THREAD_TIMES_T));
+        thread_times_read(&times[0]);
+        for(unsigned int t = 0; t < run_time; t++) {
+                sleep(1);
+                THREAD_TIMES_T *now = &times[(t + 1) % 2];
+                const THREAD_TIMES_T *before = &times[t % 2];
+                thread_times_read(now);
+                printf("\n%u values received, threads placed %u times\n",
+                       apr_atomic_read32(&values), apr_atomic_read32(&placement.placements));
+                thread_times_print(now, before, 1.0);
+        }
+        free(times);
+
+        session_close(session, NULL);
+        session_free(session);
+        session_placement = NULL;
+        hash_free(options, NULL, free);
+
+        apr_terminate();
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,1523 @@
+/**
+ * Copyright © 2026 Push Technology Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This example is written in C99. Please use an appropriate C99 capable compiler
+ *
+ * @author Push Technology Limited
+ * @since 6.4
+ */
+
+/*
+ * This example shows how to maintain a local, read-through cache of
+ * topic values which any number of application threads can query
+ * without registering their own value streams and without taking a
+ * lock.
+ *
+ * The cache is populated from value streams, which are invoked on the
+ * session's read thread. Each cached value is an immutable, reference
+ * counted snapshot of the topic's raw bytes. Readers take a reference
+ * to the current snapshot and release it when they are done; the
+ * writer replaces snapshots and only drops its own reference to a
+ * retired one once every reader that could still be looking at it has
+ * left (a two-epoch read-copy-update scheme). Readers therefore never
+ * wait for the writer, and the writer never waits on anything but
+ * readers which are already inside a lookup.
+ *
+ * Optionally ("-f"), the cache is persisted to a snapshot file so that
+ * a restarted client can serve reads immediately, before the server
+ * has resent every topic. The snapshot is an append-only log of
+ * checksummed records, written incrementally as values change. On
+ * startup it is memory mapped, every record with a valid checksum is
+ * loaded into the cache, and the file is rewritten with only the live
+ * values. It is compacted again whenever superseded records dominate.
+ * Restored values are replaced as soon as the subscription delivers
+ * the current value from the server.
+ *
+ * Each topic's specification is also kept, but interned: a deployment
+ * has only a handful of distinct specifications across however many
+ * topics, so the cache holds one immutable copy of each, keyed by the
+ * topic type and its sorted properties, and every topic sharing it
+ * points at that copy.
+ *
+ * Cached topics are also indexed in a radix tree over their paths,
+ * maintained as values arrive and topics are unsubscribed. Edges hold
+ * whole runs of path bytes rather than single characters, and each
+ * node's children are kept sorted, so the tree is compact and is
+ * walked in path order. It answers prefix queries ("everything under
+ * markets/eu/"), range queries between two paths and topic selector
+ * queries without scanning the whole cache: a selector is narrowed to
+ * the literal path segments it starts with, and only the subtree
+ * under them is matched against it. Queries take the writer mutex,
+ * briefly holding up updates; single-topic lookups remain lock free.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#ifndef WIN32
+#include <unistd.h>
+#else
+#define sleep(x) Sleep(1000 * x)
+#endif
+
+#include <apr.h>
+#include <apr_atomic.h>
+#include <apr_pools.h>
+#include <apr_file_info.h>
+#include <apr_file_io.h>
+#include <apr_mmap.h>
+#include <apr_strings.h>
+#include <apr_thread_proc.h>
+#include <apr_thread_mutex.h>
+
+#include <zlib.h>
+
+#include "diffusion.h"
+#include "args.h"
+
+ARG_OPTS_T arg_opts[] = {
+        ARG_OPTS_HELP,
+        {'u', "url", "Diffusion server URL", ARG_OPTIONAL, ARG_HAS_VALUE, "ws://localhost:8080"},
+        {'p', "principal", "Principal (username) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "client"},
+        {'c', "credentials", "Credentials (password) for the connection", ARG_OPTIONAL, ARG_HAS_VALUE, "password"},
+        {'t', "topic_selector", "Topic selector used to populate the cache", ARG_OPTIONAL, ARG_HAS_VALUE, "?.*//"},
+        {'r', "read", "Topic path that the reader threads look up", ARG_OPTIONAL, ARG_HAS_VALUE, "foo"},
+        {'n', "readers", "Number of reader threads", ARG_OPTIONAL, ARG_HAS_VALUE, "4"},
+        {'f', "snapshot", "File used to persist cached values across restarts", ARG_OPTIONAL, ARG_HAS_VALUE, NULL},
+        {'q', "query", "Path prefix, or topic selector, of cached topics to list each second", ARG_OPTIONAL, ARG_HAS_VALUE, NULL},
+        {'s', "sleep", "Time to run before disconnecting (in seconds).", ARG_OPTIONAL, ARG_HAS_VALUE, "10" },
+        END_OF_ARG_OPTS
+};
+
+/*
+ * Number of hash buckets in the cache. Must be a power of two.
+ */
+#define CACHE_BUCKETS 65536
+
+/*
+ * Number of reader counters per epoch. Readers are spread across them
+ * so that concurrent lookups don't all contend on a single cache line.
+ * Must be a power of two.
+ */
+#define CACHE_READER_STRIPES 64
+
+/*
+ * Number of retired values that the writer accumulates before waiting
+ * for a grace period and releasing them.
+ */
+#define CACHE_RETIRE_BATCH 64
+
+/*
+ * Snapshot file layout. The file starts with a header, followed by
+ * records which are each padded to an 8 byte boundary. A record with a
+ * value length of SNAPSHOT_TOMBSTONE marks a topic as having no value.
+ */
+#define SNAPSHOT_MAGIC 0x53435444 /* "DTCS" */
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_RECORD_MAGIC 0x31434552 /* "REC1" */
+#define SNAPSHOT_TOMBSTONE UINT32_MAX
+
+/*
+ * The snapshot is compacted when it is this many times larger than
+ * the records of the current values, which is its size once compacted
+ * (plus some slack, so that small caches aren't rewritten constantly).
+ */
+#define SNAPSHOT_COMPACT_RATIO 4
+#define SNAPSHOT_COMPACT_SLACK (1024 * 1024)
+
+typedef struct snapshot_header_s {
+        apr_uint32_t magic;
+        apr_uint32_t version;
+        apr_uint64_t reserved;
+} SNAPSHOT_HEADER_T;
+
+typedef struct snapshot_record_s {
+        apr_uint32_t magic;
+        // CRC-32 of the remaining header fields, path and value.
+        apr_uint32_t crc;
+        apr_uint32_t datatype;
+        apr_uint32_t path_len;
+        apr_uint32_t value_len;
+        apr_uint32_t reserved;
+} SNAPSHOT_RECORD_T;
+
+typedef struct topic_snapshot_s {
+        apr_pool_t *pool;
+        char *filename;
+        apr_file_t *file;
+        // Bytes in the file.
+        apr_off_t size;
+} TOPIC_SNAPSHOT_T;
+
+/*
+ * An immutable snapshot of a topic value. The bytes are the raw
+ * (serialised) form of the value as delivered by the value stream.
+ */
+typedef struct cached_value_s {
+        volatile apr_uint32_t refcount;
+        DIFFUSION_DATATYPE datatype;
+        struct cached_value_s *next_retired;
+        size_t len;
+        unsigned char bytes[];
+} CACHED_VALUE_T;
+
+/*
+ * A specification shared by every topic with the same type and
+ * properties. Interned specifications are immutable and are kept for
+ * the life of the cache; the count of topics using each is for
+ * reporting only.
+ */
+typedef struct interned_spec_s {
+        struct interned_spec_s *next;
+        apr_uint32_t hash;
+        char *key;
+        TOPIC_SPECIFICATION_T *specification;
+        apr_uint32_t topics;
+} INTERNED_SPEC_T;
+
+/*
+ * A topic path known to the cache. Entries are never unlinked while
+ * the cache exists, so readers can walk bucket chains without any
+ * protection other than an atomic load of each link.
+ */
+typedef struct cache_entry_s {
+        struct cache_entry_s *next;
+        apr_uint32_t hash;
+        char *path;
+        volatile void *value;
+        // Only changed with the writer mutex held.
+        INTERNED_SPEC_T *volatile specification;
+} CACHE_ENTRY_T;
+
+/*
+ * A node in the path index. The label is the run of path bytes on the
+ * edge leading to the node, and the entry is set if a cached topic's
+ * path ends here. Children are sorted by the first byte of their
+ * labels, which are distinct.
+ */
+typedef struct radix_node_s {
+        CACHE_ENTRY_T *entry;
+        struct radix_node_s **children;
+        apr_uint32_t child_count;
+        apr_uint32_t label_len;
+        char label[];
+} RADIX_NODE_T;
+
+/*
+ * Called for each topic found by a query, in path order, with a value
+ * which remains valid until the call returns. Return false to end the
+ * query early.
+ */
+typedef bool (*TOPIC_CACHE_VISITOR_T)(const char *path, const CACHED_VALUE_T *value, void *context);
+
+typedef struct cache_reader_stripe_s {
+        volatile apr_uint32_t count;
+        char pad[64 - sizeof(apr_uint32_t)];
+} CACHE_READER_STRIPE_T;
+
+typedef struct topic_cache_s {
+        apr_pool_t *pool;
+        // Serialises writers; readers never take it.
+        apr_thread_mutex_t *writer_mutex;
+        volatile void **buckets;
+        volatile apr_uint32_t epoch;
+        CACHE_READER_STRIPE_T readers[2][CACHE_READER_STRIPES];
+        CACHED_VALUE_T *retired;
+        int retired_count;
+        volatile apr_uint32_t updates;
+        // Persistent copy of the cache, or NULL. Only accessed with
+        // the writer mutex held.
+        TOPIC_SNAPSHOT_T *snapshot;
+        // Size of the snapshot records holding the cached values, that
+        // is, of a freshly compacted snapshot without its header.
+        apr_size_t live_bytes;
+        // Distinct topic specifications, guarded by the writer mutex.
+        INTERNED_SPEC_T *specifications;
+        int specification_count;
+        // Index of cached topics by path, guarded by the writer mutex.
+        RADIX_NODE_T *index;
+        apr_size_t index_nodes;
+        apr_size_t index_bytes;
+} TOPIC_CACHE_T;
+
+static apr_uint32_t
+hash_path(const char *path)
+{
+        // FNV-1a
+        apr_uint32_t hash = 2166136261u;
+        for(const unsigned char *p = (const unsigned char *)path; *p != '\0'; p++) {
+                hash ^= *p;
+                hash *= 16777619u;
+        }
+        return hash;
+}
+
+/*
+ * Atomic, fully fenced pointer load.
+ */
+static void *
+load_ptr(volatile void **mem)
+{
+        return apr_atomic_casptr(mem, NULL, NULL);
+}
+
+static CACHED_VALUE_T *
+cached_value_create(DIFFUSION_DATATYPE datatype, const void *bytes, size_t len)
+{
+        CACHED_VALUE_T *value = malloc(sizeof(CACHED_VALUE_T) + len);
+        if(value == NULL) {
+                return NULL;
+        }
+        value->refcount = 1;
+        value->datatype = datatype;
+        value->next_retired = NULL;
+        value->len = len;
+        memcpy(value->bytes, bytes, len);
+        return value;
+}
+
+/*
+ * Release a reference to a cached value returned by topic_cache_get().
+ */
+void
+topic_cache_value_release(CACHED_VALUE_T *value)
+{
+        if(value != NULL && apr_atomic_dec32(&value->refcount) == 0) {
+                free(value);
+        }
+}
+
+static TOPIC_CACHE_T *
+topic_cache_create(void)
+{
+        TOPIC_CACHE_T *cache = calloc(1, sizeof(TOPIC_CACHE_T));
+        cache->buckets = calloc(CACHE_BUCKETS, sizeof(void *));
+        cache->index = calloc(1, sizeof(RADIX_NODE_T));
+        apr_pool_create(&cache->pool, NULL);
+        apr_thread_mutex_create(&cache->writer_mutex, APR_THREAD_MUTEX_DEFAULT, cache->pool);
+        return cache;
+}
+
+/*
+ * Pick a reader stripe for the calling thread. Thread stacks are
+ * disjoint, so the address of a local variable is a cheap, portable
+ * stand-in for a thread identifier.
+ */
+static int
+reader_stripe(void)
+{
+        int marker;
+        uintptr_t addr = (uintptr_t)&marker >> 16;
+        return (int)((apr_uint32_t)(addr * 2654435761u) >> 26) & (CACHE_READER_STRIPES - 1);
+}
+
+static apr_uint32_t
+reader_enter(TOPIC_CACHE_T *cache, int stripe)
+{
+        for(;;) {
+                apr_uint32_t epoch = apr_atomic_read32(&cache->epoch);
+                apr_atomic_inc32(&cache->readers[epoch & 1][stripe].count);
+                if(apr_atomic_read32(&cache->epoch) == epoch) {
+                        return epoch;
+                }
+                // The writer flipped the epoch under us; register again
+                // so that it can't miss us when it waits.
+                apr_atomic_dec32(&cache->readers[epoch & 1][stripe].count);
+        }
+}
+
+static void
+reader_exit(TOPIC_CACHE_T *cache, apr_uint32_t epoch, int stripe)
+{
+        apr_atomic_dec32(&cache->readers[epoch & 1][stripe].count);
+}
+
+/*
+ * Wait until no reader can still hold a pointer to a value that was
+ * unpublished before this call. Must be called with the writer mutex
+ * held.
+ */
+static void
+synchronize_readers(TOPIC_CACHE_T *cache)
+{
+        apr_uint32_t epoch = apr_atomic_read32(&cache->epoch);
+        apr_atomic_set32(&cache->epoch, epoch + 1);
+
+        for(int i = 0; i < CACHE_READER_STRIPES; i++) {
+                while(apr_atomic_read32(&cache->readers[epoch & 1][i].count) != 0) {
+                        apr_thread_yield();
+                }
+        }
+}
+
+static void
+release_retired(TOPIC_CACHE_T *cache)
+{
+        if(cache->retired == NULL) {
+                return;
+        }
+        synchronize_readers(cache);
+
+        CACHED_VALUE_T *value = cache->retired;
+        while(value != NULL) {
+                CACHED_VALUE_T *next = value->next_retired;
+                topic_cache_value_release(value);
+                value = next;
+        }
+        cache->retired = NULL;
+        cache->retired_count = 0;
+}
+
+static void
+retire_value(TOPIC_CACHE_T *cache, CACHED_VALUE_T *value)
+{
+        value->next_retired = cache->retired;
+        cache->retired = value;
+        if(++cache->retired_count >= CACHE_RETIRE_BATCH) {
+                release_retired(cache);
+        }
+}
+
+static CACHE_ENTRY_T *
+cache_find(TOPIC_CACHE_T *cache, const char *path, apr_uint32_t hash)
+{
+        CACHE_ENTRY_T *entry = load_ptr(&cache->buckets[hash & (CACHE_BUCKETS - 1)]);
+        while(entry != NULL) {
+                if(entry->hash == hash && strcmp(entry->path, path) == 0) {
+                        return entry;
+                }
+                entry = entry->next;
+        }
+        return NULL;
+}
+
+/*
+ * Find the entry for a topic path, adding one if it doesn't
+ * exist. Must be called with the writer mutex held.
+ */
+static CACHE_ENTRY_T *
+cache_find_or_add(TOPIC_CACHE_T *cache, const char *path)
+{
+        apr_uint32_t hash = hash_path(path);
+        CACHE_ENTRY_T *entry = cache_find(cache, path, hash);
+        if(entry != NULL) {
+                return entry;
+        }
+
+        volatile void **bucket = &cache->buckets[hash & (CACHE_BUCKETS - 1)];
+        entry = calloc(1, sizeof(CACHE_ENTRY_T));
+        entry->hash = hash;
+        entry->path = strdup(path);
+        entry->next = load_ptr(bucket);
+        apr_atomic_xchgptr(bucket, entry);
+        return entry;
+}
+
+/*
+ * Create a node labelled with the concatenation of two runs of bytes.
+ */
+static RADIX_NODE_T *
+radix_node_create(TOPIC_CACHE_T *cache, const char *label, apr_size_t label_len,
+                  const char *suffix, apr_size_t suffix_len)
+{
+        RADIX_NODE_T *node = calloc(1, sizeof(RADIX_NODE_T) + label_len + suffix_len);
+        node->label_len = label_len + suffix_len;
+        memcpy(node->label, label, label_len);
+        memcpy(node->label + label_len, suffix, suffix_len);
+        cache->index_nodes++;
+        cache->index_bytes += sizeof(RADIX_NODE_T) + node->label_len;
+        return node;
+}
+
+static void
+radix_node_free(TOPIC_CACHE_T *cache, RADIX_NODE_T *node)
+{
+        cache->index_nodes--;
+        cache->index_bytes -= sizeof(RADIX_NODE_T) + node->label_len
+                + node->child_count * sizeof(RADIX_NODE_T *);
+        free(node->children);
+        free(node);
+}
+
+/*
+ * Find the position of the child whose label starts with c, or where
+ * it would be inserted. Sets *found if there is one.
+ */
+static apr_uint32_t
+radix_child_index(const RADIX_NODE_T *node, unsigned char c, bool *found)
+{
+        apr_uint32_t low = 0;
+        apr_uint32_t high = node->child_count;
+        while(low < high) {
+                const apr_uint32_t mid = (low + high) / 2;
+                const unsigned char m = node->children[mid]->label[0];
+                if(m == c) {
+                        *found = true;
+                        return mid;
+                }
+                if(m < c) {
+                        low = mid + 1;
+                }
+                else {
+                        high = mid;
+                }
+        }
+        *found = false;
+        return low;
+}
+
+static void
+radix_child_insert(TOPIC_CACHE_T *cache, RADIX_NODE_T *node, apr_uint32_t index, RADIX_NODE_T *child)
+{
+        node->children = realloc(node->children, (node->child_count + 1) * sizeof(RADIX_NODE_T *));
+        memmove(node->children + index + 1, node->children + index,
+                (node->child_count - index) * sizeof(RADIX_NODE_T *));
+        node->children[index] = child;
+        node->child_count++;
+        cache->index_bytes += sizeof(RADIX_NODE_T *);
+}
+
+static void
+radix_child_remove(TOPIC_CACHE_T *cache, RADIX_NODE_T *node, apr_uint32_t index)
+{
+        memmove(node->children + index, node->children + index + 1,
+                (node->child_count - index - 1) * sizeof(RADIX_NODE_T *));
+        node->child_count--;
+        cache->index_bytes -= sizeof(RADIX_NODE_T *);
+}
+
+/*
+ * Replace a node with one whose label is the first len bytes of the
+ * original, and which has the remainder as its only child.
+ */
+static RADIX_NODE_T *
+radix_split(TOPIC_CACHE_T *cache, RADIX_NODE_T *node, apr_size_t len)
+{
+        RADIX_NODE_T *head = radix_node_create(cache, node->label, len, "", 0);
+        RADIX_NODE_T *tail = radix_node_create(cache, node->label + len, node->label_len - len, "", 0);
+        tail->entry = node->entry;
+        tail->children = node->children;
+        tail->child_count = node->child_count;
+        node->children = NULL;
+        node->child_count = 0;
+        radix_node_free(cache, node);
+        radix_child_insert(cache, head, 0, tail);
+        return head;
+}
+
+/*
+ * Add a cached topic to the index. Must be called with the writer
+ * mutex held.
+ */
+static void
+radix_insert(TOPIC_CACHE_T *cache, CACHE_ENTRY_T *entry)
+{
+        RADIX_NODE_T *node = cache->index;
+        const char *key = entry->path;
+
+        while(*key != '\0') {
+                bool found;
+                const apr_uint32_t index = radix_child_index(node, *key, &found);
+                if(!found) {
+                        RADIX_NODE_T *leaf = radix_node_create(cache, key, strlen(key), "", 0);
+                        leaf->entry = entry;
+                        radix_child_insert(cache, node, index, leaf);
+                        return;
+                }
+                RADIX_NODE_T *child = node->children[index];
+                apr_size_t common = 0;
+                while(common < child->label_len && key[common] == child->label[common]) {
+                        common++;
+                }
+                if(common < child->label_len) {
+                        child = radix_split(cache, child, common);
+                        node->children[index] = child;
+                }
+                node = child;
+                key += common;
+        }
+        node->entry = entry;
+}
+
+/*
+ * Remove a topic from the subtree below node, given the rest of its
+ * path. Returns the node to take this one's place: itself, NULL if it
+ * is no longer needed, or a merge of it with its only child.
+ */
+static RADIX_NODE_T *
+radix_remove_below(TOPIC_CACHE_T *cache, RADIX_NODE_T *node, const char *key, bool is_root)
+{
+        if(*key == '\0') {
+                node->entry = NULL;
+        }
+        else {
+                bool found;
+                const apr_uint32_t index = radix_child_index(node, *key, &found);
+                if(!found) {
+                        return node;
+                }
+                RADIX_NODE_T *child = node->children[index];
+                if(strncmp(key, child->label, child->label_len) != 0) {
+                        return node;
+                }
+                RADIX_NODE_T *replacement = radix_remove_below(cache, child, key + child->label_len, false);
+                if(replacement == NULL) {
+                        radix_child_remove(cache, node, index);
+                }
+                else {
+                        node->children[index] = replacement;
+                }
+        }
+
+        if(is_root || node->entry != NULL || node->child_count > 1) {
+                return node;
+        }
+        if(node->child_count == 0) {
+                radix_node_free(cache, node);
+                return NULL;
+        }
+
+        // A pass-through node; fold it into its only child.
+        RADIX_NODE_T *child = node->children[0];
+        RADIX_NODE_T *merged = radix_node_create(cache, node->label, node->label_len,
+                                                 child->label, child->label_len);
+        merged->entry = child->entry;
+        merged->children = child->children;
+        merged->child_count = child->child_count;
+        child->children = NULL;
+        child->child_count = 0;
+        radix_node_free(cache, child);
+        radix_node_free(cache, node);
+        return merged;
+}
+
+/*
+ * Remove a topic from the index. Must be called with the writer mutex
+ * held.
+ */
+static void
+radix_remove(TOPIC_CACHE_T *cache, const char *path)
+{
+        radix_remove_below(cache, cache->index, path, true);
+}
+
+static void
+radix_free(RADIX_NODE_T *node)
+{
+        for(apr_uint32_t i = 0; i < node->child_count; i++) {
+                radix_free(node->children[i]);
+        }
+        free(node->children);
+        free(node);
+}
+
+/*
+ * State of an in-order walk over the index, visiting topics in the
+ * range [from, to). Either bound may be NULL.
+ */
+typedef struct radix_walk_s {
+        char *key;
+        apr_size_t key_cap;
+        const char *from;
+        apr_size_t from_len;
+        const char *to;
+        apr_size_t to_len;
+        const char *selector;
+        TOPIC_CACHE_VISITOR_T visitor;
+        void *context;
+        bool stopped;
+        int visited;
+} RADIX_WALK_T;
+
+static int
+compare_prefix(const char *key, apr_size_t key_len, const char *bound, apr_size_t bound_len)
+{
+        const int c = memcmp(key, bound, key_len < bound_len ? key_len : bound_len);
+        if(c != 0) {
+                return c;
+        }
+        return key_len < bound_len ? -1 : (key_len > bound_len ? 1 : 0);
+}
+
+static void
+radix_walk(RADIX_WALK_T *walk, const RADIX_NODE_T *node, apr_size_t len)
+{
+        if(len + node->label_len + 1 > walk->key_cap) {
+                walk->key_cap = (len + node->label_len + 1) * 2;
+                walk->key = realloc(walk->key, walk->key_cap);
+        }
+        memcpy(walk->key + len, node->label, node->label_len);
+        len += node->label_len;
+
+        // Every path below this node starts with the key so far.
+        bool at_or_after_from = true;
+        if(walk->from != NULL) {
+                const int c = memcmp(walk->key, walk->from, len < walk->from_len ? len : walk->from_len);
+                if(c < 0) {
+                        return;
+                }
+                // If the key is a prefix of the lower bound, only paths
+                // below it can be in range.
+                at_or_after_from = c > 0 || len >= walk->from_len;
+        }
+        if(walk->to != NULL && compare_prefix(walk->key, len, walk->to, walk->to_len) >= 0) {
+                walk->stopped = true;
+                return;
+        }
+
+        if(node->entry != NULL && at_or_after_from) {
+                walk->key[len] = '\0';
+                const CACHED_VALUE_T *value = (const CACHED_VALUE_T *)node->entry->value;
+                if(value != NULL && (walk->selector == NULL || selector_match(walk->selector, walk->key))) {
+                        walk->visited++;
+                        if(!walk->visitor(walk->key, value, walk->context)) {
+                                walk->stopped = true;
+                                return;
+                        }
+                }
+        }
+        for(apr_uint32_t i = 0; i < node->child_count && !walk->stopped; i++) {
+                radix_walk(walk, node->children[i], len);
+        }
+}
+
+/*
+ * Visit every cached topic with a path in [from, to), in path order,
+ * returning the number visited. Either bound may be NULL. If a
+ * selector is given, only topics matching it are visited.
+ */
+static int
+topic_cache_query(TOPIC_CACHE_T *cache, const char *from, const char *to, const char *selector,
+                  TOPIC_CACHE_VISITOR_T visitor, void *context)
+{
+        RADIX_WALK_T walk = {
+                .from = from,
+                .from_len = from != NULL ? strlen(from) : 0,
+                .to = to,
+                .to_len = to != NULL ? strlen(to) : 0,
+                .selector = selector,
+                .visitor = visitor,
+                .context = context
+        };
+
+        apr_thread_mutex_lock(cache->writer_mutex);
+        radix_walk(&walk, cache->index, 0);
+        apr_thread_mutex_unlock(cache->writer_mutex);
+
+        free(walk.key);
+        return walk.visited;
+}
+
+/*
+ * Visit every cached topic whose path starts with a prefix, in path
+ * order, returning the number visited.
+ */
+int
+topic_cache_query_prefix(SESSION_T *session, const char *prefix,
+                         TOPIC_CACHE_VISITOR_T visitor, void *context)
+{
+        TOPIC_CACHE_T *cache = session->user_context;
+        if(cache == NULL || prefix == NULL) {
+                return 0;
+        }
+        if(*prefix == '\0') {
+                return topic_cache_query(cache, NULL, NULL, NULL, visitor, context);
+        }
+
+        // Paths with the prefix sort before the prefix with its last
+        // byte incremented; topic paths are UTF-8, so never 0xff.
+        char *to = strdup(prefix);
+        to[strlen(to) - 1]++;
+        const int visited = topic_cache_query(cache, prefix, to, NULL, visitor, context);
+        free(to);
+        return visited;
+}
+
+/*
+ * Visit every cached topic with a path in [from, to), in path order,
+ * returning the number visited. Either bound may be NULL.
+ */
+int
+topic_cache_query_range(SESSION_T *session, const char *from, const char *to,
+                        TOPIC_CACHE_VISITOR_T visitor, void *context)
+{
+        TOPIC_CACHE_T *cache = session->user_context;
+        if(cache == NULL) {
+                return 0;
+        }
+        return topic_cache_query(cache, from, to, NULL, visitor, context);
+}
+
+/*
+ * Visit every cached topic matching a topic selector, in path order,
+ * returning the number visited. Path (">") and split-path pattern
+ * ("?") selectors are narrowed to the leading path segments with no
+ * pattern characters; other selectors are matched against every
+ * cached topic.
+ */
+int
+topic_cache_query_selector(SESSION_T *session, const char *selector,
+                           TOPIC_CACHE_VISITOR_T visitor, void *context)
+{
+        TOPIC_CACHE_T *cache = session->user_context;
+        if(cache == NULL || selector == NULL) {
+                return 0;
+        }
+
+        const char *path = selector + 1;
+        apr_size_t literal = 0;
+        if(selector[0] == '>') {
+                literal = strlen(path);
+        }
+        else if(selector[0] == '?') {
+                apr_size_t i;
+                for(i = 0; path[i] != '\0' && strchr(".^$|()[]{}\\+*?", path[i]) == NULL; i++) {
+                        if(path[i] == '/') {
+                                literal = i + 1;
+                        }
+                }
+                if(path[i] == '\0') {
+                        literal = i;
+                }
+        }
+        // Descendant qualifiers aren't part of the path.
+        while(literal > 0 && path[literal - 1] == '/') {
+                literal--;
+        }
+
+        if(literal == 0) {
+                return topic_cache_query(cache, NULL, NULL, selector, visitor, context);
+        }
+        char *from = malloc(literal + 1);
+        memcpy(from, path, literal);
+        from[literal] = '\0';
+        char *to = strdup(from);
+        to[literal - 1]++;
+        const int visited = topic_cache_query(cache, from, to, selector, visitor, context);
+        free(to);
+        free(from);
+        return visited;
+}
+
+static int
+compare_strings(const void *a, const void *b)
+{
+        return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*
+ * Build the canonical form of a specification: the topic type
+ * followed by its properties in key order.
+ */
+static char *
+specification_key(const TOPIC_SPECIFICATION_T *specification)
+{
+        HASH_T *properties = topic_specification_get_properties(specification);
+        char **keys = properties != NULL ? hash_keys(properties) : NULL;
+        size_t count = 0;
+        size_t len = 16;
+
+        while(keys != NULL && keys[count] != NULL) {
+                len += strlen(keys[count]) + strlen(hash_get(properties, keys[count])) + 2;
+                count++;
+        }
+        if(count > 1) {
+                qsort(keys, count, sizeof(char *), compare_strings);
+        }
+
+        char *key = malloc(len);
+        char *p = key + sprintf(key, "%d", topic_specification_get_topic_type(specification));
+        for(size_t i = 0; i < count; i++) {
+                p += sprintf(p, "\n%s=%s", keys[i], (const char *)hash_get(properties, keys[i]));
+        }
+
+        free(keys);
+        if(properties != NULL) {
+                hash_free(properties, free, free);
+        }
+        return key;
+}
+
+/*
+ * Return the shared copy of a specification, creating it on first
+ * use. Must be called with the writer mutex held.
+ */
+static INTERNED_SPEC_T *
+specification_intern(TOPIC_CACHE_T *cache, const TOPIC_SPECIFICATION_T *specification)
+{
+        char *key = specification_key(specification);
+        const apr_uint32_t hash = hash_path(key);
+
+        for(INTERNED_SPEC_T *interned = cache->specifications; interned != NULL; interned = interned->next) {
+                if(interned->hash == hash && strcmp(interned->key, key) == 0) {
+                        free(key);
+                        return interned;
+                }
+        }
+
+        INTERNED_SPEC_T *interned = calloc(1, sizeof(INTERNED_SPEC_T));
+        interned->hash = hash;
+        interned->key = key;
+        interned->specification = topic_specification_dup(specification);
+        interned->next = cache->specifications;
+        cache->specifications = interned;
+        cache->specification_count++;
+        return interned;
+}
+
+static apr_size_t
+pad8(apr_size_t n)
+{
+        return (n + 7) & ~(apr_size_t)7;
+}
+
+/*
+ * The size of the snapshot record for a topic's value, including its
+ * header, path and padding.
+ */
+static apr_size_t
+snapshot_record_size(const char *path, const CACHED_VALUE_T *value)
+{
+        return sizeof(SNAPSHOT_RECORD_T) + pad8(strlen(path) + value->len);
+}
+
+static apr_uint32_t
+snapshot_record_crc(const SNAPSHOT_RECORD_T *record, const void *path, const void *value)
+{
+        uLong crc = crc32(0L, Z_NULL, 0);
+        crc = crc32(crc, (const Bytef *)&record->datatype, 3 * sizeof(apr_uint32_t));
+        crc = crc32(crc, path, record->path_len);
+        if(record->value_len != SNAPSHOT_TOMBSTONE) {
+                crc = crc32(crc, value, record->value_len);
+        }
+        return (apr_uint32_t)crc;
+}
+
+static apr_status_t
+snapshot_write_record(apr_file_t *file, const char *path, const CACHED_VALUE_T *value, apr_off_t *size)
+{
+        static const char padding[8] = { 0 };
+        SNAPSHOT_RECORD_T record = {
+                .magic = SNAPSHOT_RECORD_MAGIC,
+                .datatype = value != NULL ? value->datatype : 0,
+                .path_len = strlen(path),
+                .value_len = value != NULL ? value->len : SNAPSHOT_TOMBSTONE
+        };
+        record.crc = snapshot_record_crc(&record, path, value != NULL ? value->bytes : NULL);
+
+        const apr_size_t body_len = record.path_len + (value != NULL ? value->len : 0);
+        const apr_size_t pad_len = pad8(body_len) - body_len;
+        apr_status_t rv;
+
+        if((rv = apr_file_write_full(file, &record, sizeof(record), NULL)) != APR_SUCCESS ||
+           (rv = apr_file_write_full(file, path, record.path_len, NULL)) != APR_SUCCESS ||
+           (value != NULL && (rv = apr_file_write_full(file, value->bytes, value->len, NULL)) != APR_SUCCESS) ||
+           (rv = apr_file_write_full(file, padding, pad_len, NULL)) != APR_SUCCESS) {
+                return rv;
+        }
+        *size += sizeof(record) + body_len + pad_len;
+        return APR_SUCCESS;
+}
+
+static void
+snapshot_append(TOPIC_SNAPSHOT_T *snapshot, const char *path, const CACHED_VALUE_T *value)
+{
+        if(snapshot->file != NULL &&
+           snapshot_write_record(snapshot->file, path, value, &snapshot->size) != APR_SUCCESS) {
+                // Stop persisting rather than leave a gap in the log; the
+                // file remains valid up to the last complete record.
+                printf("Failed to write to snapshot %s, persistence disabled\n", snapshot->filename);
+                apr_file_close(snapshot->file);
+                snapshot->file = NULL;
+        }
+}
+
+/*
+ * Rewrite the snapshot with only the current values, and reopen it
+ * for appending. Must be called with the writer mutex held.
+ */
+static apr_status_t
+snapshot_compact(TOPIC_CACHE_T *cache)
+{
+        TOPIC_SNAPSHOT_T *snapshot = cache->snapshot;
+        char *tmp_filename = apr_pstrcat(snapshot->pool, snapshot->filename, ".tmp", NULL);
+        apr_file_t *file = NULL;
+        apr_status_t rv;
+
+        if(snapshot->file != NULL) {
+                apr_file_close(snapshot->file);
+                snapshot->file = NULL;
+        }
+
+        rv = apr_file_open(&file, tmp_filename,
+                           APR_FOPEN_WRITE | APR_FOPEN_CREATE | APR_FOPEN_TRUNCATE | APR_FOPEN_BUFFERED,
+                           APR_FPROT_OS_DEFAULT, snapshot->pool);
+        if(rv != APR_SUCCESS) {
+                return rv;
+        }
+
+        SNAPSHOT_HEADER_T header = {
+                .magic = SNAPSHOT_MAGIC,
+                .version = SNAPSHOT_VERSION
+        };
+        apr_off_t size = sizeof(header);
+        rv = apr_file_write_full(file, &header, sizeof(header), NULL);
+        for(int i = 0; i < CACHE_BUCKETS && rv == APR_SUCCESS; i++) {
+                for(CACHE_ENTRY_T *entry = (CACHE_ENTRY_T *)cache->buckets[i];
+                    entry != NULL && rv == APR_SUCCESS;
+                    entry = entry->next) {
+                        if(entry->value != NULL) {
+                                rv = snapshot_write_record(file, entry->path, (CACHED_VALUE_T *)entry->value, &size);
+                        }
+                }
+        }
+        if(rv == APR_SUCCESS) {
+                rv = apr_file_close(file);
+        }
+        else {
+                apr_file_close(file);
+        }
+        if(rv == APR_SUCCESS) {
+                rv = apr_file_rename(tmp_filename, snapshot->filename, snapshot->pool);
+        }
+        if(rv != APR_SUCCESS) {
+                apr_file_remove(tmp_filename, snapshot->pool);
+                return rv;
+        }
+
+        snapshot->size = size;
+        return apr_file_open(&snapshot->file, snapshot->filename,
+                             APR_FOPEN_WRITE | APR_FOPEN_APPEND | APR_FOPEN_BUFFERED,
+                             APR_FPROT_OS_DEFAULT, snapshot->pool);
+}
+
+/*
+ * Publish a new value for a topic path. A NULL value removes the
+ * topic's value (and specification) from the cache. The specification
+ * may be NULL if it is not known; it is only interned the first time a
+ * topic is seen, since a topic's specification can't change without it
+ * being removed.
+ */
+static void
+topic_cache_put(TOPIC_CACHE_T *cache, const char *path, CACHED_VALUE_T *value,
+                const TOPIC_SPECIFICATION_T *specification)
+{
+        apr_thread_mutex_lock(cache->writer_mutex);
+
+        CACHE_ENTRY_T *entry = cache_find_or_add(cache, path);
+        if(value == NULL && entry->specification != NULL) {
+                entry->specification->topics--;
+                entry->specification = NULL;
+        }
+        else if(value != NULL && specification != NULL && entry->specification == NULL) {
+                INTERNED_SPEC_T *interned = specification_intern(cache, specification);
+                interned->topics++;
+                entry->specification = interned;
+        }
+        CACHED_VALUE_T *old_value = apr_atomic_xchgptr(&entry->value, value);
+        if(old_value == NULL && value != NULL) {
+                radix_insert(cache, entry);
+        }
+        else if(old_value != NULL && value == NULL) {
+                radix_remove(cache, path);
+        }
+        if(old_value != NULL) {
+                cache->live_bytes -= snapshot_record_size(path, old_value);
+                retire_value(cache, old_value);
+        }
+        if(value != NULL) {
+                cache->live_bytes += snapshot_record_size(path, value);
+        }
+        if(cache->snapshot != NULL) {
+                snapshot_append(cache->snapshot, path, value);
+        }
+        apr_atomic_inc32(&cache->updates);
+
+        apr_thread_mutex_unlock(cache->writer_mutex);
+}
+
+/*
+ * Load every valid record from a mapped snapshot into the cache,
+ * returning the number of records loaded. Loading stops at the first
+ * damaged or incomplete record, which is what a crash while appending
+ * leaves behind.
+ */
+static int
+snapshot_load(TOPIC_CACHE_T *cache, const unsigned char *data, apr_size_t size)
+{
+        const SNAPSHOT_HEADER_T *header = (const SNAPSHOT_HEADER_T *)data;
+        if(size < sizeof(SNAPSHOT_HEADER_T) ||
+           header->magic != SNAPSHOT_MAGIC || header->version != SNAPSHOT_VERSION) {
+                return 0;
+        }
+
+        int loaded = 0;
+        apr_size_t offset = sizeof(SNAPSHOT_HEADER_T);
+        char *path = NULL;
+        apr_size_t path_cap = 0;
+
+        while(offset + sizeof(SNAPSHOT_RECORD_T) <= size) {
+                SNAPSHOT_RECORD_T record;
+                memcpy(&record, data + offset, sizeof(record));
+                if(record.magic != SNAPSHOT_RECORD_MAGIC) {
+                        break;
+                }
+
+                const apr_size_t value_len = record.value_len == SNAPSHOT_TOMBSTONE ? 0 : record.value_len;
+                const apr_size_t body_len = (apr_size_t)record.path_len + value_len;
+                if(body_len > size - offset - sizeof(record)) {
+                        break;
+                }
+
+                const unsigned char *record_path = data + offset + sizeof(record);
+                const unsigned char *record_value = record_path + record.path_len;
+                if(snapshot_record_crc(&record, record_path, record_value) != record.crc) {
+                        break;
+                }
+
+                if(record.path_len + 1 > path_cap) {
+                        path_cap = record.path_len + 1;
+                        path = realloc(path, path_cap);
+                }
+                memcpy(path, record_path, record.path_len);
+                path[record.path_len] = '\0';
+
+                CACHED_VALUE_T *value = NULL;
+                if(record.value_len != SNAPSHOT_TOMBSTONE) {
+                        value = cached_value_create(record.datatype, record_value, value_len);
+                }
+                topic_cache_put(cache, path, value, NULL);
+
+                loaded++;
+                offset += sizeof(record) + pad8(body_len);
+        }
+
+        free(path);
+        return loaded;
+}
+
+/*
+ * Restore the cache from a snapshot file, if there is one, and persist
+ * all further changes to it.
+ */
+static apr_status_t
+topic_cache_open_snapshot(TOPIC_CACHE_T *cache, const char *filename, int *restored)
+{
+        TOPIC_SNAPSHOT_T *snapshot = calloc(1, sizeof(TOPIC_SNAPSHOT_T));
+        apr_pool_create(&snapshot->pool, cache->pool);
+        snapshot->filename = apr_pstrdup(snapshot->pool, filename);
+        *restored = 0;
+
+        apr_file_t *file = NULL;
+        if(apr_file_open(&file, filename, APR_FOPEN_READ, APR_FPROT_OS_DEFAULT, snapshot->pool) == APR_SUCCESS) {
+                apr_finfo_t finfo;
+                apr_mmap_t *mmap = NULL;
+                if(apr_file_info_get(&finfo, APR_FINFO_SIZE, file) == APR_SUCCESS &&
+                   finfo.size > 0 &&
+                   apr_mmap_create(&mmap, file, 0, finfo.size, APR_MMAP_READ, snapshot->pool) == APR_SUCCESS) {
+                        *restored = snapshot_load(cache, mmap->mm, mmap->size);
+                        apr_mmap_delete(mmap);
+                }
+                apr_file_close(file);
+        }
+
+        apr_thread_mutex_lock(cache->writer_mutex);
+        cache->snapshot = snapshot;
+        apr_status_t rv = snapshot_compact(cache);
+        apr_thread_mutex_unlock(cache->writer_mutex);
+        return rv;
+}
+
+/*
+ * Flush the snapshot to disk, compacting it first if it has grown
+ * too large. Called periodically from an application thread.
+ */
+static void
+topic_cache_sync_snapshot(TOPIC_CACHE_T *cache)
+{
+        apr_thread_mutex_lock(cache->writer_mutex);
+        TOPIC_SNAPSHOT_T *snapshot = cache->snapshot;
+        if(snapshot != NULL && snapshot->file != NULL) {
+                if(snapshot->size > (apr_off_t)(cache->live_bytes * SNAPSHOT_COMPACT_RATIO + SNAPSHOT_COMPACT_SLACK)) {
+                        if(snapshot_compact(cache) != APR_SUCCESS) {
+                                printf("Failed to compact snapshot %s\n", snapshot->filename);
+                        }
+                }
+                else {
+                        apr_file_flush(snapshot->file);
+                }
+        }
+        apr_thread_mutex_unlock(cache->writer_mutex);
+}
+
+/*
+ * Look up the current value of a topic in the session's cache.
+ *
+ * Never blocks. Returns NULL if the topic has no cached value;
+ * otherwise the caller owns a reference to an immutable value and must
+ * release it with topic_cache_value_release().
+ */
+CACHED_VALUE_T *
+topic_cache_get(SESSION_T *session, const char *path)
+{
+        TOPIC_CACHE_T *cache = session->user_context;
+        if(cache == NULL || path == NULL) {
+                return NULL;
+        }
+
+        const int stripe = reader_stripe();
+        const apr_uint32_t epoch = reader_enter(cache, stripe);
+
+        CACHED_VALUE_T *value = NULL;
+        CACHE_ENTRY_T *entry = cache_find(cache, path, hash_path(path));
+        if(entry != NULL) {
+                value = load_ptr(&entry->value);
+                if(value != NULL) {
+                        apr_atomic_inc32(&value->refcount);
+                }
+        }
+
+        reader_exit(cache, epoch, stripe);
+        return value;
+}
+
+/*
+ * Look up the specification of a cached topic.
+ *
+ * Never blocks. The result is shared with every other topic of the
+ * same type and properties, must not be modified or freed, and
+ * remains valid until the cache is freed. Returns NULL if the topic is
+ * not cached or its specification is not known.
+ */
+const TOPIC_SPECIFICATION_T *
+topic_cache_get_specification(SESSION_T *session, const char *path)
+{
+        TOPIC_CACHE_T *cache = session->user_context;
+        if(cache == NULL || path == NULL) {
+                return NULL;
+        }
+
+        CACHE_ENTRY_T *entry = cache_find(cache, path, hash_path(path));
+        if(entry == NULL) {
+                return NULL;
+        }
+        INTERNED_SPEC_T *interned = load_ptr((volatile void **)&entry->specification);
+        return interned != NULL ? interned->specification : NULL;
+}
+
+static void
+topic_cache_free(TOPIC_CACHE_T *cache)
+{
+        apr_thread_mutex_lock(cache->writer_mutex);
+        release_retired(cache);
+        if(cache->snapshot != NULL) {
+                if(cache->snapshot->file != NULL) {
+                        apr_file_close(cache->snapshot->file);
+                }
+                apr_pool_destroy(cache->snapshot->pool);
+                free(cache->snapshot);
+                cache->snapshot = NULL;
+        }
+        for(int i = 0; i < CACHE_BUCKETS; i++) {
+                CACHE_ENTRY_T *entry = (CACHE_ENTRY_T *)cache->buckets[i];
+                while(entry != NULL) {
+                        CACHE_ENTRY_T *next = entry->next;
+                        topic_cache_value_release((CACHED_VALUE_T *)entry->value);
+                        free(entry->path);
+                        free(entry);
+                        entry = next;
+                }
+        }
+        radix_free(cache->index);
+        while(cache->specifications != NULL) {
+                INTERNED_SPEC_T *interned = cache->specifications;
+                cache->specifications = interned->next;
+                topic_specification_free(interned->specification);
+                free(interned->key);
+                free(interned);
+        }
+        apr_thread_mutex_unlock(cache->writer_mutex);
+
+        apr_thread_mutex_destroy(cache->writer_mutex);
+        apr_pool_destroy(cache->pool);
+        free((void *)cache->buckets);
+        free(cache);
+}
+
+/*
+ * Value stream callbacks; these run on the session's read thread and
+ * are the cache's only writer.
+ */
+static int
+on_value(const char *const topic_path,
+         const TOPIC_SPECIFICATION_T *const specification,
+         DIFFUSION_DATATYPE datatype,
+         const DIFFUSION_VALUE_T *const old_value,
+         const DIFFUSION_VALUE_T *const new_value,
+         void *context)
+{
+        TOPIC_CACHE_T *cache = context;
+        void *bytes = NULL;
+        size_t len = 0;
+
+        if(new_value == NULL || !diffusion_value_get_raw_bytes(new_value, &bytes, &len)) {
+                topic_cache_put(cache, topic_path, NULL, NULL);
+                return HANDLER_SUCCESS;
+        }
+
+        CACHED_VALUE_T *value = cached_value_create(datatype, bytes, len);
+        free(bytes);
+        topic_cache_put(cache, topic_path, value, specification);
+        return HANDLER_SUCCESS;
+}
+
+static int
+on_unsubscription(const char *const topic_path,
+                  const TOPIC_SPECIFICATION_T *const specification,
+                  NOTIFY_UNSUBSCRIPTION_REASON_T reason,
+                  void *context)
+{
+        topic_cache_put(context, topic_path, NULL, NULL);
+        return HANDLER_SUCCESS;
+}
+
+static int
+on_subscribe(SESSION_T *session, void *context)
+{
+        printf("Subscribed to %s\n", (const char *)context);
+        return HANDLER_SUCCESS;
+}
+
+/*
+ * Summary of the topics found by a query.
+ */
+typedef struct {
+        char first[256];
+        char last[256];
+        size_t bytes;
+} QUERY_RESULTS_T;
+
+static bool
+collect_results(const char *path, const CACHED_VALUE_T *value, void *context)
+{
+        QUERY_RESULTS_T *results = context;
+        if(results->first[0] == '\0') {
+                snprintf(results->first, sizeof(results->first), "%s", path);
+        }
+        snprintf(results->last, sizeof(results->last), "%s", path);
+        results->bytes += value->len;
+        return true;
+}
+
+typedef struct {
+        SESSION_T *session;
+        const char *path;
+        volatile apr_uint32_t *running;
+        unsigned long reads;
+        unsigned long hits;
+} READER_ARGS_T;
+
+/*
+ * Application thread that repeatedly reads a topic's value from the
+ * cache.
+ */
+static void * APR_THREAD_FUNC
+reader_thread(apr_thread_t *thread, void *data)
+{
+        READER_ARGS_T *args = data;
+
+        while(apr_atomic_read32(args->running)) {
+                CACHED_VALUE_T *value = topic_cache_get(args->session, args->path);
+                args->reads++;
+                if(value != NULL) {
+                        args->hits++;
+                        topic_cache_value_release(value);
+                }
+        }
+
+        apr_thread_exit(thread, APR_SUCCESS);
+        return NULL;
+}
+
+/*
+ * Entry point for the example.
+ */
+int
+main(int argc, char **argv)
+{
+        /*
+         * Standard command-line parsing.
+         */
+        HASH_T *options = parse_cmdline(argc, argv, arg_opts);
+        if(options == NULL || hash_get(options, "help") != NULL) {
+                show_usage(argc, argv, arg_opts);
+                return EXIT_FAILURE;
+        }
+
+        const char *url = hash_get(options, "url");
+        const char *principal = hash_get(options, "principal");
+        CREDENTIALS_T *credentials = NULL;
+        const char *password = hash_get(options, "credentials");
+        if(password != NULL) {
+                credentials = credentials_create_password(password);
+        }
+        const char *topic_selector = hash_get(options, "topic_selector");
+        const char *read_path = hash_get(options, "read");
+        const int reader_count = atoi(hash_get(options, "readers"));
+        const char *snapshot_filename = hash_get(options, "snapshot");
+        const char *query = hash_get(options, "query");
+        const unsigned int sleep_time = atol(hash_get(options, "sleep"));
+
+        apr_initialize();
+        apr_pool_t *pool = NULL;
+        apr_pool_create(&pool, NULL);
+
+        TOPIC_CACHE_T *cache = topic_cache_create();
+
+        /*
+         * Warm the cache from the previous run's snapshot, so that
+         * readers can be served before the subscription catches up.
+         */
+        if(snapshot_filename != NULL) {
+                int restored = 0;
+                if(topic_cache_open_snapshot(cache, snapshot_filename, &restored) != APR_SUCCESS) {
+                        printf("Failed to open snapshot %s\n", snapshot_filename);
+                        return EXIT_FAILURE;
+                }
+                printf("Restored %d records from %s\n", restored, snapshot_filename);
+        }
+
+        /*
+         * Create a session, synchronously.
+         */
+        DIFFUSION_ERROR_T error = { 0 };
+        SESSION_T *session = session_create(url, principal, credentials, NULL, NULL, &error);
+        if(session == NULL) {
+                printf("Failed to create session: %s\n", error.message);
+                free(error.message);
+                return EXIT_FAILURE;
+        }
+        session->user_context = cache;
+
+        /*
+         * Value streams are typed, so add one per datatype that we want
+         * to cache. They all feed the same cache.
+         */
+        const DIFFUSION_DATATYPE datatypes[] = {
+                DATATYPE_BINARY, DATATYPE_JSON, DATATYPE_STRING,
+                DATATYPE_DOUBLE, DATATYPE_INT64, DATATYPE_RECORDV2
+        };
+        for(size_t i = 0; i < sizeof(datatypes) / sizeof(datatypes[0]); i++) {
+                VALUE_STREAM_T value_stream = {
+                        .datatype = datatypes[i],
+                        .on_unsubscription = on_unsubscription,
+                        .on_value = on_value,
+                        .context = cache
+                };
+                add_stream(session, topic_selector, &value_stream);
+        }
+
+        SUBSCRIPTION_PARAMS_T params = {
+                .topic_selector = topic_selector,
+                .on_subscribe = on_subscribe,
+                .context = (void *)topic_selector
+        };
+        subscribe(session, params);
+
+        /*
+         * Start the readers.
+         */
+        volatile apr_uint32_t running = 1;
+        apr_thread_t **threads = calloc(reader_count, sizeof(apr_thread_t *));
+        READER_ARGS_T *reader_args = calloc(reader_count, sizeof(READER_ARGS_T));
+        for(int i = 0; i < reader_count; i++) {
+                reader_args[i].session = session;
+                reader_args[i].path = read_path;
+                reader_args[i].running = &running;
+                apr_thread_create(&threads[i], NULL, reader_thread, &reader_args[i], pool);
+        }
+
+        for(unsigned int t = 0; t < sleep_time; t++) {
+                sleep(1);
+                topic_cache_sync_snapshot(cache);
+
+                CACHED_VALUE_T *value = topic_cache_get(session, read_path);
+                if(value != NULL) {
+                        const TOPIC_SPECIFICATION_T *specification = topic_cache_get_specification(session, read_path);
+                        printf("%s: datatype %d, topic type %d, %zu bytes, %u cache updates\n",
+                               read_path, value->datatype,
+                               specification != NULL ? (int)topic_specification_get_topic_type(specification) : -1,
+                               value->len, apr_atomic_read32(&cache->updates));
+                        topic_cache_value_release(value);
+                }
+                else {
+                        printf("%s: not cached, %u cache updates\n",
+                               read_path, apr_atomic_read32(&cache->updates));
+                }
+
+                if(query != NULL) {
+                        QUERY_RESULTS_T results = { 0 };
+                        const int count = strchr(">?*#", query[0]) != NULL
+                                ? topic_cache_query_selector(session, query, collect_results, &results)
+                                : topic_cache_query_prefix(session, query, collect_results, &results);
+                        printf("%d cached topics for %s", count, query);
+                        if(count > 0) {
+                                printf(", from %s to %s (%zu bytes)", results.first, results.last, results.bytes);
+                        }
+                        printf("\n");
+                }
+        }
+
+        apr_atomic_set32(&running, 0);
+        unsigned long reads = 0;
+        unsigned long hits = 0;
+        for(int i = 0; i < reader_count; i++) {
+                apr_status_t rv;
+                apr_thread_join(&rv, threads[i]);
+                reads += reader_args[i].reads;
+                hits += reader_args[i].hits;
+        }
+        printf("%d readers performed %lu lookups (%lu hits) in %u seconds\n",
+               reader_count, reads, hits, sleep_time);
+
+        apr_thread_mutex_lock(cache->writer_mutex);
+        apr_uint32_t topics = 0;
+        for(INTERNED_SPEC_T *interned = cache->specifications; interned != NULL; interned = interned->next) {
+                topics += interned->topics;
+        }
+        printf("%u topics share %d distinct specifications\n", topics, cache->specification_count);
+        printf("Path index has %zu nodes in %zu bytes\n", cache->index_nodes, cache->index_bytes);
+        apr_thread_mutex_unlock(cache->writer_mutex);
+
+        /*
+         * Close the session before freeing the cache, so that no value
+         * streams can be invoked on it.
+         */
+        session_close(session, NULL);
+        session_free(session);
+
+        topic_cache_free(cache);
+        free(reader_args);
+        free(threads);
+
+        credentials_free(credentials);
+        hash_free(options, NULL, free);
+
+        apr_pool_destroy(pool);
+        apr_terminate();
+
+        return EXIT_SUCCESS;
+}